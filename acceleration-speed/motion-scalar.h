@@ -0,0 +1,44 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2015 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCELERATION_SPEED_MOTION_SCALAR_H
+#define ACCELERATION_SPEED_MOTION_SCALAR_H
+
+#include "motion.h"
+#include "libde265/fallback.h"
+
+
+class DSPFunc_MC_16_Scalar : public DSPFunc_MC_16_Base
+{
+public:
+  DSPFunc_MC_16_Scalar(int bitDepth) : DSPFunc_MC_16_Base(bitDepth) {
+    init_acceleration_functions_fallback(&accel);
+  }
+
+  virtual const char* name() const {
+    return bitDepth==10 ? "MC16-Scalar-10bit" : "MC16-Scalar-12bit";
+  }
+};
+
+
+extern DSPFunc_MC_16_Scalar mc16_scalar_10bit;
+extern DSPFunc_MC_16_Scalar mc16_scalar_12bit;
+
+#endif
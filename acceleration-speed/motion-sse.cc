@@ -0,0 +1,68 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2015 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libde265/x86/sse.h"
+#include "motion.h"
+#include "motion-scalar.h"
+
+
+class DSPFunc_MC_16_SSE : public DSPFunc_MC_16_Base
+{
+public:
+  DSPFunc_MC_16_SSE(int bitDepth) : DSPFunc_MC_16_Base(bitDepth) {
+    init_acceleration_functions_fallback(&accel);
+    init_acceleration_functions_sse(&accel);
+  }
+
+  virtual const char* name() const {
+    return bitDepth==10 ? "MC16-SSE-10bit" : "MC16-SSE-12bit";
+  }
+
+  virtual DSPFunc* referenceImplementation() const {
+    return bitDepth==10 ? &mc16_scalar_10bit : &mc16_scalar_12bit;
+  }
+};
+
+DSPFunc_MC_16_SSE mc16_sse_10bit(10);
+DSPFunc_MC_16_SSE mc16_sse_12bit(12);
+
+
+#ifdef HAVE_AVX2
+class DSPFunc_MC_16_AVX2 : public DSPFunc_MC_16_Base
+{
+public:
+  DSPFunc_MC_16_AVX2(int bitDepth) : DSPFunc_MC_16_Base(bitDepth) {
+    init_acceleration_functions_fallback(&accel);
+    init_acceleration_functions_sse(&accel);
+    init_acceleration_functions_avx2(&accel);
+  }
+
+  virtual const char* name() const {
+    return bitDepth==10 ? "MC16-AVX2-10bit" : "MC16-AVX2-12bit";
+  }
+
+  virtual DSPFunc* referenceImplementation() const {
+    return bitDepth==10 ? &mc16_scalar_10bit : &mc16_scalar_12bit;
+  }
+};
+
+DSPFunc_MC_16_AVX2 mc16_avx2_10bit(10);
+DSPFunc_MC_16_AVX2 mc16_avx2_12bit(12);
+#endif
@@ -0,0 +1,183 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2015 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "motion.h"
+#include <string.h>
+
+
+// prediction block sizes that are cycled through
+static const int pb_sizes[8] = { 4,8,12,16,24,32,48,64 };
+
+// reference samples needed by the luma filters (see mc_luma())
+static const int luma_extra_before[4] = { 0,3,3,2 };
+static const int luma_extra_after [4] = { 0,3,4,4 };
+
+static const int refbuf_stride = MC_MAX_PB_SIZE+16;
+static const int refbuf_rows   = MC_MAX_PB_SIZE+7;
+
+
+DSPFunc_MC_16_Base::DSPFunc_MC_16_Base(int depth)
+{
+  bitDepth = depth;
+
+  samples = NULL;
+  width = height = 0;
+
+  refbuf = new uint16_t[refbuf_stride*refbuf_rows];
+
+  pbWidth = pbHeight = 0;
+}
+
+
+DSPFunc_MC_16_Base::~DSPFunc_MC_16_Base()
+{
+  delete[] samples;
+  delete[] refbuf;
+}
+
+
+bool DSPFunc_MC_16_Base::prepareNextImage(std::shared_ptr<const de265_image> img)
+{
+  int w = img->get_width(0);
+  int h = img->get_height(0);
+
+  if (samples==NULL || w!=width || h!=height) {
+    delete[] samples;
+    samples = new uint16_t[w*h];
+    width  = w;
+    height = h;
+  }
+
+  int stride = img->get_luma_stride();
+  const uint8_t* p = img->get_image_plane_at_pos(0,0,0);
+
+  // fill the additional low bits with the high bits of the sample
+
+  for (int y=0;y<h;y++)
+    for (int x=0;x<w;x++) {
+      int v = p[y*stride+x];
+      samples[y*w+x] = (v << (bitDepth-8)) | (v >> (16-bitDepth));
+    }
+
+  return true;
+}
+
+
+/* Copy the w x h block at (x0,y0) and the samples around it that the filter needs into
+   refbuf, with the samples outside of the image padded. Returns the position of (x0,y0).
+ */
+const uint16_t* DSPFunc_MC_16_Base::get_reference_samples(int x0,int y0, int w,int h,
+                                                          int extra_left, int extra_right,
+                                                          int extra_top,  int extra_bottom)
+{
+  int nRows = extra_top + h + extra_bottom;
+
+  uint16_t* blk = refbuf + (refbuf_rows-nRows)*refbuf_stride;
+
+  for (int y=-extra_top;y<h+extra_bottom;y++)
+    for (int x=-extra_left;x<w+extra_right;x++) {
+      int xA = Clip3(0,width -1, x0+x);
+      int yA = Clip3(0,height-1, y0+y);
+
+      blk[x+extra_left + (y+extra_top)*refbuf_stride] = samples[xA + yA*width];
+    }
+
+  return blk + extra_left + extra_top*refbuf_stride;
+}
+
+
+void DSPFunc_MC_16_Base::runOnBlock(int x,int y)
+{
+  int blkIdx = x/MC_MAX_PB_SIZE + y/MC_MAX_PB_SIZE * 7;
+
+  pbWidth  = pb_sizes[ blkIdx      % 8];
+  pbHeight = pb_sizes[(blkIdx*3+1) % 8];
+
+
+  // --- luma ---
+
+  for (int xFrac=0;xFrac<4;xFrac++)
+    for (int yFrac=0;yFrac<4;yFrac++) {
+      const uint16_t* src = get_reference_samples(x,y, pbWidth,pbHeight,
+                                                  luma_extra_before[xFrac], luma_extra_after[xFrac],
+                                                  luma_extra_before[yFrac], luma_extra_after[yFrac]);
+
+      accel.put_hevc_qpel_16[xFrac][yFrac](out_luma[xFrac][yFrac], MC_MAX_PB_SIZE,
+                                           src, refbuf_stride, pbWidth,pbHeight,
+                                           mcbuffer, bitDepth);
+    }
+
+
+  // --- chroma (4:2:0) ---
+
+  int mx =  blkIdx    % 8;
+  int my = (blkIdx*3) % 8;
+
+  int wC = pbWidth /2;
+  int hC = pbHeight/2;
+
+  int before = (mx||my) ? 1 : 0;
+  int after  = (mx||my) ? 2 : 0;
+
+  const uint16_t* src = get_reference_samples(x,y, wC,hC, before,after, before,after);
+
+  if (mx && my) {
+    accel.put_hevc_epel_hv_16(out_chroma, MC_MAX_PB_SIZE, src, refbuf_stride, wC,hC,
+                              mx,my, mcbuffer, bitDepth);
+  }
+  else if (mx) {
+    accel.put_hevc_epel_h_16(out_chroma, MC_MAX_PB_SIZE, src, refbuf_stride, wC,hC,
+                             mx,my, mcbuffer, bitDepth);
+  }
+  else if (my) {
+    accel.put_hevc_epel_v_16(out_chroma, MC_MAX_PB_SIZE, src, refbuf_stride, wC,hC,
+                             mx,my, mcbuffer, bitDepth);
+  }
+  else {
+    accel.put_hevc_epel_16(out_chroma, MC_MAX_PB_SIZE, src, refbuf_stride, wC,hC,
+                           mx,my, mcbuffer, bitDepth);
+  }
+}
+
+
+bool DSPFunc_MC_16_Base::compareToReferenceImplementation()
+{
+  DSPFunc_MC_16_Base* refImpl = dynamic_cast<DSPFunc_MC_16_Base*>(referenceImplementation());
+
+  for (int xFrac=0;xFrac<4;xFrac++)
+    for (int yFrac=0;yFrac<4;yFrac++)
+      for (int y=0;y<pbHeight;y++) {
+        if (memcmp(&out_luma[xFrac][yFrac][y*MC_MAX_PB_SIZE],
+                   &refImpl->out_luma[xFrac][yFrac][y*MC_MAX_PB_SIZE],
+                   pbWidth*sizeof(int16_t)) != 0) {
+          return false;
+        }
+      }
+
+  for (int y=0;y<pbHeight/2;y++) {
+    if (memcmp(&out_chroma[y*MC_MAX_PB_SIZE],
+               &refImpl->out_chroma[y*MC_MAX_PB_SIZE],
+               pbWidth/2*sizeof(int16_t)) != 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,81 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2015 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCELERATION_SPEED_MOTION_H
+#define ACCELERATION_SPEED_MOTION_H
+
+#include "acceleration-speed.h"
+#include "libde265/acceleration.h"
+#include "libde265/util.h"
+
+
+#define MC_MAX_PB_SIZE 64  // MAX_CU_SIZE in motion.cc
+
+
+/* Motion compensation for bit depths > 8 (put_hevc_qpel_16, put_hevc_epel_*_16).
+
+   The 8-bit input image is extended to 'bitDepth' bits. Each 64x64 block of the image
+   is predicted with all 16 luma filter positions and with one chroma filter position.
+   The prediction block size changes from block to block.
+
+   As in mc_luma() and mc_chroma(), the filters get the reference samples in a buffer
+   with a stride of MAX_CU_SIZE+16. The reference samples end with the last row of this
+   buffer, so that reading beyond the samples that the filter needs is detected by
+   AddressSanitizer.
+ */
+class DSPFunc_MC_16_Base : public DSPFunc
+{
+public:
+  DSPFunc_MC_16_Base(int bitDepth);
+  virtual ~DSPFunc_MC_16_Base();
+
+  virtual int getBlkWidth()  const { return MC_MAX_PB_SIZE; }
+  virtual int getBlkHeight() const { return MC_MAX_PB_SIZE; }
+
+  virtual void runOnBlock(int x,int y);
+
+  virtual bool compareToReferenceImplementation();
+  virtual bool prepareNextImage(std::shared_ptr<const de265_image> img);
+
+protected:
+  acceleration_functions accel; // set up by the derived classes
+
+  int bitDepth;
+
+private:
+  uint16_t* samples; // input image, extended to bitDepth bits
+  int width, height;
+
+  uint16_t* refbuf;  // reference samples of the current prediction
+
+  ALIGNED_32(int16_t mcbuffer[MC_MAX_PB_SIZE*(MC_MAX_PB_SIZE+7)]);
+
+  int16_t out_luma[4][4][MC_MAX_PB_SIZE*MC_MAX_PB_SIZE];
+  int16_t out_chroma[MC_MAX_PB_SIZE*MC_MAX_PB_SIZE];
+
+  int pbWidth, pbHeight; // luma size of the last prediction, chroma has half the size
+
+  const uint16_t* get_reference_samples(int x0,int y0, int w,int h,
+                                        int extra_left, int extra_right,
+                                        int extra_top,  int extra_bottom);
+};
+
+
+#endif
@@ -60,6 +60,8 @@ using namespace videogfx;
 #define NUM_THREADS 4
 
 int nThreads=0;
+int nFramesInFlight=1;
+enum de265_thread_placement threadPlacement = de265_thread_placement_none;
 bool nal_input=false;
 int quiet=0;
 bool check_hash=false;
@@ -82,10 +84,15 @@ int highestTID = 100;
 int verbosity=0;
 int disable_deblocking=0;
 int disable_sao=0;
+int two_stage_decoding=0;
+int zero_copy_input=0;
+int memory_limit=0;
+int huge_pages=0;
 
 static struct option long_options[] = {
   {"quiet",      no_argument,       0, 'q' },
   {"threads",    required_argument, 0, 't' },
+  {"frame-parallel", required_argument, 0, 'F' },
   {"check-hash", no_argument,       0, 'c' },
   {"profile",    no_argument,       0, 'p' },
   {"frames",     required_argument, 0, 'f' },
@@ -104,11 +111,22 @@ static struct option long_options[] = {
   {"verbose",    no_argument,       0, 'v' },
   {"disable-deblocking", no_argument, &disable_deblocking, 1 },
   {"disable-sao",        no_argument, &disable_sao, 1 },
+  {"two-stage",          no_argument, &two_stage_decoding, 1 },
+  {"zero-copy",          no_argument, &zero_copy_input, 1 },
+  {"thread-placement",   required_argument, 0, 'P' },
+  {"memory-limit",       required_argument, 0, 'M' },
+  {"huge-pages",         no_argument, &huge_pages, 1 },
   {0,         0,                 0,  0 }
 };
 
 
 
+static void release_input_buffer(const void* data, void* userdata)
+{
+  free((void*)data);
+}
+
+
 static void write_picture(const de265_image* img)
 {
   static FILE* fh = NULL;
@@ -563,7 +581,7 @@ int main(int argc, char** argv)
   while (1) {
     int option_index = 0;
 
-    int c = getopt_long(argc, argv, "qt:chf:o:dLB:n0vT:m:se"
+    int c = getopt_long(argc, argv, "qt:F:chf:o:dLB:n0vT:m:se"
 #if HAVE_VIDEOGFX && HAVE_SDL
                         "V"
 #endif
@@ -574,6 +592,7 @@ int main(int argc, char** argv)
     switch (c) {
     case 'q': quiet++; break;
     case 't': nThreads=atoi(optarg); break;
+    case 'F': nFramesInFlight=atoi(optarg); break;
     case 'c': check_hash=true; break;
     case 'f': max_frames=atoi(optarg); break;
     case 'o': write_yuv=true; output_filename=optarg; break;
@@ -589,6 +608,13 @@ int main(int argc, char** argv)
     case 'e': show_psnr_map=true; break;
     case 'T': highestTID=atoi(optarg); break;
     case 'v': verbosity++; break;
+    case 'M': memory_limit=atoi(optarg); break;
+    case 'P':
+      if      (strcmp(optarg,"compact")==0) { threadPlacement = de265_thread_placement_compact; }
+      else if (strcmp(optarg,"scatter")==0) { threadPlacement = de265_thread_placement_scatter; }
+      else if (strcmp(optarg,"none")==0)    { threadPlacement = de265_thread_placement_none; }
+      else { fprintf(stderr,"unknown thread placement '%s'\n",optarg); show_help=true; }
+      break;
     }
   }
 
@@ -601,6 +627,7 @@ int main(int argc, char** argv)
     fprintf(stderr,"options:\n");
     fprintf(stderr,"  -q, --quiet       do not show decoded image\n");
     fprintf(stderr,"  -t, --threads N   set number of worker threads (0 - no threading)\n");
+    fprintf(stderr,"  -F, --frame-parallel N  decode up to N pictures in parallel (needs -t)\n");
     fprintf(stderr,"  -c, --check-hash  perform hash check\n");
     fprintf(stderr,"  -n, --nal         input is a stream with 4-byte length prefixed NAL units\n");
     fprintf(stderr,"  -f, --frames N    set number of frames to process\n");
@@ -621,6 +648,11 @@ int main(int argc, char** argv)
     fprintf(stderr,"  -T, --highest-TID select highest temporal sublayer to decode\n");
     fprintf(stderr,"      --disable-deblocking   disable deblocking filter\n");
     fprintf(stderr,"      --disable-sao          disable sample-adaptive offset filter\n");
+    fprintf(stderr,"      --two-stage            parse and reconstruct slices in separate tasks (needs -t)\n");
+    fprintf(stderr,"      --zero-copy            read the whole file and decode it without copying the input\n");
+    fprintf(stderr,"      --thread-placement P   bind worker threads to CPUs (none, compact, scatter)\n");
+    fprintf(stderr,"      --memory-limit MB      limit the decoder memory (sizes the DPB accordingly)\n");
+    fprintf(stderr,"      --huge-pages           use huge pages for the picture buffers\n");
     fprintf(stderr,"  -h, --help        show help\n");
 
     exit(show_help ? 0 : 5);
@@ -636,6 +668,12 @@ int main(int argc, char** argv)
 
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_DISABLE_DEBLOCKING, disable_deblocking);
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_DISABLE_SAO, disable_sao);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_TWO_STAGE_DECODING, two_stage_decoding);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_HUGE_PAGES, huge_pages);
+
+  de265_set_parameter_int(ctx, DE265_DECODER_PARAM_MAX_FRAMES_IN_FLIGHT, nFramesInFlight);
+  de265_set_parameter_int(ctx, DE265_DECODER_PARAM_WORKER_THREAD_PLACEMENT, threadPlacement);
+  de265_set_parameter_int(ctx, DE265_DECODER_PARAM_MEMORY_LIMIT, memory_limit);
 
   if (dump_headers) {
     de265_set_parameter_int(ctx, DE265_DECODER_PARAM_DUMP_SPS_HEADERS, 1);
@@ -718,6 +756,24 @@ int main(int argc, char** argv)
         free(buf);
         pos+=n;
       }
+      else if (zero_copy_input) {
+        if (!feof(fh)) {
+          // push the complete file at once
+          fseek(fh,0,SEEK_END);
+          long length = ftell(fh);
+          fseek(fh,0,SEEK_SET);
+
+          uint8_t* buf = (uint8_t*)malloc(length);
+          int n = fread(buf,1,length,fh);
+          err = de265_push_data_zero_copy(ctx, buf, n, pos, (void*)2, release_input_buffer, NULL);
+          if (err != DE265_OK) {
+            break;
+          }
+
+          pos+=n;
+          fgetc(fh); // set EOF
+        }
+      }
       else {
         // read a chunk of input data
         uint8_t buf[BUFFER_SIZE];
@@ -813,6 +869,17 @@ int main(int argc, char** argv)
     fclose(reference_file);
   }
 
+  if (verbosity>0 && quiet<=1) {
+    fprintf(stderr,"decoder allocations: %d\n", de265_get_number_of_allocations(ctx));
+
+    struct de265_memory_usage usage;
+    de265_get_memory_usage(ctx, &usage);
+    fprintf(stderr,"decoder memory: %zu KB (pixels: %zu KB, metadata: %zu KB, "
+            "NAL queue: %zu KB, thread contexts: %zu KB)\n",
+            usage.total/1024, usage.pixels/1024, usage.metadata/1024,
+            usage.nal_queue/1024, usage.thread_contexts/1024);
+  }
+
   de265_free_decoder(ctx);
 
   struct timeval tv_end;
@@ -26,6 +26,10 @@
 #include <assert.h>
 
 
+// maximum number of edge segments that are passed to the deblocking functions in one call
+#define DEBLOCK_MAX_SEGMENTS 4
+
+
 struct acceleration_functions
 {
   void (*put_weighted_pred_avg_8)(uint8_t *_dst, ptrdiff_t dststride,
@@ -187,6 +191,62 @@ struct acceleration_functions
 
 
 
+  // --- deblocking ---
+
+  /* Filter 'nSegments' (at most DEBLOCK_MAX_SEGMENTS) consecutive 4-line segments of an edge.
+     'ptr' points to sample q0 of the first line. Each segment has its own beta, tc, filterP
+     and filterQ. A 'tc' of zero leaves the segment unchanged.
+     The luma functions also take the filter decisions (dE, dEp, dEq) of each segment.
+   */
+
+  void (*deblock_luma_8)(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                         const int* beta, const int* tc, const bool* filterP, const bool* filterQ);
+  void (*deblock_chroma_8)(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                           const int* tc, const bool* filterP, const bool* filterQ);
+
+  void (*deblock_luma_16)(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                          const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                          int bit_depth);
+  void (*deblock_chroma_16)(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                            const int* tc, const bool* filterP, const bool* filterQ, int bit_depth);
+
+  template <class pixel_t> void deblock_luma(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                             const int* beta, const int* tc,
+                                             const bool* filterP, const bool* filterQ, int bit_depth) const;
+  template <class pixel_t> void deblock_chroma(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                               const int* tc,
+                                               const bool* filterP, const bool* filterQ, int bit_depth) const;
+
+
+
+  // --- sample adaptive offset ---
+
+  /* 'saoOffsetVal' are the four offsets of the component (sao_info.saoOffsetVal[cIdx]).
+     'out' may be equal to 'in' for band offsets. For edge offsets, 'in' has to provide
+     the samples around the block, all samples of the block are classified.
+   */
+
+  void (*sao_band_offset_8)(uint8_t* out, ptrdiff_t out_stride, const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height, int saoLeftClass, const int8_t* saoOffsetVal);
+  void (*sao_edge_offset_8)(uint8_t* out, ptrdiff_t out_stride, const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height, int SaoEoClass, const int8_t* saoOffsetVal);
+
+  void (*sao_band_offset_16)(uint16_t* out, ptrdiff_t out_stride, const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height, int saoLeftClass, const int8_t* saoOffsetVal,
+                             int bit_depth);
+  void (*sao_edge_offset_16)(uint16_t* out, ptrdiff_t out_stride, const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height, int SaoEoClass, const int8_t* saoOffsetVal,
+                             int bit_depth);
+
+  template <class pixel_t> void sao_band_offset(pixel_t* out, ptrdiff_t out_stride, const pixel_t* in, ptrdiff_t in_stride,
+                                                int width, int height, int saoLeftClass, const int8_t* saoOffsetVal,
+                                                int bit_depth) const;
+  template <class pixel_t> void sao_edge_offset(pixel_t* out, ptrdiff_t out_stride, const pixel_t* in, ptrdiff_t in_stride,
+                                                int width, int height, int SaoEoClass, const int8_t* saoOffsetVal,
+                                                int bit_depth) const;
+
+
+
   // --- forward transforms ---
 
   void (*fwd_transform_4x4_dst_8)(int16_t *coeffs, const int16_t* src, ptrdiff_t stride); // fDST
@@ -356,4 +416,16 @@ template <> inline void acceleration_functions::transform_add<uint16_t>(int size
 template <> inline void acceleration_functions::add_residual(uint8_t *dst,  ptrdiff_t stride, const int32_t* r, int nT, int bit_depth) const { add_residual_8(dst,stride,r,nT,bit_depth); }
 template <> inline void acceleration_functions::add_residual(uint16_t *dst, ptrdiff_t stride, const int32_t* r, int nT, int bit_depth) const { add_residual_16(dst,stride,r,nT,bit_depth); }
 
+template <> inline void acceleration_functions::deblock_luma<uint8_t>(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments, const int* beta, const int* tc, const bool* filterP, const bool* filterQ, int bit_depth) const { deblock_luma_8(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ); }
+template <> inline void acceleration_functions::deblock_luma<uint16_t>(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments, const int* beta, const int* tc, const bool* filterP, const bool* filterQ, int bit_depth) const { deblock_luma_16(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,bit_depth); }
+
+template <> inline void acceleration_functions::deblock_chroma<uint8_t>(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments, const int* tc, const bool* filterP, const bool* filterQ, int bit_depth) const { deblock_chroma_8(ptr,stride,vertical,nSegments,tc,filterP,filterQ); }
+template <> inline void acceleration_functions::deblock_chroma<uint16_t>(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments, const int* tc, const bool* filterP, const bool* filterQ, int bit_depth) const { deblock_chroma_16(ptr,stride,vertical,nSegments,tc,filterP,filterQ,bit_depth); }
+
+template <> inline void acceleration_functions::sao_band_offset<uint8_t>(uint8_t* out, ptrdiff_t out_stride, const uint8_t* in, ptrdiff_t in_stride, int width, int height, int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth) const { sao_band_offset_8(out,out_stride,in,in_stride,width,height,saoLeftClass,saoOffsetVal); }
+template <> inline void acceleration_functions::sao_band_offset<uint16_t>(uint16_t* out, ptrdiff_t out_stride, const uint16_t* in, ptrdiff_t in_stride, int width, int height, int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth) const { sao_band_offset_16(out,out_stride,in,in_stride,width,height,saoLeftClass,saoOffsetVal,bit_depth); }
+
+template <> inline void acceleration_functions::sao_edge_offset<uint8_t>(uint8_t* out, ptrdiff_t out_stride, const uint8_t* in, ptrdiff_t in_stride, int width, int height, int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth) const { sao_edge_offset_8(out,out_stride,in,in_stride,width,height,SaoEoClass,saoOffsetVal); }
+template <> inline void acceleration_functions::sao_edge_offset<uint16_t>(uint16_t* out, ptrdiff_t out_stride, const uint16_t* in, ptrdiff_t in_stride, int width, int height, int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth) const { sao_edge_offset_16(out,out_stride,in,in_stride,width,height,SaoEoClass,saoOffsetVal,bit_depth); }
+
 #endif
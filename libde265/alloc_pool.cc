@@ -97,3 +97,52 @@ void  alloc_pool::delete_obj(void* obj)
 
   ::operator delete(obj);
 }
+
+
+
+thread_local alloc_arena* alloc_arena::mCurrentArena = NULL;
+
+
+alloc_arena::alloc_arena(size_t blockSize)
+  : mBlockSize(blockSize),
+    mCurrentBlock(-1),
+    mBlockUsed(blockSize)
+{
+}
+
+
+alloc_arena::~alloc_arena()
+{
+  FOR_LOOP(uint8_t*, p, m_memBlocks) {
+    delete[] p;
+  }
+}
+
+
+void* alloc_arena::alloc(size_t size)
+{
+  assert(size <= mBlockSize);
+
+  size = (size+15) & ~(size_t)15;
+
+  if (mBlockUsed + size > mBlockSize) {
+    mCurrentBlock++;
+    mBlockUsed = 0;
+
+    if (mCurrentBlock == m_memBlocks.size()) {
+      m_memBlocks.push_back(new uint8_t[mBlockSize]);
+    }
+  }
+
+  void* p = m_memBlocks[mCurrentBlock] + mBlockUsed;
+  mBlockUsed += size;
+
+  return p;
+}
+
+
+void alloc_arena::reset()
+{
+  mCurrentBlock = -1;
+  mBlockUsed = mBlockSize;
+}
@@ -29,6 +29,7 @@
 
 #include <vector>
 #include <cstddef>
+#include <assert.h>
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
 #endif
@@ -58,4 +59,76 @@ class alloc_pool
   void add_memory_block();
 };
 
+
+/* Bump-pointer allocator. Objects are never freed individually. All memory is
+   released at once with reset(), which keeps the memory blocks for reuse.
+
+   Each thread has a current arena (see alloc_arena_scope) that is used by classes
+   that place their objects into the arena, like the encoder's CB/TB search trees.
+ */
+class alloc_arena
+{
+ public:
+  alloc_arena(size_t blockSize=256*1024);
+  ~alloc_arena();
+
+  void* alloc(size_t size); // 16-byte aligned, size must not exceed the block size
+  void  reset();
+
+  size_t memory_usage() const { return m_memBlocks.size() * mBlockSize; }
+
+  static alloc_arena* current() { return mCurrentArena; }
+
+ private:
+  size_t mBlockSize;
+
+  std::vector<uint8_t*> m_memBlocks;
+  int    mCurrentBlock;
+  size_t mBlockUsed;
+
+  static thread_local alloc_arena* mCurrentArena;
+
+  friend class alloc_arena_scope;
+
+  alloc_arena(const alloc_arena&) = delete;
+  alloc_arena& operator=(const alloc_arena&) = delete;
+};
+
+
+// Makes an arena the current arena of this thread for the lifetime of this object.
+class alloc_arena_scope
+{
+ public:
+  alloc_arena_scope(alloc_arena* arena) {
+    mPrevArena = alloc_arena::mCurrentArena;
+    alloc_arena::mCurrentArena = arena;
+  }
+
+  ~alloc_arena_scope() { alloc_arena::mCurrentArena = mPrevArena; }
+
+ private:
+  alloc_arena* mPrevArena;
+};
+
+
+// STL allocator that takes its memory from the current arena of the thread.
+template <class T> class arena_allocator
+{
+ public:
+  typedef T value_type;
+
+  arena_allocator() { }
+  template <class U> arena_allocator(const arena_allocator<U>&) { }
+
+  T* allocate(size_t n) {
+    assert(alloc_arena::current());
+    return (T*)alloc_arena::current()->alloc(n*sizeof(T));
+  }
+
+  void deallocate(T*, size_t) { } // released with the arena
+
+  template <class U> bool operator==(const arena_allocator<U>&) const { return true; }
+  template <class U> bool operator!=(const arena_allocator<U>&) const { return false; }
+};
+
 #endif
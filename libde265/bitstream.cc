@@ -28,6 +28,12 @@
 
 
 void bitreader_init(bitreader* br, unsigned char* buffer, int len)
+{
+  bitreader_init_with_emulation_prevention(br, buffer, len, NULL, 0);
+}
+
+void bitreader_init_with_emulation_prevention(bitreader* br, unsigned char* buffer, int len,
+                                              const int* ep_positions, int num_ep)
 {
   br->data = buffer;
   br->bytes_remaining = len;
@@ -35,6 +41,11 @@ void bitreader_init(bitreader* br, unsigned char* buffer, int len)
   br->nextbits=0;
   br->nextbits_cnt=0;
 
+  br->ep.base  = buffer;
+  br->ep.first = ep_positions;
+  br->ep.next  = ep_positions;
+  br->ep.end   = ep_positions + num_ep;
+
   bitreader_refill(br);
 }
 
@@ -43,6 +54,13 @@ void bitreader_refill(bitreader* br)
   int shift = 64-br->nextbits_cnt;
 
   while (shift >= 8 && br->bytes_remaining) {
+    if (is_emulation_prevention_byte(&br->ep, br->data)) {
+      br->data++;
+      br->bytes_remaining--;
+      br->ep.next++;
+      continue;
+    }
+
     uint64_t newval = *br->data++;
     br->bytes_remaining--;
 
@@ -123,8 +141,19 @@ void prepare_for_CABAC(bitreader* br)
   skip_to_byte_boundary(br);
 
   int rewind = br->nextbits_cnt/8;
-  br->data -= rewind;
-  br->bytes_remaining += rewind;
+  while (rewind>0) {
+    br->data--;
+    br->bytes_remaining++;
+
+    // step back over skipped emulation prevention bytes
+    if (br->ep.next != br->ep.first && br->ep.base + br->ep.next[-1] == br->data) {
+      br->ep.next--;
+    }
+    else {
+      rewind--;
+    }
+  }
+
   br->nextbits = 0;
   br->nextbits_cnt = 0;
 }
@@ -36,15 +36,37 @@
 #define UVLC_ERROR -99999
 
 
+/* Zero-copy input (de265_push_data_zero_copy()) decodes the NAL data in the application
+   buffer. The emulation prevention bytes (the 0x03 in 0x000003) are still in the data
+   and are skipped while reading. This is empty for all other input, where they are removed.
+ */
+typedef struct {
+  const uint8_t* base;  // NAL data, the positions are relative to this
+  const int* first;     // sorted positions of all emulation prevention bytes
+  const int* next;      // next emulation prevention byte in reading order
+  const int* end;
+} emulation_prevention_bytes;
+
+static inline bool is_emulation_prevention_byte(const emulation_prevention_bytes* ep,
+                                                const uint8_t* p)
+{
+  return ep->next != ep->end && ep->base + *ep->next == p;
+}
+
+
 typedef struct {
   uint8_t* data;
   int bytes_remaining;
 
   uint64_t nextbits; // left-aligned bits
   int nextbits_cnt;
+
+  emulation_prevention_bytes ep;
 } bitreader;
 
 void bitreader_init(bitreader*, unsigned char* buffer, int len);
+void bitreader_init_with_emulation_prevention(bitreader*, unsigned char* buffer, int len,
+                                              const int* ep_positions, int num_ep);
 void bitreader_refill(bitreader*); // refill to at least 56+1 bits
 int  next_bit(bitreader*);
 int  next_bit_norefill(bitreader*);
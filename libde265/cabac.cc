@@ -133,26 +133,83 @@ static const uint8_t next_state_LPS[64] =
 int logcnt=1;
 #endif
 
-void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length)
+/* With zero-copy input, 'bitstream_end' stops at the next emulation prevention byte.
+   Hence, the check whether there is more input in the decoding functions also catches
+   these bytes and we only have to do something when reaching the end.
+ */
+static void set_CABAC_bitstream_end(CABAC_decoder* decoder)
+{
+  while (decoder->ep.next != decoder->ep.end &&
+         decoder->ep.base + *decoder->ep.next < decoder->bitstream_curr) {
+    decoder->ep.next++;
+  }
+
+  if (decoder->ep.next != decoder->ep.end &&
+      decoder->ep.base + *decoder->ep.next < decoder->bitstream_data_end) {
+    decoder->bitstream_end = (uint8_t*)decoder->ep.base + *decoder->ep.next;
+  }
+  else {
+    decoder->bitstream_end = decoder->bitstream_data_end;
+  }
+}
+
+/* Called when reaching 'bitstream_end'. Skip the emulation prevention byte, if any.
+   Returns whether there is more input.
+ */
+static bool skip_emulation_prevention_byte(CABAC_decoder* decoder)
+{
+  if (decoder->bitstream_curr >= decoder->bitstream_data_end) {
+    return false;
+  }
+
+  decoder->bitstream_curr++;
+  decoder->ep.next++;
+  set_CABAC_bitstream_end(decoder);
+
+  return decoder->bitstream_curr < decoder->bitstream_end;
+}
+
+#define more_CABAC_input(decoder) \
+  ((decoder)->bitstream_curr < (decoder)->bitstream_end || skip_emulation_prevention_byte(decoder))
+
+
+void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length,
+                        const emulation_prevention_bytes* ep)
 {
   assert(length >= 0);
 
   decoder->bitstream_start = bitstream;
   decoder->bitstream_curr  = bitstream;
-  decoder->bitstream_end   = bitstream+length;
+  decoder->bitstream_data_end = bitstream+length;
+
+  if (ep) {
+    decoder->ep = *ep;
+  }
+  else {
+    decoder->ep.base = NULL;
+    decoder->ep.first = decoder->ep.next = decoder->ep.end = NULL;
+  }
+
+  set_CABAC_bitstream_end(decoder);
 }
 
 void init_CABAC_decoder_2(CABAC_decoder* decoder)
 {
-  int length = decoder->bitstream_end - decoder->bitstream_curr;
+  // the position may have been changed (PCM data)
+  set_CABAC_bitstream_end(decoder);
 
   decoder->range = 510;
   decoder->bits_needed = 8;
 
   decoder->value = 0;
 
-  if (length>0) { decoder->value  = (*decoder->bitstream_curr++) << 8;  decoder->bits_needed-=8; }
-  if (length>1) { decoder->value |= (*decoder->bitstream_curr++);       decoder->bits_needed-=8; }
+  if (more_CABAC_input(decoder)) {
+    decoder->value  = (*decoder->bitstream_curr++) << 8;  decoder->bits_needed-=8;
+
+    if (more_CABAC_input(decoder)) {
+      decoder->value |= (*decoder->bitstream_curr++);     decoder->bits_needed-=8;
+    }
+  }
 
   logtrace(LogCABAC,"[%3d] init_CABAC_decode_2 r:%x v:%x\n", logcnt, decoder->range, decoder->value);
 }
@@ -190,7 +247,7 @@ int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
           if (decoder->bits_needed == 0)
             {
               decoder->bits_needed = -8;
-              if (decoder->bitstream_curr < decoder->bitstream_end)
+              if (more_CABAC_input(decoder))
                 { decoder->value |= *decoder->bitstream_curr++; }
             }
         }
@@ -223,7 +280,7 @@ int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
       if (decoder->bits_needed >= 0)
         {
           logtrace(LogCABAC,"bits_needed: %d\n", decoder->bits_needed);
-          if (decoder->bitstream_curr < decoder->bitstream_end)
+          if (more_CABAC_input(decoder))
             { decoder->value |= (*decoder->bitstream_curr++) << decoder->bits_needed; }
 
           decoder->bits_needed -= 8;
@@ -263,7 +320,7 @@ int  decode_CABAC_term_bit(CABAC_decoder* decoder)
             {
               decoder->bits_needed = -8;
 
-              if (decoder->bitstream_curr < decoder->bitstream_end) {
+              if (more_CABAC_input(decoder)) {
                 decoder->value += (*decoder->bitstream_curr++);
               }
             }
@@ -284,7 +341,7 @@ int  decode_CABAC_bypass(CABAC_decoder* decoder)
 
   if (decoder->bits_needed >= 0)
     {
-      if (decoder->bitstream_end > decoder->bitstream_curr) {
+      if (more_CABAC_input(decoder)) {
         decoder->bits_needed = -8;
         decoder->value |= *decoder->bitstream_curr++;
       }
@@ -346,7 +403,7 @@ int  decode_CABAC_FL_bypass_parallel(CABAC_decoder* decoder, int nBits)
 
   if (decoder->bits_needed >= 0)
     {
-      if (decoder->bitstream_end > decoder->bitstream_curr) {
+      if (more_CABAC_input(decoder)) {
         int input = *decoder->bitstream_curr++;
         input <<= decoder->bits_needed;
 
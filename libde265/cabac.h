@@ -23,12 +23,16 @@
 
 #include <stdint.h>
 #include "contextmodel.h"
+#include "bitstream.h"
 
 
 typedef struct {
   uint8_t* bitstream_start;
   uint8_t* bitstream_curr;
-  uint8_t* bitstream_end;
+  uint8_t* bitstream_end;  // end of data, or the next emulation prevention byte
+  uint8_t* bitstream_data_end;
+
+  emulation_prevention_bytes ep;  // only for zero-copy input
 
   uint32_t range;
   uint32_t value;
@@ -36,7 +40,8 @@ typedef struct {
 } CABAC_decoder;
 
 
-void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length);
+void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length,
+                        const emulation_prevention_bytes* ep);
 void init_CABAC_decoder_2(CABAC_decoder* decoder);
 int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model);
 int  decode_CABAC_TU(CABAC_decoder* decoder, int cMax, context_model* model);
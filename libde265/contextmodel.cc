@@ -23,130 +23,17 @@
 #include <iomanip>
 #include <sstream>
 
-bool D = false;
-
-context_model_table::context_model_table()
-  : model(NULL), refcnt(NULL)
-{
-}
-
-
-context_model_table::context_model_table(const context_model_table& src)
-{
-  if (D) printf("%p c'tor = %p\n",this,&src);
-
-  if (src.refcnt) {
-    (*(src.refcnt))++;
-  }
-
-  refcnt = src.refcnt;
-  model  = src.model;
-}
-
-
-context_model_table::~context_model_table()
-{
-  if (D) printf("%p destructor\n",this);
-
-  if (refcnt) {
-    (*refcnt)--;
-    if (*refcnt==0) {
-      if (D) printf("mfree %p\n",model);
-      delete[] model;
-      delete refcnt;
-    }
-  }
-}
-
-
 void context_model_table::init(int initType, int QPY)
 {
-  if (D) printf("%p init\n",this);
-
-  decouple_or_alloc_with_empty_data();
-
   initialize_CABAC_models(model, initType, QPY);
-}
-
-
-void context_model_table::release()
-{
-  if (D) printf("%p release %p\n",this,refcnt);
-
-  if (!refcnt) { return; }
-
-  // if (*refcnt == 1) { return; } <- keep memory for later, but does not work when we believe that we freed the memory and nulled all references
-
-  (*refcnt)--;
-  if (*refcnt==0) {
-    delete[] model;
-    delete refcnt;
-  }
-
-  model = nullptr;
-  refcnt= nullptr;
-}
-
-
-void context_model_table::decouple()
-{
-  if (D) printf("%p decouple (%p)\n",this,refcnt);
-
-  assert(refcnt); // not necessarily so, but we never use it on an unitialized object
-
-  if (*refcnt > 1) {
-    (*refcnt)--;
-
-    context_model* oldModel = model;
-
-    model = new context_model[CONTEXT_MODEL_TABLE_LENGTH];
-    refcnt= new int;
-    *refcnt=1;
-
-    memcpy(model,oldModel,sizeof(context_model)*CONTEXT_MODEL_TABLE_LENGTH);
-  }
-}
-
-
-context_model_table context_model_table::transfer()
-{
-  context_model_table newtable;
-  newtable.model = model;
-  newtable.refcnt= refcnt;
-
-  model =nullptr;
-  refcnt=nullptr;
-
-  return newtable;
-}
-
-
-context_model_table& context_model_table::operator=(const context_model_table& src)
-{
-  if (D) printf("%p assign = %p\n",this,&src);
-
-  // assert(src.refcnt); // not necessarily so, but we never use it on an unitialized object
-
-  if (!src.refcnt) {
-    release();
-    return *this;
-  }
-
-  (*(src.refcnt))++;
-
-  release();
-
-  model = src.model;
-  refcnt= src.refcnt;
-
-  return *this;
+  initialized = true;
 }
 
 
 bool context_model_table::operator==(const context_model_table& b) const
 {
-  if (b.model == model) return true;
-  if (b.model == nullptr || model == nullptr) return false;
+  if (initialized != b.initialized) return false;
+  if (!initialized) return true;
 
   for (int i=0;i<CONTEXT_MODEL_TABLE_LENGTH;i++) {
     if (!(b.model[i] == model[i])) return false;
@@ -169,27 +56,6 @@ std::string context_model_table::debug_dump() const
 }
 
 
-void context_model_table::decouple_or_alloc_with_empty_data()
-{
-  if (refcnt && *refcnt==1) { return; }
-
-  if (refcnt) {
-    assert(*refcnt>1);
-    (*refcnt)--;
-  }
-
-  if (D) printf("%p (alloc)\n",this);
-
-  model = new context_model[CONTEXT_MODEL_TABLE_LENGTH];
-  refcnt= new int;
-  *refcnt=1;
-}
-
-
-
-
-
-
 static void set_initValue(int SliceQPY,
                           context_model* model, int initValue, int nContexts)
 {
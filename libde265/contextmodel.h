@@ -96,34 +96,29 @@ void initialize_CABAC_models(context_model context_model_table[CONTEXT_MODEL_TAB
                              int QPY);
 
 
+/* A complete set of context models. The table is stored inline and can be copied
+   by value (a plain memcpy of CONTEXT_MODEL_TABLE_LENGTH bytes), e.g. to save the
+   models for WPP or to give each encoder RDO alternative its own models.
+ */
 class context_model_table
 {
  public:
-  context_model_table();
-  context_model_table(const context_model_table&);
-  ~context_model_table();
+  context_model_table() : initialized(false) { }
 
   void init(int initType, int QPY);
-  void release();
-  void decouple();
-  context_model_table transfer();
-  context_model_table copy() const { context_model_table t=*this; t.decouple(); return t; }
+  void release() { initialized = false; } // mark the table as unused
 
-  bool empty() const { return refcnt != NULL; }
+  bool empty() const { return !initialized; }
 
   context_model& operator[](int i) { return model[i]; }
 
-  context_model_table& operator=(const context_model_table&);
-
   bool operator==(const context_model_table&) const;
 
   std::string debug_dump() const;
 
  private:
-  void decouple_or_alloc_with_empty_data();
-
-  context_model* model; // [CONTEXT_MODEL_TABLE_LENGTH]
-  int* refcnt;
+  context_model model[CONTEXT_MODEL_TABLE_LENGTH];
+  bool initialized;
 };
 
 
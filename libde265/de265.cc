@@ -102,6 +102,8 @@ LIBDE265_API const char* de265_get_error_text(de265_error err)
     return "premature end of slice data";
   case DE265_ERROR_UNSPECIFIED_DECODING_ERROR:
     return "unspecified decoding error";
+  case DE265_ERROR_MEMORY_LIMIT_EXCEEDED:
+    return "stream cannot be decoded within the memory limit";
 
   case DE265_WARNING_NO_WPP_CANNOT_USE_MULTITHREADING:
     return "Cannot run decoder multi-threaded because stream does not support WPP";
@@ -254,10 +256,6 @@ LIBDE265_API de265_error de265_start_worker_threads(de265_decoder_context* de265
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
-  if (number_of_threads > MAX_THREADS) {
-    number_of_threads = MAX_THREADS;
-  }
-
   if (number_of_threads>0) {
     de265_error err = ctx->start_thread_pool(number_of_threads);
     if (de265_isOK(err)) {
@@ -271,6 +269,71 @@ LIBDE265_API de265_error de265_start_worker_threads(de265_decoder_context* de265
 }
 
 
+LIBDE265_API de265_thread_pool* de265_new_thread_pool(int number_of_threads,
+                                                      enum de265_thread_placement placement)
+{
+  thread_pool* pool = new thread_pool;
+
+  de265_error err = start_thread_pool(pool, number_of_threads, placement);
+  if (err != DE265_OK) {
+    delete pool;
+    return NULL;
+  }
+
+  return (de265_thread_pool*)pool;
+}
+
+
+LIBDE265_API void de265_free_thread_pool(de265_thread_pool* de265pool)
+{
+  thread_pool* pool = (thread_pool*)de265pool;
+
+  if (pool) {
+    stop_thread_pool(pool);
+    delete pool;
+  }
+}
+
+
+LIBDE265_API de265_error de265_attach_to_thread_pool(de265_decoder_context* de265ctx,
+                                                     de265_thread_pool* de265pool)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  thread_pool* pool = (thread_pool*)de265pool;
+
+  return ctx->attach_to_thread_pool(pool);
+}
+
+
+LIBDE265_API de265_error de265_start_async_decoding(de265_decoder_context* de265ctx,
+                                                    de265_picture_ready_callback callback,
+                                                    void* userdata)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  return ctx->start_async_decoding(callback, userdata);
+}
+
+
+/* Locks the decoder against the asynchronous decoding loop while an API function
+   accesses the decoder state. Does nothing in synchronous mode.
+ */
+class async_lock
+{
+public:
+  async_lock(decoder_context* ctx) : mCtx(ctx->is_async_decoding() ? ctx : NULL) {
+    if (mCtx) de265_mutex_lock(&mCtx->async_mutex);
+  }
+
+  ~async_lock() {
+    if (mCtx) de265_mutex_unlock(&mCtx->async_mutex);
+  }
+
+private:
+  decoder_context* mCtx;
+};
+
+
 #ifndef LIBDE265_DISABLE_DEPRECATED
 LIBDE265_API de265_error de265_decode_data(de265_decoder_context* de265ctx,
                                            const void* data8, int len)
@@ -325,7 +388,15 @@ LIBDE265_API de265_error de265_push_data(de265_decoder_context* de265ctx,
   //printf("push data (size %d)\n",len);
   //dumpdata(data8,16);
 
-  return ctx->nal_parser.push_data(data,len,pts,user_data);
+  de265_error err;
+  {
+    async_lock lock(ctx);
+    err = ctx->nal_parser.push_data(data,len,pts,user_data);
+  }
+
+  ctx->trigger_async_decoding();
+
+  return err;
 }
 
 
@@ -339,7 +410,37 @@ LIBDE265_API de265_error de265_push_NAL(de265_decoder_context* de265ctx,
   //printf("push NAL (size %d)\n",len);
   //dumpdata(data8,16);
 
-  return ctx->nal_parser.push_NAL(data,len,pts,user_data);
+  de265_error err;
+  {
+    async_lock lock(ctx);
+    err = ctx->nal_parser.push_NAL(data,len,pts,user_data);
+  }
+
+  ctx->trigger_async_decoding();
+
+  return err;
+}
+
+
+LIBDE265_API de265_error de265_push_data_zero_copy(de265_decoder_context* de265ctx,
+                                                   const void* data8, int len,
+                                                   de265_PTS pts, void* user_data,
+                                                   de265_release_data_func release,
+                                                   void* release_userdata)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  const uint8_t* data = (const uint8_t*)data8;
+
+  de265_error err;
+  {
+    async_lock lock(ctx);
+    err = ctx->nal_parser.push_data_zero_copy(data,len,pts,user_data,
+                                              release,release_userdata);
+  }
+
+  ctx->trigger_async_decoding();
+
+  return err;
 }
 
 
@@ -355,27 +456,40 @@ LIBDE265_API void        de265_push_end_of_NAL(de265_decoder_context* de265ctx)
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
-  ctx->nal_parser.flush_data();
+  {
+    async_lock lock(ctx);
+    ctx->nal_parser.flush_data();
+  }
+
+  ctx->trigger_async_decoding();
 }
 
 
 LIBDE265_API void        de265_push_end_of_frame(de265_decoder_context* de265ctx)
 {
-  de265_push_end_of_NAL(de265ctx);
-
   decoder_context* ctx = (decoder_context*)de265ctx;
-  ctx->nal_parser.mark_end_of_frame();
+
+  {
+    async_lock lock(ctx);
+    ctx->nal_parser.flush_data();
+    ctx->nal_parser.mark_end_of_frame();
+  }
+
+  ctx->trigger_async_decoding();
 }
 
 
 LIBDE265_API de265_error de265_flush_data(de265_decoder_context* de265ctx)
 {
-  de265_push_end_of_NAL(de265ctx);
-
   decoder_context* ctx = (decoder_context*)de265ctx;
 
-  ctx->nal_parser.flush_data();
-  ctx->nal_parser.mark_end_of_stream();
+  {
+    async_lock lock(ctx);
+    ctx->nal_parser.flush_data();
+    ctx->nal_parser.mark_end_of_stream();
+  }
+
+  ctx->trigger_async_decoding();
 
   return DE265_OK;
 }
@@ -406,6 +520,8 @@ LIBDE265_API const struct de265_image* de265_peek_next_picture(de265_decoder_con
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
+  async_lock lock(ctx);
+
   if (ctx->num_pictures_in_output_queue()>0) {
     de265_image* img = ctx->get_next_picture_in_output_queue();
     return img;
@@ -420,6 +536,8 @@ LIBDE265_API void de265_release_next_picture(de265_decoder_context* de265ctx)
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
+  async_lock lock(ctx);
+
   // no active output picture -> ignore release request
 
   if (ctx->num_pictures_in_output_queue()==0) { return; }
@@ -438,6 +556,42 @@ LIBDE265_API void de265_release_next_picture(de265_decoder_context* de265ctx)
   // pop output queue
 
   ctx->pop_next_picture_in_output_queue();
+
+  // the DPB may have been full
+  if (ctx->is_async_decoding()) {
+    ctx->trigger_async_decoding();
+  }
+}
+
+
+LIBDE265_API void de265_picture_ref(de265_decoder_context* de265ctx, const struct de265_image* img)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  async_lock lock(ctx);
+
+  const_cast<de265_image*>(img)->nApplicationRefs++;
+}
+
+
+LIBDE265_API void de265_picture_unref(de265_decoder_context* de265ctx, const struct de265_image* img)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  async_lock lock(ctx);
+
+  de265_image* image = const_cast<de265_image*>(img);
+
+  assert(image->nApplicationRefs > 0);
+  image->nApplicationRefs--;
+
+  if (image->nApplicationRefs==0) {
+    // pictures whose DPB slot has been reused in the meantime are freed now
+    if (!ctx->release_detached_image(image) && ctx->is_async_decoding()) {
+      // the DPB may have been full
+      ctx->trigger_async_decoding();
+    }
+  }
 }
 
 
@@ -477,6 +631,8 @@ LIBDE265_API de265_error de265_get_warning(de265_decoder_context* de265ctx)
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
+  async_lock lock(ctx);
+
   return ctx->get_warning();
 }
 
@@ -502,6 +658,18 @@ LIBDE265_API void de265_set_parameter_bool(de265_decoder_context* de265ctx, enum
       ctx->param_disable_sao = !!value;
       break;
 
+    case DE265_DECODER_PARAM_TWO_STAGE_DECODING:
+      ctx->param_two_stage_decoding = !!value;
+      break;
+
+    case DE265_DECODER_PARAM_HUGE_PAGES:
+      ctx->param_huge_pages = !!value;
+      break;
+
+    case DE265_DECODER_PARAM_KEEP_DECODING_METADATA:
+      ctx->param_keep_decoding_metadata = !!value;
+      break;
+
       /*
     case DE265_DECODER_PARAM_DISABLE_MC_RESIDUAL_IDCT:
       ctx->param_disable_mc_residual_idct = !!value;
@@ -545,6 +713,18 @@ LIBDE265_API void de265_set_parameter_int(de265_decoder_context* de265ctx, enum
       ctx->set_acceleration_functions((enum de265_acceleration)value);
       break;
 
+    case DE265_DECODER_PARAM_MAX_FRAMES_IN_FLIGHT:
+      ctx->param_max_frames_in_flight = (value<1 ? 1 : value);
+      break;
+
+    case DE265_DECODER_PARAM_WORKER_THREAD_PLACEMENT:
+      ctx->param_thread_placement = (enum de265_thread_placement)value;
+      break;
+
+    case DE265_DECODER_PARAM_MEMORY_LIMIT:
+      ctx->param_memory_limit = (value<0 ? 0 : (size_t)value*1024*1024);
+      break;
+
     default:
       assert(false);
       break;
@@ -572,6 +752,15 @@ LIBDE265_API int de265_get_parameter_bool(de265_decoder_context* de265ctx, enum
     case DE265_DECODER_PARAM_DISABLE_SAO:
       return ctx->param_disable_sao;
 
+    case DE265_DECODER_PARAM_TWO_STAGE_DECODING:
+      return ctx->param_two_stage_decoding;
+
+    case DE265_DECODER_PARAM_HUGE_PAGES:
+      return ctx->param_huge_pages;
+
+    case DE265_DECODER_PARAM_KEEP_DECODING_METADATA:
+      return ctx->param_keep_decoding_metadata;
+
       /*
     case DE265_DECODER_PARAM_DISABLE_MC_RESIDUAL_IDCT:
       return ctx->param_disable_mc_residual_idct;
@@ -591,6 +780,7 @@ LIBDE265_API int de265_get_number_of_input_bytes_pending(de265_decoder_context*
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
+  async_lock lock(ctx);
   return ctx->nal_parser.bytes_in_input_queue();
 }
 
@@ -599,10 +789,30 @@ LIBDE265_API int de265_get_number_of_NAL_units_pending(de265_decoder_context* de
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
 
+  async_lock lock(ctx);
   return ctx->nal_parser.number_of_NAL_units_pending();
 }
 
 
+LIBDE265_API int de265_get_number_of_allocations(de265_decoder_context* de265ctx)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  // atomic, no async_lock needed while the asynchronous decoding is running
+  return ctx->num_allocations.load();
+}
+
+
+LIBDE265_API void de265_get_memory_usage(de265_decoder_context* de265ctx,
+                                         struct de265_memory_usage* usage)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  async_lock lock(ctx);
+  ctx->get_memory_usage(usage);
+}
+
+
 LIBDE265_API int de265_get_image_width(const struct de265_image* img,int channel)
 {
   switch (channel) {
@@ -35,6 +35,7 @@ extern "C" {
 #define __STDC_LIMIT_MACROS 1
 #endif
 #include <stdint.h>
+#include <stddef.h>
 
 #if defined(_MSC_VER) && !defined(LIBDE265_STATIC_BUILD)
   #ifdef LIBDE265_EXPORTS
@@ -99,6 +100,7 @@ typedef enum {
   DE265_ERROR_NO_INITIAL_SLICE_HEADER=16,
   DE265_ERROR_PREMATURE_END_OF_SLICE=17,
   DE265_ERROR_UNSPECIFIED_DECODING_ERROR=18,
+  DE265_ERROR_MEMORY_LIMIT_EXCEEDED=19,
 
   // --- errors that should become obsolete in later libde265 versions ---
 
@@ -250,6 +252,23 @@ LIBDE265_API void        de265_push_end_of_frame(de265_decoder_context*);
 LIBDE265_API de265_error de265_push_NAL(de265_decoder_context*, const void* data, int length,
                                         de265_PTS pts, void* user_data);
 
+/* Push a buffer with complete NAL units in bytestream format (with startcodes and all
+   stuffing-bytes) without copying it. The decoder reads the data directly from the buffer.
+   Hence, the buffer must stay valid and unchanged until the decoder calls 'release' for it.
+   This happens during decoding (in the decoding thread when decoding asynchronously),
+   in de265_reset(), or in de265_free_decoder().
+   The PTS is assigned to all NALs in the buffer. Data pending from de265_push_data()
+   is flushed first.
+   This function only pushes data into the decoder, nothing will be decoded.
+*/
+typedef void (*de265_release_data_func)(const void* data, void* release_userdata);
+
+LIBDE265_API de265_error de265_push_data_zero_copy(de265_decoder_context*,
+                                                   const void* data, int length,
+                                                   de265_PTS pts, void* user_data,
+                                                   de265_release_data_func release,
+                                                   void* release_userdata);
+
 /* Indicate the end-of-stream. All data pending at the decoder input will be
    pushed into the decoder and the decoded picture queue will be completely emptied.
  */
@@ -265,12 +284,36 @@ LIBDE265_API int de265_get_number_of_input_bytes_pending(de265_decoder_context*)
  */
 LIBDE265_API int de265_get_number_of_NAL_units_pending(de265_decoder_context*);
 
+/* Return the number of memory allocations of the objects that the decoder recycles:
+   picture buffers of the default allocation functions, PPS objects, image units, slice
+   units, slice headers, decoding metadata, thread contexts and decoding tasks. The number
+   does not increase anymore once the stream is being decoded.
+   Not counted are the allocations made while parsing VPS, SPS and SEI NAL units, the NAL
+   input buffers and the growth of the tables inside the recycled objects, which only
+   happens until the largest picture size has been seen.
+ */
+LIBDE265_API int de265_get_number_of_allocations(de265_decoder_context*);
+
+/* Memory currently held by the decoder, in bytes. */
+struct de265_memory_usage
+{
+  size_t pixels;          // picture planes (DPB, SAO line buffers, recycled picture buffers)
+  size_t metadata;        // per-picture decoding information (modes, motion vectors, ...)
+  size_t nal_queue;       // NAL units waiting for decoding or kept for reuse
+  size_t thread_contexts; // slice decoding state and two-stage decoding buffers
+  size_t total;
+};
+
+LIBDE265_API void de265_get_memory_usage(de265_decoder_context*, struct de265_memory_usage*);
+
 /* Do some decoding. Returns status whether it did perform some decoding or
    why it could not do so. If 'more' is non-null, indicates whether de265_decode()
    should be called again (possibly after resolving the indicated problem).
    DE265_OK - decoding ok
    DE265_ERROR_IMAGE_BUFFER_FULL - DPB full, extract some images before continuing
    DE265_ERROR_WAITING_FOR_INPUT_DATA - insert more data before continuing
+   DE265_ERROR_MEMORY_LIMIT_EXCEEDED - the picture was dropped because the pictures needed
+                                       by the stream do not fit into DE265_DECODER_PARAM_MEMORY_LIMIT
 
    You have to consider these cases:
    - decoding successful   -> err  = DE265_OK, more=true
@@ -298,6 +341,16 @@ LIBDE265_API const struct de265_image* de265_get_next_picture(de265_decoder_cont
    use the data anymore after calling this function. */
 LIBDE265_API void de265_release_next_picture(de265_decoder_context*);
 
+/* Keep a decoded picture after it has been released from the output queue, without copying
+   it. Take the reference between de265_peek_next_picture() and de265_release_next_picture().
+   The picture stays valid until the same number of de265_picture_unref() calls. Its buffer
+   is only reused when the application and the decoder are both done with it.
+   When the decoder needs the DPB slot of a referenced picture, the picture is moved out of
+   the DPB, so the application can keep any number of pictures.
+   All references must be dropped before de265_free_decoder(). */
+LIBDE265_API void de265_picture_ref(de265_decoder_context*, const struct de265_image*);
+LIBDE265_API void de265_picture_unref(de265_decoder_context*, const struct de265_image*);
+
 
 LIBDE265_API de265_error de265_get_warning(de265_decoder_context*);
 
@@ -387,11 +440,62 @@ enum de265_param {
   DE265_DECODER_PARAM_SUPPRESS_FAULTY_PICTURES=6, // (bool)  do not output frames with decoding errors, default: no (output all images)
 
   DE265_DECODER_PARAM_DISABLE_DEBLOCKING=7,   // (bool)  disable deblocking
-  DE265_DECODER_PARAM_DISABLE_SAO=8           // (bool)  disable SAO filter
+  DE265_DECODER_PARAM_DISABLE_SAO=8,          // (bool)  disable SAO filter
   //DE265_DECODER_PARAM_DISABLE_MC_RESIDUAL_IDCT=9,     // (bool)  disable decoding of IDCT residuals in MC blocks
   //DE265_DECODER_PARAM_DISABLE_INTRA_RESIDUAL_IDCT=10  // (bool)  disable decoding of IDCT residuals in MC blocks
+
+  DE265_DECODER_PARAM_MAX_FRAMES_IN_FLIGHT=11, // (int)  number of pictures decoded in parallel by the worker threads, default: 1 (no frame-parallel decoding)
+  DE265_DECODER_PARAM_WORKER_THREAD_PLACEMENT=12, // (int)  enum de265_thread_placement, set before starting the worker threads, default: NONE
+  DE265_DECODER_PARAM_TWO_STAGE_DECODING=13,   // (bool) reconstruct in a separate task while parsing slices without WPP (needs worker threads), default: no
+  DE265_DECODER_PARAM_MEMORY_LIMIT=14,         // (int)  upper bound of the decoder memory in MB, the DPB is sized to fit into it, default: 0 (no limit)
+  DE265_DECODER_PARAM_HUGE_PAGES=15,           // (bool) back large picture planes with 2 MB huge pages if the system supports it (default allocation functions only), default: no
+  DE265_DECODER_PARAM_KEEP_DECODING_METADATA=16 // (bool) keep the full metadata (intra modes, transform tree, motion) of decoded pictures for analysis tools, default: no
 };
 
+// binding of the worker threads to CPUs (currently only supported on Linux)
+enum de265_thread_placement {
+  de265_thread_placement_none    = 0, // let the operating system schedule the threads
+  de265_thread_placement_compact = 1, // fill the cores of one CPU package before using the next package
+  de265_thread_placement_scatter = 2  // distribute the threads evenly over all CPU packages
+};
+
+
+/* === shared worker threads === */
+
+typedef void de265_thread_pool; // private structure
+
+/* Create a pool of worker threads that can be shared by several decoders.
+   The tasks of the attached decoders are scheduled round-robin.
+   Must be freed with de265_free_thread_pool() after all decoders using it have been freed. */
+LIBDE265_API de265_thread_pool* de265_new_thread_pool(int number_of_threads,
+                                                      enum de265_thread_placement placement);
+
+LIBDE265_API void de265_free_thread_pool(de265_thread_pool*);
+
+/* Decode with the worker threads of a shared pool instead of starting own worker threads
+   with de265_start_worker_threads(). */
+LIBDE265_API de265_error de265_attach_to_thread_pool(de265_decoder_context*, de265_thread_pool*);
+
+
+/* === asynchronous decoding === */
+
+/* Called from a worker thread when new pictures have been added to the output queue.
+   'end_of_stream' is set in the last call after all data up to de265_flush_data() has
+   been decoded. The callback may call de265_peek_next_picture() and
+   de265_release_next_picture(), but it should return quickly (e.g. only signal an eventfd). */
+typedef void (*de265_picture_ready_callback)(de265_decoder_context*, void* userdata,
+                                             int end_of_stream);
+
+/* Decode in the background on the worker threads (which must have been started before).
+   Afterwards, the de265_push_*() functions and de265_flush_data() return at once and
+   de265_decode() must not be called anymore. Decoding errors are reported through
+   de265_get_warning().
+   Since the decoder reuses a picture as soon as it is released, take the pictures
+   with de265_peek_next_picture() and call de265_release_next_picture() when done. */
+LIBDE265_API de265_error de265_start_async_decoding(de265_decoder_context*,
+                                                    de265_picture_ready_callback callback,
+                                                    void* userdata);
+
 // sorted such that a large ID includes all optimizations from lower IDs
 enum de265_acceleration {
   de265_acceleration_SCALAR = 0, // only fallback implementation
@@ -400,7 +504,7 @@ enum de265_acceleration {
   de265_acceleration_SSE2 = 30,
   de265_acceleration_SSE4 = 40,
   de265_acceleration_AVX  = 50,    // not implemented yet
-  de265_acceleration_AVX2 = 60,    // not implemented yet
+  de265_acceleration_AVX2 = 60,    // motion compensation, weighted prediction and deblocking
   de265_acceleration_ARM  = 70,
   de265_acceleration_NEON = 80,
   de265_acceleration_AUTO = 10000
@@ -402,7 +402,8 @@ static uint8_t table_8_23_tc[54] = {
 
 // 8.7.2.4
 template <class pixel_t>
-void edge_filtering_luma_internal(de265_image* img, bool vertical,
+void edge_filtering_luma_internal(const acceleration_functions& accel,
+                                  de265_image* img, bool vertical,
                                   int yStart,int yEnd, int xStart,int xEnd)
 {
   //printf("luma %d-%d %d-%d\n",xStart,xEnd,yStart,yEnd);
@@ -419,41 +420,52 @@ void edge_filtering_luma_internal(de265_image* img, bool vertical,
   xEnd = libde265_min(xEnd,img->get_deblk_width());
   yEnd = libde265_min(yEnd,img->get_deblk_height());
 
-  for (int y=yStart;y<yEnd;y+=yIncr)
-    for (int x=xStart;x<xEnd;x+=xIncr) {
-      // x;y in deblocking units (4x4 pixels)
+  // DEBLOCK_MAX_SEGMENTS consecutive segments along the edge are filtered together
 
-      int xDi = x<<2; // *4 -> pixel resolution
-      int yDi = y<<2; // *4 -> pixel resolution
-      int bS = img->get_deblk_bS(xDi,yDi);
+  const int xBatch = vertical ? xIncr : DEBLOCK_MAX_SEGMENTS;
+  const int yBatch = vertical ? DEBLOCK_MAX_SEGMENTS : yIncr;
 
-      //printf("x,y:%d,%d  xDi,yDi:%d,%d\n",x,y,xDi,yDi);
+  for (int yBlk=yStart;yBlk<yEnd;yBlk+=yBatch)
+    for (int xBlk=xStart;xBlk<xEnd;xBlk+=xBatch) {
+      int  beta[DEBLOCK_MAX_SEGMENTS];
+      int  tc  [DEBLOCK_MAX_SEGMENTS];
+      bool filterP[DEBLOCK_MAX_SEGMENTS];
+      bool filterQ[DEBLOCK_MAX_SEGMENTS];
 
-      logtrace(LogDeblock,"deblock POC=%d %c --- x:%d y:%d bS:%d---\n",
-               img->PicOrderCntVal,vertical ? 'V':'H',xDi,yDi,bS);
+      int nSegments = 0;
+      bool filterAny = false;
 
-#if 0
-      {
-        uint8_t* ptr = img->y + stride*yDi + xDi;
+      for (int s=0;s<DEBLOCK_MAX_SEGMENTS;s++) {
+        // x;y in deblocking units (4x4 pixels)
 
-        for (int dy=-4;dy<4;dy++) {
-          for (int dx=-4;dx<4;dx++) {
-            printf("%02x ", ptr[dy*stride + dx]);
-            if (dx==-1) printf("| ");
-          }
-          printf("\n");
-          if (dy==-1) printf("-------------------------\n");
+        int x = vertical ? xBlk : xBlk+s;
+        int y = vertical ? yBlk+s : yBlk;
+
+        if (x>=xEnd || y>=yEnd) {
+          break;
         }
-      }
-#endif
+
+        nSegments++;
+
+        // not filtered unless set below
+        beta[s] = tc[s] = 0;
+        filterP[s] = filterQ[s] = false;
+
+        int xDi = x<<2; // *4 -> pixel resolution
+        int yDi = y<<2; // *4 -> pixel resolution
+        int bS = img->get_deblk_bS(xDi,yDi);
+
+        //printf("x,y:%d,%d  xDi,yDi:%d,%d\n",x,y,xDi,yDi);
+
+        logtrace(LogDeblock,"deblock POC=%d %c --- x:%d y:%d bS:%d---\n",
+                 img->PicOrderCntVal,vertical ? 'V':'H',xDi,yDi,bS);
 
 #if 0
-      if (!vertical)
         {
           uint8_t* ptr = img->y + stride*yDi + xDi;
 
           for (int dy=-4;dy<4;dy++) {
-            for (int dx=0;dx<4;dx++) {
+            for (int dx=-4;dx<4;dx++) {
               printf("%02x ", ptr[dy*stride + dx]);
               if (dx==-1) printf("| ");
             }
@@ -463,259 +475,99 @@ void edge_filtering_luma_internal(de265_image* img, bool vertical,
         }
 #endif
 
-      if (bS>0) {
-
-        // 8.7.2.4.3
-
-        pixel_t* ptr = img->get_image_plane_at_pos_NEW<pixel_t>(0, xDi,yDi);
-
-        pixel_t q[4][4], p[4][4];
-        for (int k=0;k<4;k++)
-          for (int i=0;i<4;i++)
-            {
-              if (vertical) {
-                q[k][i] = ptr[ i  +k*stride];
-                p[k][i] = ptr[-i-1+k*stride];
-              }
-              else {
-                q[k][i] = ptr[k + i   *stride];
-                p[k][i] = ptr[k -(i+1)*stride];
-              }
-            }
-
 #if 0
-        for (int k=0;k<4;k++)
+        if (!vertical)
           {
-            for (int i=0;i<4;i++)
-              {
-                printf("%02x ", p[k][3-i]);
-              }
-
-            printf("| ");
+            uint8_t* ptr = img->y + stride*yDi + xDi;
 
-            for (int i=0;i<4;i++)
-              {
-                printf("%02x ", q[k][i]);
+            for (int dy=-4;dy<4;dy++) {
+              for (int dx=0;dx<4;dx++) {
+                printf("%02x ", ptr[dy*stride + dx]);
+                if (dx==-1) printf("| ");
               }
-            printf("\n");
+              printf("\n");
+              if (dy==-1) printf("-------------------------\n");
+            }
           }
 #endif
 
+        if (bS>0) {
 
-        int QP_Q = img->get_QPY(xDi,yDi);
-        int QP_P = (vertical ?
-                    img->get_QPY(xDi-1,yDi) :
-                    img->get_QPY(xDi,yDi-1) );
-        int qP_L = (QP_Q+QP_P+1)>>1;
-
-        logtrace(LogDeblock,"QP: %d & %d -> %d\n",QP_Q,QP_P,qP_L);
-
-        int sliceIndexQ00 = img->get_SliceHeaderIndex(xDi,yDi);
-        int beta_offset = img->slices[sliceIndexQ00]->slice_beta_offset;
-        int tc_offset   = img->slices[sliceIndexQ00]->slice_tc_offset;
+          // 8.7.2.4.3
 
-        int Q_beta = Clip3(0,51, qP_L + beta_offset);
-        int betaPrime = table_8_23_beta[Q_beta];
-        int beta = betaPrime * (1<<(bitDepth_Y - 8));
-
-        int Q_tc = Clip3(0,53, qP_L + 2*(bS-1) + tc_offset);
-        int tcPrime = table_8_23_tc[Q_tc];
-        int tc = tcPrime * (1<<(bitDepth_Y - 8));
-
-        logtrace(LogDeblock,"beta: %d (%d)  tc: %d (%d)\n",beta,beta_offset, tc,tc_offset);
-
-        int dE=0, dEp=0, dEq=0;
-
-        if (vertical || !vertical) {
-          int dp0 = abs_value(p[0][2] - 2*p[0][1] + p[0][0]);
-          int dp3 = abs_value(p[3][2] - 2*p[3][1] + p[3][0]);
-          int dq0 = abs_value(q[0][2] - 2*q[0][1] + q[0][0]);
-          int dq3 = abs_value(q[3][2] - 2*q[3][1] + q[3][0]);
-
-          int dpq0 = dp0 + dq0;
-          int dpq3 = dp3 + dq3;
-
-          int dp = dp0 + dp3;
-          int dq = dq0 + dq3;
-          int d  = dpq0+ dpq3;
-
-          if (d<beta) {
-            //int dpq = 2*dpq0;
-            bool dSam0 = (2*dpq0 < (beta>>2) &&
-                          abs_value(p[0][3]-p[0][0])+abs_value(q[0][0]-q[0][3]) < (beta>>3) &&
-                          abs_value(p[0][0]-q[0][0]) < ((5*tc+1)>>1));
-
-            bool dSam3 = (2*dpq3 < (beta>>2) &&
-                          abs_value(p[3][3]-p[3][0])+abs_value(q[3][0]-q[3][3]) < (beta>>3) &&
-                          abs_value(p[3][0]-q[3][0]) < ((5*tc+1)>>1));
-
-            if (dSam0 && dSam3) {
-              dE=2;
-            }
-            else {
-              dE=1;
-            }
-
-            if (dp < ((beta + (beta>>1))>>3)) { dEp=1; }
-            if (dq < ((beta + (beta>>1))>>3)) { dEq=1; }
-
-            logtrace(LogDeblock,"dE:%d dEp:%d dEq:%d\n",dE,dEp,dEq);
-          }
-        }
-        else {
-          // TODO
-          assert(0);
-        }
+          int QP_Q = img->get_QPY(xDi,yDi);
+          int QP_P = (vertical ?
+                      img->get_QPY(xDi-1,yDi) :
+                      img->get_QPY(xDi,yDi-1) );
+          int qP_L = (QP_Q+QP_P+1)>>1;
 
+          logtrace(LogDeblock,"QP: %d & %d -> %d\n",QP_Q,QP_P,qP_L);
 
-        // 8.7.2.4.4
+          int sliceIndexQ00 = img->get_SliceHeaderIndex(xDi,yDi);
+          int beta_offset = img->slices[sliceIndexQ00]->slice_beta_offset;
+          int tc_offset   = img->slices[sliceIndexQ00]->slice_tc_offset;
 
-        if (dE != 0) {
-          bool filterP = true;
-          bool filterQ = true;
+          int Q_beta = Clip3(0,51, qP_L + beta_offset);
+          int betaPrime = table_8_23_beta[Q_beta];
+          beta[s] = betaPrime * (1<<(bitDepth_Y - 8));
 
-          if (vertical) {
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xDi-1,yDi)) filterP=false;
-            if (img->get_cu_transquant_bypass(xDi-1,yDi)) filterP=false;
+          int Q_tc = Clip3(0,53, qP_L + 2*(bS-1) + tc_offset);
+          int tcPrime = table_8_23_tc[Q_tc];
+          tc[s] = tcPrime * (1<<(bitDepth_Y - 8));
 
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xDi,yDi)) filterQ=false;
-            if (img->get_cu_transquant_bypass(xDi,yDi)) filterQ=false;
-          }
-          else {
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xDi,yDi-1)) filterP=false;
-            if (img->get_cu_transquant_bypass(xDi,yDi-1)) filterP=false;
+          logtrace(LogDeblock,"beta: %d (%d)  tc: %d (%d)\n",beta[s],beta_offset, tc[s],tc_offset);
 
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xDi,yDi)) filterQ=false;
-            if (img->get_cu_transquant_bypass(xDi,yDi)) filterQ=false;
+          if (tc[s] == 0) {
+            continue; // neither strong nor weak filtering changes any sample
           }
 
-          for (int k=0;k<4;k++) {
-            //int nDp,nDq;
-
-            logtrace(LogDeblock,"line:%d\n",k);
-
-            const pixel_t p0 = p[k][0];
-            const pixel_t p1 = p[k][1];
-            const pixel_t p2 = p[k][2];
-            const pixel_t p3 = p[k][3];
-            const pixel_t q0 = q[k][0];
-            const pixel_t q1 = q[k][1];
-            const pixel_t q2 = q[k][2];
-            const pixel_t q3 = q[k][3];
-
-            if (dE==2) {
-              // strong filtering
-
-              //nDp=nDq=3;
-
-              pixel_t pnew[3],qnew[3];
-              pnew[0] = Clip3(p0-2*tc,p0+2*tc, (p2 + 2*p1 + 2*p0 + 2*q0 + q1 +4)>>3);
-              pnew[1] = Clip3(p1-2*tc,p1+2*tc, (p2 + p1 + p0 + q0+2)>>2);
-              pnew[2] = Clip3(p2-2*tc,p2+2*tc, (2*p3 + 3*p2 + p1 + p0 + q0 + 4)>>3);
-              qnew[0] = Clip3(q0-2*tc,q0+2*tc, (p1+2*p0+2*q0+2*q1+q2+4)>>3);
-              qnew[1] = Clip3(q1-2*tc,q1+2*tc, (p0+q0+q1+q2+2)>>2);
-              qnew[2] = Clip3(q2-2*tc,q2+2*tc, (p0+q0+q1+3*q2+2*q3+4)>>3);
-
-              logtrace(LogDeblock,"strong filtering\n");
+          // 8.7.2.4.4
 
-              if (vertical) {
-                for (int i=0;i<3;i++) {
-                  if (filterP) { ptr[-i-1+k*stride] = pnew[i]; }
-                  if (filterQ) { ptr[ i + k*stride] = qnew[i]; }
-                }
-
-                // ptr[-1+k*stride] = ptr[ 0+k*stride] = 200;
-              }
-              else {
-                for (int i=0;i<3;i++) {
-                  if (filterP) { ptr[ k -(i+1)*stride] = pnew[i]; }
-                  if (filterQ) { ptr[ k + i   *stride] = qnew[i]; }
-                }
-              }
-            }
-            else {
-              // weak filtering
+          filterP[s] = true;
+          filterQ[s] = true;
 
-              //nDp=nDq=0;
-
-              int delta = (9*(q0-p0) - 3*(q1-p1) + 8)>>4;
-              logtrace(LogDeblock,"delta=%d, tc=%d\n",delta,tc);
-
-              if (abs_value(delta) < tc*10) {
-
-                delta = Clip3(-tc,tc,delta);
-                logtrace(LogDeblock," deblk + %d;%d [%02x->%02x]  - %d;%d [%02x->%02x] delta:%d\n",
-                         vertical ? xDi-1 : xDi+k,
-                         vertical ? yDi+k : yDi-1, p0,Clip_BitDepth(p0+delta, bitDepth_Y),
-                         vertical ? xDi   : xDi+k,
-                         vertical ? yDi+k : yDi,   q0,Clip_BitDepth(q0-delta, bitDepth_Y),
-                         delta);
-
-                if (vertical) {
-                  if (filterP) { ptr[-0-1+k*stride] = Clip_BitDepth(p0+delta, bitDepth_Y); }
-                  if (filterQ) { ptr[ 0  +k*stride] = Clip_BitDepth(q0-delta, bitDepth_Y); }
-                }
-                else {
-                  if (filterP) { ptr[ k -1*stride] = Clip_BitDepth(p0+delta, bitDepth_Y); }
-                  if (filterQ) { ptr[ k +0*stride] = Clip_BitDepth(q0-delta, bitDepth_Y); }
-                }
+          int xP = vertical ? xDi-1 : xDi;
+          int yP = vertical ? yDi   : yDi-1;
 
-                //ptr[ 0+k*stride] = 200;
+          if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xP,yP)) filterP[s]=false;
+          if (img->get_cu_transquant_bypass(xP,yP)) filterP[s]=false;
 
-                if (dEp==1 && filterP) {
-                  int delta_p = Clip3(-(tc>>1), tc>>1, (((p2+p0+1)>>1)-p1+delta)>>1);
+          if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xDi,yDi)) filterQ[s]=false;
+          if (img->get_cu_transquant_bypass(xDi,yDi)) filterQ[s]=false;
 
-                  logtrace(LogDeblock," deblk dEp %d;%d delta:%d\n",
-                           vertical ? xDi-2 : xDi+k,
-                           vertical ? yDi+k : yDi-2,
-                           delta_p);
-
-                  if (vertical) { ptr[-1-1+k*stride] = Clip_BitDepth(p1+delta_p, bitDepth_Y); }
-                  else          { ptr[ k  -2*stride] = Clip_BitDepth(p1+delta_p, bitDepth_Y); }
-                }
-
-                if (dEq==1 && filterQ) {
-                  int delta_q = Clip3(-(tc>>1), tc>>1, (((q2+q0+1)>>1)-q1-delta)>>1);
-
-                  logtrace(LogDeblock," delkb dEq %d;%d delta:%d\n",
-                           vertical ? xDi+1 : xDi+k,
-                           vertical ? yDi+k : yDi+1,
-                           delta_q);
-
-                  if (vertical) { ptr[ 1  +k*stride] = Clip_BitDepth(q1+delta_q, bitDepth_Y); }
-                  else          { ptr[ k  +1*stride] = Clip_BitDepth(q1+delta_q, bitDepth_Y); }
-                }
+          filterAny |= (filterP[s] || filterQ[s]);
+        }
+      }
 
-                //nDp = dEp+1;
-                //nDq = dEq+1;
+      if (filterAny) {
+        pixel_t* ptr = img->get_image_plane_at_pos_NEW<pixel_t>(0, xBlk<<2,yBlk<<2);
 
-                //logtrace(LogDeblock,"weak filtering (%d:%d)\n",nDp,nDq);
-              }
-            }
-          }
-        }
+        accel.deblock_luma<pixel_t>(ptr, stride, vertical, nSegments,
+                                    beta, tc, filterP, filterQ, bitDepth_Y);
       }
     }
 }
 
 
-void edge_filtering_luma(de265_image* img, bool vertical,
+void edge_filtering_luma(const acceleration_functions& accel,
+                         de265_image* img, bool vertical,
                          int yStart,int yEnd, int xStart,int xEnd)
 {
   if (img->high_bit_depth(0)) {
-    edge_filtering_luma_internal<uint16_t>(img,vertical,yStart,yEnd,xStart,xEnd);
+    edge_filtering_luma_internal<uint16_t>(accel,img,vertical,yStart,yEnd,xStart,xEnd);
   }
   else {
-    edge_filtering_luma_internal<uint8_t>(img,vertical,yStart,yEnd,xStart,xEnd);
+    edge_filtering_luma_internal<uint8_t>(accel,img,vertical,yStart,yEnd,xStart,xEnd);
   }
 }
 
-void edge_filtering_luma_CTB(de265_image* img, bool vertical, int xCtb,int yCtb)
+void edge_filtering_luma_CTB(const acceleration_functions& accel,
+                             de265_image* img, bool vertical, int xCtb,int yCtb)
 {
   int ctbSize = img->get_sps().CtbSizeY;
   int deblkSize = ctbSize/4;
 
-  edge_filtering_luma(img,vertical,
+  edge_filtering_luma(accel,img,vertical,
                       yCtb*deblkSize, (yCtb+1)*deblkSize,
                       xCtb*deblkSize, (xCtb+1)*deblkSize);
 }
@@ -727,7 +579,8 @@ void edge_filtering_luma_CTB(de265_image* img, bool vertical, int xCtb,int yCtb)
 /** ?Start and ?End values in 4-luma pixels resolution.
  */
 template <class pixel_t>
-void edge_filtering_chroma_internal(de265_image* img, bool vertical,
+void edge_filtering_chroma_internal(const acceleration_functions& accel,
+                                    de265_image* img, bool vertical,
                                     int yStart,int yEnd,
                                     int xStart,int xEnd)
 {
@@ -751,144 +604,129 @@ void edge_filtering_chroma_internal(de265_image* img, bool vertical,
 
   int bitDepth_C = sps.BitDepth_C;
 
-  for (int y=yStart;y<yEnd;y+=yIncr)
-    for (int x=xStart;x<xEnd;x+=xIncr) {
-      int xDi = x << (3-SubWidthC);
-      int yDi = y << (3-SubHeightC);
+  // DEBLOCK_MAX_SEGMENTS consecutive segments along the edge are filtered together
 
-      //printf("x,y:%d,%d  xDi,yDi:%d,%d\n",x,y,xDi,yDi);
+  const int xBatch = vertical ? xIncr : DEBLOCK_MAX_SEGMENTS*xIncr;
+  const int yBatch = vertical ? DEBLOCK_MAX_SEGMENTS*yIncr : yIncr;
 
-      int bS = img->get_deblk_bS(xDi*SubWidthC,yDi*SubHeightC);
+  for (int yBlk=yStart;yBlk<yEnd;yBlk+=yBatch)
+    for (int xBlk=xStart;xBlk<xEnd;xBlk+=xBatch)
+      for (int cplane=0;cplane<2;cplane++) {
+        int cQpPicOffset = (cplane==0 ?
+                            img->get_pps().pic_cb_qp_offset :
+                            img->get_pps().pic_cr_qp_offset);
 
-      if (bS>1) {
-        // 8.7.2.4.5
+        int  tc[DEBLOCK_MAX_SEGMENTS];
+        bool filterP[DEBLOCK_MAX_SEGMENTS];
+        bool filterQ[DEBLOCK_MAX_SEGMENTS];
 
-        for (int cplane=0;cplane<2;cplane++) {
-          int cQpPicOffset = (cplane==0 ?
-                              img->get_pps().pic_cb_qp_offset :
-                              img->get_pps().pic_cr_qp_offset);
+        int nSegments = 0;
+        bool filterAny = false;
 
-          pixel_t* ptr = img->get_image_plane_at_pos_NEW<pixel_t>(cplane+1, xDi,yDi);
+        for (int s=0;s<DEBLOCK_MAX_SEGMENTS;s++) {
+          int x = vertical ? xBlk : xBlk+s*xIncr;
+          int y = vertical ? yBlk+s*yIncr : yBlk;
 
-          pixel_t p[2][4];
-          pixel_t q[2][4];
+          if (x>=xEnd || y>=yEnd) {
+            break;
+          }
 
-          logtrace(LogDeblock,"-%s- %d %d\n",cplane==0 ? "Cb" : "Cr",xDi,yDi);
+          nSegments++;
 
-          for (int i=0;i<2;i++)
-            for (int k=0;k<4;k++)
-              {
-                if (vertical) {
-                  q[i][k] = ptr[ i  +k*stride];
-                  p[i][k] = ptr[-i-1+k*stride];
-                }
-                else {
-                  q[i][k] = ptr[k + i   *stride];
-                  p[i][k] = ptr[k -(i+1)*stride];
-                }
-              }
+          // not filtered unless set below
+          tc[s] = 0;
+          filterP[s] = filterQ[s] = false;
 
-#if 0
-          for (int k=0;k<4;k++)
-            {
-              for (int i=0;i<2;i++)
-                {
-                  printf("%02x ", p[1-i][k]);
-                }
+          int xDi = x << (3-SubWidthC);
+          int yDi = y << (3-SubHeightC);
 
-              printf("| ");
+          //printf("x,y:%d,%d  xDi,yDi:%d,%d\n",x,y,xDi,yDi);
 
-              for (int i=0;i<2;i++)
-                {
-                  printf("%02x ", q[i][k]);
-                }
-              printf("\n");
+          int bS = img->get_deblk_bS(xDi*SubWidthC,yDi*SubHeightC);
+
+          if (bS>1) {
+            // 8.7.2.4.5
+
+            logtrace(LogDeblock,"-%s- %d %d\n",cplane==0 ? "Cb" : "Cr",xDi,yDi);
+
+            int QP_Q = img->get_QPY(SubWidthC*xDi,SubHeightC*yDi);
+            int QP_P = (vertical ?
+                        img->get_QPY(SubWidthC*xDi-1,SubHeightC*yDi) :
+                        img->get_QPY(SubWidthC*xDi,SubHeightC*yDi-1));
+            int qP_i = ((QP_Q+QP_P+1)>>1) + cQpPicOffset;
+            int QP_C;
+            if (sps.ChromaArrayType == CHROMA_420) {
+              QP_C = table8_22(qP_i);
+            } else {
+              QP_C = libde265_min(qP_i, 51);
             }
-#endif
 
-          int QP_Q = img->get_QPY(SubWidthC*xDi,SubHeightC*yDi);
-          int QP_P = (vertical ?
-                      img->get_QPY(SubWidthC*xDi-1,SubHeightC*yDi) :
-                      img->get_QPY(SubWidthC*xDi,SubHeightC*yDi-1));
-          int qP_i = ((QP_Q+QP_P+1)>>1) + cQpPicOffset;
-          int QP_C;
-          if (sps.ChromaArrayType == CHROMA_420) {
-            QP_C = table8_22(qP_i);
-          } else {
-            QP_C = libde265_min(qP_i, 51);
-          }
 
+            //printf("POC=%d\n",ctx->img->PicOrderCntVal);
+            logtrace(LogDeblock,"%d %d: ((%d+%d+1)>>1) + %d = qP_i=%d  (QP_C=%d)\n",
+                     SubWidthC*xDi,SubHeightC*yDi, QP_Q,QP_P,cQpPicOffset,qP_i,QP_C);
 
-          //printf("POC=%d\n",ctx->img->PicOrderCntVal);
-          logtrace(LogDeblock,"%d %d: ((%d+%d+1)>>1) + %d = qP_i=%d  (QP_C=%d)\n",
-                   SubWidthC*xDi,SubHeightC*yDi, QP_Q,QP_P,cQpPicOffset,qP_i,QP_C);
+            int sliceIndexQ00 = img->get_SliceHeaderIndex(SubWidthC*xDi,SubHeightC*yDi);
+            int tc_offset   = img->slices[sliceIndexQ00]->slice_tc_offset;
 
-          int sliceIndexQ00 = img->get_SliceHeaderIndex(SubWidthC*xDi,SubHeightC*yDi);
-          int tc_offset   = img->slices[sliceIndexQ00]->slice_tc_offset;
+            int Q = Clip3(0,53, QP_C + 2*(bS-1) + tc_offset);
 
-          int Q = Clip3(0,53, QP_C + 2*(bS-1) + tc_offset);
+            int tcPrime = table_8_23_tc[Q];
+            tc[s] = tcPrime * (1<<(sps.BitDepth_C - 8));
 
-          int tcPrime = table_8_23_tc[Q];
-          int tc = tcPrime * (1<<(sps.BitDepth_C - 8));
+            logtrace(LogDeblock,"tc_offset=%d Q=%d tc'=%d tc=%d\n",tc_offset,Q,tcPrime,tc[s]);
 
-          logtrace(LogDeblock,"tc_offset=%d Q=%d tc'=%d tc=%d\n",tc_offset,Q,tcPrime,tc);
+            if (tc[s] == 0) {
+              continue;
+            }
 
-          if (vertical) {
-            bool filterP = true;
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(SubWidthC*xDi-1,SubHeightC*yDi)) filterP=false;
-            if (img->get_cu_transquant_bypass(SubWidthC*xDi-1,SubHeightC*yDi)) filterP=false;
+            int xP = vertical ? SubWidthC*xDi-1 : SubWidthC*xDi;
+            int yP = vertical ? SubHeightC*yDi  : SubHeightC*yDi-1;
 
-            bool filterQ = true;
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(SubWidthC*xDi,SubHeightC*yDi)) filterQ=false;
-            if (img->get_cu_transquant_bypass(SubWidthC*xDi,SubHeightC*yDi)) filterQ=false;
+            filterP[s] = true;
+            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(xP,yP)) filterP[s]=false;
+            if (img->get_cu_transquant_bypass(xP,yP)) filterP[s]=false;
 
+            filterQ[s] = true;
+            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(SubWidthC*xDi,SubHeightC*yDi)) filterQ[s]=false;
+            if (img->get_cu_transquant_bypass(SubWidthC*xDi,SubHeightC*yDi)) filterQ[s]=false;
 
-            for (int k=0;k<4;k++) {
-              int delta = Clip3(-tc,tc, ((((q[0][k]-p[0][k])<<2)+p[1][k]-q[1][k]+4)>>3));
-              logtrace(LogDeblock,"delta=%d\n",delta);
-              if (filterP) { ptr[-1+k*stride] = Clip_BitDepth(p[0][k]+delta, bitDepth_C); }
-              if (filterQ) { ptr[ 0+k*stride] = Clip_BitDepth(q[0][k]-delta, bitDepth_C); }
-            }
-          }
-          else {
-            bool filterP = true;
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(SubWidthC*xDi,SubHeightC*yDi-1)) filterP=false;
-            if (img->get_cu_transquant_bypass(SubWidthC*xDi,SubHeightC*yDi-1)) filterP=false;
-
-            bool filterQ = true;
-            if (sps.pcm_loop_filter_disable_flag && img->get_pcm_flag(SubWidthC*xDi,SubHeightC*yDi)) filterQ=false;
-            if (img->get_cu_transquant_bypass(SubWidthC*xDi,SubHeightC*yDi)) filterQ=false;
-
-            for (int k=0;k<4;k++) {
-              int delta = Clip3(-tc,tc, ((((q[0][k]-p[0][k])<<2)+p[1][k]-q[1][k]+4)>>3));
-              if (filterP) { ptr[ k-1*stride] = Clip_BitDepth(p[0][k]+delta, bitDepth_C); }
-              if (filterQ) { ptr[ k+0*stride] = Clip_BitDepth(q[0][k]-delta, bitDepth_C); }
-            }
+            filterAny |= (filterP[s] || filterQ[s]);
           }
         }
+
+        if (filterAny) {
+          pixel_t* ptr = img->get_image_plane_at_pos_NEW<pixel_t>(cplane+1,
+                                                                  xBlk << (3-SubWidthC),
+                                                                  yBlk << (3-SubHeightC));
+
+          accel.deblock_chroma<pixel_t>(ptr, stride, vertical, nSegments,
+                                        tc, filterP, filterQ, bitDepth_C);
+        }
       }
-    }
 }
 
 
-void edge_filtering_chroma(de265_image* img, bool vertical, int yStart,int yEnd,
+void edge_filtering_chroma(const acceleration_functions& accel,
+                           de265_image* img, bool vertical, int yStart,int yEnd,
                            int xStart,int xEnd)
 {
   if (img->high_bit_depth(1)) {
-    edge_filtering_chroma_internal<uint16_t>(img,vertical,yStart,yEnd,xStart,xEnd);
+    edge_filtering_chroma_internal<uint16_t>(accel,img,vertical,yStart,yEnd,xStart,xEnd);
   }
   else {
-    edge_filtering_chroma_internal<uint8_t>(img,vertical,yStart,yEnd,xStart,xEnd);
+    edge_filtering_chroma_internal<uint8_t>(accel,img,vertical,yStart,yEnd,xStart,xEnd);
   }
 }
 
 
-void edge_filtering_chroma_CTB(de265_image* img, bool vertical, int xCtb,int yCtb)
+void edge_filtering_chroma_CTB(const acceleration_functions& accel,
+                               de265_image* img, bool vertical, int xCtb,int yCtb)
 {
   int ctbSize = img->get_sps().CtbSizeY;
   int deblkSize = ctbSize/4;
 
-  edge_filtering_chroma(img,vertical,
+  edge_filtering_chroma(accel,img,vertical,
                         yCtb*deblkSize, (yCtb+1)*deblkSize,
                         xCtb*deblkSize, (xCtb+1)*deblkSize);
 }
@@ -901,6 +739,7 @@ public:
   struct de265_image* img;
   int  ctb_y;
   bool vertical;
+  bool lastFilterStage;
 
   virtual void work();
   virtual std::string name() const {
@@ -929,15 +768,16 @@ void thread_task_deblock_CTBRow::work()
   }
 
   int finalProgress = CTB_PROGRESS_DEBLK_V;
-  if (!vertical) finalProgress = CTB_PROGRESS_DEBLK_H;
+  if (!vertical) finalProgress = (lastFilterStage ? CTB_PROGRESS_COMPLETE : CTB_PROGRESS_DEBLK_H);
 
   int rightCtb = img->get_sps().PicWidthInCtbsY-1;
 
   if (vertical) {
     // pass 1: vertical
 
-    int CtbRow = std::min(ctb_y+1 , img->get_sps().PicHeightInCtbsY-1);
-    img->wait_for_progress(this, rightCtb,CtbRow, CTB_PROGRESS_PREFILTER);
+    /* Slices may be decoded in parallel (frame-parallel decoding),
+       hence we cannot only check the last CTB in the rows. */
+    img->wait_for_CTB_rows(this, ctb_y-1,ctb_y+1, CTB_PROGRESS_PREFILTER);
   }
   else {
     // pass 2: horizontal
@@ -970,12 +810,14 @@ void thread_task_deblock_CTBRow::work()
   }
 
   if (deblocking_enabled) {
+    const acceleration_functions& accel = img->decctx->acceleration;
+
     derive_boundaryStrength(img, vertical, first,last, xStart,xEnd);
 
-    edge_filtering_luma(img, vertical, first,last, xStart,xEnd);
+    edge_filtering_luma(accel, img, vertical, first,last, xStart,xEnd);
 
     if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
-      edge_filtering_chroma(img, vertical, first,last, xStart,xEnd);
+      edge_filtering_chroma(accel, img, vertical, first,last, xStart,xEnd);
     }
   }
 
@@ -989,7 +831,7 @@ void thread_task_deblock_CTBRow::work()
 }
 
 
-void add_deblocking_tasks(image_unit* imgunit)
+void add_deblocking_tasks(image_unit* imgunit, bool lastFilterStage)
 {
   de265_image* img = imgunit->img;
   decoder_context* ctx = img->decctx;
@@ -1003,14 +845,18 @@ void add_deblocking_tasks(image_unit* imgunit)
     {
       for (int y=0;y<img->get_sps().PicHeightInCtbsY;y++)
         {
-          thread_task_deblock_CTBRow* task = new thread_task_deblock_CTBRow;
+          thread_task_deblock_CTBRow* task = imgunit->deblock_tasks.get(ctx->num_allocations);
 
           task->img   = img;
           task->ctb_y = y;
           task->vertical = (pass==0);
+          task->lastFilterStage = lastFilterStage;
+
+          // the vertical pass waits for the decoding of row y+1,
+          // the horizontal pass for the vertical pass of row y+1
+          task->priority = task_priority(imgunit->decode_order, y + (pass==0 ? 1 : 2));
 
-          imgunit->tasks.push_back(task);
-          add_task(&ctx->thread_pool_, task);
+          add_task(&ctx->task_queue_, task);
           n++;
         }
     }
@@ -1029,10 +875,10 @@ void apply_deblocking_filter(de265_image* img) // decoder_context* ctx)
 
       logtrace(LogDeblock,"VERTICAL\n");
       derive_boundaryStrength(img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
-      edge_filtering_luma    (img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
+      edge_filtering_luma    (ctx->acceleration, img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
 
       if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
-        edge_filtering_chroma  (img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
+        edge_filtering_chroma  (ctx->acceleration, img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
       }
 #if 0
       char buf[1000];
@@ -1044,10 +890,10 @@ void apply_deblocking_filter(de265_image* img) // decoder_context* ctx)
 
       logtrace(LogDeblock,"HORIZONTAL\n");
       derive_boundaryStrength(img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
-      edge_filtering_luma    (img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
+      edge_filtering_luma    (ctx->acceleration, img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
 
       if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
-        edge_filtering_chroma  (img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
+        edge_filtering_chroma  (ctx->acceleration, img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
       }
 
 #if 0
@@ -23,7 +23,9 @@
 
 #include "libde265/decctx.h"
 
-void add_deblocking_tasks(image_unit* imgunit);
+/* lastFilterStage - when set, the horizontal pass marks the CTB rows as
+   CTB_PROGRESS_COMPLETE (no SAO is following) */
+void add_deblocking_tasks(image_unit* imgunit, bool lastFilterStage);
 void apply_deblocking_filter(de265_image* img); //decoder_context* ctx);
 
 #endif
@@ -23,6 +23,7 @@
 #include "sao.h"
 #include "sei.h"
 #include "deblock.h"
+#include "reconstruction.h"
 
 #include <string.h>
 #include <assert.h>
@@ -89,6 +90,8 @@ thread_context::thread_context()
 
 
 
+  recon = NULL;
+
   IsCuQpDeltaCoded = false;
   CuQpDelta = 0;
 
@@ -155,6 +158,7 @@ slice_unit::slice_unit(decoder_context* decctx)
 {
   state = Unprocessed;
   nThreadContexts = 0;
+  nAllocatedThreadContexts = 0;
 }
 
 slice_unit::~slice_unit()
@@ -167,20 +171,41 @@ slice_unit::~slice_unit()
 }
 
 
+void slice_unit::reset()
+{
+  // the NAL has been released and the thread contexts are kept
+
+  shdr = NULL;
+  imgunit = NULL;
+  flush_reorder_buffer = false;
+  state = Unprocessed;
+  finished_threads.reset();
+  nThreads = 0;
+  first_decoded_CTB_RS = -1;
+  last_decoded_CTB_RS = -1;
+  nThreadContexts = 0;
+}
+
+
 void slice_unit::allocate_thread_contexts(int n)
 {
-  assert(thread_contexts==NULL);
+  assert(nThreadContexts==0);
+
+  if (n > nAllocatedThreadContexts) {
+    delete[] thread_contexts;
+
+    thread_contexts = new thread_context[n];
+    nAllocatedThreadContexts = n;
+    ctx->num_allocations++;
+  }
 
-  thread_contexts = new thread_context[n];
   nThreadContexts = n;
 }
 
 
 image_unit::image_unit()
 {
-  img=NULL;
-  role=Invalid;
-  state=Unprocessed;
+  reset();
 }
 
 
@@ -189,10 +214,33 @@ image_unit::~image_unit()
   for (int i=0;i<slice_units.size();i++) {
     delete slice_units[i];
   }
+}
 
-  for (int i=0;i<tasks.size();i++) {
-    delete tasks[i];
-  }
+
+void image_unit::reset()
+{
+  img=NULL;
+  role=Invalid;
+  state=Unprocessed;
+  filters_pending=false;
+  decode_order=0;
+
+  // the vectors keep their memory for the next picture
+
+  slice_units.clear();
+  suffix_SEIs.clear();
+  used_images.clear();
+  ctx_models.clear();
+}
+
+
+void image_unit::recycle_tasks()
+{
+  slice_segment_tasks.recycle();
+  reconstruction_tasks.recycle();
+  ctb_row_tasks.recycle();
+  deblock_tasks.recycle();
+  sao_tasks.recycle();
 }
 
 
@@ -214,6 +262,13 @@ decoder_context::decoder_context()
 
   param_disable_deblocking = false;
   param_disable_sao = false;
+
+  param_max_frames_in_flight = 1;
+  param_thread_placement = de265_thread_placement_none;
+  param_two_stage_decoding = false;
+  param_memory_limit = 0;
+  param_huge_pages = false;
+  param_keep_decoding_metadata = false;
   //param_disable_mc_residual_idct = false;
   //param_disable_intra_residual_idct = false;
 
@@ -240,6 +295,18 @@ decoder_context::decoder_context()
 
   //memset(&thread_pool,0,sizeof(struct thread_pool));
   num_worker_threads = 0;
+  shared_thread_pool = NULL;
+  next_decode_order = 0;
+  num_allocations = 0;
+
+  async_active = false;
+  async_callback = NULL;
+  async_userdata = NULL;
+  async_task.ctx = this;
+  async_requests = 0;
+  async_end_of_stream_reported = false;
+  de265_mutex_init(&async_mutex);
+  de265_cond_init(&async_idle);
 
 
   // frame-rate
@@ -322,6 +389,232 @@ decoder_context::~decoder_context()
     delete image_units.back();
     image_units.pop_back();
   }
+
+  free_image_units.clear();
+  free_slice_units.clear();
+
+  de265_cond_destroy(&async_idle);
+  de265_mutex_destroy(&async_mutex);
+}
+
+
+image_unit* decoder_context::alloc_image_unit()
+{
+  image_unit* imgunit = free_image_units.pop();
+  if (imgunit == NULL) {
+    imgunit = new image_unit;
+    num_allocations++;
+  }
+
+  return imgunit;
+}
+
+
+void decoder_context::free_image_unit(image_unit* imgunit)
+{
+  for (int i=0;i<imgunit->slice_units.size();i++) {
+    free_slice_unit(imgunit->slice_units[i]);
+  }
+
+  imgunit->recycle_tasks();
+  imgunit->reset();
+
+  free_image_units.push(imgunit);
+}
+
+
+slice_unit* decoder_context::alloc_slice_unit()
+{
+  slice_unit* sliceunit = free_slice_units.pop();
+  if (sliceunit == NULL) {
+    sliceunit = new slice_unit(this);
+    num_allocations++;
+  }
+
+  return sliceunit;
+}
+
+
+void decoder_context::free_slice_unit(slice_unit* sliceunit)
+{
+  nal_parser.free_NAL_unit(sliceunit->nal);
+  sliceunit->nal = NULL;
+
+  sliceunit->reset();
+  free_slice_units.push(sliceunit);
+}
+
+
+slice_segment_header* decoder_context::alloc_slice_segment_header()
+{
+  slice_segment_header* shdr = free_slice_headers.pop();
+  if (shdr == NULL) {
+    shdr = new slice_segment_header;
+    num_allocations++;
+  }
+
+  return shdr;
+}
+
+
+void decoder_context::free_slice_segment_header(slice_segment_header* shdr)
+{
+  free_slice_headers.push(shdr);
+}
+
+
+decoding_metadata* decoder_context::alloc_decoding_metadata(const seq_parameter_set* sps)
+{
+  decoding_metadata* metadata = free_decoding_metadata_sets.pop();
+  if (metadata == NULL) {
+    metadata = new decoding_metadata;
+    num_allocations++;
+  }
+
+  if (!metadata->alloc(sps)) {
+    delete metadata;
+    return NULL;
+  }
+
+  return metadata;
+}
+
+
+void decoder_context::free_decoding_metadata(decoding_metadata* metadata)
+{
+  if (metadata) {
+    free_decoding_metadata_sets.push(metadata);
+  }
+}
+
+
+static size_t image_unit_thread_context_memory(const image_unit* imgunit)
+{
+  size_t size = 0;
+
+  for (int i=0;i<imgunit->slice_units.size();i++) {
+    size += imgunit->slice_units[i]->thread_context_memory_usage();
+  }
+
+  for (int i=0;i<imgunit->slice_segment_tasks.num_allocated();i++) {
+    const reconstruction_pipeline* pipeline = imgunit->slice_segment_tasks.get_allocated(i)->pipeline;
+    if (pipeline) {
+      size += pipeline->memory_usage();
+    }
+  }
+
+  return size;
+}
+
+
+void decoder_context::get_memory_usage(de265_memory_usage* usage)
+{
+  usage->pixels = image_pool.memory_usage();
+  usage->metadata = 0;
+  usage->nal_queue = nal_parser.memory_usage();
+  usage->thread_contexts = 0;
+
+  for (int i=0;i<dpb.size();i++) {
+    const de265_image* img = dpb.get_image(i);
+    usage->pixels   += img->get_pixel_memory_usage();
+    usage->metadata += img->get_metadata_memory_usage();
+  }
+
+  for (int i=0;i<dpb.num_detached_images();i++) {
+    const de265_image* img = dpb.get_detached_image(i);
+    usage->pixels   += img->get_pixel_memory_usage();
+    usage->metadata += img->get_metadata_memory_usage();
+  }
+
+  for (int i=0;i<image_units.size();i++) {
+    const image_unit* imgunit = image_units[i];
+
+    usage->pixels += imgunit->sao_lines.memory_usage();
+    usage->thread_contexts += image_unit_thread_context_memory(imgunit);
+
+    for (int s=0;s<imgunit->slice_units.size();s++) {
+      usage->nal_queue += imgunit->slice_units[s]->nal->memory_usage();
+    }
+  }
+
+  for (int i=0;i<free_image_units.size();i++) {
+    usage->pixels += free_image_units[i]->sao_lines.memory_usage();
+    usage->thread_contexts += image_unit_thread_context_memory(free_image_units[i]);
+  }
+
+  for (int i=0;i<free_slice_units.size();i++) {
+    usage->thread_contexts += free_slice_units[i]->thread_context_memory_usage();
+  }
+
+  for (int i=0;i<free_decoding_metadata_sets.size();i++) {
+    usage->metadata += free_decoding_metadata_sets[i]->memory_usage();
+  }
+
+  usage->total = (usage->pixels + usage->metadata +
+                  usage->nal_queue + usage->thread_contexts);
+}
+
+
+/* Without a memory limit, the DPB may grow up to DPB_DEFAULT_MAX_IMAGES pictures.
+   With a limit, it holds as many pictures of the size of 'img' as fit into the memory
+   that is not used otherwise, but at least the pictures needed by the stream.
+   Returns false if even these do not fit into the limit.
+
+   The input data is not included, because the application controls how much of it is
+   pushed ahead of the decoding.
+ */
+bool decoder_context::update_DPB_size(const seq_parameter_set* sps, const de265_image* img)
+{
+  if (param_memory_limit == 0) {
+    dpb.set_max_size_of_DPB(DPB_DEFAULT_MAX_IMAGES);
+    dpb.set_norm_size_of_DPB(DPB_DEFAULT_MAX_IMAGES);
+    return true;
+  }
+
+  int highestTid = sps->sps_max_sub_layers-1;
+
+  // The decoder only outputs pictures when the reorder buffer is full, so pictures
+  // waiting for output may be kept in addition to the reference pictures.
+  int nMinPictures = (sps->sps_max_dec_pic_buffering[highestTid] +
+                      sps->sps_max_num_reorder_pics[highestTid]);
+
+  // pictures decoded in parallel
+  int nFramesInFlight = 1;
+  if (use_frame_parallel_decoding()) {
+    nFramesInFlight = param_max_frames_in_flight;
+    nMinPictures += nFramesInFlight-1;
+  }
+
+  // The decoding metadata is only attached to the pictures in decoding.
+
+  size_t decodingMetadataSize = img->get_decoding_metadata_memory_usage();
+
+  size_t pictureSize = (img->get_pixel_memory_usage() + img->get_metadata_memory_usage()
+                        - decodingMetadataSize);
+
+  size_t scratchSize = nFramesInFlight * decodingMetadataSize;
+
+  if (scratchSize + nMinPictures*pictureSize > param_memory_limit) {
+    return false;
+  }
+
+  de265_memory_usage usage;
+  get_memory_usage(&usage);
+
+  size_t otherSize = scratchSize + usage.thread_contexts;
+
+  size_t nPictures = 0;
+  if (otherSize < param_memory_limit) {
+    nPictures = (param_memory_limit - otherSize) / pictureSize;
+  }
+
+  nPictures = std::max(nPictures, (size_t)nMinPictures);
+  nPictures = std::min(nPictures, (size_t)DPB_DEFAULT_MAX_IMAGES);
+
+  dpb.set_max_size_of_DPB(nPictures);
+  dpb.set_norm_size_of_DPB(nPictures);
+
+  return true;
 }
 
 
@@ -343,9 +636,28 @@ void decoder_context::set_image_allocation_functions(de265_image_allocation* all
 
 de265_error decoder_context::start_thread_pool(int nThreads)
 {
-  ::start_thread_pool(&thread_pool_, nThreads);
+  de265_error err = ::start_thread_pool(&thread_pool_, nThreads, param_thread_placement);
+
+  num_worker_threads = thread_pool_.num_threads; // may be less if not all threads could be started
+
+  if (num_worker_threads>0) {
+    attach_task_queue(&thread_pool_, &task_queue_);
+  }
+
+  return err;
+}
+
+
+de265_error decoder_context::attach_to_thread_pool(thread_pool* pool)
+{
+  stop_thread_pool();
+
+  shared_thread_pool = pool;
+  num_worker_threads = pool->num_threads;
 
-  num_worker_threads = nThreads;
+  if (num_worker_threads>0) {
+    attach_task_queue(pool, &task_queue_);
+  }
 
   return DE265_OK;
 }
@@ -353,19 +665,36 @@ de265_error decoder_context::start_thread_pool(int nThreads)
 
 void decoder_context::stop_thread_pool()
 {
+  stop_async_decoding();
+
   if (get_num_worker_threads()>0) {
+    // the pool drops queued tasks, so we cannot stop while pictures are in flight
+    wait_for_frames_in_flight();
+
+    detach_task_queue(&task_queue_);
+
     //flush_thread_pool(&ctx->thread_pool);
-    ::stop_thread_pool(&thread_pool_);
+    if (shared_thread_pool==NULL) {
+      ::stop_thread_pool(&thread_pool_);
+    }
+
+    num_worker_threads = 0;
   }
+
+  shared_thread_pool = NULL;
 }
 
 
 void decoder_context::reset()
 {
-  if (num_worker_threads>0) {
-    //flush_thread_pool(&ctx->thread_pool);
-    ::stop_thread_pool(&thread_pool_);
-  }
+  const int nWorkerThreads = num_worker_threads;
+  thread_pool* sharedPool = shared_thread_pool;
+
+  const bool async = is_async_decoding();
+  de265_picture_ready_callback asyncCallback = async_callback;
+  void* asyncUserdata = async_userdata;
+
+  stop_thread_pool();
 
   // --------------------------------------------------
 
@@ -424,9 +753,147 @@ void decoder_context::reset()
 
   // --- start threads again ---
 
-  if (num_worker_threads>0) {
+  if (sharedPool) {
+    attach_to_thread_pool(sharedPool);
+  }
+  else if (nWorkerThreads>0) {
     // TODO: need error checking
-    start_thread_pool(num_worker_threads);
+    start_thread_pool(nWorkerThreads);
+  }
+
+  if (async) {
+    start_async_decoding(asyncCallback, asyncUserdata);
+  }
+}
+
+
+// --- asynchronous decoding ---
+
+void thread_task_async_decode::work()
+{
+  ctx->run_async_decoding();
+}
+
+
+de265_error decoder_context::start_async_decoding(de265_picture_ready_callback callback,
+                                                  void* userdata)
+{
+  if (get_num_worker_threads()==0) {
+    return DE265_ERROR_CANNOT_START_THREADPOOL;
+  }
+
+  stop_async_decoding();
+
+  async_callback = callback;
+  async_userdata = userdata;
+  async_end_of_stream_reported = false;
+  async_task.priority = -1; // never waits, run it before all picture tasks
+  async_active = true;
+
+  // decode the data that has been pushed already
+  trigger_async_decoding();
+
+  return DE265_OK;
+}
+
+
+void decoder_context::stop_async_decoding()
+{
+  if (!async_active) {
+    return;
+  }
+
+  de265_mutex_lock(&async_mutex);
+
+  async_active = false;
+
+  // a queued task has to run and finish before we may continue
+  while (async_requests > 0) {
+    de265_cond_wait(&async_idle, &async_mutex);
+  }
+
+  de265_mutex_unlock(&async_mutex);
+}
+
+
+void decoder_context::trigger_async_decoding()
+{
+  if (!async_active) {
+    return;
+  }
+
+  // only queue the task if it is not queued already, it will see our request anyway
+
+  if (async_requests.fetch_add(1) == 0) {
+    add_task(&task_queue_, &async_task);
+  }
+}
+
+
+void decoder_context::run_async_decoding()
+{
+  for (;;) {
+    int nRequests = async_requests;
+
+    // decode until we have to wait for input, for output space or for the worker threads
+
+    for (;;) {
+      de265_mutex_lock(&async_mutex);
+
+      if (!async_active) {
+        de265_mutex_unlock(&async_mutex);
+        break;
+      }
+
+      // all input has been decoded, decode() will only flush the reorder buffer
+      bool idle = (nal_parser.get_NAL_queue_length() == 0 &&
+                   (nal_parser.is_end_of_stream() || nal_parser.is_end_of_frame()) &&
+                   image_units.empty());
+
+      int nOutputBefore = dpb.num_pictures_in_output_queue();
+
+      int more = 0;
+      de265_error err = decode(&more, false);
+
+      bool newPictures = (dpb.num_pictures_in_output_queue() > nOutputBefore);
+
+      bool endOfStream = (idle && nal_parser.is_end_of_stream() &&
+                          !async_end_of_stream_reported);
+      if (endOfStream) {
+        async_end_of_stream_reported = true;
+      }
+
+      if (err != DE265_OK &&
+          err != DE265_ERROR_WAITING_FOR_INPUT_DATA &&
+          err != DE265_ERROR_IMAGE_BUFFER_FULL) {
+        add_warning(err, false);
+      }
+
+      de265_mutex_unlock(&async_mutex);
+
+      if (newPictures || endOfStream) {
+        async_callback((de265_decoder_context*)this, async_userdata, endOfStream);
+      }
+
+      if (!more || idle ||
+          err == DE265_ERROR_WAITING_FOR_INPUT_DATA ||
+          err == DE265_ERROR_IMAGE_BUFFER_FULL) {
+        break;
+      }
+    }
+
+
+    // end the task if there were no new triggers while we were decoding
+
+    de265_mutex_lock(&async_mutex);
+
+    if (async_requests.fetch_sub(nRequests) == nRequests) {
+      de265_cond_broadcast(&async_idle, &async_mutex);
+      de265_mutex_unlock(&async_mutex);
+      return; // 'this' may be gone now
+    }
+
+    de265_mutex_unlock(&async_mutex);
   }
 }
 
@@ -444,6 +911,11 @@ void base_context::set_acceleration_functions(enum de265_acceleration l)
     init_acceleration_functions_sse(&acceleration);
   }
 #endif
+#ifdef HAVE_AVX2
+  if (l>=de265_acceleration_AVX2) {
+    init_acceleration_functions_avx2(&acceleration);
+  }
+#endif
 #ifdef HAVE_ARM
   if (l>=de265_acceleration_ARM) {
     init_acceleration_functions_arm(&acceleration);
@@ -460,37 +932,22 @@ void decoder_context::init_thread_context(thread_context* tctx)
   tctx->currentQG_x = -1;
   tctx->currentQG_y = -1;
 
+  // the thread contexts of recycled slice units still hold the state of the last slice
 
+  tctx->IsCuQpDeltaCoded = false;
+  tctx->CuQpDelta = 0;
+  tctx->IsCuChromaQpOffsetCoded = false;
+  tctx->CuQpOffsetCb = 0;
+  tctx->CuQpOffsetCr = 0;
 
-  // --- find QPY that was active at the end of the previous slice ---
-
-  // find the previous CTB in TS order
-
-  const pic_parameter_set& pps = tctx->img->get_pps();
-  const seq_parameter_set& sps = tctx->img->get_sps();
-
-
-  if (tctx->shdr->slice_segment_address > 0) {
-    int prevCtb = pps.CtbAddrTStoRS[ pps.CtbAddrRStoTS[tctx->shdr->slice_segment_address] -1 ];
-
-    int ctbX = prevCtb % sps.PicWidthInCtbsY;
-    int ctbY = prevCtb / sps.PicWidthInCtbsY;
 
 
-    // take the pixel at the bottom right corner (but consider that the image size might be smaller)
+  /* The QPY at the end of the previous slice is only needed by dependent slice segments.
+     The previous slice may still be decoding in another thread here, so it is read in
+     initialize_CABAC_at_slice_segment_start() after waiting for that slice.
+     All other substreams start with the slice QP. */
 
-    int x = ((ctbX+1) << sps.Log2CtbSizeY)-1;
-    int y = ((ctbY+1) << sps.Log2CtbSizeY)-1;
-
-    x = std::min(x,sps.pic_width_in_luma_samples-1);
-    y = std::min(y,sps.pic_height_in_luma_samples-1);
-
-    //printf("READ QPY: %d %d -> %d (should %d)\n",x,y,imgunit->img->get_QPY(x,y), tc.currentQPY);
-
-    //if (tctx->shdr->dependent_slice_segment_flag) {  // TODO: do we need this condition ?
-    tctx->currentQPY = tctx->img->get_QPY(x,y);
-      //}
-  }
+  tctx->currentQPY = tctx->shdr->SliceQPY;
 }
 
 
@@ -498,31 +955,55 @@ void decoder_context::add_task_decode_CTB_row(thread_context* tctx,
                                               bool firstSliceSubstream,
                                               int ctbRow)
 {
-  thread_task_ctb_row* task = new thread_task_ctb_row;
+  thread_task_ctb_row* task = tctx->imgunit->ctb_row_tasks.get(num_allocations);
   task->firstSliceSubstream = firstSliceSubstream;
   task->tctx = tctx;
   task->debug_startCtbRow = ctbRow;
+  task->priority = task_priority(tctx->imgunit->decode_order, ctbRow);
   tctx->task = task;
 
-  add_task(&thread_pool_, task);
-
-  tctx->imgunit->tasks.push_back(task);
+  add_task(&task_queue_, task);
 }
 
 
 void decoder_context::add_task_decode_slice_segment(thread_context* tctx, bool firstSliceSubstream,
                                                     int ctbx,int ctby)
 {
-  thread_task_slice_segment* task = new thread_task_slice_segment;
+  thread_task_slice_segment* task = tctx->imgunit->slice_segment_tasks.get(num_allocations);
   task->firstSliceSubstream = firstSliceSubstream;
   task->tctx = tctx;
   task->debug_startCtbX = ctbx;
   task->debug_startCtbY = ctby;
+  task->priority = task_priority(tctx->imgunit->decode_order, ctby);
   tctx->task = task;
 
-  add_task(&thread_pool_, task);
+  thread_task_reconstruction* recon_task = NULL;
+
+  task->two_stage = param_two_stage_decoding;
 
-  tctx->imgunit->tasks.push_back(task);
+  if (param_two_stage_decoding) {
+    // the pipeline is kept with the recycled task
+    if (task->pipeline == NULL) {
+      task->pipeline = new reconstruction_pipeline;
+      num_allocations++;
+    }
+    task->pipeline->start(tctx);
+
+    recon_task = tctx->imgunit->reconstruction_tasks.get(num_allocations);
+    recon_task->pipeline = task->pipeline;
+    recon_task->img = tctx->img;
+    recon_task->debug_startCtbX = ctbx;
+    recon_task->debug_startCtbY = ctby;
+    recon_task->priority = task->priority;
+
+    tctx->img->thread_start(1);
+  }
+
+  add_task(&task_queue_, task);
+
+  if (recon_task) {
+    add_task(&task_queue_, recon_task);
+  }
 }
 
 
@@ -569,7 +1050,20 @@ de265_error decoder_context::read_pps_NAL(bitreader& reader)
 {
   logdebug(LogHeaders,"----> read PPS\n");
 
-  std::shared_ptr<pic_parameter_set> new_pps = std::make_shared<pic_parameter_set>();
+  std::shared_ptr<pic_parameter_set> new_pps;
+
+  for (size_t i=0;i<pps_pool.size();i++) {
+    if (pps_pool[i].use_count()==1) {
+      new_pps = pps_pool[i];
+      break;
+    }
+  }
+
+  if (!new_pps) {
+    new_pps = std::make_shared<pic_parameter_set>();
+    pps_pool.push_back(new_pps);
+    num_allocations++;
+  }
 
   bool success = new_pps->read(&reader,this);
 
@@ -621,13 +1115,13 @@ de265_error decoder_context::read_slice_NAL(bitreader& reader, NAL_unit* nal, na
 
   // --- read slice header ---
 
-  slice_segment_header* shdr = new slice_segment_header;
+  slice_segment_header* shdr = alloc_slice_segment_header();
   bool continueDecoding;
   de265_error err = shdr->read(&reader,this, &continueDecoding);
   if (!continueDecoding) {
     if (img) { img->integrity = INTEGRITY_NOT_DECODED; }
     nal_parser.free_NAL_unit(nal);
-    delete shdr;
+    free_slice_segment_header(shdr);
     return err;
   }
 
@@ -636,159 +1130,413 @@ de265_error decoder_context::read_slice_NAL(bitreader& reader, NAL_unit* nal, na
   }
 
 
-  if (process_slice_segment_header(shdr, &err, nal->pts, &nal_hdr, nal->user_data) == false)
-    {
-      if (img!=NULL) img->integrity = INTEGRITY_NOT_DECODED;
-      nal_parser.free_NAL_unit(nal);
-      delete shdr;
-      return err;
+  if (process_slice_segment_header(shdr, &err, nal->pts, &nal_hdr, nal->user_data) == false)
+    {
+      if (img!=NULL) img->integrity = INTEGRITY_NOT_DECODED;
+      nal_parser.free_NAL_unit(nal);
+      free_slice_segment_header(shdr);
+      return err;
+    }
+
+  this->img->add_slice_segment_header(shdr);
+
+  skip_bits(&reader,1); // TODO: why?
+  prepare_for_CABAC(&reader);
+
+
+  // modify entry_point_offsets
+  // (not with zero-copy input, where the emulation prevention bytes are still in the data)
+
+  if (!nal->has_emulation_prevention_bytes()) {
+    int headerLength = reader.data - nal->data();
+    for (int i=0;i<shdr->num_entry_point_offsets;i++) {
+      shdr->entry_point_offset[i] -= nal->num_skipped_bytes_before(shdr->entry_point_offset[i],
+                                                                   headerLength);
+    }
+  }
+
+
+
+  // --- start a new image if this is the first slice ---
+
+  if (shdr->first_slice_segment_in_pic_flag) {
+    image_unit* imgunit = alloc_image_unit();
+    imgunit->img = this->img;
+    imgunit->decode_order = next_decode_order++;
+    image_units.push_back(imgunit);
+  }
+
+
+  // --- add slice to current picture ---
+
+  if ( ! image_units.empty() ) {
+
+    slice_unit* sliceunit = alloc_slice_unit();
+    sliceunit->nal = nal;
+    sliceunit->shdr = shdr;
+    sliceunit->reader = reader;
+
+    sliceunit->flush_reorder_buffer = flush_reorder_buffer_at_this_frame;
+
+
+    image_units.back()->slice_units.push_back(sliceunit);
+  }
+
+  bool did_work;
+  err = decode_some(&did_work, false);
+
+  return DE265_OK;
+}
+
+
+template <class T> void pop_front(std::vector<T>& vec)
+{
+  for (int i=1;i<vec.size();i++)
+    vec[i-1] = vec[i];
+
+  vec.pop_back();
+}
+
+
+de265_error decoder_context::decode_some(bool* did_work, bool may_block)
+{
+  de265_error err = DE265_OK;
+
+  *did_work = false;
+
+  if (image_units.empty()) { return DE265_OK; }  // nothing to do
+
+  if (use_pipelined_decoding() ||
+      image_units[0]->state == image_unit::InProgress) {
+    return decode_some_frame_parallel(did_work, may_block);
+  }
+
+
+  // decode something if there is work to do
+
+  if ( ! image_units.empty() ) { // && ! image_units[0]->slice_units.empty() ) {
+
+    image_unit* imgunit = image_units[0];
+    slice_unit* sliceunit = imgunit->get_next_unprocessed_slice_segment();
+
+    if (sliceunit != NULL) {
+
+      //pop_front(imgunit->slice_units);
+
+      if (sliceunit->flush_reorder_buffer) {
+        dpb.flush_reorder_buffer();
+      }
+
+      *did_work = true;
+
+      //err = decode_slice_unit_sequential(imgunit, sliceunit);
+      err = decode_slice_unit_parallel(imgunit, sliceunit);
+      if (err) {
+        return err;
+      }
+
+      //delete sliceunit;
+    }
+  }
+
+
+
+  // if we decoded all slices of the current image and there will not
+  // be added any more slices to the image, output the image
+
+  if ( ( image_units.size()>=2 && image_units[0]->all_slice_segments_processed()) ||
+       ( image_units.size()>=1 && image_units[0]->all_slice_segments_processed() &&
+         nal_parser.number_of_NAL_units_pending()==0 &&
+         (nal_parser.is_end_of_stream() || nal_parser.is_end_of_frame()) )) {
+
+    image_unit* imgunit = image_units[0];
+
+    *did_work=true;
+
+
+    // mark all CTBs as decoded even if they are not, because faulty input
+    // streams could miss part of the picture
+    // TODO: this will not work when slice decoding is parallel to post-filtering,
+    // so we will have to replace this with keeping track of which CTB should have
+    // been decoded (but aren't because of the input stream being faulty)
+
+    imgunit->img->mark_all_CTB_progress(CTB_PROGRESS_PREFILTER);
+
+
+
+    // run post-processing filters (deblocking & SAO)
+
+    if (img->decctx->num_worker_threads)
+      run_postprocessing_filters_parallel(imgunit);
+    else
+      run_postprocessing_filters_sequential(imgunit);
+
+    err = finish_image_unit(imgunit);
+  }
+
+  return err;
+}
+
+
+/* Output the decoded image of the first image unit and remove the unit from the queue.
+ */
+de265_error decoder_context::finish_image_unit(image_unit* imgunit)
+{
+  de265_error err = DE265_OK;
+
+  assert(imgunit == image_units[0]);
+
+  imgunit->img->mark_all_CTB_progress(CTB_PROGRESS_COMPLETE);
+
+  // the picture only keeps the metadata needed for the decoding of other pictures
+
+  if (!param_keep_decoding_metadata) {
+    free_decoding_metadata(imgunit->img->detach_decoding_metadata());
+  }
+
+  // process suffix SEIs
+
+  for (int i=0;i<imgunit->suffix_SEIs.size();i++) {
+    const sei_message& sei = imgunit->suffix_SEIs[i];
+
+    err = process_sei(&sei, imgunit->img);
+    if (err != DE265_OK)
+      break;
+  }
+
+
+  push_picture_to_output_queue(imgunit);
+
+  // remove just decoded image unit from queue
+
+  free_image_unit(imgunit);
+
+  pop_front(image_units);
+
+  return err;
+}
+
+
+// --- pipelined / frame-parallel decoding ---
+
+/* Image units are started as soon as all their slices are available. Each
+   picture is completely queued (slices, deblocking, SAO) before the next one.
+   Since all dependencies point to tasks that were queued earlier, the tasks
+   can never block each other in a cycle.
+   Pictures are finished in decoding order. We only block on the oldest picture
+   if we may not start any more pictures or if we have nothing else to do.
+ */
+de265_error decoder_context::decode_some_frame_parallel(bool* did_work, bool may_block)
+{
+  de265_error err = DE265_OK;
+
+  // --- start decoding of complete image units ---
+
+  int nInFlight = 0;
+
+  for (int i=0;i<image_units.size();i++) {
+    image_unit* imgunit = image_units[i];
+
+    if (imgunit->state == image_unit::InProgress) {
+      if (imgunit->filters_pending) {
+        // the following pictures may only be started after the filters of this one are queued
+        if (!imgunit->img->debug_is_completed()) {
+          break;
+        }
+
+        start_pending_filters(imgunit);
+        *did_work = true;
+      }
+
+      nInFlight++;
+      continue;
     }
 
-  this->img->add_slice_segment_header(shdr);
+    bool complete = (i+1 < image_units.size() ||
+                     (nal_parser.number_of_NAL_units_pending()==0 &&
+                      (nal_parser.is_end_of_stream() || nal_parser.is_end_of_frame())));
 
-  skip_bits(&reader,1); // TODO: why?
-  prepare_for_CABAC(&reader);
+    if (!complete || nInFlight >= param_max_frames_in_flight) {
+      break;
+    }
 
+    de265_error starterr = decode_image_unit_frame_parallel(imgunit);
+    if (err == DE265_OK) { err = starterr; }
 
-  // modify entry_point_offsets
+    nInFlight++;
+    *did_work = true;
 
-  int headerLength = reader.data - nal->data();
-  for (int i=0;i<shdr->num_entry_point_offsets;i++) {
-    shdr->entry_point_offset[i] -= nal->num_skipped_bytes_before(shdr->entry_point_offset[i],
-                                                                 headerLength);
+    if (imgunit->filters_pending) {
+      break;
+    }
   }
 
 
+  // --- output finished image units ---
 
-  // --- start a new image if this is the first slice ---
+  while (!image_units.empty() &&
+         image_units[0]->state == image_unit::InProgress) {
 
-  if (shdr->first_slice_segment_in_pic_flag) {
-    image_unit* imgunit = new image_unit;
-    imgunit->img = this->img;
-    image_units.push_back(imgunit);
-  }
+    image_unit* imgunit = image_units[0];
 
+    bool block = (may_block && !*did_work);
+    if (!block && (imgunit->filters_pending || !imgunit->img->debug_is_completed())) {
+      break;
+    }
 
-  // --- add slice to current picture ---
+    if (imgunit->filters_pending) {
+      start_pending_filters(imgunit);
+    }
 
-  if ( ! image_units.empty() ) {
+    imgunit->img->wait_for_completion();
 
-    slice_unit* sliceunit = new slice_unit(this);
-    sliceunit->nal = nal;
-    sliceunit->shdr = shdr;
-    sliceunit->reader = reader;
 
-    sliceunit->flush_reorder_buffer = flush_reorder_buffer_at_this_frame;
+    // release the images that we kept in the DPB
 
+    for (int i=0;i<imgunit->used_images.size();i++) {
+      imgunit->used_images[i]->nDecodingUsers--;
+    }
+    imgunit->used_images.clear();
 
-    image_units.back()->slice_units.push_back(sliceunit);
-  }
+    if (imgunit->slice_units[0]->flush_reorder_buffer) {
+      dpb.flush_reorder_buffer();
+    }
 
-  bool did_work;
-  err = decode_some(&did_work);
+    bool lastImageUnit = (image_units.size()==1);
 
-  return DE265_OK;
-}
+    de265_error finisherr = finish_image_unit(imgunit);
 
+    /* As in sequential decoding, errors (e.g. checksum mismatches) are only returned for
+       the last picture that was read so far. Earlier pictures are finished while the
+       following NALs are being read and their errors are not passed on, so that
+       decoding continues with the next picture. */
 
-template <class T> void pop_front(std::vector<T>& vec)
-{
-  for (int i=1;i<vec.size();i++)
-    vec[i-1] = vec[i];
+    if (err == DE265_OK && lastImageUnit) { err = finisherr; }
 
-  vec.pop_back();
+    *did_work = true;
+  }
+
+  return err;
 }
 
 
-de265_error decoder_context::decode_some(bool* did_work)
+de265_error decoder_context::decode_image_unit_frame_parallel(image_unit* imgunit)
 {
   de265_error err = DE265_OK;
 
-  *did_work = false;
-
-  if (image_units.empty()) { return DE265_OK; }  // nothing to do
-
+  de265_image* img = imgunit->img;
 
-  // decode something if there is work to do
+  imgunit->state = image_unit::InProgress;
 
-  if ( ! image_units.empty() ) { // && ! image_units[0]->slice_units.empty() ) {
 
-    image_unit* imgunit = image_units[0];
-    slice_unit* sliceunit = imgunit->get_next_unprocessed_slice_segment();
+  // keep the image and its reference images in the DPB until decoding has finished
 
-    if (sliceunit != NULL) {
+  imgunit->used_images.push_back(img);
 
-      //pop_front(imgunit->slice_units);
+  for (int s=0;s<imgunit->slice_units.size();s++) {
+    const slice_segment_header* shdr = imgunit->slice_units[s]->shdr;
 
-      if (sliceunit->flush_reorder_buffer) {
-        dpb.flush_reorder_buffer();
+    for (int l=0;l<2;l++) {
+      int nRefs = (l==0 ? shdr->num_ref_idx_l0_active : shdr->num_ref_idx_l1_active);
+      if (shdr->slice_type == SLICE_TYPE_I ||
+          (l==1 && shdr->slice_type != SLICE_TYPE_B)) {
+        nRefs = 0;
       }
 
-      *did_work = true;
-
-      //err = decode_slice_unit_sequential(imgunit, sliceunit);
-      err = decode_slice_unit_parallel(imgunit, sliceunit);
-      if (err) {
-        return err;
+      for (int i=0;i<nRefs && i<MAX_NUM_REF_PICS;i++) {
+        de265_image* refimg = dpb.get_image(shdr->RefPicList[l][i]);
+        if (refimg) {
+          imgunit->used_images.push_back(refimg);
+        }
       }
-
-      //delete sliceunit;
     }
   }
 
+  for (int i=0;i<imgunit->used_images.size();i++) {
+    imgunit->used_images[i]->nDecodingUsers++;
+  }
 
 
-  // if we decoded all slices of the current image and there will not
-  // be added any more slices to the image, output the image
+  // queue decoding tasks for all slices
 
-  if ( ( image_units.size()>=2 && image_units[0]->all_slice_segments_processed()) ||
-       ( image_units.size()>=1 && image_units[0]->all_slice_segments_processed() &&
-         nal_parser.number_of_NAL_units_pending()==0 &&
-         (nal_parser.is_end_of_stream() || nal_parser.is_end_of_frame()) )) {
+  bool slicesInOrder = true;
 
-    image_unit* imgunit = image_units[0];
+  for (int s=0;s<imgunit->slice_units.size();s++) {
+    slice_unit* sliceunit = imgunit->slice_units[s];
 
-    *did_work=true;
+    de265_error sliceerr = decode_slice_unit_parallel(imgunit, sliceunit);
+    if (err == DE265_OK) { err = sliceerr; }
 
+    // no task will mark this slice as decoded
+    if (sliceunit->nThreads == 0) {
+      mark_whole_slice_as_processed(imgunit,sliceunit,CTB_PROGRESS_PREFILTER);
+    }
 
-    // mark all CTBs as decoded even if they are not, because faulty input
-    // streams could miss part of the picture
-    // TODO: this will not work when slice decoding is parallel to post-filtering,
-    // so we will have to replace this with keeping track of which CTB should have
-    // been decoded (but aren't because of the input stream being faulty)
+    if (s>0 &&
+        sliceunit->shdr->slice_segment_address <=
+        imgunit->slice_units[s-1]->shdr->slice_segment_address) {
+      slicesInOrder = false;
+    }
+  }
 
-    imgunit->img->mark_all_CTB_progress(CTB_PROGRESS_PREFILTER);
+  /* With a broken slice order, not all CTBs will be marked as decoded.
+     Wait for the slices and mark the whole image before we start the filters.
+     The asynchronous decoding task may not block. It is triggered again when the
+     slices are done and then starts the filters in decode_some_frame_parallel(). */
 
+  if (!slicesInOrder) {
+    imgunit->filters_pending = true;
 
+    if (!is_async_decoding()) {
+      start_pending_filters(imgunit);
+    }
+  }
+  else {
+    add_postprocessing_tasks(imgunit);
+  }
 
-    // run post-processing filters (deblocking & SAO)
+  return err;
+}
 
-    if (img->decctx->num_worker_threads)
-      run_postprocessing_filters_parallel(imgunit);
-    else
-      run_postprocessing_filters_sequential(imgunit->img);
 
-    // process suffix SEIs
+void decoder_context::start_pending_filters(image_unit* imgunit)
+{
+  imgunit->img->wait_for_completion();
+  imgunit->img->mark_all_CTB_progress(CTB_PROGRESS_PREFILTER);
 
-    for (int i=0;i<imgunit->suffix_SEIs.size();i++) {
-      const sei_message& sei = imgunit->suffix_SEIs[i];
+  imgunit->filters_pending = false;
 
-      err = process_sei(&sei, imgunit->img);
-      if (err != DE265_OK)
-        break;
+  add_postprocessing_tasks(imgunit);
+}
+
+
+bool decoder_context::has_frames_in_flight() const
+{
+  for (int i=0;i<image_units.size();i++) {
+    if (image_units[i]->state == image_unit::InProgress) {
+      return true;
     }
+  }
 
+  return false;
+}
 
-    push_picture_to_output_queue(imgunit);
 
-    // remove just decoded image unit from queue
+void decoder_context::wait_for_frames_in_flight()
+{
+  for (int i=0;i<image_units.size();i++) {
+    if (image_units[i]->state == image_unit::InProgress) {
+      if (image_units[i]->filters_pending) {
+        start_pending_filters(image_units[i]);
+      }
 
-    delete imgunit;
+      image_units[i]->img->wait_for_completion();
 
-    pop_front(image_units);
+      /* Without in-loop filters, only finish_image_unit() marks the picture as complete.
+         Later pictures in flight may be waiting for it as a reference. */
+      image_units[i]->img->mark_all_CTB_progress(CTB_PROGRESS_COMPLETE);
+    }
   }
-
-  return err;
 }
 
 
@@ -829,7 +1577,8 @@ de265_error decoder_context::decode_slice_unit_sequential(image_unit* imgunit,
 
   init_CABAC_decoder(&tctx.cabac_decoder,
                      sliceunit->reader.data,
-                     sliceunit->reader.bytes_remaining);
+                     sliceunit->reader.bytes_remaining,
+                     &sliceunit->reader.ep);
 
   // alloc CABAC-model array if entropy_coding_sync is enabled
 
@@ -854,8 +1603,17 @@ void decoder_context::mark_whole_slice_as_processed(image_unit* imgunit,
 {
   //printf("mark whole slice\n");
 
+  de265_image* img = imgunit->img;
+  const pic_parameter_set& pps = img->get_pps();
+
+  if (sliceunit->shdr->slice_segment_address >= pps.CtbAddrRStoTS.size()) {
+    return;
+  }
+
+
+  // mark all CTBs upto the next slice segment as processed (in tile-scan order)
 
-  // mark all CTBs upto the next slice segment as processed
+  int endTS;
 
   slice_unit* nextSegment = imgunit->get_next_slice_segment(sliceunit);
   if (nextSegment) {
@@ -865,16 +1623,30 @@ void decoder_context::mark_whole_slice_as_processed(image_unit* imgunit,
            nextSegment->shdr->slice_segment_address);
     */
 
-    for (int ctb=sliceunit->shdr->slice_segment_address;
-         ctb < nextSegment->shdr->slice_segment_address;
-         ctb++)
-      {
-        if (ctb >= imgunit->img->number_of_ctbs())
-          break;
-
-        imgunit->img->ctb_progress[ctb].set_progress(progress);
-      }
+    if (nextSegment->shdr->slice_segment_address < pps.CtbAddrRStoTS.size()) {
+      endTS = pps.CtbAddrRStoTS[nextSegment->shdr->slice_segment_address];
+    }
+    else {
+      endTS = img->number_of_ctbs();
+    }
+  }
+  else if (imgunit->state == image_unit::InProgress) {
+    // frame-parallel decoding: this is the last slice segment in the image
+    endTS = img->number_of_ctbs();
+  }
+  else {
+    return;
   }
+
+  for (int ts=pps.CtbAddrRStoTS[sliceunit->shdr->slice_segment_address];
+       ts < endTS;
+       ts++)
+    {
+      if (ts >= img->number_of_ctbs())
+        break;
+
+      img->ctb_progress[ pps.CtbAddrTStoRS[ts] ].set_progress(progress);
+    }
 }
 
 
@@ -904,10 +1676,15 @@ de265_error decoder_context::decode_slice_unit_parallel(image_unit* imgunit,
                     pps.tiles_enabled_flag);
 
 
-  // TODO: remove this warning later when we do frame-parallel decoding
-  if (img->decctx->num_worker_threads > 0 &&
+  bool frame_parallel = (imgunit->state == image_unit::InProgress);
+
+  // Independent slices are decoded in parallel (see decode_slice_unit_task()),
+  // but a picture with only one of them is decoded on a single thread.
+
+  if (img->decctx->num_worker_threads > 0 && !use_frame_parallel_decoding() &&
       pps.entropy_coding_sync_enabled_flag == false &&
-      pps.tiles_enabled_flag == false) {
+      pps.tiles_enabled_flag == false &&
+      imgunit->number_of_independent_slice_segments() < 2) {
 
     img->decctx->add_warning(DE265_WARNING_NO_WPP_CANNOT_USE_MULTITHREADING, true);
   }
@@ -938,9 +1715,20 @@ de265_error decoder_context::decode_slice_unit_parallel(image_unit* imgunit,
   }
 
 
-  // TODO: even though we cannot split this into several tasks, we should run it
-  // as a background thread
+  if (use_WPP && use_tiles) {
+    // TODO: this is not allowed ... output some warning or error
+
+    return DE265_WARNING_PPS_HEADER_INVALID;
+  }
+
+
+  // In frame-parallel mode, we only queue the tasks and return.
+
   if (!use_WPP && !use_tiles) {
+    if (frame_parallel) {
+      return decode_slice_unit_task(imgunit, sliceunit);
+    }
+
     //printf("SEQ\n");
     err = decode_slice_unit_sequential(imgunit, sliceunit);
     sliceunit->state = slice_unit::Decoded;
@@ -949,33 +1737,78 @@ de265_error decoder_context::decode_slice_unit_parallel(image_unit* imgunit,
   }
 
 
-  if (use_WPP && use_tiles) {
-    // TODO: this is not allowed ... output some warning or error
-
-    return DE265_WARNING_PPS_HEADER_INVALID;
-  }
-
-
   if (use_WPP) {
     //printf("WPP\n");
     err = decode_slice_unit_WPP(imgunit, sliceunit);
-    sliceunit->state = slice_unit::Decoded;
-    mark_whole_slice_as_processed(imgunit,sliceunit,CTB_PROGRESS_PREFILTER);
-    return err;
   }
-  else if (use_tiles) {
+  else {
     //printf("TILE\n");
     err = decode_slice_unit_tiles(imgunit, sliceunit);
-    sliceunit->state = slice_unit::Decoded;
-    mark_whole_slice_as_processed(imgunit,sliceunit,CTB_PROGRESS_PREFILTER);
+  }
+
+  if (frame_parallel) {
     return err;
   }
 
-  assert(false);
+  img->wait_for_completion();
+
+  imgunit->recycle_tasks();
+
+  sliceunit->state = slice_unit::Decoded;
+  mark_whole_slice_as_processed(imgunit,sliceunit,CTB_PROGRESS_PREFILTER);
   return err;
 }
 
 
+/* Decode a slice without WPP or tiles as a single background task (pipelined decoding).
+   Since all slice segments of a picture are queued at once, independent slices are
+   decoded in parallel. A dependent slice segment waits for the previous segment to
+   take over its CABAC state (see initialize_CABAC_at_slice_segment_start()).
+ */
+de265_error decoder_context::decode_slice_unit_task(image_unit* imgunit,
+                                                    slice_unit* sliceunit)
+{
+  de265_image* img = imgunit->img;
+  slice_segment_header* shdr = sliceunit->shdr;
+  const pic_parameter_set& pps = img->get_pps();
+  int ctbsWidth = img->get_sps().PicWidthInCtbsY;
+
+  if (shdr->slice_segment_address >= pps.CtbAddrRStoTS.size()) {
+    return DE265_ERROR_CTB_OUTSIDE_IMAGE_AREA;
+  }
+
+  if (sliceunit->reader.bytes_remaining <= 0) {
+    return DE265_ERROR_PREMATURE_END_OF_SLICE;
+  }
+
+  sliceunit->allocate_thread_contexts(1);
+
+  thread_context* tctx = sliceunit->get_thread_context(0);
+
+  tctx->shdr    = shdr;
+  tctx->decctx  = this;
+  tctx->img     = img;
+  tctx->imgunit = imgunit;
+  tctx->sliceunit= sliceunit;
+  tctx->CtbAddrInTS = pps.CtbAddrRStoTS[shdr->slice_segment_address];
+
+  init_thread_context(tctx);
+
+  init_CABAC_decoder(&tctx->cabac_decoder,
+                     sliceunit->reader.data,
+                     sliceunit->reader.bytes_remaining,
+                     &sliceunit->reader.ep);
+
+  sliceunit->nThreads = 1;
+  img->thread_start(1);
+  add_task_decode_slice_segment(tctx, true,
+                                shdr->slice_segment_address % ctbsWidth,
+                                shdr->slice_segment_address / ctbsWidth);
+
+  return DE265_OK;
+}
+
+
 de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
                                                    slice_unit* sliceunit)
 {
@@ -989,9 +1822,6 @@ de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
   int ctbsWidth = img->get_sps().PicWidthInCtbsY;
 
 
-  assert(img->num_threads_active() == 0);
-
-
   // reserve space to store entropy coding context models for each CTB row
 
   if (shdr->first_slice_segment_in_pic_flag) {
@@ -1057,23 +1887,30 @@ de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
 
     init_CABAC_decoder(&tctx->cabac_decoder,
                        &sliceunit->reader.data[dataStartIndex],
-                       dataEnd-dataStartIndex);
+                       dataEnd-dataStartIndex,
+                       &sliceunit->reader.ep);
+
+    sliceunit->nThreads++;
+  }
+
+
+  // add tasks (the number of tasks has to be known before the first task finishes)
 
-    // add task
+  img->thread_start(sliceunit->nThreads);
+
+  for (int entryPt=0;entryPt<sliceunit->nThreads;entryPt++) {
+    thread_context* tctx = sliceunit->get_thread_context(entryPt);
 
     //printf("start task for ctb-row: %d\n",ctbRow);
-    img->thread_start(1);
-    sliceunit->nThreads++;
-    add_task_decode_CTB_row(tctx, entryPt==0, ctbRow);
+    add_task_decode_CTB_row(tctx, entryPt==0, tctx->CtbAddrInTS / ctbsWidth);
   }
 
 #if 0
   for (;;) {
-    printf("q:%d r:%d b:%d f:%d\n",
-           img->nThreadsQueued,
-           img->nThreadsRunning,
-           img->nThreadsBlocked,
-           img->nThreadsFinished);
+    printf("p:%d r:%d b:%d\n",
+           img->nThreadsPending.load(),
+           img->nThreadsRunning.load(),
+           img->nThreadsBlocked.load());
 
     if (img->debug_is_completed()) break;
 
@@ -1081,12 +1918,6 @@ de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
   }
 #endif
 
-  img->wait_for_completion();
-
-  for (int i=0;i<imgunit->tasks.size();i++)
-    delete imgunit->tasks[i];
-  imgunit->tasks.clear();
-
   return DE265_OK;
 }
 
@@ -1103,8 +1934,6 @@ de265_error decoder_context::decode_slice_unit_tiles(image_unit* imgunit,
   int ctbsWidth = img->get_sps().PicWidthInCtbsY;
 
 
-  assert(img->num_threads_active() == 0);
-
   sliceunit->allocate_thread_contexts(nTiles);
 
 
@@ -1159,24 +1988,27 @@ de265_error decoder_context::decode_slice_unit_tiles(image_unit* imgunit,
 
     init_CABAC_decoder(&tctx->cabac_decoder,
                        &sliceunit->reader.data[dataStartIndex],
-                       dataEnd-dataStartIndex);
+                       dataEnd-dataStartIndex,
+                       &sliceunit->reader.ep);
+
+    sliceunit->nThreads++;
+  }
+
+
+  // add tasks (the number of tasks has to be known before the first task finishes)
 
-    // add task
+  img->thread_start(sliceunit->nThreads);
+
+  for (int entryPt=0;entryPt<sliceunit->nThreads;entryPt++) {
+    thread_context* tctx = sliceunit->get_thread_context(entryPt);
+    int ctbAddrRS = pps.CtbAddrTStoRS[tctx->CtbAddrInTS];
 
     //printf("add tiles thread\n");
-    img->thread_start(1);
-    sliceunit->nThreads++;
     add_task_decode_slice_segment(tctx, entryPt==0,
                                   ctbAddrRS % ctbsWidth,
                                   ctbAddrRS / ctbsWidth);
   }
 
-  img->wait_for_completion();
-
-  for (int i=0;i<imgunit->tasks.size();i++)
-    delete imgunit->tasks[i];
-  imgunit->tasks.clear();
-
   return err;
 }
 
@@ -1190,7 +2022,14 @@ de265_error decoder_context::decode_NAL(NAL_unit* nal)
   de265_error err = DE265_OK;
 
   bitreader reader;
-  bitreader_init(&reader, nal->data(), nal->size());
+  if (nal->has_emulation_prevention_bytes()) {
+    bitreader_init_with_emulation_prevention(&reader, nal->data(), nal->size(),
+                                             nal->skipped_byte_positions(),
+                                             nal->num_skipped_bytes());
+  }
+  else {
+    bitreader_init(&reader, nal->data(), nal->size());
+  }
 
   nal_header nal_hdr;
   nal_hdr.read(&reader);
@@ -1265,7 +2104,7 @@ de265_error decoder_context::decode_NAL(NAL_unit* nal)
 }
 
 
-de265_error decoder_context::decode(int* more)
+de265_error decoder_context::decode(int* more, bool may_block)
 {
   decoder_context* ctx = this;
 
@@ -1303,6 +2142,42 @@ de265_error decoder_context::decode(int* more)
 
   if (!ctx->dpb.has_free_dpb_picture(false)) {
     if (more) *more = 1;
+
+    // in pipelined mode, the DPB may be filled with pictures that are still queued or in flight
+
+    if (!image_units.empty() &&
+        (use_pipelined_decoding() || image_units[0]->state == image_unit::InProgress)) {
+      bool did_work;
+      de265_error err = decode_some(&did_work, may_block);
+      if (!may_block && more) { *more = did_work; }
+
+      // Otherwise, the remaining image units are waiting for input that we cannot parse
+      // until the application frees a picture.
+      if (did_work || err != DE265_OK) {
+        return err;
+      }
+    }
+
+    return DE265_ERROR_IMAGE_BUFFER_FULL;
+  }
+
+
+  /* Before the DPB slot array is enlarged, the frames in flight have to be finished (see
+     process_slice_segment_header()). The asynchronous decoding task may not wait for them.
+     It pauses until the slot array can take a picture and its unavailable reference
+     pictures, and is triggered again by the next picture that completes. */
+
+  if (is_async_decoding() &&
+      dpb.num_free_slots() < 1+MAX_NUM_REF_PICS &&
+      has_frames_in_flight()) {
+    if (more) *more = 1;
+
+    bool did_work;
+    de265_error err = decode_some(&did_work, false);
+    if (did_work || err != DE265_OK) {
+      return err;
+    }
+
     return DE265_ERROR_IMAGE_BUFFER_FULL;
   }
 
@@ -1326,7 +2201,7 @@ de265_error decoder_context::decode(int* more)
     return DE265_ERROR_WAITING_FOR_INPUT_DATA;
   }
   else {
-    err = decode_some(&did_work);
+    err = decode_some(&did_work, may_block);
   }
 
   if (more) {
@@ -1415,6 +2290,11 @@ int decoder_context::generate_unavailable_reference_picture(const seq_parameter_
 
   std::shared_ptr<const seq_parameter_set> current_sps = this->sps[ (int)current_pps->seq_parameter_set_id ];
 
+  if (!dpb.has_free_slot()) {
+    assert(!is_async_decoding() || !has_frames_in_flight()); // see decode()
+    wait_for_frames_in_flight(); // DPB slot array may be reallocated
+  }
+
   int idx = dpb.new_image(current_sps, this, 0,0, false);
   assert(idx>=0);
   //printf("-> fill with unavailable POC %d\n",POC);
@@ -1433,6 +2313,8 @@ int decoder_context::generate_unavailable_reference_picture(const seq_parameter_
   img->PicState = (longTerm ? UsedForLongTermReference : UsedForShortTermReference);
   img->integrity = INTEGRITY_UNAVAILABLE_REFERENCE;
 
+  img->mark_all_CTB_progress(CTB_PROGRESS_COMPLETE);
+
   return idx;
 }
 
@@ -1443,7 +2325,11 @@ int decoder_context::generate_unavailable_reference_picture(const seq_parameter_
  */
 void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
 {
-  std::vector<int> removeReferencesList;
+  // Filled in place, the recycled slice header keeps the capacity. Each DPB picture is
+  // added at most once.
+  std::vector<int>& removeReferencesList = hdr->RemoveReferencesList;
+  removeReferencesList.clear();
+  removeReferencesList.reserve(dpb.size());
 
   const int currentID = img->get_ID();
 
@@ -1568,7 +2454,7 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
   // (old 8-99) / (new 8-106)
   // 1.
 
-  std::vector<char> picInAnyList(dpb.size(), false);
+  picInAnyList.assign(dpb.size(), false);
 
 
   dpb.log_dpb_content();
@@ -1709,8 +2595,6 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
           }
       }
 
-  hdr->RemoveReferencesList = removeReferencesList;
-
   //remove_images_from_dpb(hdr->RemoveReferencesList);
 }
 
@@ -1868,8 +2752,10 @@ bool decoder_context::construct_reference_picture_lists(slice_segment_header* hd
 
 
 
-void decoder_context::run_postprocessing_filters_sequential(de265_image* img)
+void decoder_context::run_postprocessing_filters_sequential(image_unit* imgunit)
 {
+    de265_image* img = imgunit->img;
+
 #if SAVE_INTERMEDIATE_IMAGES
     char buf[1000];
     sprintf(buf,"pre-lf-%05d.yuv", img->PicOrderCntVal);
@@ -1886,7 +2772,7 @@ void decoder_context::run_postprocessing_filters_sequential(de265_image* img)
 #endif
 
     if (!img->decctx->param_disable_sao) {
-      apply_sample_adaptive_offset_sequential(img);
+      apply_sample_adaptive_offset_sequential(imgunit);
     }
 
 #if SAVE_INTERMEDIATE_IMAGES
@@ -1897,23 +2783,31 @@ void decoder_context::run_postprocessing_filters_sequential(de265_image* img)
 
 
 void decoder_context::run_postprocessing_filters_parallel(image_unit* imgunit)
+{
+  add_postprocessing_tasks(imgunit);
+
+  imgunit->img->wait_for_completion();
+}
+
+
+void decoder_context::add_postprocessing_tasks(image_unit* imgunit)
 {
   de265_image* img = imgunit->img;
 
   int saoWaitsForProgress = CTB_PROGRESS_PREFILTER;
-  bool waitForCompletion = false;
+
+  bool sao = (!img->decctx->param_disable_sao &&
+              img->get_sps().sample_adaptive_offset_enabled_flag);
 
   if (!img->decctx->param_disable_deblocking) {
-    add_deblocking_tasks(imgunit);
+    // when there is no SAO, the deblocking produces the final image
+    add_deblocking_tasks(imgunit, !sao);
     saoWaitsForProgress = CTB_PROGRESS_DEBLK_H;
   }
 
-  if (!img->decctx->param_disable_sao) {
-    waitForCompletion |= add_sao_tasks(imgunit, saoWaitsForProgress);
-    //apply_sample_adaptive_offset(img);
+  if (sao) {
+    add_sao_tasks(imgunit, saoWaitsForProgress);
   }
-
-  img->wait_for_completion();
 }
 
 /*
@@ -2008,7 +2902,13 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
     // --- find and allocate image buffer for decoding ---
 
     int image_buffer_idx;
-    bool isOutputImage = (!sps->sample_adaptive_offset_enabled_flag || param_disable_sao);
+    bool isOutputImage = true; // SAO is applied in place
+
+    if (!dpb.has_free_slot()) {
+      assert(!is_async_decoding() || !has_frames_in_flight()); // see decode()
+      wait_for_frames_in_flight(); // DPB slot array may be reallocated
+    }
+
     image_buffer_idx = dpb.new_image(current_sps, this, pts, user_data, isOutputImage);
     if (image_buffer_idx == -1) {
       *err = DE265_ERROR_IMAGE_BUFFER_FULL;
@@ -2016,6 +2916,27 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
     }
 
     /*de265_image* */ img = dpb.get_image(image_buffer_idx);
+
+    decoding_metadata* metadata = alloc_decoding_metadata(sps);
+    if (metadata == NULL) {
+      img->release();
+
+      img = NULL;
+      *err = DE265_ERROR_OUT_OF_MEMORY;
+      return false;
+    }
+
+    img->attach_decoding_metadata(metadata);
+
+    if (!update_DPB_size(sps, img)) {
+      img->release();
+      image_pool.purge();
+
+      img = NULL;
+      *err = DE265_ERROR_MEMORY_LIMIT_EXCEEDED;
+      return false;
+    }
+
     img->nal_hdr = *nal_hdr;
 
     // Note: sps is already set in new_image() -> ??? still the case with shared_ptr ?
@@ -48,6 +48,9 @@ class slice_segment_header;
 class image_unit;
 class slice_unit;
 class decoder_context;
+class thread_task_reconstruction;
+class thread_task_deblock_CTBRow;
+class thread_task_sao;
 
 
 class thread_context
@@ -117,6 +120,8 @@ public:
   slice_unit* sliceunit;
   thread_task* task; // executing thread_task or NULL if not multi-threaded
 
+  reconstruction_pipeline* recon; // two-stage decoding: record blocks instead of decoding them
+
 private:
   thread_context(const thread_context&); // not allowed
   const thread_context& operator=(const thread_context&); // not allowed
@@ -147,6 +152,8 @@ public:
   slice_unit(decoder_context* decctx);
   ~slice_unit();
 
+  void reset(); // prepare a recycled slice unit, see decoder_context::free_slice_unit()
+
   NAL_unit* nal;   // we are the owner
   slice_segment_header* shdr;  // not the owner (de265_image is owner)
   bitreader reader;
@@ -169,17 +176,22 @@ public:
   int first_decoded_CTB_RS; // TODO
   int last_decoded_CTB_RS;  // TODO
 
-  void allocate_thread_contexts(int n);
+  void allocate_thread_contexts(int n); // reuses the contexts of a recycled slice unit
   thread_context* get_thread_context(int n) {
     assert(n < nThreadContexts);
     return &thread_contexts[n];
   }
   int num_thread_contexts() const { return nThreadContexts; }
 
+  size_t thread_context_memory_usage() const {
+    return nAllocatedThreadContexts * sizeof(thread_context);
+  }
+
 private:
   thread_context* thread_contexts; /* NOTE: cannot use std::vector, because thread_context has
                                       no copy constructor. */
   int nThreadContexts;
+  int nAllocatedThreadContexts;
 
 public:
   decoder_context* ctx;
@@ -190,14 +202,126 @@ private:
 };
 
 
+/* Recycled objects of the decoder. The list owns the objects. */
+template <class T> class free_list
+{
+ public:
+  free_list() { }
+  ~free_list() { clear(); }
+
+  T* pop() { // returns NULL if empty
+    if (objects.empty()) return NULL;
+    T* obj = objects.back();
+    objects.pop_back();
+    return obj;
+  }
+
+  void push(T* obj) { objects.push_back(obj); }
+
+  int size() const { return objects.size(); }
+  T* operator[](int i) const { return objects[i]; }
+
+  void clear() {
+    for (int i=0;i<objects.size();i++) {
+      delete objects[i];
+    }
+    objects.clear();
+  }
+
+ private:
+  std::vector<T*> objects;
+
+  free_list(const free_list&); // not allowed
+  const free_list& operator=(const free_list&); // not allowed
+};
+
+
+/* The tasks of one type for an image unit. They are allocated on first use and kept
+   for the next picture when the image unit is recycled.
+   Some task types are only forward-declared here. The tasks are therefore stored
+   as thread_task, which has a virtual destructor.
+ */
+template <class T> class task_list
+{
+ public:
+  task_list() : nUsed(0) { }
+  ~task_list() {
+    for (int i=0;i<tasks.size();i++) {
+      delete tasks[i];
+    }
+  }
+
+  T* get(std::atomic<int>& num_allocations) {
+    if (nUsed == tasks.size()) {
+      tasks.push_back(new T);
+      num_allocations++;
+    }
+
+    T* task = static_cast<T*>(tasks[nUsed++]);
+    task->state = thread_task::Queued;
+    return task;
+  }
+
+  void recycle() { nUsed=0; } // all tasks must be finished
+
+  // all tasks, including the unused ones
+  int num_allocated() const { return tasks.size(); }
+  const T* get_allocated(int i) const { return static_cast<const T*>(tasks[i]); }
+
+ private:
+  std::vector<thread_task*> tasks;
+  int nUsed;
+
+  task_list(const task_list&); // not allowed
+  const task_list& operator=(const task_list&); // not allowed
+};
+
+
+/* SAO is applied in place. The SAO of a CTB row reads the unfiltered samples of the
+   last line of the row above and of the first line of the row below. These lines are
+   saved before the row they belong to is filtered.
+ */
+class sao_line_buffers
+{
+ public:
+  sao_line_buffers();
+  ~sao_line_buffers();
+
+  void init(const de265_image* img); // prepare for a picture, the buffers keep their memory
+
+  // Saves the first or last line of a CTB row (all color components).
+  // Only the first call for each line copies it. Call before the row is filtered.
+  void save_line(const de265_image* img, int ctbRow, bool bottom);
+
+  const uint8_t* get_line(int cIdx, int ctbRow, bool bottom) const {
+    return &lines[cIdx][(2*ctbRow + bottom) * line_size[cIdx]];
+  }
+
+  size_t memory_usage() const;
+
+ private:
+  std::vector<uint8_t> lines[3];
+  std::vector<uint8_t> saved;  // [2*ctbRow + bottom]
+  int line_size[3];            // bytes
+  int nComponents;
+
+  de265_mutex mutex;
+
+  sao_line_buffers(const sao_line_buffers&); // not allowed
+  const sao_line_buffers& operator=(const sao_line_buffers&); // not allowed
+};
+
+
 class image_unit
 {
 public:
   image_unit();
   ~image_unit();
 
+  void reset(); // prepare a recycled image unit for the next picture
+
   de265_image* img;
-  de265_image  sao_output; // if SAO is used, this is allocated and used as SAO output buffer
+  sao_line_buffers sao_lines;
 
   std::vector<slice_unit*> slice_units;
   std::vector<sei_message> suffix_SEIs;
@@ -244,6 +368,15 @@ public:
     return false;
   }
 
+  // slices that do not continue the CABAC state of a previous slice segment
+  int number_of_independent_slice_segments() const {
+    int n=0;
+    for (int i=0; i<slice_units.size(); i++) {
+      if (!slice_units[i]->shdr->dependent_slice_segment_flag) n++;
+    }
+    return n;
+  }
+
   bool is_first_slice_segment(const slice_unit* s) const {
     if (slice_units.size()==0) return false;
     return (slice_units[0] == s);
@@ -256,12 +389,28 @@ public:
   } role;
 
   enum { Unprocessed,
-         InProgress,
+         InProgress,     // frame-parallel decoding: all slices have been queued for decoding
          Decoded,
          Dropped         // will not be decoded
   } state;
 
-  std::vector<thread_task*> tasks; // we are the owner
+  /* Frame-parallel decoding of slices that are not in order: the filters are queued
+     when the slices have been decoded (see decode_image_unit_frame_parallel()). */
+  bool filters_pending;
+
+  task_list<thread_task_slice_segment>  slice_segment_tasks;
+  task_list<thread_task_reconstruction> reconstruction_tasks;
+  task_list<thread_task_ctb_row>        ctb_row_tasks;
+  task_list<thread_task_deblock_CTBRow> deblock_tasks;
+  task_list<thread_task_sao>            sao_tasks;
+
+  void recycle_tasks(); // all tasks must be finished
+
+  int64_t decode_order; // scheduling priority of the tasks, see task_priority()
+
+  /* Frame-parallel decoding: images (the decoded image and its references)
+     that are kept in the DPB until this image unit is finished. */
+  std::vector<de265_image*> used_images;
 
   /* Saved context models for WPP.
      There is one saved model for the initialization of each CTB row.
@@ -288,6 +437,20 @@ class base_context : public error_queue
 };
 
 
+class decoder_context;
+
+/* Runs the decoding loop on a worker thread (asynchronous decoding).
+ */
+class thread_task_async_decode : public thread_task
+{
+public:
+  decoder_context* ctx;
+
+  virtual void work();
+  virtual std::string name() const { return "async-decode"; }
+};
+
+
 class decoder_context : public base_context {
  public:
   decoder_context();
@@ -296,8 +459,26 @@ class decoder_context : public base_context {
   de265_error start_thread_pool(int nThreads);
   void        stop_thread_pool();
 
+  // use the worker threads of a pool that is shared with other decoders
+  de265_error attach_to_thread_pool(thread_pool* pool);
+
   void reset();
 
+  // --- asynchronous decoding ---
+
+  /* The decoding loop runs as a task on the worker threads. It is triggered when new
+     input data arrives, when a picture has been decoded and when an output picture is
+     released. The task never waits for pictures. If it cannot continue, it ends and is
+     queued again by the next trigger. While it is active, all API calls that access
+     the decoder state lock 'async_mutex'. */
+  de265_error start_async_decoding(de265_picture_ready_callback callback, void* userdata);
+  void        stop_async_decoding();
+  bool        is_async_decoding() const { return async_active; }
+  void        trigger_async_decoding();
+  void        run_async_decoding(); // called by thread_task_async_decode
+
+  de265_mutex async_mutex;
+
   bool has_sps(int id) const { return (bool)sps[id]; }
   bool has_pps(int id) const { return (bool)pps[id]; }
 
@@ -320,13 +501,33 @@ class decoder_context : public base_context {
 
   de265_error decode_NAL(NAL_unit* nal);
 
-  de265_error decode(int* more);
-  de265_error decode_some(bool* did_work);
+  de265_error decode(int* more, bool may_block=true);
+  de265_error decode_some(bool* did_work, bool may_block=true);
 
   de265_error decode_slice_unit_sequential(image_unit* imgunit, slice_unit* sliceunit);
   de265_error decode_slice_unit_parallel(image_unit* imgunit, slice_unit* sliceunit);
   de265_error decode_slice_unit_WPP(image_unit* imgunit, slice_unit* sliceunit);
   de265_error decode_slice_unit_tiles(image_unit* imgunit, slice_unit* sliceunit);
+  de265_error decode_slice_unit_task(image_unit* imgunit, slice_unit* sliceunit);
+
+  // --- pipelined / frame-parallel decoding ---
+
+  /* With worker threads, all slices and in-loop filters of a picture are queued as tasks.
+     Deblocking and SAO of a CTB row start as soon as the rows they depend on are available.
+     Several pictures are decoded in parallel if param_max_frames_in_flight>1. */
+  bool use_pipelined_decoding() const {
+    return num_worker_threads>0;
+  }
+
+  bool use_frame_parallel_decoding() const {
+    return num_worker_threads>0 && param_max_frames_in_flight>1;
+  }
+
+  de265_error decode_some_frame_parallel(bool* did_work, bool may_block);
+  de265_error decode_image_unit_frame_parallel(image_unit* imgunit);
+  void        start_pending_filters(image_unit* imgunit); // waits for the slices
+  void        wait_for_frames_in_flight();
+  bool        has_frames_in_flight() const;
 
 
   void process_nal_hdr(nal_header*);
@@ -338,6 +539,10 @@ class decoder_context : public base_context {
   //void push_current_picture_to_output_queue();
   de265_error push_picture_to_output_queue(image_unit*);
 
+  void mark_whole_slice_as_processed(image_unit* imgunit,
+                                     slice_unit* sliceunit,
+                                     int progress);
+
 
   // --- parameters ---
 
@@ -352,6 +557,13 @@ class decoder_context : public base_context {
 
   bool param_disable_deblocking;
   bool param_disable_sao;
+
+  int  param_max_frames_in_flight; // number of pictures decoded in parallel (needs worker threads)
+  enum de265_thread_placement param_thread_placement;
+  bool param_two_stage_decoding; // separate entropy decoding from reconstruction
+  size_t param_memory_limit;     // in bytes, 0: no limit
+  bool param_huge_pages;         // huge pages for the picture planes (default allocation)
+  bool param_keep_decoding_metadata; // do not detach the decoding metadata from decoded pictures
   //bool param_disable_mc_residual_idct;  // not implemented yet
   //bool param_disable_intra_residual_idct;  // not implemented yet
 
@@ -360,6 +572,45 @@ class decoder_context : public base_context {
   de265_image_allocation param_image_allocation_functions;
   void*                  param_image_allocation_userdata;
 
+  // recycled planes of the default image allocation (declared before the dpb,
+  // which releases its images into the pool when it is destroyed)
+  image_buffer_pool image_pool;
+
+
+  // --- recycled decoder objects ---
+
+  /* Image units, slice units (with their thread contexts), tasks and slice headers
+     are kept for reuse. Once the decoder is running, no more memory is allocated
+     for them. */
+
+  image_unit* alloc_image_unit();
+  void        free_image_unit(image_unit*);
+
+  slice_unit* alloc_slice_unit();
+  void        free_slice_unit(slice_unit*);
+
+  slice_segment_header* alloc_slice_segment_header();
+  void                  free_slice_segment_header(slice_segment_header*);
+
+  // returns NULL if out of memory, free_decoding_metadata() accepts NULL
+  decoding_metadata* alloc_decoding_metadata(const seq_parameter_set* sps);
+  void               free_decoding_metadata(decoding_metadata*);
+
+  /* Counts the allocations of recycled decoder objects and picture buffers, which do not
+     grow anymore when the stream is running. See de265_get_number_of_allocations() for
+     what is included. */
+  std::atomic<int> num_allocations;
+
+  void get_memory_usage(de265_memory_usage*); // see de265_get_memory_usage()
+
+ private:
+  free_list<image_unit> free_image_units;
+  free_list<slice_unit> free_slice_units;
+  free_list<slice_segment_header> free_slice_headers; // before the dpb, see image_pool
+  free_list<decoding_metadata> free_decoding_metadata_sets; // before the dpb
+
+ public:
+
 
   // --- input stream data ---
 
@@ -377,6 +628,8 @@ class decoder_context : public base_context {
   int          num_pictures_in_output_queue() const { return dpb.num_pictures_in_output_queue(); }
   void         pop_next_picture_in_output_queue() { dpb.pop_next_picture_in_output_queue(); }
 
+  bool release_detached_image(de265_image* img) { return dpb.release_detached_image(img); }
+
  private:
   de265_error read_vps_NAL(bitreader&);
   de265_error read_sps_NAL(bitreader&);
@@ -396,8 +649,25 @@ class decoder_context : public base_context {
   std::shared_ptr<seq_parameter_set>    current_sps;
   std::shared_ptr<pic_parameter_set>    current_pps;
 
+  /* All PPS objects that have been allocated. A new PPS is read into one that is not
+     referenced anymore (by pps[], images or slice headers) so that its tables are reused. */
+  std::vector<std::shared_ptr<pic_parameter_set> > pps_pool;
+
  public:
-  thread_pool thread_pool_;
+  thread_pool thread_pool_;        // own worker threads
+  thread_pool* shared_thread_pool; // when not using own threads
+  task_queue  task_queue_;         // our tasks for the pool that we use
+
+  int64_t next_decode_order; // counts the image units for the task priorities
+
+ private:
+  std::atomic<bool> async_active;
+  de265_picture_ready_callback async_callback;
+  void* async_userdata;
+  thread_task_async_decode async_task;
+  std::atomic<int> async_requests;  // triggers not handled yet, the task is queued while >0
+  de265_cond  async_idle;           // signaled when async_requests drops to zero
+  bool        async_end_of_stream_reported;
 
  private:
   int num_worker_threads;
@@ -485,6 +755,8 @@ class decoder_context : public base_context {
   int RefPicSetLtCurr[MAX_NUM_REF_PICS];
   int RefPicSetLtFoll[MAX_NUM_REF_PICS];
 
+  std::vector<char> picInAnyList; // [dpb index], kept to avoid an allocation per picture
+
 
   // --- parameters derived from parameter sets ---
 
@@ -508,9 +780,7 @@ class decoder_context : public base_context {
   void add_task_decode_slice_segment(thread_context* tctx, bool firstSliceSubstream,
                                      int ctbX,int ctbY);
 
-  void mark_whole_slice_as_processed(image_unit* imgunit,
-                                     slice_unit* sliceunit,
-                                     int progress);
+  bool update_DPB_size(const seq_parameter_set* sps, const de265_image* img);
 
   void process_picture_order_count(slice_segment_header* hdr);
   int generate_unavailable_reference_picture(const seq_parameter_set* sps,
@@ -520,8 +790,11 @@ class decoder_context : public base_context {
 
 
   void remove_images_from_dpb(const std::vector<int>& removeImageList);
-  void run_postprocessing_filters_sequential(struct de265_image* img);
+  void run_postprocessing_filters_sequential(image_unit* imgunit);
   void run_postprocessing_filters_parallel(image_unit* img);
+  void add_postprocessing_tasks(image_unit* imgunit);
+
+  de265_error finish_image_unit(image_unit* imgunit);
 };
 
 
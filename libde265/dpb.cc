@@ -24,13 +24,14 @@
 #include <assert.h>
 
 
-#define DPB_DEFAULT_MAX_IMAGES  30
-
-
 decoded_picture_buffer::decoded_picture_buffer()
 {
   max_images_in_DPB  = DPB_DEFAULT_MAX_IMAGES;
   norm_images_in_DPB = DPB_DEFAULT_MAX_IMAGES;
+
+  // room for the unavailable reference pictures of one picture in a full DPB
+  dpb.reserve(DPB_DEFAULT_MAX_IMAGES + MAX_NUM_REF_PICS);
+  num_slots = 0;
 }
 
 
@@ -38,6 +39,9 @@ decoded_picture_buffer::~decoded_picture_buffer()
 {
   for (int i=0;i<dpb.size();i++)
     delete dpb[i];
+
+  for (int i=0;i<detached_images.size();i++)
+    delete detached_images[i];
 }
 
 
@@ -64,7 +68,7 @@ bool decoded_picture_buffer::has_free_dpb_picture(bool high_priority) const
 
   // scan for empty slots
   for (int i=0;i<dpb.size();i++) {
-    if (dpb[i]->PicOutputFlag==false && dpb[i]->PicState == UnusedForReference) {
+    if (dpb[i]->is_unused_by_decoder()) {
       return true;
     }
   }
@@ -192,7 +196,11 @@ void decoded_picture_buffer::clear()
       {
         dpb[i]->PicOutputFlag = false;
         dpb[i]->PicState = UnusedForReference;
-        dpb[i]->release();
+
+        // pictures referenced by the application are released when they are reused
+        if (dpb[i]->nApplicationRefs==0) {
+          dpb[i]->release();
+        }
       }
   }
 
@@ -201,6 +209,20 @@ void decoded_picture_buffer::clear()
 }
 
 
+int decoded_picture_buffer::num_free_slots() const
+{
+  int nFree = dpb.capacity() - dpb.size();
+
+  for (int i=0;i<dpb.size();i++) {
+    if (dpb[i]->is_unused_by_decoder()) {
+      nFree++;
+    }
+  }
+
+  return nFree;
+}
+
+
 int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> sps,
                                       decoder_context* decctx,
                                       de265_PTS pts, void* user_data, bool isOutputImage)
@@ -212,10 +234,19 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
 
   int free_image_buffer_idx = -1;
   for (int i=0;i<dpb.size();i++) {
-    if (dpb[i]->can_be_released()) {
-      dpb[i]->release(); /* TODO: this is surely not the best place to free the image, but
-                            we have to do it here because releasing it in de265_release_image()
-                            would break the API compatibility. */
+    if (dpb[i]->is_unused_by_decoder()) {
+      if (dpb[i]->nApplicationRefs > 0) {
+        // The application still uses the picture. Move it out of the DPB, it is
+        // freed with the last reference (see release_detached_image()).
+
+        detached_images.push_back(dpb[i]);
+        dpb[i] = new de265_image;
+      }
+      else {
+        dpb[i]->release(); /* TODO: this is surely not the best place to free the image, but
+                              we have to do it here because releasing it in de265_release_image()
+                              would break the API compatibility. */
+      }
 
       free_image_buffer_idx = i;
       break;
@@ -223,15 +254,16 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
   }
 
 
-  // Try to free a buffer at the end if the DPB got too large.
+  // Try to free buffers at the end if the DPB got too large.
   /* This should also probably move to a better place as soon as the API allows for this. */
 
-  if (dpb.size() > norm_images_in_DPB &&           // buffer too large
-      free_image_buffer_idx != dpb.size()-1 &&     // last slot not reused in this alloc
-      dpb.back()->can_be_released())               // last slot is free
+  while (dpb.size() > norm_images_in_DPB &&        // buffer too large
+         free_image_buffer_idx != dpb.size()-1 &&  // last slot not reused in this alloc
+         dpb.back()->can_be_released())            // last slot is free
     {
       delete dpb.back();
       dpb.pop_back();
+      num_slots = dpb.size();
     }
 
 
@@ -240,6 +272,7 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
   if (free_image_buffer_idx == -1) {
     free_image_buffer_idx = dpb.size();
     dpb.push_back(new de265_image);
+    num_slots = dpb.size();
   }
 
 
@@ -267,9 +300,25 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
 }
 
 
+bool decoded_picture_buffer::release_detached_image(de265_image* img)
+{
+  for (int i=0;i<detached_images.size();i++) {
+    if (detached_images[i]==img) {
+      delete img;
+
+      detached_images[i] = detached_images.back();
+      detached_images.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
 void decoded_picture_buffer::pop_next_picture_in_output_queue()
 {
-  image_output_queue.pop_front();
+  image_output_queue.erase(image_output_queue.begin());
 
 
   loginfo(LogDPB, "DPB output queue: ");
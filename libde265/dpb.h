@@ -24,11 +24,13 @@
 #include "libde265/image.h"
 #include "libde265/sps.h"
 
-#include <deque>
 #include <vector>
+#include <atomic>
 
 class decoder_context;
 
+#define DPB_DEFAULT_MAX_IMAGES  30
+
 class decoded_picture_buffer {
 public:
   decoded_picture_buffer();
@@ -37,6 +39,8 @@ public:
   void set_max_size_of_DPB(int n)  { max_images_in_DPB=n; }
   void set_norm_size_of_DPB(int n) { norm_images_in_DPB=n; }
 
+  int get_max_size_of_DPB() const { return max_images_in_DPB; }
+
   /* Alloc a new image in the DPB and return its index.
      If there is no space for a new image, return -1. */
   int new_image(std::shared_ptr<const seq_parameter_set> sps, decoder_context* decctx,
@@ -47,23 +51,40 @@ public:
      are included in the check. */
   bool has_free_dpb_picture(bool high_priority) const;
 
+  /* Check whether new_image() can reuse a slot or add one without enlarging the
+     slot array. Other threads may access the images while the array is not enlarged
+     (frame-parallel decoding). */
+  bool has_free_slot() const { return num_free_slots() > 0; }
+
+  /* Number of images that can be added without enlarging the slot array. */
+  int num_free_slots() const;
+
   /* Remove all pictures from DPB and queues. Decoding should be stopped while calling this. */
   void clear();
 
-  int size() const { return dpb.size(); }
+  int size() const { return num_slots.load(std::memory_order_acquire); }
 
   /* Raw access to the images. */
 
   /* */ de265_image* get_image(int index)       {
-    if (index>=dpb.size()) return NULL;
+    if (index>=size()) return NULL;
     return dpb[index];
   }
 
   const de265_image* get_image(int index) const {
-    if (index>=dpb.size()) return NULL;
+    if (index>=size()) return NULL;
     return dpb[index];
   }
 
+  /* Pictures that were moved out of their slot because the application still
+     referenced them when the slot was reused. */
+  int num_detached_images() const { return detached_images.size(); }
+  const de265_image* get_detached_image(int i) const { return detached_images[i]; }
+
+  /* Free a picture after the application dropped its last reference, if it was
+     moved out of the DPB. Returns false if the picture is still in a DPB slot. */
+  bool release_detached_image(de265_image* img);
+
   /* Search DPB for the slot index of a specific picture. */
   int DPB_index_of_picture_with_POC(int poc, int currentID, bool preferLongTerm=false) const;
   int DPB_index_of_picture_with_LSB(int lsb, int currentID, bool preferLongTerm=false) const;
@@ -107,8 +128,14 @@ private:
 
   std::vector<struct de265_image*> dpb; // decoded picture buffer
 
+  /* Copy of dpb.size(). Decoding threads query the DPB while the main thread may add
+     a slot (frame-parallel decoding). */
+  std::atomic<int> num_slots;
+
+  std::vector<struct de265_image*> detached_images;
+
   std::vector<struct de265_image*> reorder_output_queue;
-  std::deque<struct de265_image*>  image_output_queue;
+  std::vector<struct de265_image*> image_output_queue; // short, a deque would allocate blocks while it runs
 
 private:
   decoded_picture_buffer(const decoded_picture_buffer&); // no copy
@@ -73,11 +73,6 @@ CodingOption<node> CodingOptions<node>::new_option(bool active)
 template <class node>
 void CodingOptions<node>::start(enum RateEstimationMethod rateMethod)
 {
-  /* We don't need the input context model anymore.
-     Releasing it now may save a copy during a later decouple().
-  */
-  mContextModelInput->release();
-
   bool adaptiveContext;
   switch (rateMethod) {
   case Rate_Default:
@@ -92,13 +87,6 @@ void CodingOptions<node>::start(enum RateEstimationMethod rateMethod)
   }
 
   if (adaptiveContext) {
-    /* If we modify the context models in this algorithm,
-       we need separate models for each option.
-    */
-    for (auto& option : mOptions) {
-      option.context.decouple();
-    }
-
     cabac = &cabac_adaptive;
   }
   else {
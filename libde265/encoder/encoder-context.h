@@ -75,6 +75,14 @@ class encoder_context : public base_context
   image_data* imgdata; // input image
   slice_segment_header* shdr;
 
+  /* The RD search of a CTB allocates all enc_cb/enc_tb nodes and their buffers from
+     ctb_arena, which is reset when the CTB has been coded. Only a copy of the coded
+     tree is kept in picture_arena, which is reset at the start of the next picture.
+     Both must outlive the trees in 'ctbs'.
+   */
+  alloc_arena ctb_arena;
+  alloc_arena picture_arena;
+
   CTBTreeMatrix ctbs;
 
   // temporary memory for motion compensated pixels (when CB-algo passes this down to TB-algo)
@@ -180,6 +180,7 @@ double encode_image(encoder_context* ectx,
   // encode CTB by CTB
 
   ectx->ctbs.clear();
+  ectx->picture_arena.reset();
 
   for (int y=0;y<ectx->get_sps().PicHeightInCtbsY;y++)
     for (int x=0;x<ectx->get_sps().PicWidthInCtbsY;x++)
@@ -191,12 +192,14 @@ double encode_image(encoder_context* ectx,
 
         logtrace(LogSlice,"encode CTB at %d %d\n",x0,y0);
 
+        alloc_arena_scope ctb_scope(&ectx->ctb_arena);
+
         // make a copy of the context model that we can modify for testing alternatives
 
         context_model_table ctxModel;
         //copy_context_model_table(ctxModel, ectx->ctx_model_bitstream);
-        ctxModel = ectx->cabac_ctx_models.copy();
-        ctxModel = modelEstim.copy(); // TODO TMP
+        ctxModel = ectx->cabac_ctx_models;
+        ctxModel = modelEstim; // TODO TMP
 
         disable_logging(LogSymbols);
         enable_logging(LogSymbols);  // TODO TMP
@@ -282,11 +285,17 @@ double encode_image(encoder_context* ectx,
                     x==ectx->get_sps().PicWidthInCtbsY-1);
         ectx->cabac_encoder.write_CABAC_term_bit(last);
 
-        //delete cb;
+        mse += cb->distortion;
 
-        //ectx->free_all_pools();
 
-        mse += cb->distortion;
+        // Keep the coded tree for the following CTBs, and drop all search alternatives.
+
+        {
+          alloc_arena_scope picture_scope(&ectx->picture_arena);
+          ectx->ctbs.setCTB(x,y, cb->copy_coded_tree(NULL, ectx->ctbs.getCTBRootPointer(x0,y0)));
+        }
+
+        ectx->ctb_arena.reset();
       }
 
   mse /= ectx->img->get_width() * ectx->img->get_height();
@@ -44,13 +44,22 @@ small_image_buffer::small_image_buffer(int log2Size,int bytes_per_pixel)
   mBytesPerRow = bytes_per_pixel * (1<<log2Size);
 
   int nBytes = mWidth*mHeight*bytes_per_pixel;
-  mBuf = new uint8_t[nBytes];
+  mBuf = (uint8_t*)alloc_arena::current()->alloc(nBytes);
 }
 
 
 small_image_buffer::~small_image_buffer()
 {
-  delete[] mBuf;
+  // mBuf is released with the arena
+}
+
+
+std::shared_ptr<small_image_buffer> small_image_buffer::clone() const
+{
+  std::shared_ptr<small_image_buffer> b = new_small_image_buffer(Log2(mWidth),
+                                                                 mBytesPerRow/mWidth);
+  copy_to(*b);
+  return b;
 }
 
 
@@ -65,8 +74,6 @@ void enc_cb::set_rqt_root_bf_from_children_cbf()
 
 
 
-alloc_pool enc_tb::mMemPool(sizeof(enc_tb));
-
 enc_tb::enc_tb(int x,int y,int log2TbSize, enc_cb* _cb)
   : enc_node(x,y,log2TbSize)
 {
@@ -99,11 +106,8 @@ enc_tb::~enc_tb()
       delete children[i];
     }
   }
-  else {
-    for (int i=0;i<3;i++) {
-      delete[] coeff[i];
-    }
-  }
+
+  // coefficient memory is released with the arena
 
   if (DEBUG_ALLOCS) { allocTB--; printf("TB ~: %d\n",allocTB); }
 }
@@ -112,7 +116,38 @@ enc_tb::~enc_tb()
 void enc_tb::alloc_coeff_memory(int cIdx, int tbSize)
 {
   assert(coeff[cIdx]==NULL);
-  coeff[cIdx] = new int16_t[tbSize*tbSize];
+  coeff[cIdx] = (int16_t*)alloc_arena::current()->alloc(tbSize*tbSize*sizeof(int16_t));
+}
+
+
+enc_tb* enc_tb::copy_coded_tree(enc_cb* _cb, enc_tb* _parent, enc_tb** _downPtr) const
+{
+  enc_tb* tb = new enc_tb(*this);
+  tb->cb = _cb;
+  tb->parent = _parent;
+  tb->downPtr = _downPtr;
+
+  if (split_transform_flag) {
+    for (int i=0;i<4;i++) {
+      if (children[i]) {
+        tb->children[i] = children[i]->copy_coded_tree(_cb, tb, &tb->children[i]);
+      }
+    }
+  }
+  else {
+    tb->coeff[0]=tb->coeff[1]=tb->coeff[2]=NULL;
+  }
+
+  for (int i=0;i<3;i++) {
+    tb->intra_prediction[i].reset();
+    tb->residual[i].reset();
+
+    if (reconstruction[i]) {
+      tb->reconstruction[i] = reconstruction[i]->clone();
+    }
+  }
+
+  return tb;
 }
 
 
@@ -134,7 +169,7 @@ void enc_tb::reconstruct_tb(encoder_context* ectx,
 
   if (!reconstruction[cIdx]) {
 
-    reconstruction[cIdx] = std::make_shared<small_image_buffer>(log2TbSize, sizeof(uint8_t));
+    reconstruction[cIdx] = new_small_image_buffer(log2TbSize, sizeof(uint8_t));
 
     if (cb->PredMode == MODE_SKIP) {
       PixelAccessor dstPixels(*reconstruction[cIdx], xC,yC);
@@ -301,9 +336,6 @@ void enc_tb::set_cbf_flags_from_children()
 
 
 
-alloc_pool enc_cb::mMemPool(sizeof(enc_cb), 200);
-
-
 enc_cb::enc_cb()
   : split_cu_flag(false),
     cu_transquant_bypass_flag(false),
@@ -333,6 +365,27 @@ enc_cb::~enc_cb()
 }
 
 
+enc_cb* enc_cb::copy_coded_tree(enc_cb* _parent, enc_cb** _downPtr) const
+{
+  enc_cb* cb = new enc_cb(*this);
+  cb->parent = _parent;
+  cb->downPtr = _downPtr;
+
+  if (split_cu_flag) {
+    for (int i=0;i<4;i++) {
+      if (children[i]) {
+        cb->children[i] = children[i]->copy_coded_tree(cb, &cb->children[i]);
+      }
+    }
+  }
+  else if (transform_tree) {
+    cb->transform_tree = transform_tree->copy_coded_tree(cb, NULL, &cb->transform_tree);
+  }
+
+  return cb;
+}
+
+
 /*
 void enc_cb::write_to_image(de265_image* img) const
 {
@@ -56,6 +56,8 @@ class small_image_buffer
 
   int getStride() const { return mStride; } // pixels per row
 
+  std::shared_ptr<small_image_buffer> clone() const;
+
  private:
   uint8_t*  mBuf;
   uint16_t  mStride;
@@ -70,6 +72,16 @@ class small_image_buffer
 };
 
 
+/* The object and its pixel memory are placed into the current arena of the thread,
+   like the enc_cb / enc_tb nodes it is attached to.
+ */
+inline std::shared_ptr<small_image_buffer> new_small_image_buffer(int log2Size,int bytes_per_pixel=1)
+{
+  return std::allocate_shared<small_image_buffer>(arena_allocator<small_image_buffer>(),
+                                                  log2Size, bytes_per_pixel);
+}
+
+
 class enc_node
 {
 public:
@@ -197,20 +209,26 @@ class enc_tb : public enc_node
 
   PixelAccessor getPixels(int x,int y, int cIdx, const seq_parameter_set& sps);
 
+  /* Copy of the TB tree (in the current arena) with only the data that is accessed
+     after the CTB has been coded: the syntax elements and the reconstruction.
+   */
+  enc_tb* copy_coded_tree(enc_cb* cb, enc_tb* parent, enc_tb** downPtr) const;
+
   void writeReconstructionToImage(de265_image* img,
                                   const seq_parameter_set* sps) const;
 
-  /*
-  static void* operator new(const size_t size) { return mMemPool.new_obj(size); }
-  static void operator delete(void* obj) { mMemPool.delete_obj(obj); }
-  */
+  virtual void debug_dumpTree(int flags, int indent=0) const;
 
 
-  virtual void debug_dumpTree(int flags, int indent=0) const;
+  // memory management (see encoder_context::ctb_arena)
 
-private:
-  static alloc_pool mMemPool;
+  static void* operator new(const size_t size) {
+    assert(alloc_arena::current());
+    return alloc_arena::current()->alloc(size);
+  }
+  static void operator delete(void* obj) { } // released with the arena
 
+private:
   void reconstruct_tb(encoder_context* ectx,
                       de265_image* img, int x0,int y0, int log2TbSize,
                       int cIdx) const;
@@ -313,26 +331,23 @@ public:
   void writeReconstructionToImage(de265_image* img,
                                   const seq_parameter_set* sps) const;
 
+  // see enc_tb::copy_coded_tree()
+  enc_cb* copy_coded_tree(enc_cb* parent, enc_cb** downPtr) const;
+
 
   virtual void debug_dumpTree(int flags, int indent=0) const;
 
 
-  // memory management
+  // memory management (see encoder_context::ctb_arena)
 
   static void* operator new(const size_t size) {
-    void* p = mMemPool.new_obj(size);
-    //printf("ALLOC %p\n",p);
-    return p;
-  }
-  static void operator delete(void* obj) {
-    //printf("DELETE %p\n",obj);
-    mMemPool.delete_obj(obj);
+    assert(alloc_arena::current());
+    return alloc_arena::current()->alloc(size);
   }
+  static void operator delete(void* obj) { } // released with the arena
 
  private:
   //void write_to_image(de265_image*) const;
-
-  static alloc_pool mMemPool;
 };
 
 
@@ -0,0 +1,213 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "fallback-deblock.h"
+#include "util.h"
+
+
+template <class pixel_t>
+static void deblock_luma_segment(pixel_t* ptr, ptrdiff_t stride, bool vertical,
+                                 int beta, int tc, bool filterP, bool filterQ, int bitDepth_Y)
+{
+  // xs steps across the edge, ks along the edge
+
+  const ptrdiff_t xs = vertical ? 1 : stride;
+  const ptrdiff_t ks = vertical ? stride : 1;
+
+  pixel_t q[4][4], p[4][4];
+  for (int k=0;k<4;k++)
+    for (int i=0;i<4;i++)
+      {
+        q[k][i] = ptr[ i   *xs + k*ks];
+        p[k][i] = ptr[-(i+1)*xs + k*ks];
+      }
+
+  int dE=0, dEp=0, dEq=0;
+
+  int dp0 = abs_value(p[0][2] - 2*p[0][1] + p[0][0]);
+  int dp3 = abs_value(p[3][2] - 2*p[3][1] + p[3][0]);
+  int dq0 = abs_value(q[0][2] - 2*q[0][1] + q[0][0]);
+  int dq3 = abs_value(q[3][2] - 2*q[3][1] + q[3][0]);
+
+  int dpq0 = dp0 + dq0;
+  int dpq3 = dp3 + dq3;
+
+  int dp = dp0 + dp3;
+  int dq = dq0 + dq3;
+  int d  = dpq0+ dpq3;
+
+  if (d<beta) {
+    bool dSam0 = (2*dpq0 < (beta>>2) &&
+                  abs_value(p[0][3]-p[0][0])+abs_value(q[0][0]-q[0][3]) < (beta>>3) &&
+                  abs_value(p[0][0]-q[0][0]) < ((5*tc+1)>>1));
+
+    bool dSam3 = (2*dpq3 < (beta>>2) &&
+                  abs_value(p[3][3]-p[3][0])+abs_value(q[3][0]-q[3][3]) < (beta>>3) &&
+                  abs_value(p[3][0]-q[3][0]) < ((5*tc+1)>>1));
+
+    if (dSam0 && dSam3) {
+      dE=2;
+    }
+    else {
+      dE=1;
+    }
+
+    if (dp < ((beta + (beta>>1))>>3)) { dEp=1; }
+    if (dq < ((beta + (beta>>1))>>3)) { dEq=1; }
+
+    logtrace(LogDeblock,"dE:%d dEp:%d dEq:%d\n",dE,dEp,dEq);
+  }
+
+  if (dE == 0) {
+    return;
+  }
+
+  for (int k=0;k<4;k++) {
+    pixel_t* line = ptr + k*ks;
+
+    const pixel_t p0 = p[k][0];
+    const pixel_t p1 = p[k][1];
+    const pixel_t p2 = p[k][2];
+    const pixel_t p3 = p[k][3];
+    const pixel_t q0 = q[k][0];
+    const pixel_t q1 = q[k][1];
+    const pixel_t q2 = q[k][2];
+    const pixel_t q3 = q[k][3];
+
+    if (dE==2) {
+      // strong filtering
+
+      if (filterP) {
+        line[-1*xs] = Clip3(p0-2*tc,p0+2*tc, (p2 + 2*p1 + 2*p0 + 2*q0 + q1 +4)>>3);
+        line[-2*xs] = Clip3(p1-2*tc,p1+2*tc, (p2 + p1 + p0 + q0+2)>>2);
+        line[-3*xs] = Clip3(p2-2*tc,p2+2*tc, (2*p3 + 3*p2 + p1 + p0 + q0 + 4)>>3);
+      }
+
+      if (filterQ) {
+        line[ 0*xs] = Clip3(q0-2*tc,q0+2*tc, (p1+2*p0+2*q0+2*q1+q2+4)>>3);
+        line[ 1*xs] = Clip3(q1-2*tc,q1+2*tc, (p0+q0+q1+q2+2)>>2);
+        line[ 2*xs] = Clip3(q2-2*tc,q2+2*tc, (p0+q0+q1+3*q2+2*q3+4)>>3);
+      }
+    }
+    else {
+      // weak filtering
+
+      int delta = (9*(q0-p0) - 3*(q1-p1) + 8)>>4;
+
+      if (abs_value(delta) < tc*10) {
+        delta = Clip3(-tc,tc,delta);
+
+        if (filterP) { line[-1*xs] = Clip_BitDepth(p0+delta, bitDepth_Y); }
+        if (filterQ) { line[ 0*xs] = Clip_BitDepth(q0-delta, bitDepth_Y); }
+
+        if (dEp==1 && filterP) {
+          int delta_p = Clip3(-(tc>>1), tc>>1, (((p2+p0+1)>>1)-p1+delta)>>1);
+          line[-2*xs] = Clip_BitDepth(p1+delta_p, bitDepth_Y);
+        }
+
+        if (dEq==1 && filterQ) {
+          int delta_q = Clip3(-(tc>>1), tc>>1, (((q2+q0+1)>>1)-q1-delta)>>1);
+          line[ 1*xs] = Clip_BitDepth(q1+delta_q, bitDepth_Y);
+        }
+      }
+    }
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_chroma_segment(pixel_t* ptr, ptrdiff_t stride, bool vertical,
+                                   int tc, bool filterP, bool filterQ, int bitDepth_C)
+{
+  const ptrdiff_t xs = vertical ? 1 : stride;
+  const ptrdiff_t ks = vertical ? stride : 1;
+
+  for (int k=0;k<4;k++) {
+    pixel_t* line = ptr + k*ks;
+
+    int p0 = line[-1*xs];
+    int p1 = line[-2*xs];
+    int q0 = line[ 0*xs];
+    int q1 = line[ 1*xs];
+
+    int delta = Clip3(-tc,tc, ((((q0-p0)*4)+p1-q1+4)>>3));
+    if (filterP) { line[-1*xs] = Clip_BitDepth(p0+delta, bitDepth_C); }
+    if (filterQ) { line[ 0*xs] = Clip_BitDepth(q0-delta, bitDepth_C); }
+  }
+}
+
+
+template <class pixel_t>
+void deblock_luma_fallback(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                           const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                           int bitDepth_Y)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s++) {
+    if (tc[s]) {
+      deblock_luma_segment(ptr + s*segmentStep, stride, vertical,
+                           beta[s], tc[s], filterP[s], filterQ[s], bitDepth_Y);
+    }
+  }
+}
+
+
+template <class pixel_t>
+void deblock_chroma_fallback(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                             const int* tc, const bool* filterP, const bool* filterQ,
+                             int bitDepth_C)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s++) {
+    if (tc[s]) {
+      deblock_chroma_segment(ptr + s*segmentStep, stride, vertical,
+                             tc[s], filterP[s], filterQ[s], bitDepth_C);
+    }
+  }
+}
+
+
+void deblock_luma_8_fallback(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                             const int* beta, const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_luma_fallback<uint8_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,8);
+}
+
+void deblock_luma_16_fallback(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                              const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                              int bit_depth)
+{
+  deblock_luma_fallback<uint16_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,bit_depth);
+}
+
+void deblock_chroma_8_fallback(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                               const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_chroma_fallback<uint8_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,8);
+}
+
+void deblock_chroma_16_fallback(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                const int* tc, const bool* filterP, const bool* filterQ, int bit_depth)
+{
+  deblock_chroma_fallback<uint16_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,bit_depth);
+}
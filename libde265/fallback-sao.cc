@@ -0,0 +1,113 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "fallback-sao.h"
+#include "util.h"
+
+
+template <class pixel_t>
+void sao_band_offset_fallback(pixel_t* out, ptrdiff_t out_stride,
+                              const pixel_t* in, ptrdiff_t in_stride,
+                              int width, int height,
+                              int saoLeftClass, const int8_t* saoOffsetVal, int bitDepth)
+{
+  const int maxPixelValue = (1<<bitDepth)-1;
+  const int bandShift = bitDepth-5;
+
+  int offsetTable[32] = { 0 };
+
+  for (int k=0;k<4;k++) {
+    offsetTable[ (k+saoLeftClass)&31 ] = saoOffsetVal[k];
+  }
+
+  for (int j=0;j<height;j++)
+    for (int i=0;i<width;i++) {
+      int v = in[i+j*in_stride];
+      out[i+j*out_stride] = Clip3(0,maxPixelValue, v + offsetTable[v>>bandShift]);
+    }
+}
+
+
+template <class pixel_t>
+void sao_edge_offset_fallback(pixel_t* out, ptrdiff_t out_stride,
+                              const pixel_t* in, ptrdiff_t in_stride,
+                              int width, int height,
+                              int SaoEoClass, const int8_t* saoOffsetVal, int bitDepth)
+{
+  const int maxPixelValue = (1<<bitDepth)-1;
+
+  int hPos[2], vPos[2];
+  sao_edge_offset_neighbors(SaoEoClass, hPos,vPos);
+
+  const ptrdiff_t pos0 = hPos[0] + vPos[0]*in_stride;
+  const ptrdiff_t pos1 = hPos[1] + vPos[1]*in_stride;
+
+  // indexed with the sum of the two pixel-difference signs (+2)
+  const int offsetTable[5] = { saoOffsetVal[0], saoOffsetVal[1], 0, saoOffsetVal[2], saoOffsetVal[3] };
+
+  for (int j=0;j<height;j++) {
+    const pixel_t* in_ptr  = &in [j*in_stride];
+    /* */ pixel_t* out_ptr = &out[j*out_stride];
+
+    for (int i=0;i<width;i++) {
+      int edgeIdx = Sign(in_ptr[i] - in_ptr[i+pos0]) + Sign(in_ptr[i] - in_ptr[i+pos1]);
+
+      out_ptr[i] = Clip3(0,maxPixelValue, in_ptr[i] + offsetTable[edgeIdx+2]);
+    }
+  }
+}
+
+
+void sao_band_offset_8_fallback(uint8_t* out, ptrdiff_t out_stride,
+                                const uint8_t* in, ptrdiff_t in_stride,
+                                int width, int height,
+                                int saoLeftClass, const int8_t* saoOffsetVal)
+{
+  sao_band_offset_fallback<uint8_t>(out,out_stride, in,in_stride, width,height,
+                                    saoLeftClass,saoOffsetVal, 8);
+}
+
+void sao_band_offset_16_fallback(uint16_t* out, ptrdiff_t out_stride,
+                                 const uint16_t* in, ptrdiff_t in_stride,
+                                 int width, int height,
+                                 int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth)
+{
+  sao_band_offset_fallback<uint16_t>(out,out_stride, in,in_stride, width,height,
+                                     saoLeftClass,saoOffsetVal, bit_depth);
+}
+
+void sao_edge_offset_8_fallback(uint8_t* out, ptrdiff_t out_stride,
+                                const uint8_t* in, ptrdiff_t in_stride,
+                                int width, int height,
+                                int SaoEoClass, const int8_t* saoOffsetVal)
+{
+  sao_edge_offset_fallback<uint8_t>(out,out_stride, in,in_stride, width,height,
+                                    SaoEoClass,saoOffsetVal, 8);
+}
+
+void sao_edge_offset_16_fallback(uint16_t* out, ptrdiff_t out_stride,
+                                 const uint16_t* in, ptrdiff_t in_stride,
+                                 int width, int height,
+                                 int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth)
+{
+  sao_edge_offset_fallback<uint16_t>(out,out_stride, in,in_stride, width,height,
+                                     SaoEoClass,saoOffsetVal, bit_depth);
+}
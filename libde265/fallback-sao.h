@@ -0,0 +1,65 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FALLBACK_SAO_H
+#define FALLBACK_SAO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <assert.h>
+
+
+/* Positions of the two neighbors that are compared with a sample in edge offset class SaoEoClass. */
+inline void sao_edge_offset_neighbors(int SaoEoClass, int hPos[2], int vPos[2])
+{
+  static const int8_t neighborH[4][2] = { {-1,1}, { 0,0}, {-1,1}, {1,-1} };
+  static const int8_t neighborV[4][2] = { { 0,0}, {-1,1}, {-1,1}, {-1,1} };
+
+  assert(SaoEoClass>=0 && SaoEoClass<4);
+
+  hPos[0] = neighborH[SaoEoClass][0];
+  hPos[1] = neighborH[SaoEoClass][1];
+  vPos[0] = neighborV[SaoEoClass][0];
+  vPos[1] = neighborV[SaoEoClass][1];
+}
+
+
+void sao_band_offset_8_fallback(uint8_t* out, ptrdiff_t out_stride,
+                                const uint8_t* in, ptrdiff_t in_stride,
+                                int width, int height,
+                                int saoLeftClass, const int8_t* saoOffsetVal);
+
+void sao_band_offset_16_fallback(uint16_t* out, ptrdiff_t out_stride,
+                                 const uint16_t* in, ptrdiff_t in_stride,
+                                 int width, int height,
+                                 int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth);
+
+void sao_edge_offset_8_fallback(uint8_t* out, ptrdiff_t out_stride,
+                                const uint8_t* in, ptrdiff_t in_stride,
+                                int width, int height,
+                                int SaoEoClass, const int8_t* saoOffsetVal);
+
+void sao_edge_offset_16_fallback(uint16_t* out, ptrdiff_t out_stride,
+                                 const uint16_t* in, ptrdiff_t in_stride,
+                                 int width, int height,
+                                 int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth);
+
+#endif
@@ -21,6 +21,8 @@
 #include "fallback.h"
 #include "fallback-motion.h"
 #include "fallback-dct.h"
+#include "fallback-deblock.h"
+#include "fallback-sao.h"
 
 
 void init_acceleration_functions_fallback(struct acceleration_functions* accel)
@@ -124,4 +126,14 @@ void init_acceleration_functions_fallback(struct acceleration_functions* accel)
   accel->hadamard_transform_8[1] = hadamard_8x8_8_fallback;
   accel->hadamard_transform_8[2] = hadamard_16x16_8_fallback;
   accel->hadamard_transform_8[3] = hadamard_32x32_8_fallback;
+
+  accel->deblock_luma_8    = deblock_luma_8_fallback;
+  accel->deblock_chroma_8  = deblock_chroma_8_fallback;
+  accel->deblock_luma_16   = deblock_luma_16_fallback;
+  accel->deblock_chroma_16 = deblock_chroma_16_fallback;
+
+  accel->sao_band_offset_8  = sao_band_offset_8_fallback;
+  accel->sao_edge_offset_8  = sao_edge_offset_8_fallback;
+  accel->sao_band_offset_16 = sao_band_offset_16_fallback;
+  accel->sao_edge_offset_16 = sao_edge_offset_16_fallback;
 }
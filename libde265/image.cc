@@ -27,12 +27,17 @@
 #include <assert.h>
 
 #include <limits>
+#include <algorithm>
 
 
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #ifdef HAVE_SSE4_1
 // SSE code processes 128bit per iteration and thus might read more data
 // than is later actually used.
@@ -65,6 +70,8 @@ static inline void *ALLOC_ALIGNED(size_t alignment, size_t size) {
 
 #define ALLOC_ALIGNED_16(size)              ALLOC_ALIGNED(16, size)
 
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
 static const int alignment = 16;
 
 LIBDE265_API void* de265_alloc_image_plane(struct de265_image* img, int cIdx,
@@ -105,9 +112,43 @@ LIBDE265_API void de265_free_image_plane(struct de265_image* img, int cIdx)
 }
 
 
+/* With 'hugePages', planes of at least one huge page are aligned to the huge page size
+   and the kernel is asked to back them with transparent huge pages. This reduces the
+   TLB misses when the motion compensation reads from large reference pictures.
+   If huge pages are not available, the memory is used with normal pages. The planes are
+   freed with FREE_ALIGNED() like all others.
+ */
+static uint8_t* alloc_plane(size_t size, bool hugePages)
+{
+#if defined(MADV_HUGEPAGE) && defined(HAVE_POSIX_MEMALIGN)
+  if (hugePages && size >= HUGE_PAGE_SIZE) {
+    uint8_t* p = (uint8_t*)ALLOC_ALIGNED(HUGE_PAGE_SIZE, size);
+    if (p != NULL) {
+      madvise(p, size, MADV_HUGEPAGE); // on failure, we simply get normal pages
+      return p;
+    }
+  }
+#endif
+
+  return (uint8_t *)ALLOC_ALIGNED_16(size);
+}
+
+
 static int  de265_image_get_buffer(de265_decoder_context* ctx,
                                    de265_image_spec* spec, de265_image* img, void* userdata)
 {
+  decoder_context* decctx = (decoder_context*)ctx;
+  bool hugePages = false;
+
+  if (decctx) {
+    if (decctx->image_pool.get_buffer(spec, img)) {
+      return 1;
+    }
+
+    decctx->num_allocations++;
+    hugePages = decctx->param_huge_pages;
+  }
+
   const int rawChromaWidth  = spec->width  / img->SubWidthC;
   const int rawChromaHeight = spec->height / img->SubHeightC;
 
@@ -126,12 +167,12 @@ static int  de265_image_get_buffer(de265_decoder_context* ctx,
   bool alloc_failed = false;
 
   uint8_t* p[3] = { 0,0,0 };
-  p[0] = (uint8_t *)ALLOC_ALIGNED_16(luma_height   * luma_bpl   + MEMORY_PADDING);
+  p[0] = alloc_plane(luma_height   * luma_bpl   + MEMORY_PADDING, hugePages);
   if (p[0]==NULL) { alloc_failed=true; }
 
   if (img->get_chroma_format() != de265_chroma_mono) {
-    p[1] = (uint8_t *)ALLOC_ALIGNED_16(chroma_height * chroma_bpl + MEMORY_PADDING);
-    p[2] = (uint8_t *)ALLOC_ALIGNED_16(chroma_height * chroma_bpl + MEMORY_PADDING);
+    p[1] = alloc_plane(chroma_height * chroma_bpl + MEMORY_PADDING, hugePages);
+    p[2] = alloc_plane(chroma_height * chroma_bpl + MEMORY_PADDING, hugePages);
 
     if (p[1]==NULL || p[2]==NULL) { alloc_failed=true; }
   }
@@ -160,6 +201,12 @@ static int  de265_image_get_buffer(de265_decoder_context* ctx,
 static void de265_image_release_buffer(de265_decoder_context* ctx,
                                        de265_image* img, void* userdata)
 {
+  decoder_context* decctx = (decoder_context*)ctx;
+  if (decctx) {
+    decctx->image_pool.release_buffer(img);
+    return;
+  }
+
   for (int i=0;i<3;i++) {
     uint8_t* p = (uint8_t*)img->get_image_plane(i);
     if (p) {
@@ -175,6 +222,119 @@ de265_image_allocation de265_image::default_image_allocation = {
 };
 
 
+image_buffer_pool::image_buffer_pool()
+{
+  de265_mutex_init(&mutex);
+}
+
+
+image_buffer_pool::~image_buffer_pool()
+{
+  purge();
+  de265_mutex_destroy(&mutex);
+}
+
+
+static void free_pooled_buffer(uint8_t* planes[3])
+{
+  for (int i=0;i<3;i++) {
+    if (planes[i]) {
+      FREE_ALIGNED(planes[i]);
+    }
+  }
+}
+
+
+bool image_buffer_pool::get_buffer(const de265_image_spec* spec, de265_image* img)
+{
+  de265_mutex_lock(&mutex);
+
+  bool found = false;
+
+  for (int i=buffers.size()-1; i>=0; i--) {
+    const buffer& b = buffers[i];
+
+    if (b.width  == spec->width &&
+        b.height == spec->height &&
+        b.chroma == img->get_chroma_format() &&
+        b.BitDepth_Y == img->BitDepth_Y &&
+        b.BitDepth_C == img->BitDepth_C) {
+      img->set_image_plane(0, b.planes[0], b.luma_stride, NULL);
+      img->set_image_plane(1, b.planes[1], b.chroma_stride, NULL);
+      img->set_image_plane(2, b.planes[2], b.chroma_stride, NULL);
+
+      buffers.erase(buffers.begin()+i);
+      found = true;
+      break;
+    }
+  }
+
+  // The stream switched to another format. The old buffers will not be needed anymore.
+
+  if (!found) {
+    for (int i=0;i<buffers.size();i++) {
+      free_pooled_buffer(buffers[i].planes);
+    }
+    buffers.clear();
+  }
+
+  de265_mutex_unlock(&mutex);
+
+  return found;
+}
+
+
+void image_buffer_pool::release_buffer(de265_image* img)
+{
+  buffer b;
+  b.width  = img->get_width();
+  b.height = img->get_height();
+  b.chroma = img->get_chroma_format();
+  b.BitDepth_Y = img->BitDepth_Y;
+  b.BitDepth_C = img->BitDepth_C;
+  b.luma_stride   = img->get_image_stride(0);
+  b.chroma_stride = img->get_image_stride(1);
+  b.memory_size   = img->get_pixel_memory_usage();
+
+  for (int i=0;i<3;i++) {
+    b.planes[i] = (uint8_t*)img->get_image_plane(i);
+  }
+
+  de265_mutex_lock(&mutex);
+  buffers.push_back(b);
+  de265_mutex_unlock(&mutex);
+}
+
+
+void image_buffer_pool::purge()
+{
+  de265_mutex_lock(&mutex);
+
+  for (int i=0;i<buffers.size();i++) {
+    free_pooled_buffer(buffers[i].planes);
+  }
+  buffers.clear();
+
+  de265_mutex_unlock(&mutex);
+}
+
+
+size_t image_buffer_pool::memory_usage()
+{
+  size_t size = 0;
+
+  de265_mutex_lock(&mutex);
+
+  for (int i=0;i<buffers.size();i++) {
+    size += buffers[i].memory_size;
+  }
+
+  de265_mutex_unlock(&mutex);
+
+  return size;
+}
+
+
 void de265_image::set_image_plane(int cIdx, uint8_t* mem, int stride, void *userdata)
 {
   pixels[cIdx] = mem;
@@ -185,7 +345,7 @@ void de265_image::set_image_plane(int cIdx, uint8_t* mem, int stride, void *user
 }
 
 
-uint32_t de265_image::s_next_image_ID = 0;
+std::atomic<uint32_t> de265_image::s_next_image_ID(0);
 
 de265_image::de265_image()
 {
@@ -212,6 +372,7 @@ de265_image::de265_image()
   user_data = NULL;
 
   ctb_progress = NULL;
+  attached_metadata = NULL;
 
   integrity = INTEGRITY_NOT_DECODED;
 
@@ -219,12 +380,13 @@ de265_image::de265_image()
   PicOrderCntVal = -1; // undefined
   PicState = UnusedForReference;
   PicOutputFlag = false;
+  nDecodingUsers = 0;
+  nApplicationRefs = 0;
 
-  nThreadsQueued   = 0;
+  nThreadsPending  = 0;
   nThreadsRunning  = 0;
   nThreadsBlocked  = 0;
-  nThreadsFinished = 0;
-  nThreadsTotal    = 0;
+  nCompletionWaiters = 0;
 
   de265_mutex_init(&mutex);
   de265_cond_init(&finished_cond);
@@ -243,11 +405,12 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
 
   if (sps) { this->sps = sps; }
 
-  release(); /* TODO: review code for efficient allocation when arrays are already
-                allocated to the requested size. Without the release, the old image-data
-                will not be freed. */
+  release(); /* Without the release, the old image-data will not be freed.
+                With the default allocation, the pixel planes go back to the decoder's
+                image_buffer_pool and are handed out again below. The metadata arrays
+                are only reallocated when their size changes. */
 
-  ID = s_next_image_ID++;
+  ID = s_next_image_ID.fetch_add(1);
   removed_at_picture_id = std::numeric_limits<int32_t>::max();
 
   decctx = dctx;
@@ -410,38 +573,38 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
   // --- allocate decoding info arrays ---
 
   if (allocMetadata) {
-    // intra pred mode
-
-    mem_alloc_success &= intraPredMode.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
-                                             sps->Log2MinPUSize);
-
-    mem_alloc_success &= intraPredModeC.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
-                                              sps->Log2MinPUSize);
+    // decoding metadata (a decoder attaches its own, see attach_decoding_metadata())
 
-    // cb info
+    if (dctx==NULL) {
+      mem_alloc_success &= intraPredMode.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
+                                               sps->Log2MinPUSize);
 
-    mem_alloc_success &= cb_info.alloc(sps->PicWidthInMinCbsY, sps->PicHeightInMinCbsY,
-                                       sps->Log2MinCbSizeY);
+      mem_alloc_success &= intraPredModeC.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
+                                                sps->Log2MinPUSize);
 
-    // pb info
+      int puWidth  = sps->PicWidthInMinCbsY  << (sps->Log2MinCbSizeY -2);
+      int puHeight = sps->PicHeightInMinCbsY << (sps->Log2MinCbSizeY -2);
 
-    int puWidth  = sps->PicWidthInMinCbsY  << (sps->Log2MinCbSizeY -2);
-    int puHeight = sps->PicHeightInMinCbsY << (sps->Log2MinCbSizeY -2);
+      mem_alloc_success &= pb_info.alloc(puWidth,puHeight, 2);
 
-    mem_alloc_success &= pb_info.alloc(puWidth,puHeight, 2);
+      mem_alloc_success &= tu_info.alloc(sps->PicWidthInTbsY, sps->PicHeightInTbsY,
+                                         sps->Log2MinTrafoSize);
 
+      int deblk_w = (sps->pic_width_in_luma_samples +3)/4;
+      int deblk_h = (sps->pic_height_in_luma_samples+3)/4;
 
-    // tu info
+      mem_alloc_success &= deblk_info.alloc(deblk_w, deblk_h, 2);
+    }
 
-    mem_alloc_success &= tu_info.alloc(sps->PicWidthInTbsY, sps->PicHeightInTbsY,
-                                       sps->Log2MinTrafoSize);
+    // cb info
 
-    // deblk info
+    mem_alloc_success &= cb_info.alloc(sps->PicWidthInMinCbsY, sps->PicHeightInMinCbsY,
+                                       sps->Log2MinCbSizeY);
 
-    int deblk_w = (sps->pic_width_in_luma_samples +3)/4;
-    int deblk_h = (sps->pic_height_in_luma_samples+3)/4;
+    // collocated motion vectors
 
-    mem_alloc_success &= deblk_info.alloc(deblk_w, deblk_h, 2);
+    mem_alloc_success &= col_mv_info.alloc((sps->pic_width_in_luma_samples +15)/16,
+                                           (sps->pic_height_in_luma_samples+15)/16, 4);
 
     // CTB info
 
@@ -508,15 +671,130 @@ void de265_image::release()
         }
     }
 
+  // return the decoding metadata
+
+  if (attached_metadata) {
+    decoding_metadata* m = detach_decoding_metadata();
+    if (decctx) decctx->free_decoding_metadata(m);
+    else        delete m;
+  }
+
   // free slices
 
   for (int i=0;i<slices.size();i++) {
-    delete slices[i];
+    if (decctx) decctx->free_slice_segment_header(slices[i]);
+    else        delete slices[i];
   }
   slices.clear();
 }
 
 
+size_t de265_image::get_pixel_memory_usage() const
+{
+  if (pixels[0]==NULL) {
+    return 0;
+  }
+
+  size_t size = (size_t)stride * height * ((BitDepth_Y+7)/8);
+
+  if (chroma_format != de265_chroma_mono) {
+    size += 2 * (size_t)chroma_stride * chroma_height * ((BitDepth_C+7)/8);
+  }
+
+  return size;
+}
+
+
+size_t de265_image::get_metadata_memory_usage() const
+{
+  return (ctb_info.memory_usage() +
+          cb_info.memory_usage() +
+          col_mv_info.memory_usage() +
+          ctb_info.size() * sizeof(de265_progress_lock) +
+          get_decoding_metadata_memory_usage());
+}
+
+
+size_t de265_image::get_decoding_metadata_memory_usage() const
+{
+  return (pb_info.memory_usage() +
+          intraPredMode.memory_usage() +
+          intraPredModeC.memory_usage() +
+          tu_info.memory_usage() +
+          deblk_info.memory_usage());
+}
+
+
+bool decoding_metadata::alloc(const seq_parameter_set* sps)
+{
+  bool success = true;
+
+  success &= intraPredMode.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
+                                 sps->Log2MinPUSize);
+
+  success &= intraPredModeC.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
+                                  sps->Log2MinPUSize);
+
+  int puWidth  = sps->PicWidthInMinCbsY  << (sps->Log2MinCbSizeY -2);
+  int puHeight = sps->PicHeightInMinCbsY << (sps->Log2MinCbSizeY -2);
+
+  success &= pb_info.alloc(puWidth,puHeight, 2);
+
+  success &= tu_info.alloc(sps->PicWidthInTbsY, sps->PicHeightInTbsY,
+                           sps->Log2MinTrafoSize);
+
+  int deblk_w = (sps->pic_width_in_luma_samples +3)/4;
+  int deblk_h = (sps->pic_height_in_luma_samples+3)/4;
+
+  success &= deblk_info.alloc(deblk_w, deblk_h, 2);
+
+  return success;
+}
+
+
+size_t decoding_metadata::memory_usage() const
+{
+  return (pb_info.memory_usage() +
+          intraPredMode.memory_usage() +
+          intraPredModeC.memory_usage() +
+          tu_info.memory_usage() +
+          deblk_info.memory_usage());
+}
+
+
+void de265_image::attach_decoding_metadata(decoding_metadata* m)
+{
+  assert(attached_metadata==NULL);
+
+  pb_info.swap(m->pb_info);
+  intraPredMode.swap(m->intraPredMode);
+  intraPredModeC.swap(m->intraPredModeC);
+  tu_info.swap(m->tu_info);
+  deblk_info.swap(m->deblk_info);
+
+  attached_metadata = m;
+}
+
+
+decoding_metadata* de265_image::detach_decoding_metadata()
+{
+  decoding_metadata* m = attached_metadata;
+  if (m==NULL) {
+    return NULL;
+  }
+
+  pb_info.swap(m->pb_info);
+  intraPredMode.swap(m->intraPredMode);
+  intraPredModeC.swap(m->intraPredModeC);
+  tu_info.swap(m->tu_info);
+  deblk_info.swap(m->deblk_info);
+
+  attached_metadata = NULL;
+
+  return m;
+}
+
+
 void de265_image::fill_image(int y,int cb,int cr)
 {
   if (y>=0) {
@@ -619,59 +897,52 @@ void de265_image::exchange_pixel_data_with(de265_image& b)
 
 void de265_image::thread_start(int nThreads)
 {
-  de265_mutex_lock(&mutex);
-
-  //printf("nThreads before: %d %d\n",nThreadsQueued, nThreadsTotal);
-
-  nThreadsQueued += nThreads;
-  nThreadsTotal += nThreads;
+  //printf("nThreads before: %d\n",nThreadsPending.load());
 
-  //printf("nThreads after: %d %d\n",nThreadsQueued, nThreadsTotal);
-
-  de265_mutex_unlock(&mutex);
+  nThreadsPending.fetch_add(nThreads, std::memory_order_relaxed);
 }
 
 void de265_image::thread_run(const thread_task* task)
 {
   //printf("run thread %s\n", task->name().c_str());
 
-  de265_mutex_lock(&mutex);
-  nThreadsQueued--;
-  nThreadsRunning++;
-  de265_mutex_unlock(&mutex);
+  nThreadsRunning.fetch_add(1, std::memory_order_relaxed);
 }
 
 void de265_image::thread_blocks()
 {
-  de265_mutex_lock(&mutex);
-  nThreadsRunning--;
-  nThreadsBlocked++;
-  de265_mutex_unlock(&mutex);
+  nThreadsRunning.fetch_sub(1, std::memory_order_relaxed);
+  nThreadsBlocked.fetch_add(1, std::memory_order_relaxed);
 }
 
 void de265_image::thread_unblocks()
 {
-  de265_mutex_lock(&mutex);
-  nThreadsBlocked--;
-  nThreadsRunning++;
-  de265_mutex_unlock(&mutex);
+  nThreadsBlocked.fetch_sub(1, std::memory_order_relaxed);
+  nThreadsRunning.fetch_add(1, std::memory_order_relaxed);
 }
 
 void de265_image::thread_finishes(const thread_task* task)
 {
   //printf("finish thread %s\n", task->name().c_str());
 
-  de265_mutex_lock(&mutex);
+  nThreadsRunning.fetch_sub(1, std::memory_order_relaxed);
 
-  nThreadsRunning--;
-  nThreadsFinished++;
-  assert(nThreadsRunning >= 0);
+  // read this before the image is marked as finished and may be reused
+  decoder_context* asyncDecoder = (decctx && decctx->is_async_decoding()) ? decctx : NULL;
 
-  if (nThreadsFinished==nThreadsTotal) {
+  int pending = nThreadsPending.fetch_sub(1, std::memory_order_seq_cst) - 1;
+  assert(pending >= 0);
+
+  if (pending==0 && nCompletionWaiters.load(std::memory_order_seq_cst) > 0) {
+    de265_mutex_lock(&mutex);
     de265_cond_broadcast(&finished_cond, &mutex);
+    de265_mutex_unlock(&mutex);
   }
 
-  de265_mutex_unlock(&mutex);
+  // let the asynchronous decoding loop output the picture
+  if (pending==0 && asyncDecoder) {
+    asyncDecoder->trigger_async_decoding();
+  }
 }
 
 void de265_image::wait_for_progress(thread_task* task, int ctbx,int ctby, int progress)
@@ -704,18 +975,56 @@ void de265_image::wait_for_progress(thread_task* task, int ctbAddrRS, int progre
 }
 
 
+void de265_image::wait_for_CTB_rows(thread_task* task, int firstRow,int lastRow, int progress)
+{
+  const int ctbW = sps->PicWidthInCtbsY;
+
+  firstRow = std::max(firstRow, 0);
+  lastRow  = std::min(lastRow, sps->PicHeightInCtbsY-1);
+
+  for (int y=firstRow; y<=lastRow; y++)
+    for (int x=0; x<ctbW; x++) {
+      wait_for_progress(task, x + ctbW*y, progress);
+    }
+}
+
+void de265_image::wait_for_progress_in_image(thread_task* task, const de265_image* other,
+                                             int ctbAddrRS, int progress)
+{
+  if (task==NULL) { return; }
+
+  de265_progress_lock* progresslock = &other->ctb_progress[ctbAddrRS];
+  if (progresslock->get_progress() < progress) {
+    thread_blocks();
+    task->state = thread_task::Blocked;
+
+    progresslock->wait_for_progress(progress);
+    task->state = thread_task::Running;
+    thread_unblocks();
+  }
+}
+
+
 void de265_image::wait_for_completion()
 {
+  if (debug_is_completed()) {
+    return;
+  }
+
   de265_mutex_lock(&mutex);
-  while (nThreadsFinished!=nThreadsTotal) {
+  nCompletionWaiters.fetch_add(1, std::memory_order_seq_cst);
+
+  while (nThreadsPending.load(std::memory_order_seq_cst) != 0) {
     de265_cond_wait(&finished_cond, &mutex);
   }
+
+  nCompletionWaiters.fetch_sub(1, std::memory_order_relaxed);
   de265_mutex_unlock(&mutex);
 }
 
 bool de265_image::debug_is_completed() const
 {
-  return nThreadsFinished==nThreadsTotal;
+  return nThreadsPending.load(std::memory_order_acquire) == 0;
 }
 
 
@@ -729,6 +1038,7 @@ void de265_image::clear_metadata()
   //tu_info.clear();  // done on the fly
   ctb_info.clear();
   deblk_info.clear();
+  col_mv_info.clear();
 
   // --- reset CTB progresses ---
 
@@ -754,6 +1064,14 @@ void de265_image::set_mv_info(int x,int y, int nPbW,int nPbH, const PBMotion& mv
       {
         pb_info[ xPu+pbx + (yPu+pby)*stride ] = mv;
       }
+
+  // the PB covers the top left corners of these 16x16 blocks
+
+  for (int yCol=(y+15) & ~15; yCol<y+nPbH; yCol+=16)
+    for (int xCol=(x+15) & ~15; xCol<x+nPbW; xCol+=16)
+      {
+        col_mv_info.get(xCol,yCol) = mv;
+      }
 }
 
 
@@ -30,6 +30,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <memory>
+#include <atomic>
+#include <algorithm>
 #ifdef HAVE_STDBOOL_H
 #include <stdbool.h>
 #endif
@@ -80,6 +82,7 @@ enum PictureState {
 #define CTB_PROGRESS_DEBLK_V   2
 #define CTB_PROGRESS_DEBLK_H   3
 #define CTB_PROGRESS_SAO       4
+#define CTB_PROGRESS_COMPLETE  5  // final pixel data, image can be used as reference
 
 class decoder_context;
 
@@ -149,6 +152,16 @@ template <class DataUnit> class MetaDataArray
 
   int size() const { return data_size; }
 
+  size_t memory_usage() const { return data_size * sizeof(DataUnit); }
+
+  void swap(MetaDataArray& other) {
+    std::swap(data, other.data);
+    std::swap(data_size, other.data_size);
+    std::swap(log2unitSize, other.log2unitSize);
+    std::swap(width_in_units, other.width_in_units);
+    std::swap(height_in_units, other.height_in_units);
+  }
+
   // private:
   DataUnit* data;
   int data_size;
@@ -217,6 +230,27 @@ typedef struct {
 } CB_ref_info;
 
 
+/* Metadata that is only used while a picture is decoded and filtered.
+   The decoder keeps a few of these and attaches one to each picture that is being decoded
+   (see de265_image::attach_decoding_metadata()). A finished picture only keeps the
+   metadata needed when it is used as a reference: the CTB and CB info and the motion
+   vectors in 16x16 units.
+ */
+class decoding_metadata
+{
+ public:
+  LIBDE265_CHECK_RESULT bool alloc(const seq_parameter_set* sps);
+
+  size_t memory_usage() const;
+
+  MetaDataArray<PBMotion> pb_info;
+  MetaDataArray<uint8_t>  intraPredMode;
+  MetaDataArray<uint8_t>  intraPredModeC;
+  MetaDataArray<uint8_t>  tu_info;
+  MetaDataArray<uint8_t>  deblk_info;
+};
+
+
 
 
 struct de265_image {
@@ -236,8 +270,18 @@ struct de265_image {
 
   bool is_allocated() const { return pixels[0] != NULL; }
 
+  // memory held by the image (see de265_get_memory_usage())
+  size_t get_pixel_memory_usage() const;
+  size_t get_metadata_memory_usage() const;
+  size_t get_decoding_metadata_memory_usage() const; // the part that can be detached
+
   void release();
 
+  /* Decoder images do not allocate the decoding metadata themselves. The decoder attaches
+     it for the time of the decoding. The arrays of 'm' are swapped into the image. */
+  void attach_decoding_metadata(decoding_metadata* m);
+  decoding_metadata* detach_decoding_metadata(); // returns NULL if there is none
+
   void set_headers(std::shared_ptr<video_parameter_set> _vps,
                    std::shared_ptr<seq_parameter_set>   _sps,
                    std::shared_ptr<pic_parameter_set>   _pps) {
@@ -321,7 +365,11 @@ struct de265_image {
     return get_bit_depth(cIdx)>8;
   }
 
-  bool can_be_released() const { return PicOutputFlag==false && PicState==UnusedForReference; }
+  // The DPB slot can be reused. Pictures still referenced by the application are moved out of it.
+  bool is_unused_by_decoder() const { return PicOutputFlag==false && PicState==UnusedForReference &&
+                                             nDecodingUsers==0; }
+
+  bool can_be_released() const { return is_unused_by_decoder() && nApplicationRefs==0; }
 
 
   void add_slice_segment_header(slice_segment_header* shdr) {
@@ -346,7 +394,7 @@ struct de265_image {
 
 private:
   uint32_t ID;
-  static uint32_t s_next_image_ID;
+  static std::atomic<uint32_t> s_next_image_ID; // images are allocated by several decoders and threads
 
   uint8_t* pixels[3];
   uint8_t  bpp_shift[3];  // 0 for 8 bit, 1 for 16 bit
@@ -381,6 +429,11 @@ public:
   enum PictureState PicState;
   bool PicOutputFlag;
 
+  int  nDecodingUsers; /* Number of pictures in flight (including this one) that still
+                          access this image (frame-parallel decoding). */
+
+  int  nApplicationRefs; // references held by the application, see de265_picture_ref()
+
   int32_t removed_at_picture_id;
 
   const video_parameter_set& get_vps() const { return *vps; }
@@ -417,6 +470,11 @@ private:
   MetaDataArray<uint8_t>     tu_info;
   MetaDataArray<uint8_t>     deblk_info;
 
+  // PB motion of the top left 4x4 block of each 16x16 block, for collocated motion vectors
+  MetaDataArray<PBMotion>    col_mv_info;
+
+  decoding_metadata* attached_metadata;
+
 public:
   // --- meta information ---
 
@@ -462,18 +520,24 @@ public:
   void wait_for_progress(thread_task* task, int ctbx,int ctby, int progress);
   void wait_for_progress(thread_task* task, int ctbAddrRS, int progress);
 
+  // wait until all CTBs in rows [firstRow;lastRow] reached 'progress'
+  void wait_for_CTB_rows(thread_task* task, int firstRow,int lastRow, int progress);
+
+  /* Wait for the progress of a CTB in another image (a reference image in frame-parallel
+     decoding). The blocking is accounted to this image. */
+  void wait_for_progress_in_image(thread_task* task, const de265_image* other,
+                                  int ctbAddrRS, int progress);
+
   void wait_for_completion();  // block until image is decoded by background threads
   bool debug_is_completed() const;
   int  num_threads_active() const { return nThreadsRunning + nThreadsBlocked; } // for debug only
 
   //private:
-  int   nThreadsQueued;
-  int   nThreadsRunning;
-  int   nThreadsBlocked;
-  int   nThreadsFinished;
-  int   nThreadsTotal;
+  std::atomic<int> nThreadsPending; // countdown of tasks to complete decoding
+  std::atomic<int> nThreadsRunning; // for debug only
+  std::atomic<int> nThreadsBlocked; // for debug only
 
-  // ALIGNED_8(de265_sync_int tasks_pending); // number of tasks pending to complete decoding
+  std::atomic<int> nCompletionWaiters; // threads sleeping in wait_for_completion()
   de265_mutex mutex;
   de265_cond  finished_cond;
 
@@ -855,10 +919,58 @@ public:
 
   void set_mv_info(int x,int y, int nPbW,int nPbH, const PBMotion& mv);
 
+  // also available when the picture is only kept as a reference (in 16x16 units)
+  const PBMotion& get_collocated_mv_info(int x,int y) const
+  {
+    return col_mv_info.get(x,y);
+  }
+
   // --- value logging ---
 
   void printBlk(int x0,int y0, int cIdx, int log2BlkSize);
 };
 
 
+/* Keeps the pixel planes of released pictures for reuse by the default image allocation.
+   A decoder allocates pictures of the same size and format over and over. Handing back
+   the planes of a previous picture avoids the allocation and the page faults when
+   touching fresh memory.
+ */
+class image_buffer_pool
+{
+ public:
+  image_buffer_pool();
+  ~image_buffer_pool();
+
+  /* Set the planes of 'img' to a pooled buffer of the same size, chroma format and
+     bit depths. Returns false if there is none. Buffers of other formats are freed. */
+  bool get_buffer(const de265_image_spec* spec, de265_image* img);
+
+  // Take over the planes of 'img'.
+  void release_buffer(de265_image* img);
+
+  void purge(); // free all pooled buffers
+
+  size_t memory_usage(); // pixel memory of the pooled buffers
+
+ private:
+  struct buffer {
+    int width, height;
+    enum de265_chroma chroma;
+    int BitDepth_Y, BitDepth_C;
+
+    uint8_t* planes[3];
+    int luma_stride, chroma_stride;
+
+    size_t memory_size;
+  };
+
+  std::vector<buffer> buffers;
+  de265_mutex mutex;
+
+  image_buffer_pool(const image_buffer_pool&); // no copy
+  image_buffer_pool& operator=(const image_buffer_pool&); // no copy
+};
+
+
 #endif
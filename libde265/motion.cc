@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <signal.h>
 #include <string.h>
+#include <algorithm>
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
 # include <malloc.h>
@@ -348,7 +349,11 @@ void generate_inter_prediction_samples(base_context* ctx,
 
       logtrace(LogMotion, "refIdx: %d -> dpb[%d]\n", vi->refIdx[l], shdr->RefPicList[l][vi->refIdx[l]]);
 
-      if (!refPic || refPic->PicState == UnusedForReference) {
+      /* Check the PicState that was saved in the slice header, because in frame-parallel
+         decoding, the reference may already have been removed by a following picture. */
+      if (!refPic ||
+          (shdr->RefPicList_PicState[l][vi->refIdx[l]] == UnusedForReference &&
+           refPic->PicState == UnusedForReference)) {
         img->integrity = INTEGRITY_DECODING_ERRORS;
         ctx->add_warning(DE265_WARNING_NONEXISTING_REFERENCE_PICTURE_ACCESSED, false);
 
@@ -1131,7 +1136,7 @@ void derive_collocated_motion_vectors(base_context* ctx,
 
   // get the collocated MV
 
-  const PBMotion& mvi = colImg->get_mv_info(xColPb,yColPb);
+  const PBMotion& mvi = colImg->get_collocated_mv_info(xColPb,yColPb);
   int listCol;
   int refIdxCol;
   MotionVector mvCol;
@@ -2085,27 +2090,139 @@ void motion_vectors_and_ref_indices(base_context* ctx,
    nPbW/nPbH : size of PB
    nCS   : CB size
  */
+// --- frame-parallel decoding: wait for reference image data ---
+
+/* The collocated motion vectors are taken from the center or bottom-right
+   position of the PB, which are both in the CTB row of the PB.
+ */
+static void wait_for_collocated_CTBs(base_context* ctx,
+                                     const slice_segment_header* shdr,
+                                     de265_image* img, thread_task* task,
+                                     int xP,int yP, int nPbW)
+{
+  if (shdr->slice_temporal_mvp_enabled_flag == 0 ||
+      shdr->slice_type == SLICE_TYPE_I) {
+    return;
+  }
+
+  int colPic;
+  if (shdr->slice_type == SLICE_TYPE_B &&
+      shdr->collocated_from_l0_flag == 0) {
+    colPic = shdr->RefPicList[1][ shdr->collocated_ref_idx ];
+  }
+  else {
+    colPic = shdr->RefPicList[0][ shdr->collocated_ref_idx ];
+  }
+
+  if (!ctx->has_image(colPic)) {
+    return;
+  }
+
+  const de265_image* colImg = ctx->get_image(colPic);
+  const seq_parameter_set& sps = img->get_sps();
+
+  const int ctbY  = yP >> sps.Log2CtbSizeY;
+  const int ctbX0 = xP >> sps.Log2CtbSizeY;
+  const int ctbX1 = std::min((xP+nPbW) >> sps.Log2CtbSizeY, sps.PicWidthInCtbsY-1);
+
+  for (int x=ctbX0; x<=ctbX1; x++) {
+    img->wait_for_progress_in_image(task, colImg, x + ctbY*sps.PicWidthInCtbsY,
+                                    CTB_PROGRESS_PREFILTER);
+  }
+}
+
+
+static void wait_for_reference_areas(base_context* ctx,
+                                     const slice_segment_header* shdr,
+                                     de265_image* img, thread_task* task,
+                                     int xP,int yP, int nPbH,
+                                     const PBMotion* vi)
+{
+  const seq_parameter_set& sps = img->get_sps();
+
+  for (int l=0;l<2;l++) {
+    if (!vi->predFlag[l] || vi->refIdx[l] >= MAX_NUM_REF_PICS) {
+      continue;
+    }
+
+    const de265_image* refPic = ctx->get_image(shdr->RefPicList[l][vi->refIdx[l]]);
+    if (!refPic || refPic->ctb_progress == NULL) {
+      continue;
+    }
+
+    // lines accessed by the interpolation filters (luma and chroma)
+
+    int y0 = yP + (vi->mv[l].y >> 2) - 4;
+    int y1 = yP + nPbH-1 + (vi->mv[l].y >> 2) + 4;
+
+    y0 = Clip3(0, sps.pic_height_in_luma_samples-1, y0);
+    y1 = Clip3(0, sps.pic_height_in_luma_samples-1, y1);
+
+    // The deblocking of the CTB row below can still modify the bottom lines of a row.
+
+    const int ctbRow0 = y0 >> sps.Log2CtbSizeY;
+    const int ctbRow1 = std::min((y1 >> sps.Log2CtbSizeY) +1, sps.PicHeightInCtbsY-1);
+
+    // Rows are finished from left to right, so we only have to check the last CTB.
+
+    for (int y=ctbRow0; y<=ctbRow1; y++) {
+      img->wait_for_progress_in_image(task, refPic,
+                                      (y+1)*sps.PicWidthInCtbsY -1,
+                                      CTB_PROGRESS_COMPLETE);
+    }
+  }
+}
+
+
+void derive_prediction_unit_motion(base_context* ctx,
+                                   const slice_segment_header* shdr,
+                                   de265_image* img,
+                                   const PBMotionCoding& motion,
+                                   int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH,
+                                   int partIdx, thread_task* task, PBMotion* out_vi)
+{
+  if (task) {
+    wait_for_collocated_CTBs(ctx,shdr,img,task, xC+xB,yC+yB, nPbW);
+  }
+
+  motion_vectors_and_ref_indices(ctx, shdr, img, motion,
+                                 xC,yC, xB,yB, nCS, nPbW,nPbH, partIdx, out_vi);
+
+  img->set_mv_info(xC+xB,yC+yB,nPbW,nPbH, *out_vi);
+}
+
+
+void predict_prediction_unit(base_context* ctx,
+                             const slice_segment_header* shdr,
+                             de265_image* img,
+                             int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH,
+                             const PBMotion& vi, thread_task* task)
+{
+  if (task) {
+    wait_for_reference_areas(ctx,shdr,img,task, xC+xB,yC+yB, nPbH, &vi);
+  }
+
+  generate_inter_prediction_samples(ctx,shdr, img, xC,yC, xB,yB, nCS, nPbW,nPbH, &vi);
+}
+
+
 void decode_prediction_unit(base_context* ctx,
                             const slice_segment_header* shdr,
                             de265_image* img,
                             const PBMotionCoding& motion,
-                            int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH, int partIdx)
+                            int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH, int partIdx,
+                            thread_task* task)
 {
   logtrace(LogMotion,"decode_prediction_unit POC=%d %d;%d %dx%d\n",
            img->PicOrderCntVal, xC+xB,yC+yB, nPbW,nPbH);
 
-  //slice_segment_header* shdr = tctx->shdr;
-
   // 1.
 
   PBMotion vi;
-  motion_vectors_and_ref_indices(ctx, shdr, img, motion,
-                                 xC,yC, xB,yB, nCS, nPbW,nPbH, partIdx, &vi);
+  derive_prediction_unit_motion(ctx,shdr,img,motion, xC,yC,xB,yB, nCS, nPbW,nPbH, partIdx,
+                                task, &vi);
 
   // 2.
 
-  generate_inter_prediction_samples(ctx,shdr, img, xC,yC, xB,yB, nCS, nPbW,nPbH, &vi);
-
-
-  img->set_mv_info(xC+xB,yC+yB,nPbW,nPbH, vi);
+  predict_prediction_unit(ctx,shdr,img, xC,yC,xB,yB, nCS, nPbW,nPbH, vi, task);
 }
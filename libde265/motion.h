@@ -25,6 +25,7 @@
 #include "slice.h"
 
 class base_context;
+class thread_task;
 class slice_segment_header;
 
 class MotionVector
@@ -104,9 +105,24 @@ void fill_luma_motion_vector_predictors(base_context* ctx,
                                         MotionVector out_mvpList[2]);
 
 
+/* When 'task' is not NULL, block until the referenced areas of the reference images
+   have been decoded (frame-parallel decoding). */
 void decode_prediction_unit(base_context* ctx,const slice_segment_header* shdr,
                             de265_image* img, const PBMotionCoding& motion,
-                            int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH, int partIdx);
+                            int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH, int partIdx,
+                            thread_task* task);
+
+/* The two steps of decode_prediction_unit(), used separately in two-stage decoding:
+   derive the motion vectors (and store them in the image metadata) and generate
+   the prediction samples. */
+void derive_prediction_unit_motion(base_context* ctx,const slice_segment_header* shdr,
+                                   de265_image* img, const PBMotionCoding& motion,
+                                   int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH,
+                                   int partIdx, thread_task* task, PBMotion* out_vi);
+void predict_prediction_unit(base_context* ctx,const slice_segment_header* shdr,
+                             de265_image* img,
+                             int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH,
+                             const PBMotion& vi, thread_task* task);
 
 
 
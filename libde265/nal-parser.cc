@@ -39,6 +39,9 @@ NAL_unit::NAL_unit()
   nal_data = NULL;
   data_size = 0;
   capacity = 0;
+
+  external_data = NULL;
+  external_buffer = NULL;
 }
 
 NAL_unit::~NAL_unit()
@@ -55,11 +58,16 @@ void NAL_unit::clear()
   // set size to zero but keep memory
   data_size = 0;
 
+  external_data = NULL;
+  external_buffer = NULL;
+
   skipped_bytes.clear();
 }
 
 LIBDE265_CHECK_RESULT bool NAL_unit::resize(int new_size)
 {
+  assert(external_data == NULL);
+
   if (capacity < new_size) {
     unsigned char* newbuffer = (unsigned char*)malloc(new_size);
     if (newbuffer == NULL) {
@@ -97,6 +105,13 @@ bool LIBDE265_CHECK_RESULT NAL_unit::set_data(const unsigned char* in_data, int
   return true;
 }
 
+void NAL_unit::set_external_data(const unsigned char* data, int n, zero_copy_buffer* buffer)
+{
+  external_data = (unsigned char*)data; // only read
+  external_buffer = buffer;
+  data_size = n;
+}
+
 void NAL_unit::insert_skipped_byte(int pos)
 {
   skipped_bytes.push_back(pos);
@@ -149,6 +164,12 @@ void NAL_unit::remove_stuffing_bytes()
 }
 
 
+size_t NAL_unit::memory_usage() const
+{
+  return sizeof(NAL_unit) + capacity + skipped_bytes.capacity()*sizeof(int);
+}
+
+
 
 
 
@@ -164,6 +185,8 @@ NAL_Parser::NAL_Parser()
 
 NAL_Parser::~NAL_Parser()
 {
+  // NOTE: freeing the NALs also releases the zero-copy buffers
+
   // --- free NAL queues ---
 
   // empty NAL queue
@@ -184,6 +207,10 @@ NAL_Parser::~NAL_Parser()
   for (int i=0;i<NAL_free_list.size();i++) {
     delete NAL_free_list[i];
   }
+
+  for (int i=0;i<zero_copy_free_list.size();i++) {
+    delete zero_copy_free_list[i];
+  }
 }
 
 
@@ -216,6 +243,13 @@ void NAL_Parser::free_NAL_unit(NAL_unit* nal)
     // Allow calling with NULL just like regular "free()"
     return;
   }
+
+  zero_copy_buffer* buffer = nal->get_external_buffer();
+  if (buffer) {
+    nal->clear();
+    release_zero_copy_buffer(buffer);
+  }
+
   if (NAL_free_list.size() < DE265_NAL_FREE_LIST_SIZE) {
     NAL_free_list.push_back(nal);
   }
@@ -231,7 +265,7 @@ NAL_unit* NAL_Parser::pop_from_NAL_queue()
   }
   else {
     NAL_unit* nal = NAL_queue.front();
-    NAL_queue.pop();
+    NAL_queue.pop_front();
 
     nBytes_in_NAL_queue -= nal->size();
 
@@ -241,10 +275,29 @@ NAL_unit* NAL_Parser::pop_from_NAL_queue()
 
 void NAL_Parser::push_to_NAL_queue(NAL_unit* nal)
 {
-  NAL_queue.push(nal);
+  NAL_queue.push_back(nal);
   nBytes_in_NAL_queue += nal->size();
 }
 
+size_t NAL_Parser::memory_usage() const
+{
+  size_t size = 0;
+
+  for (int i=0;i<NAL_queue.size();i++) {
+    size += NAL_queue[i]->memory_usage();
+  }
+
+  for (int i=0;i<NAL_free_list.size();i++) {
+    size += NAL_free_list[i]->memory_usage();
+  }
+
+  if (pending_input_NAL) {
+    size += pending_input_NAL->memory_usage();
+  }
+
+  return size;
+}
+
 de265_error NAL_Parser::push_data(const unsigned char* data, int len,
                                   de265_PTS pts, void* user_data)
 {
@@ -392,6 +445,117 @@ de265_error NAL_Parser::push_NAL(const unsigned char* data, int len,
 }
 
 
+/* Split the buffer at the start codes and queue the NALs without copying them.
+   The emulation prevention bytes are not removed, but only recorded.
+ */
+de265_error NAL_Parser::push_data_zero_copy(const unsigned char* data, int len,
+                                            de265_PTS pts, void* user_data,
+                                            de265_release_data_func release,
+                                            void* release_userdata)
+{
+  // complete the last NAL of preceding push_data() input
+
+  de265_error err = flush_data();
+  if (err != DE265_OK) {
+    return err;
+  }
+
+  end_of_frame = false;
+
+
+  zero_copy_buffer* buffer;
+  if (zero_copy_free_list.empty()) {
+    buffer = new zero_copy_buffer;
+  }
+  else {
+    buffer = zero_copy_free_list.back();
+    zero_copy_free_list.pop_back();
+  }
+
+  buffer->data = data;
+  buffer->release = release;
+  buffer->release_userdata = release_userdata;
+  buffer->nNALs = 1; // keep the buffer while scanning it
+
+
+  NAL_unit* nal = NULL;
+  int nal_start = 0;
+
+  for (int i=0; i+2<len; ) {
+    if (data[i+2]>3) {
+      // fast forward, there is no start code or emulation prevention byte at i..i+2
+      i+=3;
+    }
+    else if (data[i]==0 && data[i+1]==0 && data[i+2]==1) {
+      if (nal) {
+        push_zero_copy_NAL(nal, data+nal_start, i-nal_start, buffer);
+      }
+
+      nal = alloc_NAL_unit(0);
+      if (nal == NULL) {
+        err = DE265_ERROR_OUT_OF_MEMORY;
+        break;
+      }
+      nal->pts = pts;
+      nal->user_data = user_data;
+
+      i += 3;
+      nal_start = i;
+    }
+    else if (data[i]==0 && data[i+1]==0 && data[i+2]==3 && nal) {
+      nal->insert_skipped_byte(i+2 - nal_start);
+      i += 3;
+    }
+    else {
+      i++;
+    }
+  }
+
+  if (nal) {
+    push_zero_copy_NAL(nal, data+nal_start, len-nal_start, buffer);
+  }
+
+  release_zero_copy_buffer(buffer);
+
+  return err;
+}
+
+
+void NAL_Parser::push_zero_copy_NAL(NAL_unit* nal, const unsigned char* data, int len,
+                                    zero_copy_buffer* buffer)
+{
+  // remove trailing zero bytes (from the next start code)
+
+  while (len>0 && data[len-1]==0) {
+    len--;
+  }
+
+  if (len==0) {
+    free_NAL_unit(nal);
+    return;
+  }
+
+  nal->set_external_data(data, len, buffer);
+  buffer->nNALs++;
+
+  push_to_NAL_queue(nal);
+}
+
+
+void NAL_Parser::release_zero_copy_buffer(zero_copy_buffer* buffer)
+{
+  buffer->nNALs--;
+
+  if (buffer->nNALs==0) {
+    if (buffer->release) {
+      buffer->release(buffer->data, buffer->release_userdata);
+    }
+
+    zero_copy_free_list.push_back(buffer);
+  }
+}
+
+
 de265_error NAL_Parser::flush_data()
 {
   if (pending_input_NAL) {
@@ -27,12 +27,25 @@
 #include "libde265/util.h"
 
 #include <vector>
-#include <queue>
+#include <deque>
 
 #define DE265_NAL_FREE_LIST_SIZE 16
 #define DE265_SKIPPED_BYTES_INITIAL_SIZE 16
 
 
+/* An application buffer pushed with de265_push_data_zero_copy(). It is released
+   when the last NAL unit in it has been freed.
+ */
+struct zero_copy_buffer
+{
+  const void* data;
+  de265_release_data_func release;
+  void* release_userdata;
+
+  int nNALs; // NAL units that still use the buffer
+};
+
+
 class NAL_unit {
  public:
   NAL_unit();
@@ -54,14 +67,27 @@ class NAL_unit {
 
   int size() const { return data_size; }
   void set_size(int s) { data_size=s; }
-  unsigned char* data() { return nal_data; }
-  const unsigned char* data() const { return nal_data; }
+  unsigned char* data() { return external_data ? external_data : nal_data; }
+  const unsigned char* data() const { return external_data ? external_data : nal_data; }
+
+
+  // --- zero-copy input ---
+
+  /* Use the NAL data in an application buffer. It still contains the emulation prevention
+     bytes, which are only marked with insert_skipped_byte(). The data is not modified.
+   */
+  void set_external_data(const unsigned char* data, int n, zero_copy_buffer* buffer);
+
+  zero_copy_buffer* get_external_buffer() const { return external_buffer; }
+
+  bool has_emulation_prevention_bytes() const { return external_buffer != NULL; }
 
 
   // --- skipped stuffing bytes ---
 
   int num_skipped_bytes_before(int byte_position, int headerLength) const;
   int  num_skipped_bytes() const { return skipped_bytes.size(); }
+  const int* skipped_byte_positions() const { return skipped_bytes.data(); }
 
   //void clear_skipped_bytes() { skipped_bytes.clear(); }
 
@@ -75,11 +101,16 @@ class NAL_unit {
    */
   void remove_stuffing_bytes();
 
+  size_t memory_usage() const; // allocated memory, not counting zero-copy input buffers
+
  private:
   unsigned char* nal_data;
   int data_size;
   int capacity;
 
+  unsigned char* external_data;      // zero-copy input, NULL otherwise
+  zero_copy_buffer* external_buffer;
+
   std::vector<int> skipped_bytes; // up to position[x], there were 'x' skipped bytes
 };
 
@@ -96,6 +127,10 @@ class NAL_Parser
   de265_error push_NAL(const unsigned char* data, int len,
                        de265_PTS pts, void* user_data = NULL);
 
+  de265_error push_data_zero_copy(const unsigned char* data, int len,
+                                  de265_PTS pts, void* user_data,
+                                  de265_release_data_func release, void* release_userdata);
+
   NAL_unit*   pop_from_NAL_queue();
   de265_error flush_data();
   void        mark_end_of_stream() { end_of_stream=true; }
@@ -122,6 +157,8 @@ class NAL_Parser
 
 
   int get_NAL_queue_length() const { return NAL_queue.size(); }
+  size_t memory_usage() const; // of the queued, pending and unused NAL units
+
   bool is_end_of_stream() const { return end_of_stream; }
   bool is_end_of_frame() const { return end_of_frame; }
 
@@ -137,7 +174,7 @@ class NAL_Parser
 
   // NAL level
 
-  std::queue<NAL_unit*> NAL_queue;  // enqueued NALs have suffing bytes removed
+  std::deque<NAL_unit*> NAL_queue;  // enqueued NALs have suffing bytes removed
   int nBytes_in_NAL_queue; // data bytes currently in NAL_queue
 
   void push_to_NAL_queue(NAL_unit*);
@@ -148,6 +185,14 @@ class NAL_Parser
   std::vector<NAL_unit*> NAL_free_list;  // maximum size: DE265_NAL_FREE_LIST_SIZE
 
   LIBDE265_CHECK_RESULT NAL_unit* alloc_NAL_unit(int size);
+
+
+  // zero-copy input
+
+  std::vector<zero_copy_buffer*> zero_copy_free_list;
+
+  void push_zero_copy_NAL(NAL_unit*, const unsigned char* data, int len, zero_copy_buffer*);
+  void release_zero_copy_buffer(zero_copy_buffer*);
 };
 
 
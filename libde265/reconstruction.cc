@@ -0,0 +1,286 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reconstruction.h"
+#include "slice.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+
+
+reconstruction_pipeline::reconstruction_pipeline()
+{
+  buffer_memory = 0;
+
+  de265_mutex_init(&mutex);
+  de265_cond_init(&cond_var);
+}
+
+
+reconstruction_pipeline::~reconstruction_pipeline()
+{
+  de265_cond_destroy(&cond_var);
+  de265_mutex_destroy(&mutex);
+}
+
+
+void reconstruction_pipeline::start(const thread_context* tctx)
+{
+  first_parsed_ctb = 0;
+  num_parsed_ctbs = 0;
+  current_ctb_idx = 0;
+  reconstructing = false;
+  parsing_finished = false;
+
+  ctbs[0].clear(); // the buffers keep their memory
+
+  recon_tctx.decctx    = tctx->decctx;
+  recon_tctx.img       = tctx->img;
+  recon_tctx.shdr      = tctx->shdr;
+  recon_tctx.imgunit   = tctx->imgunit;
+  recon_tctx.sliceunit = tctx->sliceunit;
+}
+
+
+void reconstruction_pipeline::add_transform_block(const thread_context* tctx,
+                                                  int x0,int y0, int xCUBase,int yCUBase,
+                                                  int nT, int cIdx, enum PredMode cuPredMode,
+                                                  bool cbf)
+{
+  ctb_syntax& ctb = current_ctb();
+
+  recon_block blk;
+  blk.type = recon_block::TransformBlock;
+  blk.x0 = x0;
+  blk.y0 = y0;
+  blk.xCUBase = xCUBase;
+  blk.yCUBase = yCUBase;
+  blk.nT = nT;
+  blk.cIdx = cIdx;
+  blk.cuPredMode = cuPredMode;
+  blk.cbf = cbf;
+  blk.transform_skip_flag = tctx->transform_skip_flag[cIdx];
+  blk.cu_transquant_bypass_flag = tctx->cu_transquant_bypass_flag;
+  blk.explicit_rdpcm_flag = tctx->explicit_rdpcm_flag;
+  blk.explicit_rdpcm_dir  = tctx->explicit_rdpcm_dir;
+  blk.ResScaleVal = tctx->ResScaleVal;
+  blk.qPYPrime  = tctx->qPYPrime;
+  blk.qPCbPrime = tctx->qPCbPrime;
+  blk.qPCrPrime = tctx->qPCrPrime;
+
+  blk.firstCoeff = ctb.coeffList.size();
+  blk.nCoeff = 0;
+
+  if (cbf) {
+    int n = tctx->nCoeff[cIdx];
+    blk.nCoeff = n;
+
+    ctb.coeffList.insert(ctb.coeffList.end(), tctx->coeffList[cIdx], tctx->coeffList[cIdx]+n);
+    ctb.coeffPos .insert(ctb.coeffPos .end(), tctx->coeffPos [cIdx], tctx->coeffPos [cIdx]+n);
+  }
+
+  ctb.blocks.push_back(blk);
+}
+
+
+void reconstruction_pipeline::add_prediction_block(int xC,int yC, int xB,int yB,
+                                                   int nCS, int nPbW,int nPbH,
+                                                   const PBMotion& vi)
+{
+  recon_block blk;
+  blk.type = recon_block::PredictionBlock;
+  blk.x0 = xC;
+  blk.y0 = yC;
+  blk.xCUBase = xB;
+  blk.yCUBase = yB;
+  blk.nCS  = nCS;
+  blk.nPbW = nPbW;
+  blk.nPbH = nPbH;
+  blk.motion = vi;
+
+  current_ctb().blocks.push_back(blk);
+}
+
+
+void reconstruction_pipeline::reconstruct_CTB(const ctb_syntax& ctb, thread_task* task)
+{
+  thread_context* tctx = &recon_tctx;
+  tctx->task = task;
+
+  for (int i=0;i<ctb.blocks.size();i++) {
+    const recon_block& blk = ctb.blocks[i];
+
+    if (blk.type == recon_block::PredictionBlock) {
+      predict_prediction_unit(tctx->decctx, tctx->shdr, tctx->img,
+                              blk.x0,blk.y0, blk.xCUBase,blk.yCUBase,
+                              blk.nCS, blk.nPbW,blk.nPbH, blk.motion, task);
+    }
+    else {
+      int cIdx = blk.cIdx;
+
+      tctx->transform_skip_flag[cIdx] = blk.transform_skip_flag;
+      tctx->cu_transquant_bypass_flag = blk.cu_transquant_bypass_flag;
+      tctx->explicit_rdpcm_flag = blk.explicit_rdpcm_flag;
+      tctx->explicit_rdpcm_dir  = blk.explicit_rdpcm_dir;
+      tctx->ResScaleVal = blk.ResScaleVal;
+      tctx->qPYPrime  = blk.qPYPrime;
+      tctx->qPCbPrime = blk.qPCbPrime;
+      tctx->qPCrPrime = blk.qPCrPrime;
+
+      tctx->nCoeff[cIdx] = blk.nCoeff;
+      if (blk.nCoeff) {
+        memcpy(tctx->coeffList[cIdx], &ctb.coeffList[blk.firstCoeff], blk.nCoeff*sizeof(int16_t));
+        memcpy(tctx->coeffPos [cIdx], &ctb.coeffPos [blk.firstCoeff], blk.nCoeff*sizeof(int16_t));
+      }
+
+      decode_TU(tctx, blk.x0,blk.y0, blk.xCUBase,blk.yCUBase, blk.nT, cIdx,
+                (enum PredMode)blk.cuPredMode, blk.cbf);
+    }
+  }
+
+  if (ctb.ctbAddrRS >= 0) {
+    tctx->img->ctb_progress[ctb.ctbAddrRS].set_progress(CTB_PROGRESS_PREFILTER);
+  }
+}
+
+
+void reconstruction_pipeline::reconstruct_first_CTB(thread_task* task)
+{
+  assert(num_parsed_ctbs>0 && !reconstructing);
+
+  reconstructing = true;
+  de265_mutex_unlock(&mutex);
+
+  reconstruct_CTB(ctbs[first_parsed_ctb], task);
+
+  de265_mutex_lock(&mutex);
+  reconstructing = false;
+  first_parsed_ctb = (first_parsed_ctb+1) % MAX_PARSED_CTBS;
+  num_parsed_ctbs--;
+
+  de265_cond_broadcast(&cond_var, &mutex);
+}
+
+
+void reconstruction_pipeline::end_of_CTB(thread_task* task, int ctbAddrRS)
+{
+  current_ctb().ctbAddrRS = ctbAddrRS;
+
+  de265_mutex_lock(&mutex);
+
+  num_parsed_ctbs++;
+  de265_cond_broadcast(&cond_var, &mutex);
+
+  // Make room for the next CTB. Only wait if another thread is reconstructing.
+
+  while (num_parsed_ctbs == MAX_PARSED_CTBS) {
+    if (reconstructing) {
+      de265_cond_wait(&cond_var, &mutex);
+    }
+    else {
+      reconstruct_first_CTB(task);
+    }
+  }
+
+  de265_mutex_unlock(&mutex);
+
+  current_ctb_idx = (current_ctb_idx+1) % MAX_PARSED_CTBS;
+  current_ctb().clear();
+}
+
+
+void reconstruction_pipeline::finish(thread_task* task)
+{
+  // a partially decoded CTB (decoding error) is reconstructed as far as it was parsed
+
+  if (!current_ctb().blocks.empty()) {
+    end_of_CTB(task, -1);
+  }
+
+  de265_mutex_lock(&mutex);
+
+  parsing_finished = true;
+  de265_cond_broadcast(&cond_var, &mutex);
+
+  while (num_parsed_ctbs>0 || reconstructing) {
+    if (reconstructing) {
+      de265_cond_wait(&cond_var, &mutex);
+    }
+    else {
+      reconstruct_first_CTB(task);
+    }
+  }
+
+  size_t size = 0;
+  for (int i=0;i<MAX_PARSED_CTBS;i++) {
+    size += ctbs[i].memory_usage();
+  }
+  buffer_memory = size;
+
+  de265_mutex_unlock(&mutex);
+}
+
+
+void reconstruction_pipeline::run(thread_task* task)
+{
+  de265_image* img = recon_tctx.img;
+
+  de265_mutex_lock(&mutex);
+
+  for (;;) {
+    if (num_parsed_ctbs>0 && !reconstructing) {
+      reconstruct_first_CTB(task);
+    }
+    else if (parsing_finished && num_parsed_ctbs==0) {
+      break;
+    }
+    else {
+      img->thread_blocks();
+      task->state = thread_task::Blocked;
+
+      de265_cond_wait(&cond_var, &mutex);
+
+      task->state = thread_task::Running;
+      img->thread_unblocks();
+    }
+  }
+
+  de265_mutex_unlock(&mutex);
+}
+
+
+void thread_task_reconstruction::work()
+{
+  state = Running;
+  img->thread_run(this);
+
+  pipeline->run(this);
+
+  state = Finished;
+  img->thread_finishes(this);
+}
+
+
+std::string thread_task_reconstruction::name() const {
+  char buf[100];
+  sprintf(buf,"reconstruction-%d;%d",debug_startCtbX,debug_startCtbY);
+  return buf;
+}
@@ -0,0 +1,169 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DE265_RECONSTRUCTION_H
+#define DE265_RECONSTRUCTION_H
+
+#include "libde265/decctx.h"
+#include "libde265/motion.h"
+
+#include <vector>
+#include <atomic>
+
+
+/* Two-stage decoding (DE265_DECODER_PARAM_TWO_STAGE_DECODING).
+
+   The slice segment task only does the entropy decoding. Instead of reconstructing
+   the blocks immediately, it records the parameters of each transform block and
+   prediction block of a CTB in a ctb_syntax buffer. A reconstruction task, queued
+   together with the slice segment task, reconstructs the parsed CTBs in parallel to
+   the parsing of the next CTBs.
+ */
+
+
+// One transform block (of one color component) or one inter prediction block.
+struct recon_block
+{
+  enum { TransformBlock, PredictionBlock };
+
+  uint8_t type;
+
+  // transform block (chroma blocks are in chroma coordinates)
+
+  uint8_t cIdx;
+  uint8_t cuPredMode;
+  uint8_t cbf;
+  uint8_t transform_skip_flag;
+  uint8_t cu_transquant_bypass_flag;
+  uint8_t explicit_rdpcm_flag;
+  uint8_t explicit_rdpcm_dir;
+  int8_t  ResScaleVal;
+  uint8_t qPYPrime, qPCbPrime, qPCrPrime;
+
+  int16_t nT;
+  int16_t x0,y0;           // TB position, or position of the CB for prediction blocks
+  int16_t xCUBase,yCUBase; // CB position, or offset of the PB for prediction blocks
+
+  uint16_t nCoeff;
+  int      firstCoeff;     // index into ctb_syntax::coeffList/coeffPos
+
+  // prediction block
+
+  int16_t nCS, nPbW, nPbH;
+  PBMotion motion;
+};
+
+
+class ctb_syntax
+{
+ public:
+  int ctbAddrRS; // -1 for an incompletely decoded CTB at the end of a faulty slice
+
+  std::vector<recon_block> blocks;
+  std::vector<int16_t> coeffList;
+  std::vector<int16_t> coeffPos;
+
+  void clear() {
+    blocks.clear();
+    coeffList.clear();
+    coeffPos.clear();
+  }
+
+  size_t memory_usage() const {
+    return (blocks.capacity()*sizeof(recon_block) +
+            coeffList.capacity()*sizeof(int16_t) +
+            coeffPos.capacity()*sizeof(int16_t));
+  }
+};
+
+
+class reconstruction_pipeline;
+
+class thread_task_reconstruction : public thread_task
+{
+public:
+  reconstruction_pipeline* pipeline; // owned by the thread_task_slice_segment
+  de265_image* img;
+  int    debug_startCtbX, debug_startCtbY;
+
+  virtual void work();
+  virtual std::string name() const;
+};
+
+
+/* The parser may run ahead of the reconstruction by up to MAX_PARSED_CTBS CTBs.
+   The reconstruction task waits for parsed CTBs, like the deblocking tasks wait for
+   decoded CTBs. It has the same priority as the slice segment task and is queued after
+   it. Hence, the parser must not wait for the reconstruction task to start. When the
+   buffer is full and the reconstruction task is not busy (e.g. it did not start yet
+   because there is only one worker thread), the parser reconstructs the oldest CTB itself.
+ */
+class reconstruction_pipeline
+{
+ public:
+  reconstruction_pipeline();
+  ~reconstruction_pipeline();
+
+  void start(const thread_context* tctx); // prepare for a new slice segment
+
+  // parser side
+
+  void finish(thread_task* task); // reconstructs all remaining CTBs, must always be called
+
+  void add_transform_block(const thread_context* tctx,
+                           int x0,int y0, int xCUBase,int yCUBase,
+                           int nT, int cIdx, enum PredMode cuPredMode, bool cbf);
+  void add_prediction_block(int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH,
+                            const PBMotion& vi);
+
+  void end_of_CTB(thread_task* task, int ctbAddrRS);
+
+  // reconstruction task
+
+  void run(thread_task* task);
+
+  // memory of the pipeline, as of the end of the last slice segment
+  size_t memory_usage() const { return sizeof(reconstruction_pipeline) + buffer_memory; }
+
+ private:
+  enum { MAX_PARSED_CTBS = 16 };
+
+  ctb_syntax ctbs[MAX_PARSED_CTBS];
+  int first_parsed_ctb; // next CTB to reconstruct
+  int num_parsed_ctbs;
+  int current_ctb_idx;  // CTB being parsed, only accessed by the parser
+
+  bool reconstructing;  // a thread is currently reconstructing ctbs[first_parsed_ctb]
+  bool parsing_finished;
+
+  std::atomic<size_t> buffer_memory; // set in finish()
+
+  de265_mutex mutex;
+  de265_cond  cond_var;
+
+  thread_context recon_tctx;
+
+  ctb_syntax& current_ctb() { return ctbs[current_ctb_idx]; }
+
+  void reconstruct_first_CTB(thread_task* task); // call with locked mutex
+  void reconstruct_CTB(const ctb_syntax& ctb, thread_task* task);
+};
+
+#endif
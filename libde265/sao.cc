@@ -20,11 +20,79 @@
 
 #include "sao.h"
 #include "util.h"
+#include "fallback-sao.h"
 
 #include <stdlib.h>
 #include <string.h>
 
 
+/* Checks for the CTBs around the CTB at (xC;yC) (in component samples) whether SAO edge
+   offsets may compare samples across the CTB boundary (picture, slice, and tile boundaries).
+   Returns false if a neighboring CTB has no slice header.
+ */
+static bool get_sao_neighbor_availability(de265_image* img, int cIdx,
+                                          int xC,int yC, int ctbW,int ctbH,
+                                          int ctbSliceAddrRS, bool avail[3][3])
+{
+  const seq_parameter_set& sps = img->get_sps();
+  const pic_parameter_set& pps = img->get_pps();
+
+  const int width  = img->get_width(cIdx);
+  const int height = img->get_height(cIdx);
+
+  const int picWidthInCtbs = sps.PicWidthInCtbsY;
+  const int chromashiftW = sps.get_chroma_shift_W(cIdx);
+  const int chromashiftH = sps.get_chroma_shift_H(cIdx);
+  const int ctbshiftW = sps.Log2CtbSizeY - chromashiftW;
+  const int ctbshiftH = sps.Log2CtbSizeY - chromashiftH;
+
+  const slice_segment_header* ctbSliceHeader = img->get_SliceHeader(xC<<chromashiftW,
+                                                                    yC<<chromashiftH);
+
+  for (int dy=-1;dy<=1;dy++)
+    for (int dx=-1;dx<=1;dx++) {
+      int xS = (dx<0 ? xC-1 : dx>0 ? xC+ctbW : xC);
+      int yS = (dy<0 ? yC-1 : dy>0 ? yC+ctbH : yC);
+
+      bool& a = avail[1+dy][1+dx];
+      a = true;
+
+      if (xS<0 || yS<0 || xS>=width || yS>=height) {
+        a = false;
+        continue;
+      }
+
+      const slice_segment_header* sliceHeader = img->get_SliceHeader(xS<<chromashiftW,
+                                                                     yS<<chromashiftH);
+      if (sliceHeader==NULL) {
+        return false;
+      }
+
+      int sliceAddrRS = sliceHeader->SliceAddrRS;
+      if (sliceAddrRS <  ctbSliceAddrRS &&
+          ctbSliceHeader->slice_loop_filter_across_slices_enabled_flag==0) {
+        a = false;
+      }
+
+      if (sliceAddrRS >  ctbSliceAddrRS &&
+          sliceHeader->slice_loop_filter_across_slices_enabled_flag==0) {
+        a = false;
+      }
+
+      if (pps.loop_filter_across_tiles_enabled_flag==0 &&
+          pps.TileIdRS[(xS>>ctbshiftW) + (yS>>ctbshiftH)*picWidthInCtbs] !=
+          pps.TileIdRS[(xC>>ctbshiftW) + (yC>>ctbshiftH)*picWidthInCtbs]) {
+        a = false;
+      }
+    }
+
+  return true;
+}
+
+
+/* in_img and out_img point to the top left sample of the CTB. They may be the same
+   for band offsets. For edge offsets, in_img must also provide the samples around the CTB.
+ */
 template <class pixel_t>
 void apply_sao_internal(de265_image* img, int xCtb,int yCtb,
                         const slice_segment_header* shdr, int cIdx, int nSW,int nSH,
@@ -80,12 +148,7 @@ void apply_sao_internal(de265_image* img, int xCtb,int yCtb,
     int vPosStride[2]; // vPos[] multiplied by image stride
     int SaoEoClass = (saoinfo->SaoEoClass >> (2*cIdx)) & 0x3;
 
-    switch (SaoEoClass) {
-    case 0: hPos[0]=-1; hPos[1]= 1; vPos[0]= 0; vPos[1]=0; break;
-    case 1: hPos[0]= 0; hPos[1]= 0; vPos[0]=-1; vPos[1]=1; break;
-    case 2: hPos[0]=-1; hPos[1]= 1; vPos[0]=-1; vPos[1]=1; break;
-    case 3: hPos[0]= 1; hPos[1]=-1; vPos[0]=-1; vPos[1]=1; break;
-    }
+    sao_edge_offset_neighbors(SaoEoClass, hPos,vPos);
 
     vPosStride[0] = vPos[0] * in_stride;
     vPosStride[1] = vPos[1] * in_stride;
@@ -100,9 +163,68 @@ void apply_sao_internal(de265_image* img, int xCtb,int yCtb,
     saoOffsetVal[4] = saoinfo->saoOffsetVal[cIdx][4-1];
 
 
+    /* Without PCM and transquant_bypass, only the samples at the CTB boundary need
+       individual checks. Which of the neighboring CTBs may be accessed is determined once.
+     */
+
+    bool neighborAvail[3][3]; // [1+dy][1+dx]
+
+    if (!extendedTests &&
+        get_sao_neighbor_availability(img, cIdx, xC,yC, ctbW,ctbH, ctbSliceAddrRS, neighborAvail)) {
+
+      bool allAvail = true;
+      for (int k=0;k<2;k++) {
+        allAvail &= neighborAvail[1+vPos[k]][1];
+        allAvail &= neighborAvail[1][1+hPos[k]];
+        allAvail &= neighborAvail[1+vPos[k]][1+hPos[k]];
+      }
+
+      const acceleration_functions& accel = img->decctx->acceleration;
+
+      if (allAvail) {
+        accel.sao_edge_offset<pixel_t>(out_img, out_stride, in_img, in_stride, ctbW,ctbH,
+                                       SaoEoClass, saoinfo->saoOffsetVal[cIdx], bitDepth);
+        return;
+      }
+
+      // inner samples
+
+      accel.sao_edge_offset<pixel_t>(out_img + 1+out_stride, out_stride,
+                                     in_img  + 1+in_stride,  in_stride, ctbW-2,ctbH-2,
+                                     SaoEoClass, saoinfo->saoOffsetVal[cIdx], bitDepth);
+
+      // samples at the CTB boundary
+
+      for (int j=0;j<ctbH;j++) {
+        const pixel_t* in_ptr  = &in_img [j*in_stride];
+        /* */ pixel_t* out_ptr = &out_img[j*out_stride];
+
+        const int iStep = (j==0 || j==ctbH-1) ? 1 : ctbW-1;
+
+        for (int i=0;i<ctbW;i+=iStep) {
+          bool avail = true;
+          for (int k=0;k<2;k++) {
+            int x = i+hPos[k];
+            int y = j+vPos[k];
+            avail &= neighborAvail[y<0 ? 0 : y>=ctbH ? 2 : 1][x<0 ? 0 : x>=ctbW ? 2 : 1];
+          }
+
+          if (avail) {
+            int edgeIdx = ( Sign(in_ptr[i] - in_ptr[i+hPos[0]+vPosStride[0]]) +
+                            Sign(in_ptr[i] - in_ptr[i+hPos[1]+vPosStride[1]])   );
+
+            out_ptr[i] = Clip3(0,maxPixelValue, in_ptr[i] + saoOffsetVal[edgeIdx+2]);
+          }
+        }
+      }
+
+      return;
+    }
+
+
     for (int j=0;j<ctbH;j++) {
-      const pixel_t* in_ptr  = &in_img [xC+(yC+j)*in_stride];
-      /* */ pixel_t* out_ptr = &out_img[xC+(yC+j)*out_stride];
+      const pixel_t* in_ptr  = &in_img [j*in_stride];
+      /* */ pixel_t* out_ptr = &out_img[j*out_stride];
 
       for (int i=0;i<ctbW;i++) {
         int edgeIdx = -1;
@@ -183,6 +305,12 @@ void apply_sao_internal(de265_image* img, int xCtb,int yCtb,
     int saoLeftClass = saoinfo->sao_band_position[cIdx];
     logtrace(LogSAO,"saoLeftClass: %d\n",saoLeftClass);
 
+    // Shifts are a strange thing. On x86, >>x actually computes >>(x%64).
+    // So we have to take care of large bandShifts.
+    if (bandShift >= 8) {
+      return;
+    }
+
     int bandTable[32];
     memset(bandTable, 0, sizeof(int)*32);
 
@@ -211,168 +339,239 @@ void apply_sao_internal(de265_image* img, int xCtb,int yCtb,
             continue;
           }
 
-          // Shifts are a strange thing. On x86, >>x actually computes >>(x%64).
-          // So we have to take care of large bandShifts.
-          int bandIdx;
-          if (bandShift >= 8) {
-            bandIdx = 0;
-          } else {
-            bandIdx = bandTable[ in_img[xC+i+(yC+j)*in_stride]>>bandShift ];
-          }
+          int bandIdx = bandTable[ in_img[i+j*in_stride]>>bandShift ];
 
           if (bandIdx>0) {
             int offset = saoinfo->saoOffsetVal[cIdx][bandIdx-1];
 
             logtrace(LogSAO,"%d %d (%d) offset %d  %x -> %x\n",xC+i,yC+j,bandIdx,
                      offset,
-                     in_img[xC+i+(yC+j)*in_stride],
-                     in_img[xC+i+(yC+j)*in_stride]+offset);
+                     in_img[i+j*in_stride],
+                     in_img[i+j*in_stride]+offset);
 
-            out_img[xC+i+(yC+j)*out_stride] = Clip3(0,maxPixelValue,
-                                                    in_img[xC+i+(yC+j)*in_stride] + offset);
+            out_img[i+j*out_stride] = Clip3(0,maxPixelValue,
+                                            in_img[i+j*in_stride] + offset);
           }
         }
     }
-    else
-      {
-        // (B) simplified version (only works if no PCM and transquant_bypass is active)
-
-        for (int j=0;j<ctbH;j++)
-          for (int i=0;i<ctbW;i++) {
-
-            // see above
-            int bandIdx;
-            if (bandShift >= 8) {
-              bandIdx = 0;
-            } else {
-              bandIdx = bandTable[ in_img[xC+i+(yC+j)*in_stride]>>bandShift ];
-            }
-
-            if (bandIdx>0) {
-              int offset = saoinfo->saoOffsetVal[cIdx][bandIdx-1];
+    else {
+      // (B) all samples are filtered (only works if no PCM and transquant_bypass is active)
 
-              out_img[xC+i+(yC+j)*out_stride] = Clip3(0,maxPixelValue,
-                                                      in_img[xC+i+(yC+j)*in_stride] + offset);
-            }
-          }
-      }
+      img->decctx->acceleration.sao_band_offset<pixel_t>(out_img, out_stride, in_img, in_stride,
+                                                         ctbW,ctbH, saoLeftClass,
+                                                         saoinfo->saoOffsetVal[cIdx], bitDepth);
+    }
   }
 }
 
 
-template <class pixel_t>
-void apply_sao(de265_image* img, int xCtb,int yCtb,
-               const slice_segment_header* shdr, int cIdx, int nSW,int nSH,
-               const pixel_t* in_img,  int in_stride,
-               /* */ pixel_t* out_img, int out_stride)
+sao_line_buffers::sao_line_buffers()
 {
-  if (img->high_bit_depth(cIdx)) {
-    apply_sao_internal<uint16_t>(img,xCtb,yCtb, shdr,cIdx,nSW,nSH,
-                                 (uint16_t*)in_img, in_stride,
-                                 (uint16_t*)out_img,out_stride);
+  for (int c=0;c<3;c++) {
+    line_size[c] = 0;
   }
-  else {
-    apply_sao_internal<uint8_t>(img,xCtb,yCtb, shdr,cIdx,nSW,nSH,
-                                in_img, in_stride,
-                                out_img,out_stride);
+  nComponents = 0;
+
+  de265_mutex_init(&mutex);
+}
+
+
+sao_line_buffers::~sao_line_buffers()
+{
+  de265_mutex_destroy(&mutex);
+}
+
+
+void sao_line_buffers::init(const de265_image* img)
+{
+  const seq_parameter_set& sps = img->get_sps();
+
+  nComponents = (sps.ChromaArrayType == CHROMA_MONO ? 1 : 3);
+
+  for (int c=0;c<nComponents;c++) {
+    line_size[c] = img->get_width(c) * img->get_bytes_per_pixel(c);
+    lines[c].resize(2*sps.PicHeightInCtbsY * line_size[c]);
   }
+
+  saved.assign(2*sps.PicHeightInCtbsY, 0);
 }
 
 
-void apply_sample_adaptive_offset(de265_image* img)
+void sao_line_buffers::save_line(const de265_image* img, int ctbRow, bool bottom)
 {
   const seq_parameter_set& sps = img->get_sps();
 
-  if (sps.sample_adaptive_offset_enabled_flag==0) {
-    return;
+  de265_mutex_lock(&mutex);
+
+  if (!saved[2*ctbRow + bottom]) {
+    for (int c=0;c<nComponents;c++) {
+      int nSH = (1<<sps.Log2CtbSizeY) / (c==0 ? 1 : sps.SubHeightC);
+
+      int y = ctbRow*nSH;
+      if (bottom) {
+        y = libde265_min(y+nSH, img->get_height(c)) - 1;
+      }
+
+      memcpy(&lines[c][(2*ctbRow + bottom) * line_size[c]],
+             img->get_image_plane_at_pos_any_depth(c, 0,y),
+             line_size[c]);
+    }
+
+    saved[2*ctbRow + bottom] = 1;
   }
 
-  de265_image inputCopy;
-  de265_error err = inputCopy.copy_image(img);
-  if (err != DE265_OK) {
-    img->decctx->add_warning(DE265_WARNING_CANNOT_APPLY_SAO_OUT_OF_MEMORY,false);
-    return;
+  de265_mutex_unlock(&mutex);
+}
+
+
+size_t sao_line_buffers::memory_usage() const
+{
+  size_t size = saved.capacity();
+
+  for (int c=0;c<3;c++) {
+    size += lines[c].capacity();
   }
 
-  for (int yCtb=0; yCtb<sps.PicHeightInCtbsY; yCtb++)
-    for (int xCtb=0; xCtb<sps.PicWidthInCtbsY; xCtb++)
-      {
-        const slice_segment_header* shdr = img->get_SliceHeaderCtb(xCtb,yCtb);
+  return size;
+}
+
+
+/* Filters one color component of a CTB row in place.
+
+   The CTBs are processed from left to right. For edge offsets, each CTB is copied into a
+   small buffer together with the surrounding samples: the last column of the CTB to the
+   left is taken from a copy made before that CTB was filtered, the lines above and below
+   come from the saved lines of the neighboring CTB rows.
+ */
+template <class pixel_t>
+static void apply_sao_to_CTB_row(de265_image* img, const sao_line_buffers& lines,
+                                 int ctbY, int cIdx)
+{
+  const seq_parameter_set& sps = img->get_sps();
+
+  const int ctbSize = 1<<sps.Log2CtbSizeY;
+  const int nSW = ctbSize / (cIdx==0 ? 1 : sps.SubWidthC);
+  const int nSH = ctbSize / (cIdx==0 ? 1 : sps.SubHeightC);
+
+  const int width  = img->get_width(cIdx);
+  const int height = img->get_height(cIdx);
+  const int stride = img->get_image_stride(cIdx);
+
+  const int yC   = ctbY*nSH;
+  const int ctbH = libde265_min(nSH, height-yC);
 
-        if (shdr->slice_sao_luma_flag) {
-          apply_sao(img, xCtb,yCtb, shdr, 0, 1<<sps.Log2CtbSizeY, 1<<sps.Log2CtbSizeY,
-                    inputCopy.get_image_plane(0), inputCopy.get_image_stride(0),
-                    img->get_image_plane(0), img->get_image_stride(0));
+  const pixel_t* lineAbove = NULL;
+  const pixel_t* lineBelow = NULL;
+  if (ctbY>0)          { lineAbove = (const pixel_t*)lines.get_line(cIdx, ctbY-1, true);  }
+  if (yC+ctbH<height)  { lineBelow = (const pixel_t*)lines.get_line(cIdx, ctbY+1, false); }
+
+  // CTB with a border of one sample (maximum CTB size is 64)
+  const int blkStride = 64+2;
+  pixel_t blk[blkStride*(64+2)];
+  pixel_t* const blkCtb = &blk[blkStride+1];
+
+  pixel_t leftColumn[64]; // unfiltered last column of the previous CTB
+
+  for (int xCtb=0; xCtb<sps.PicWidthInCtbsY; xCtb++)
+    {
+      const slice_segment_header* shdr = img->get_SliceHeaderCtb(xCtb,ctbY);
+      if (shdr==NULL) {
+        break;
+      }
+
+      const int xC   = xCtb*nSW;
+      const int ctbW = libde265_min(nSW, width-xC);
+
+      pixel_t* ctb = img->get_image_plane_at_pos_NEW<pixel_t>(cIdx, xC,yC);
+
+      int SaoTypeIdx = 0;
+      if (cIdx==0 ? shdr->slice_sao_luma_flag : shdr->slice_sao_chroma_flag) {
+        SaoTypeIdx = (img->get_sao_info(xCtb,ctbY)->SaoTypeIdx >> (2*cIdx)) & 0x3;
+      }
+
+      if (SaoTypeIdx==2) {
+        const int xLeft  = (xC>0 ? 1 : 0);
+        const int xRight = (xC+ctbW<width ? 1 : 0);
+
+        for (int j=0;j<ctbH;j++) {
+          memcpy(&blkCtb[j*blkStride], &ctb[j*stride], (ctbW+xRight)*sizeof(pixel_t));
+          blkCtb[j*blkStride-1] = leftColumn[j];
         }
 
-        if (shdr->slice_sao_chroma_flag) {
-          int nSW = (1<<sps.Log2CtbSizeY) / sps.SubWidthC;
-          int nSH = (1<<sps.Log2CtbSizeY) / sps.SubHeightC;
+        const int n = xLeft + ctbW + xRight;
 
-          apply_sao(img, xCtb,yCtb, shdr, 1, nSW,nSH,
-                    inputCopy.get_image_plane(1), inputCopy.get_image_stride(1),
-                    img->get_image_plane(1), img->get_image_stride(1));
+        if (lineAbove) {
+          memcpy(&blkCtb[-blkStride-xLeft], &lineAbove[xC-xLeft], n*sizeof(pixel_t));
+        }
 
-          apply_sao(img, xCtb,yCtb, shdr, 2, nSW,nSH,
-                    inputCopy.get_image_plane(2), inputCopy.get_image_stride(2),
-                    img->get_image_plane(2), img->get_image_stride(2));
+        if (lineBelow) {
+          memcpy(&blkCtb[ctbH*blkStride-xLeft], &lineBelow[xC-xLeft], n*sizeof(pixel_t));
         }
       }
+
+      for (int j=0;j<ctbH;j++) {
+        leftColumn[j] = ctb[ctbW-1 + j*stride];
+      }
+
+      if (SaoTypeIdx==2) {
+        apply_sao_internal<pixel_t>(img, xCtb,ctbY, shdr, cIdx, nSW,nSH,
+                                    blkCtb, blkStride,
+                                    ctb, stride);
+      }
+      else if (SaoTypeIdx==1) {
+        apply_sao_internal<pixel_t>(img, xCtb,ctbY, shdr, cIdx, nSW,nSH,
+                                    ctb, stride,
+                                    ctb, stride);
+      }
+    }
 }
 
 
-void apply_sample_adaptive_offset_sequential(de265_image* img)
+static void apply_sao_to_CTB_row(de265_image* img, sao_line_buffers& lines, int ctbY)
 {
   const seq_parameter_set& sps = img->get_sps();
 
-  if (sps.sample_adaptive_offset_enabled_flag==0) {
-    return;
-  }
+  // save the lines that the neighboring rows need before filtering this row,
+  // and the lines of the neighboring rows before they are filtered
 
-  int lumaImageSize   = img->get_image_stride(0) * img->get_height(0) * img->get_bytes_per_pixel(0);
-  int chromaImageSize = img->get_image_stride(1) * img->get_height(1) * img->get_bytes_per_pixel(1);
-
-  uint8_t* inputCopy = new uint8_t[ libde265_max(lumaImageSize, chromaImageSize) ];
-  if (inputCopy == NULL) {
-    img->decctx->add_warning(DE265_WARNING_CANNOT_APPLY_SAO_OUT_OF_MEMORY,false);
-    return;
+  if (ctbY>0) {
+    lines.save_line(img, ctbY-1, true);
+    lines.save_line(img, ctbY,   false);
   }
 
+  if (ctbY<sps.PicHeightInCtbsY-1) {
+    lines.save_line(img, ctbY,   true);
+    lines.save_line(img, ctbY+1, false);
+  }
 
   int nChannels = 3;
   if (sps.ChromaArrayType == CHROMA_MONO) { nChannels=1; }
 
   for (int cIdx=0;cIdx<nChannels;cIdx++) {
+    if (img->high_bit_depth(cIdx)) {
+      apply_sao_to_CTB_row<uint16_t>(img, lines, ctbY, cIdx);
+    }
+    else {
+      apply_sao_to_CTB_row<uint8_t>(img, lines, ctbY, cIdx);
+    }
+  }
+}
 
-    int stride = img->get_image_stride(cIdx);
-    int height = img->get_height(cIdx);
-
-    memcpy(inputCopy, img->get_image_plane(cIdx), stride * height * img->get_bytes_per_pixel(cIdx));
 
-    for (int yCtb=0; yCtb<sps.PicHeightInCtbsY; yCtb++)
-      for (int xCtb=0; xCtb<sps.PicWidthInCtbsY; xCtb++)
-        {
-          const slice_segment_header* shdr = img->get_SliceHeaderCtb(xCtb,yCtb);
-          if (shdr==NULL) { return; }
+void apply_sample_adaptive_offset_sequential(image_unit* imgunit)
+{
+  de265_image* img = imgunit->img;
+  const seq_parameter_set& sps = img->get_sps();
 
-          if (cIdx==0 && shdr->slice_sao_luma_flag) {
-            apply_sao(img, xCtb,yCtb, shdr, 0, 1<<sps.Log2CtbSizeY, 1<<sps.Log2CtbSizeY,
-                      inputCopy, stride,
-                      img->get_image_plane(0), img->get_image_stride(0));
-          }
+  if (sps.sample_adaptive_offset_enabled_flag==0) {
+    return;
+  }
 
-          if (cIdx!=0 && shdr->slice_sao_chroma_flag) {
-            int nSW = (1<<sps.Log2CtbSizeY) / sps.SubWidthC;
-            int nSH = (1<<sps.Log2CtbSizeY) / sps.SubHeightC;
+  imgunit->sao_lines.init(img);
 
-            apply_sao(img, xCtb,yCtb, shdr, cIdx, nSW,nSH,
-                      inputCopy, stride,
-                      img->get_image_plane(cIdx), img->get_image_stride(cIdx));
-          }
-        }
+  for (int yCtb=0; yCtb<sps.PicHeightInCtbsY; yCtb++) {
+    apply_sao_to_CTB_row(img, imgunit->sao_lines, yCtb);
   }
-
-  delete[] inputCopy;
 }
 
 
@@ -382,12 +581,8 @@ class thread_task_sao : public thread_task
 {
 public:
   int  ctb_y;
-  de265_image* img; /* this is where we get the SPS from
-                       (either inputImg or outputImg can be a dummy image)
-                    */
-
-  de265_image* inputImg;
-  de265_image* outputImg;
+  de265_image* img;
+  sao_line_buffers* lines;
   int inputProgress;
 
   virtual void work();
@@ -406,63 +601,19 @@ void thread_task_sao::work()
 
   const seq_parameter_set& sps = img->get_sps();
 
-  const int rightCtb = sps.PicWidthInCtbsY-1;
-  const int ctbSize  = (1<<sps.Log2CtbSizeY);
-
 
   // wait until also the CTB-rows below and above are ready
 
-  img->wait_for_progress(this, rightCtb,ctb_y,  inputProgress);
-
-  if (ctb_y>0) {
-    img->wait_for_progress(this, rightCtb,ctb_y-1, inputProgress);
-  }
-
-  if (ctb_y+1<sps.PicHeightInCtbsY) {
-    img->wait_for_progress(this, rightCtb,ctb_y+1, inputProgress);
-  }
+  img->wait_for_CTB_rows(this, ctb_y-1,ctb_y+1, inputProgress);
 
 
-  // copy input image to output for this CTB-row
+  apply_sao_to_CTB_row(img, *lines, ctb_y);
 
-  outputImg->copy_lines_from(inputImg, ctb_y * ctbSize, (ctb_y+1) * ctbSize);
 
+  // The neighboring rows only read the saved lines of this row. Hence, its samples are final.
 
-  // process SAO in the CTB-row
-
-  for (int xCtb=0; xCtb<sps.PicWidthInCtbsY; xCtb++)
-    {
-      const slice_segment_header* shdr = img->get_SliceHeaderCtb(xCtb,ctb_y);
-      if (shdr==NULL) {
-        break;
-      }
-
-      if (shdr->slice_sao_luma_flag) {
-        apply_sao(img, xCtb,ctb_y, shdr, 0, ctbSize, ctbSize,
-                  inputImg ->get_image_plane(0), inputImg ->get_image_stride(0),
-                  outputImg->get_image_plane(0), outputImg->get_image_stride(0));
-      }
-
-      if (shdr->slice_sao_chroma_flag) {
-        int nSW = ctbSize / sps.SubWidthC;
-        int nSH = ctbSize / sps.SubHeightC;
-
-        apply_sao(img, xCtb,ctb_y, shdr, 1, nSW,nSH,
-                  inputImg ->get_image_plane(1), inputImg ->get_image_stride(1),
-                  outputImg->get_image_plane(1), outputImg->get_image_stride(1));
-
-        apply_sao(img, xCtb,ctb_y, shdr, 2, nSW,nSH,
-                  inputImg ->get_image_plane(2), inputImg ->get_image_stride(2),
-                  outputImg->get_image_plane(2), outputImg->get_image_stride(2));
-      }
-    }
-
-
-  // mark SAO progress
-
-  for (int x=0;x<=rightCtb;x++) {
-    const int CtbWidth = sps.PicWidthInCtbsY;
-    img->ctb_progress[x+ctb_y*CtbWidth].set_progress(CTB_PROGRESS_SAO);
+  for (int x=0;x<sps.PicWidthInCtbsY;x++) {
+    img->ctb_progress[x+ctb_y*sps.PicWidthInCtbsY].set_progress(CTB_PROGRESS_COMPLETE);
   }
 
 
@@ -483,16 +634,7 @@ bool add_sao_tasks(image_unit* imgunit, int saoInputProgress)
 
   decoder_context* ctx = img->decctx;
 
-  de265_error err = imgunit->sao_output.alloc_image(img->get_width(), img->get_height(),
-                                                    img->get_chroma_format(),
-                                                    img->get_shared_sps(),
-                                                    false,
-                                                    img->decctx, //img->encctx,
-                                                    img->pts, img->user_data, true);
-  if (err != DE265_OK) {
-    img->decctx->add_warning(DE265_WARNING_CANNOT_APPLY_SAO_OUT_OF_MEMORY,false);
-    return false;
-  }
+  imgunit->sao_lines.init(img);
 
   int nRows = sps.PicHeightInCtbsY;
 
@@ -501,24 +643,21 @@ bool add_sao_tasks(image_unit* imgunit, int saoInputProgress)
 
   for (int y=0;y<nRows;y++)
     {
-      thread_task_sao* task = new thread_task_sao;
+      thread_task_sao* task = imgunit->sao_tasks.get(ctx->num_allocations);
 
-      task->inputImg  = img;
-      task->outputImg = &imgunit->sao_output;
       task->img = img;
+      task->lines = &imgunit->sao_lines;
       task->ctb_y = y;
       task->inputProgress = saoInputProgress;
 
-      imgunit->tasks.push_back(task);
-      add_task(&ctx->thread_pool_, task);
+      // row y+1 of the input is finished by a task with priority row y+1 (decoding)
+      // or y+3 (horizontal deblocking)
+      task->priority = task_priority(imgunit->decode_order,
+                                     y + (saoInputProgress==CTB_PROGRESS_PREFILTER ? 1 : 3));
+
+      add_task(&ctx->task_queue_, task);
       n++;
     }
 
-  /* Currently need barrier here because when are finished, we have to swap the pixel
-     data back into the main image. */
-  img->wait_for_completion();
-
-  img->exchange_pixel_data_with(imgunit->sao_output);
-
   return true;
 }
@@ -23,13 +23,13 @@
 
 #include "libde265/decctx.h"
 
-void apply_sample_adaptive_offset(de265_image* img);
-
-/* requires less memory than the function above */
-void apply_sample_adaptive_offset_sequential(de265_image* img);
+/* SAO is applied in place. Before a CTB row is filtered, the lines of its boundaries
+   that the neighboring rows need are saved in imgunit->sao_lines. */
+void apply_sample_adaptive_offset_sequential(image_unit* imgunit);
 
 /* saoInputProgress - the CTB progress that SAO will wait for before beginning processing.
    Returns 'true' if any tasks have been added.
+   Each task marks its CTB row as CTB_PROGRESS_COMPLETE.
  */
 bool add_sao_tasks(image_unit* imgunit, int saoInputProgress);
 
@@ -29,9 +29,11 @@
 #include "transform.h"
 #include "threads.h"
 #include "image.h"
+#include "reconstruction.h"
 
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
 #include <stdlib.h>
 
 
@@ -3421,11 +3423,16 @@ int residual_coding(thread_context* tctx,
 }
 
 
-static void decode_TU(thread_context* tctx,
-                      int x0,int y0,
-                      int xCUBase,int yCUBase,
-                      int nT, int cIdx, enum PredMode cuPredMode, bool cbf)
+void decode_TU(thread_context* tctx,
+               int x0,int y0,
+               int xCUBase,int yCUBase,
+               int nT, int cIdx, enum PredMode cuPredMode, bool cbf)
 {
+  if (tctx->recon) {
+    tctx->recon->add_transform_block(tctx, x0,y0, xCUBase,yCUBase, nT, cIdx, cuPredMode, cbf);
+    return;
+  }
+
   de265_image* img = tctx->img;
   const seq_parameter_set& sps = img->get_sps();
 
@@ -4054,6 +4061,23 @@ void read_prediction_unit_SKIP(thread_context* tctx,
 }
 
 
+static void decode_PB(thread_context* tctx,
+                      int xC,int yC, int xB,int yB, int nCS, int nPbW,int nPbH, int partIdx)
+{
+  if (tctx->recon) {
+    PBMotion vi;
+    derive_prediction_unit_motion(tctx->decctx, tctx->shdr, tctx->img, tctx->motion,
+                                  xC,yC, xB,yB, nCS, nPbW,nPbH, partIdx, tctx->task, &vi);
+
+    tctx->recon->add_prediction_block(xC,yC, xB,yB, nCS, nPbW,nPbH, vi);
+  }
+  else {
+    decode_prediction_unit(tctx->decctx, tctx->shdr, tctx->img, tctx->motion,
+                           xC,yC, xB,yB, nCS, nPbW,nPbH, partIdx, tctx->task);
+  }
+}
+
+
 /* xC/yC : CB position
    xB/yB : position offset of the PB
    nPbW/nPbH : size of PB
@@ -4133,8 +4157,7 @@ void read_prediction_unit(thread_context* tctx,
 
 
 
-  decode_prediction_unit(tctx->decctx, tctx->shdr, tctx->img, tctx->motion,
-                         xC,yC,xB,yB, nCS, nPbW,nPbH, partIdx);
+  decode_PB(tctx, xC,yC,xB,yB, nCS, nPbW,nPbH, partIdx);
 }
 
 
@@ -4186,9 +4209,10 @@ static void read_pcm_samples(thread_context* tctx, int x0, int y0, int log2CbSiz
 {
   bitreader br;
   br.data            = tctx->cabac_decoder.bitstream_curr;
-  br.bytes_remaining = tctx->cabac_decoder.bitstream_end - tctx->cabac_decoder.bitstream_curr;
+  br.bytes_remaining = tctx->cabac_decoder.bitstream_data_end - tctx->cabac_decoder.bitstream_curr;
   br.nextbits = 0;
   br.nextbits_cnt = 0;
+  br.ep = tctx->cabac_decoder.ep;
 
 
   if (tctx->img->high_bit_depth(0)) {
@@ -4209,6 +4233,7 @@ static void read_pcm_samples(thread_context* tctx, int x0, int y0, int log2CbSiz
 
   prepare_for_CABAC(&br);
   tctx->cabac_decoder.bitstream_curr = br.data;
+  tctx->cabac_decoder.ep = br.ep;
   init_CABAC_decoder_2(&tctx->cabac_decoder);
 }
 
@@ -4306,8 +4331,7 @@ void read_coding_unit(thread_context* tctx,
     // DECODE
 
     int nCS_L = 1<<log2CbSize;
-    decode_prediction_unit(tctx->decctx,tctx->shdr,tctx->img,tctx->motion,
-                           x0,y0, 0,0, nCS_L, nCS_L,nCS_L, 0);
+    decode_PB(tctx, x0,y0, 0,0, nCS_L, nCS_L,nCS_L, 0);
   }
   else /* not skipped */ {
     if (shdr->slice_type != SLICE_TYPE_I) {
@@ -4729,7 +4753,7 @@ enum DecodeResult decode_substream(thread_context* tctx,
 
     // read and decode CTB
 
-    if (tctx->ctx_model.empty() == false) {
+    if (tctx->ctx_model.empty()) {
       return Decode_Error;
     }
 
@@ -4748,7 +4772,6 @@ enum DecodeResult decode_substream(thread_context* tctx,
         }
 
         tctx->imgunit->ctx_models[ctby] = tctx->ctx_model;
-        tctx->imgunit->ctx_models[ctby].decouple(); // store an independent copy
       }
 
 
@@ -4763,13 +4786,17 @@ enum DecodeResult decode_substream(thread_context* tctx,
 
       if (pps.dependent_slice_segments_enabled_flag) {
         tctx->shdr->ctx_model_storage = tctx->ctx_model;
-        tctx->shdr->ctx_model_storage.decouple(); // store an independent copy
 
         tctx->shdr->ctx_model_storage_defined = true;
       }
     }
 
-    tctx->img->ctb_progress[ctbx+ctby*ctbW].set_progress(CTB_PROGRESS_PREFILTER);
+    if (tctx->recon) {
+      tctx->recon->end_of_CTB(tctx->task, ctbx+ctby*ctbW);
+    }
+    else {
+      tctx->img->ctb_progress[ctbx+ctby*ctbW].set_progress(CTB_PROGRESS_PREFILTER);
+    }
 
     //printf("%p: decoded %d|%d\n",tctx, ctby,ctbx);
 
@@ -4841,12 +4868,6 @@ bool initialize_CABAC_at_slice_segment_start(thread_context* tctx)
   if (shdr->dependent_slice_segment_flag) {
     int prevCtb = pps.CtbAddrTStoRS[ pps.CtbAddrRStoTS[shdr->slice_segment_address] -1 ];
 
-    int sliceIdx = img->get_SliceHeaderIndex_atIndex(prevCtb);
-    if (sliceIdx >= img->slices.size()) {
-      return false;
-    }
-    slice_segment_header* prevCtbHdr = img->slices[ sliceIdx ];
-
     if (pps.is_tile_start_CTB(shdr->slice_segment_address % sps.PicWidthInCtbsY,
                               shdr->slice_segment_address / sps.PicWidthInCtbsY
                               )) {
@@ -4866,6 +4887,28 @@ bool initialize_CABAC_at_slice_segment_start(thread_context* tctx)
 
       prevSliceSegment->finished_threads.wait_for_progress(prevSliceSegment->nThreads);
 
+      // The slice header index of the previous CTB is only valid after it has been decoded.
+      // Independent slice segments may still be decoding in parallel to us.
+
+      int sliceIdx = img->get_SliceHeaderIndex_atIndex(prevCtb);
+      if (sliceIdx >= img->slices.size()) {
+        return false;
+      }
+      slice_segment_header* prevCtbHdr = img->slices[ sliceIdx ];
+
+      // The previous slice may still have been decoding when the thread context was
+      // initialized (see init_thread_context()). Take the QPY at its end now.
+
+      {
+        int ctbX = prevCtb % sps.PicWidthInCtbsY;
+        int ctbY = prevCtb / sps.PicWidthInCtbsY;
+
+        int x = std::min(((ctbX+1) << sps.Log2CtbSizeY)-1, sps.pic_width_in_luma_samples-1);
+        int y = std::min(((ctbY+1) << sps.Log2CtbSizeY)-1, sps.pic_height_in_luma_samples-1);
+
+        tctx->currentQPY = img->get_QPY(x,y);
+      }
+
 
       /*
       printf("wait for %d,%d (init)\n",
@@ -4890,6 +4933,20 @@ bool initialize_CABAC_at_slice_segment_start(thread_context* tctx)
 }
 
 
+/* Count the finished tasks of a slice segment. The last task marks all CTBs
+   of the slice segment as decoded (also those missing in a faulty stream).
+ */
+static void slice_segment_task_finished(thread_context* tctx)
+{
+  slice_unit* sliceunit = tctx->sliceunit;
+
+  if (sliceunit->finished_threads.increase_progress(1) == sliceunit->nThreads) {
+    tctx->decctx->mark_whole_slice_as_processed(tctx->imgunit, sliceunit,
+                                                CTB_PROGRESS_PREFILTER);
+  }
+}
+
+
 std::string thread_task_ctb_row::name() const {
   char buf[100];
   sprintf(buf,"ctb-row-%d",debug_startCtbRow);
@@ -4904,11 +4961,18 @@ std::string thread_task_slice_segment::name() const {
 }
 
 
+thread_task_slice_segment::~thread_task_slice_segment()
+{
+  delete pipeline;
+}
+
+
 void thread_task_slice_segment::work()
 {
   thread_task_slice_segment* data = this;
   thread_context* tctx = data->tctx;
   de265_image* img = tctx->img;
+  reconstruction_pipeline* pipeline = (two_stage ? this->pipeline : NULL);
 
   state = Running;
   img->thread_run(this);
@@ -4920,8 +4984,10 @@ void thread_task_slice_segment::work()
   if (data->firstSliceSubstream) {
     bool success = initialize_CABAC_at_slice_segment_start(tctx);
     if (!success) {
+      if (pipeline) { pipeline->finish(this); } // release the reconstruction task
+
       state = Finished;
-      tctx->sliceunit->finished_threads.increase_progress(1);
+      slice_segment_task_finished(tctx);
       img->thread_finishes(this);
       return;
     }
@@ -4932,10 +4998,17 @@ void thread_task_slice_segment::work()
 
   init_CABAC_decoder_2(&tctx->cabac_decoder);
 
+  tctx->recon = pipeline;
+
   /*enum DecodeResult result =*/ decode_substream(tctx, false, data->firstSliceSubstream);
 
+  if (pipeline) {
+    pipeline->finish(this);
+    tctx->recon = NULL;
+  }
+
   state = Finished;
-  tctx->sliceunit->finished_threads.increase_progress(1);
+  slice_segment_task_finished(tctx);
   img->thread_finishes(this);
 
   return; // DE265_OK;
@@ -4970,7 +5043,7 @@ void thread_task_ctb_row::work()
       }
 
       state = Finished;
-      tctx->sliceunit->finished_threads.increase_progress(1);
+      slice_segment_task_finished(tctx);
       img->thread_finishes(this);
       return;
     }
@@ -5001,7 +5074,7 @@ void thread_task_ctb_row::work()
   }
 
   state = Finished;
-  tctx->sliceunit->finished_threads.increase_progress(1);
+  slice_segment_task_finished(tctx);
   img->thread_finishes(this);
 }
 
@@ -39,6 +39,7 @@
 
 class decoder_context;
 class thread_context;
+class reconstruction_pipeline;
 class error_queue;
 class seq_parameter_set;
 class pic_parameter_set;
@@ -280,6 +281,13 @@ typedef struct {
 
 de265_error read_slice_segment_data(thread_context* tctx);
 
+// Intra prediction and residual of one transform block. In two-stage decoding,
+// the block is only recorded for the reconstruction task.
+void decode_TU(thread_context* tctx,
+               int x0,int y0,
+               int xCUBase,int yCUBase,
+               int nT, int cIdx, enum PredMode cuPredMode, bool cbf);
+
 bool alloc_and_init_significant_coeff_ctxIdx_lookupTable();
 void free_significant_coeff_ctxIdx_lookupTable();
 
@@ -298,10 +306,16 @@ public:
 class thread_task_slice_segment : public thread_task
 {
 public:
+  thread_task_slice_segment() : two_stage(false), pipeline(NULL) { }
+  virtual ~thread_task_slice_segment();
+
   bool   firstSliceSubstream;
   int    debug_startCtbX, debug_startCtbY;
   thread_context* tctx;
 
+  bool two_stage;
+  reconstruction_pipeline* pipeline; // only used in two-stage decoding, kept for reuse
+
   virtual void work();
   virtual std::string name() const;
 };
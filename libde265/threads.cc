@@ -21,6 +21,7 @@
 #include "threads.h"
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
 # include <malloc.h>
@@ -85,9 +86,28 @@ void de265_cond_signal(de265_cond* c) { win32_cond_signal(c); }
 
 
 
+static inline void cpu_relax()
+{
+#if defined(_MSC_VER)
+  YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || (defined(__arm__) && __ARM_ARCH >= 7)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+
+// bounds for the number of spin iterations before a waiting thread goes to sleep
+#define PROGRESS_SPIN_MIN   16
+#define PROGRESS_SPIN_MAX 2048
+
+
 de265_progress_lock::de265_progress_lock()
 {
   mProgress = 0;
+  mWaiters = 0;
+  mSpinLimit = PROGRESS_SPIN_MIN;
 
   de265_mutex_init(&mutex);
   de265_cond_init(&cond);
@@ -101,43 +121,77 @@ de265_progress_lock::~de265_progress_lock()
 
 void de265_progress_lock::wait_for_progress(int progress)
 {
-  if (mProgress >= progress) {
+  if (get_progress() >= progress) {
     return;
   }
 
-  de265_mutex_lock(&mutex);
-  while (mProgress < progress) {
-    de265_cond_wait(&cond, &mutex);
+  // Spin for a while, the progress is often set shortly afterwards (e.g. in WPP).
+  // Adapt the spin limit depending on whether spinning was successful.
+
+  const int spinLimit = mSpinLimit.load(std::memory_order_relaxed);
+
+  for (int i=0;i<spinLimit;i++) {
+    cpu_relax();
+
+    if (get_progress() >= progress) {
+      if (spinLimit < PROGRESS_SPIN_MAX) {
+        mSpinLimit.store(spinLimit*2, std::memory_order_relaxed);
+      }
+      return;
+    }
   }
-  de265_mutex_unlock(&mutex);
-}
 
-void de265_progress_lock::set_progress(int progress)
-{
+  if (spinLimit > PROGRESS_SPIN_MIN) {
+    mSpinLimit.store(spinLimit/2, std::memory_order_relaxed);
+  }
+
+
+  // go to sleep
+
   de265_mutex_lock(&mutex);
 
-  if (progress>mProgress) {
-    mProgress = progress;
+  // Register as waiter before checking the progress again. Since both are sequentially
+  // consistent, either the setter sees the waiter or we see the new progress.
 
-    de265_cond_broadcast(&cond, &mutex);
+  mWaiters.fetch_add(1, std::memory_order_seq_cst);
+
+  while (mProgress.load(std::memory_order_seq_cst) < progress) {
+    de265_cond_wait(&cond, &mutex);
   }
 
+  mWaiters.fetch_sub(1, std::memory_order_relaxed);
+
   de265_mutex_unlock(&mutex);
 }
 
-void de265_progress_lock::increase_progress(int progress)
+void de265_progress_lock::wake_waiters()
 {
-  de265_mutex_lock(&mutex);
+  if (mWaiters.load(std::memory_order_seq_cst) > 0) {
+    de265_mutex_lock(&mutex);
+    de265_cond_broadcast(&cond, &mutex);
+    de265_mutex_unlock(&mutex);
+  }
+}
 
-  mProgress += progress;
-  de265_cond_broadcast(&cond, &mutex);
+void de265_progress_lock::set_progress(int progress)
+{
+  int current = mProgress.load(std::memory_order_relaxed);
 
-  de265_mutex_unlock(&mutex);
+  while (progress > current) {
+    if (mProgress.compare_exchange_weak(current, progress, std::memory_order_seq_cst)) {
+      wake_waiters();
+      return;
+    }
+  }
 }
 
-int  de265_progress_lock::get_progress() const
+int  de265_progress_lock::increase_progress(int progress)
 {
-  return mProgress;
+  int newProgress = mProgress.fetch_add(progress, std::memory_order_seq_cst) + progress;
+
+  wake_waiters();
+
+  return newProgress;
 }
 
 
@@ -186,84 +240,504 @@ void printblks(const thread_pool* pool)
 #endif
 
 
+task_fifo::task_fifo()
+{
+  ring* r = new ring;
+  r->size  = 64;
+  r->items = new std::atomic<thread_task*>[r->size];
+  r->prev  = NULL;
+
+  top    = 0;
+  bottom = 0;
+  array  = r;
+}
+
+
+task_fifo::~task_fifo()
+{
+  ring* r = array.load(std::memory_order_relaxed);
+  while (r) {
+    ring* prev = r->prev;
+    delete[] r->items;
+    delete r;
+    r = prev;
+  }
+}
+
+
+task_fifo::ring* task_fifo::grow(ring* r, int64_t b, int64_t t)
+{
+  ring* n = new ring;
+  n->size  = r->size*2;
+  n->items = new std::atomic<thread_task*>[n->size];
+  n->prev  = r;
+
+  for (int64_t i=t; i<b; i++) {
+    (*n)[i].store((*r)[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  array.store(n, std::memory_order_release);
+  return n;
+}
+
+
+void task_fifo::push(thread_task* task)
+{
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_acquire);
+  ring* r = array.load(std::memory_order_relaxed);
+
+  if (b-t > r->size-1) {
+    r = grow(r,b,t);
+  }
+
+  (*r)[b].store(task, std::memory_order_relaxed);
+  bottom.store(b+1, std::memory_order_release);
+}
+
+
+thread_task* task_fifo::pop()
+{
+  return pop_if_empty(*this);
+}
+
+
+thread_task* task_fifo::pop_if_empty(const task_fifo& own)
+{
+  int64_t t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom.load(std::memory_order_acquire);
+
+  if (t >= b) {
+    return NULL;
+  }
+
+  ring* r = array.load(std::memory_order_acquire);
+  thread_task* task = (*r)[t].load(std::memory_order_relaxed);
+
+  if (&own != this && !own.empty()) {
+    return NULL;
+  }
+
+  if (!top.compare_exchange_strong(t, t+1,
+                                   std::memory_order_seq_cst,
+                                   std::memory_order_relaxed)) {
+    return NULL; // lost the race against another worker
+  }
+
+  return task;
+}
+
+
+bool task_fifo::empty() const
+{
+  int64_t t = top.load(std::memory_order_acquire);
+  int64_t b = bottom.load(std::memory_order_acquire);
+  return t >= b;
+}
+
+
+void task_fifo::clear()
+{
+  top.store(bottom.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+
+
+/* Take the next task, preferring the own queue. We may only take tasks from other workers
+   when the own queue is empty. Otherwise, we could start a task while an earlier task
+   in our own queue (on which the other task may depend) is still waiting for us.
+   New tasks may arrive in the own queue meanwhile. pop_if_empty() ensures that these
+   are queued later than the task that we take.
+ */
+static thread_task* get_next_task(thread_pool* pool, int id)
+{
+  task_fifo& own = *pool->queues[id];
+
+  while (!own.empty()) {
+    thread_task* task = own.pop();
+    if (task) {
+      return task;
+    }
+  }
+
+  for (int i=1;i<pool->num_threads;i++) {
+    int victim = (id+i) % pool->num_threads;
+
+    thread_task* task = pool->queues[victim]->pop_if_empty(own);
+    if (task) {
+      return task;
+    }
+
+    if (!own.empty()) {
+      return get_next_task(pool, id);
+    }
+  }
+
+  return NULL;
+}
+
+
+static bool have_queued_tasks(const thread_pool* pool)
+{
+  if (pool->num_tasks_pending > 0) {
+    return true;
+  }
+
+  for (int i=0;i<pool->num_threads;i++) {
+    if (!pool->queues[i]->empty()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+// number of tasks per worker that may be waiting in the worker queues
+#define DISPATCHED_TASKS_PER_THREAD 2
+
+
+/* Move tasks from the task_queues into the worker queues, taking one task from each
+   attached queue in turn. Must be called with push_mutex locked.
+   Returns the number of dispatched tasks.
+ */
+static int dispatch_tasks(thread_pool* pool)
+{
+  const int maxDispatched = pool->num_threads * DISPATCHED_TASKS_PER_THREAD;
+  const int nClients = pool->clients.size();
+
+  int nDispatched = 0;
+  int nEmptyClients = 0;
+
+  while (nEmptyClients < nClients &&
+         pool->num_tasks_dispatched < maxDispatched) {
+
+    task_queue* queue = pool->clients[pool->next_client];
+    pool->next_client = (pool->next_client+1) % nClients;
+
+    if (queue->empty()) {
+      nEmptyClients++;
+      continue;
+    }
+
+    nEmptyClients = 0;
+
+    thread_task* task = queue->pop();
+
+    pool->num_tasks_dispatched++;
+    pool->num_tasks_pending--;
+
+    pool->queues[pool->next_queue]->push(task);
+    pool->next_queue = (pool->next_queue+1) % pool->num_threads;
+
+    nDispatched++;
+  }
+
+  return nDispatched;
+}
+
+
+static void wake_up_workers(thread_pool* pool, int nTasks)
+{
+  // wake up threads, but only if there are sleeping ones
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (nTasks>0 && pool->num_threads_sleeping > 0) {
+    de265_mutex_lock(&pool->mutex);
+    if (nTasks==1) { de265_cond_signal(&pool->cond_var); }
+    else           { de265_cond_broadcast(&pool->cond_var, &pool->mutex); }
+    de265_mutex_unlock(&pool->mutex);
+  }
+}
+
+
+static void refill_worker_queues(thread_pool* pool)
+{
+  de265_mutex_lock(&pool->push_mutex);
+  int nDispatched = dispatch_tasks(pool);
+  de265_mutex_unlock(&pool->push_mutex);
+
+  wake_up_workers(pool, nDispatched-1); // we take one of the tasks ourselves
+}
+
+
+// number of unsuccessful rounds through all queues before a worker goes to sleep
+#define WORKER_SPIN_ROUNDS 64
+
+
 static THREAD_RESULT_TYPE THREAD_CALLING_CONVENTION worker_thread(THREAD_PARAM_TYPE pool_ptr)
 {
   thread_pool* pool = (thread_pool*)pool_ptr;
 
-
-  de265_mutex_lock(&pool->mutex);
+  const int id = pool->num_threads_started++;
 
   while(true) {
 
-    // wait until we can pick a task or until the pool has been stopped
+    // try to get a task, spinning for a short while before going to sleep
 
-    for (;;) {
-      // end waiting if thread-pool has been stopped or we have a task to execute
+    thread_task* task = NULL;
 
-      if (pool->stopped || pool->tasks.size()>0) {
+    for (int spin=0; spin<WORKER_SPIN_ROUNDS && !pool->stopped; spin++) {
+      task = get_next_task(pool, id);
+      if (task) {
+        pool->num_tasks_dispatched--;
         break;
       }
 
-      //printf("going idle\n");
-      de265_cond_wait(&pool->cond_var, &pool->mutex);
+      if (pool->num_tasks_pending > 0) {
+        refill_worker_queues(pool);
+      }
     }
 
     // if the pool was shut down, end the execution
 
     if (pool->stopped) {
-      de265_mutex_unlock(&pool->mutex);
       return (THREAD_RESULT_TYPE)0;
     }
 
+    if (task == NULL) {
+      // No work available. Announce that we are going to sleep before the final check,
+      // such that add_task() will either see us sleeping, or we see its new task.
 
-    // get a task
+      de265_mutex_lock(&pool->mutex);
 
-    thread_task* task = pool->tasks.front();
-    pool->tasks.pop_front();
+      pool->num_threads_sleeping++;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    pool->num_threads_working++;
+      while (!pool->stopped && !have_queued_tasks(pool)) {
+        //printf("going idle\n");
+        de265_cond_wait(&pool->cond_var, &pool->mutex);
+      }
 
-    //printblks(pool);
+      pool->num_threads_sleeping--;
 
-    de265_mutex_unlock(&pool->mutex);
+      de265_mutex_unlock(&pool->mutex);
+      continue;
+    }
 
 
     // execute the task
 
-    task->work();
+    pool->num_threads_working++;
 
-    // end processing and check if this was the last task to be processed
+    //printblks(pool);
 
-    de265_mutex_lock(&pool->mutex);
+    task->work();
 
     pool->num_threads_working--;
   }
-  de265_mutex_unlock(&pool->mutex);
 
   return (THREAD_RESULT_TYPE)0;
 }
 
 
-de265_error start_thread_pool(thread_pool* pool, int num_threads)
+thread_pool::thread_pool()
+{
+  stopped = true;
+  next_queue = 0;
+  next_client = 0;
+  num_tasks_pending = 0;
+  num_tasks_dispatched = 0;
+  num_threads = 0;
+  num_threads_started = 0;
+  num_threads_working = 0;
+  num_threads_sleeping = 0;
+}
+
+
+thread_pool::~thread_pool()
+{
+  for (int i=0;i<queues.size();i++) {
+    delete queues[i];
+  }
+}
+
+
+// --- binding of worker threads to CPUs ---
+
+#if defined(__linux__)
+#include <sched.h>
+#include <algorithm>
+
+struct cpu_topology_entry
+{
+  int cpu;
+  int package;     // physical_package_id
+  int core;        // core_id, unique only within the package
+  int core_index;  // enumerates the cores of a package
+  int smt_index;   // enumerates the hardware threads of a core
+};
+
+
+static int read_cpu_topology_value(int cpu, const char* name, int default_value)
+{
+  char path[256];
+  sprintf(path,"/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+  FILE* fh = fopen(path,"r");
+  if (fh==NULL) {
+    return default_value;
+  }
+
+  int value;
+  if (fscanf(fh,"%d",&value) != 1) {
+    value = default_value;
+  }
+
+  fclose(fh);
+  return value;
+}
+
+
+static bool compare_topology(const cpu_topology_entry& a, const cpu_topology_entry& b)
+{
+  if (a.package != b.package) return a.package < b.package;
+  if (a.core    != b.core)    return a.core    < b.core;
+  return a.cpu < b.cpu;
+}
+
+
+static bool compare_compact(const cpu_topology_entry& a, const cpu_topology_entry& b)
+{
+  if (a.package   != b.package)   return a.package   < b.package;
+  if (a.smt_index != b.smt_index) return a.smt_index < b.smt_index;
+  if (a.core      != b.core)      return a.core      < b.core;
+  return a.cpu < b.cpu;
+}
+
+
+static bool compare_scatter(const cpu_topology_entry& a, const cpu_topology_entry& b)
+{
+  if (a.smt_index  != b.smt_index)  return a.smt_index  < b.smt_index;
+  if (a.core_index != b.core_index) return a.core_index < b.core_index;
+  if (a.package    != b.package)    return a.package    < b.package;
+  return a.cpu < b.cpu;
+}
+
+
+/* Get the CPUs that we may run on in the order in which the worker threads are assigned.
+   'compact' fills the physical cores of a package first, then their SMT siblings, and then
+   continues with the next package. 'scatter' assigns the cores round-robin to the packages.
+ */
+static std::vector<int> get_cpu_placement_order(enum de265_thread_placement placement)
+{
+  std::vector<int> order;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return order;
+  }
+
+  std::vector<cpu_topology_entry> cpus;
+  for (int cpu=0; cpu<CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed)) {
+      cpu_topology_entry e;
+      e.cpu     = cpu;
+      e.package = read_cpu_topology_value(cpu, "physical_package_id", 0);
+      e.core    = read_cpu_topology_value(cpu, "core_id", cpu);
+      cpus.push_back(e);
+    }
+  }
+
+  // enumerate the cores within each package and the hardware threads within each core
+
+  std::sort(cpus.begin(), cpus.end(), compare_topology);
+
+  for (int i=0;i<cpus.size();i++) {
+    cpus[i].smt_index  = 0;
+    cpus[i].core_index = 0;
+
+    for (int k=0;k<i;k++) {
+      if (cpus[k].package == cpus[i].package) {
+        if (cpus[k].core == cpus[i].core) {
+          cpus[i].smt_index++;
+        }
+      }
+    }
+  }
+
+  for (int i=0;i<cpus.size();i++) {
+    for (int k=0;k<cpus.size();k++) {
+      if (cpus[k].package == cpus[i].package &&
+          cpus[k].smt_index == 0 &&
+          cpus[k].core < cpus[i].core) {
+        cpus[i].core_index++;
+      }
+    }
+  }
+
+  if (placement == de265_thread_placement_scatter) {
+    std::sort(cpus.begin(), cpus.end(), compare_scatter);
+  }
+  else {
+    std::sort(cpus.begin(), cpus.end(), compare_compact);
+  }
+
+  for (int i=0;i<cpus.size();i++) {
+    order.push_back(cpus[i].cpu);
+  }
+
+  return order;
+}
+
+
+static void bind_thread_to_cpu(de265_thread thread, int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  pthread_setaffinity_np(thread, sizeof(set), &set); // ignore errors, placement is only a hint
+}
+#else
+static std::vector<int> get_cpu_placement_order(enum de265_thread_placement placement)
+{
+  return std::vector<int>(); // not supported
+}
+
+static void bind_thread_to_cpu(de265_thread thread, int cpu) { }
+#endif
+
+
+de265_error start_thread_pool(thread_pool* pool, int num_threads,
+                              enum de265_thread_placement placement)
 {
   de265_error err = DE265_OK;
 
-  // limit number of threads to maximum
+  for (int i=0;i<pool->queues.size();i++) {
+    delete pool->queues[i];
+  }
 
-  if (num_threads > MAX_THREADS) {
-    num_threads = MAX_THREADS;
-    err = DE265_WARNING_NUMBER_OF_THREADS_LIMITED_TO_MAXIMUM;
+  pool->queues.resize(num_threads);
+  for (int i=0;i<num_threads;i++) {
+    pool->queues[i] = new task_fifo;
   }
 
-  pool->num_threads = 0; // will be increased below
+  pool->thread.resize(num_threads);
+  pool->ctbx.resize(num_threads);
+  pool->ctby.resize(num_threads);
+
+  pool->num_threads = num_threads;
+  pool->next_queue = 0;
+  pool->next_client = 0;
+  pool->num_tasks_pending = 0;
+  pool->num_tasks_dispatched = 0;
+  pool->num_threads_started = 0;
+  pool->num_threads_working = 0;
+  pool->num_threads_sleeping = 0;
+  pool->stopped = false;
 
+  de265_mutex_init(&pool->push_mutex);
   de265_mutex_init(&pool->mutex);
   de265_cond_init(&pool->cond_var);
 
-  de265_mutex_lock(&pool->mutex);
-  pool->num_threads_working = 0;
-  pool->stopped = false;
-  de265_mutex_unlock(&pool->mutex);
+  std::vector<int> cpus;
+  if (placement != de265_thread_placement_none) {
+    cpus = get_cpu_placement_order(placement);
+  }
 
   // start worker threads
 
@@ -271,10 +745,20 @@ de265_error start_thread_pool(thread_pool* pool, int num_threads)
     int ret = de265_thread_create(&pool->thread[i], worker_thread, pool);
     if (ret != 0) {
       // cerr << "pthread_create() failed: " << ret << endl;
+
+      // shut down the threads that could be started
+
+      std::vector<de265_thread>::iterator end = pool->thread.begin()+i;
+      pool->thread.erase(end, pool->thread.end());
+      stop_thread_pool(pool);
+
+      pool->num_threads = 0;
       return DE265_ERROR_CANNOT_START_THREADPOOL;
     }
 
-    pool->num_threads++;
+    if (!cpus.empty()) {
+      bind_thread_to_cpu(pool->thread[i], cpus[i % cpus.size()]);
+    }
   }
 
   return err;
@@ -289,26 +773,108 @@ void stop_thread_pool(thread_pool* pool)
 
   de265_cond_broadcast(&pool->cond_var, &pool->mutex);
 
-  for (int i=0;i<pool->num_threads;i++) {
+  for (int i=0;i<pool->thread.size();i++) {
     de265_thread_join(pool->thread[i]);
     de265_thread_destroy(&pool->thread[i]);
   }
 
+  pool->thread.clear();
+
+  de265_mutex_destroy(&pool->push_mutex);
   de265_mutex_destroy(&pool->mutex);
   de265_cond_destroy(&pool->cond_var);
 }
 
 
-void   add_task(thread_pool* pool, thread_task* task)
+bool task_queue::entry::operator<(const entry& e) const
 {
-  de265_mutex_lock(&pool->mutex);
-  if (!pool->stopped) {
+  // std::push_heap() keeps the largest element on top, hence the reversed comparison
+
+  if (priority != e.priority) {
+    return priority > e.priority;
+  }
+
+  return sequence_number > e.sequence_number;
+}
+
 
-    pool->tasks.push_back(task);
+void task_queue::push(thread_task* task)
+{
+  entry e;
+  e.priority = task->priority;
+  e.sequence_number = next_sequence_number++;
+  e.task = task;
+
+  tasks.push_back(e);
+  std::push_heap(tasks.begin(), tasks.end());
+}
+
+
+thread_task* task_queue::pop()
+{
+  assert(!tasks.empty());
+
+  std::pop_heap(tasks.begin(), tasks.end());
+  thread_task* task = tasks.back().task;
+  tasks.pop_back();
+
+  return task;
+}
 
-    // wake up one thread
 
-    de265_cond_signal(&pool->cond_var);
+void attach_task_queue(thread_pool* pool, task_queue* queue)
+{
+  de265_mutex_lock(&pool->push_mutex);
+  pool->clients.push_back(queue);
+  queue->pool = pool;
+  de265_mutex_unlock(&pool->push_mutex);
+}
+
+
+void detach_task_queue(task_queue* queue)
+{
+  thread_pool* pool = queue->pool;
+  if (pool==NULL) {
+    return;
   }
-  de265_mutex_unlock(&pool->mutex);
+
+  de265_mutex_lock(&pool->push_mutex);
+
+  for (int i=0;i<pool->clients.size();i++) {
+    if (pool->clients[i] == queue) {
+      pool->clients.erase(pool->clients.begin()+i);
+      break;
+    }
+  }
+
+  if (pool->next_client >= pool->clients.size()) {
+    pool->next_client = 0;
+  }
+
+  pool->num_tasks_pending -= queue->size();
+  queue->clear();
+  queue->pool = NULL;
+
+  de265_mutex_unlock(&pool->push_mutex);
+}
+
+
+void   add_task(task_queue* queue, thread_task* task)
+{
+  thread_pool* pool = queue->pool;
+
+  if (pool==NULL || pool->stopped) {
+    return;
+  }
+
+  de265_mutex_lock(&pool->push_mutex);
+
+  queue->push(task);
+  pool->num_tasks_pending++;
+
+  int nDispatched = dispatch_tasks(pool);
+
+  de265_mutex_unlock(&pool->push_mutex);
+
+  wake_up_workers(pool, nDispatched);
 }
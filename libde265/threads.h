@@ -32,8 +32,10 @@
 #endif
 
 #include <deque>
+#include <vector>
 #include <string>
 #include <atomic>
+#include <stdint.h>
 
 #ifndef _WIN32
 #include <pthread.h>
@@ -75,6 +77,11 @@ void de265_cond_wait(de265_cond* c,de265_mutex* m);
 void de265_cond_signal(de265_cond* c);
 
 
+/* Progress counter that threads can wait on.
+   The counter is atomic and only monotonically increased. Waiters spin for a short
+   while before they go to sleep on the condition variable. Setting the progress only
+   takes the mutex when there are sleeping waiters.
+ */
 class de265_progress_lock
 {
 public:
@@ -83,66 +90,193 @@ public:
 
   void wait_for_progress(int progress);
   void set_progress(int progress);
-  void increase_progress(int progress);
-  int  get_progress() const;
-  void reset(int value=0) { mProgress=value; }
+  int  increase_progress(int progress); // returns the new progress
+  int  get_progress() const { return mProgress.load(std::memory_order_acquire); }
+  void reset(int value=0) { mProgress.store(value, std::memory_order_relaxed); }
 
 private:
-  int mProgress;
+  std::atomic<int> mProgress;
+  std::atomic<int> mWaiters;   // number of threads sleeping on 'cond'
+  std::atomic<int> mSpinLimit; // adapted to how long we typically have to wait
+
+  void wake_waiters();
 
   // private data
 
   de265_mutex mutex;
   de265_cond  cond;
+
+  de265_progress_lock(const de265_progress_lock&); // not copyable
+  de265_progress_lock& operator=(const de265_progress_lock&);
 };
 
 
 
+/* Tasks with a smaller priority value are handed to the workers first.
+   A task may only wait for tasks with a smaller or equal priority value
+   (and tasks with equal values are run in the order in which they were queued).
+   Decoder tasks are ordered by picture decoding order first and then by the
+   last CTB row they wait for.
+ */
+inline int64_t task_priority(int64_t picture, int ctbRow)
+{
+  return (picture << 24) + ctbRow;
+}
+
+
 class thread_task
 {
 public:
-  thread_task() : state(Queued) { }
+  thread_task() : state(Queued), priority(0) { }
   virtual ~thread_task() { }
 
   enum { Queued, Running, Blocked, Finished } state;
 
+  int64_t priority; // see task_priority()
+
   virtual void work() = 0;
 
   virtual std::string name() const { return "noname"; }
 };
 
 
-#define MAX_THREADS 32
+/* FIFO of the tasks that have been dispatched to one worker. Tasks are appended at the
+   bottom by one producer at a time (dispatch_tasks() holds the pool's push_mutex). The
+   owner and the other workers take them from the top without a lock, by a CAS on 'top'.
+   The ring buffer is the one of a Chase-Lev deque, but there is no LIFO end for the
+   owner: tasks block while waiting for tasks that were queued earlier, so each queue has
+   to be processed in FIFO order to prevent deadlocks.
+ */
+class task_fifo
+{
+ public:
+  task_fifo();
+  ~task_fifo();
+
+  void push(thread_task* task); // producer only
+  thread_task* pop();           // any thread, returns NULL if empty or on contention
+
+  /* Like pop(), but gives up when 'own' is not empty once the task has been observed.
+     Everything pushed to 'own' afterwards was queued later than the taken task. */
+  thread_task* pop_if_empty(const task_fifo& own);
+
+  bool empty() const;
+  void clear();                 // only when no worker is running
+
+ private:
+  struct ring {
+    int64_t size; // power of two
+    std::atomic<thread_task*>* items;
+    ring* prev;   // old rings are kept alive until destruction, there may still be readers
+
+    std::atomic<thread_task*>& operator[](int64_t i) { return items[i & (size-1)]; }
+  };
+
+  std::atomic<int64_t> top;
+  std::atomic<int64_t> bottom;
+  std::atomic<ring*>   array;
+
+  ring* grow(ring* r, int64_t b, int64_t t);
+
+  task_fifo(const task_fifo&); // not copyable
+  task_fifo& operator=(const task_fifo&);
+};
 
-/* TODO NOTE: When unblocking a task, we have to check first
-   if there are threads waiting because of the run-count limit.
-   If there are higher-priority tasks, those should be run instead
-   of the just unblocked task.
+
+class thread_pool;
+
+/* The tasks of one context (a decoder) that uses a thread_pool. Several task queues
+   can be attached to the same pool. The tasks of the attached queues are handed to
+   the workers in round-robin order, such that no context can starve the others.
+   Within one queue, the task with the smallest priority value is handed out first.
+   All methods are protected by pool->push_mutex.
+ */
+class task_queue
+{
+ public:
+  task_queue() : pool(NULL), next_sequence_number(0) { }
+
+  thread_pool* pool; // NULL when not attached
+
+  void push(thread_task* task);
+  thread_task* pop();
+
+  bool empty() const { return tasks.empty(); }
+  int  size() const { return tasks.size(); }
+  void clear() { tasks.clear(); }
+
+ private:
+  struct entry {
+    int64_t priority;
+    int64_t sequence_number; // FIFO order among tasks with the same priority
+    thread_task* task;
+
+    bool operator<(const entry& e) const; // heap order, the top is the next task to run
+  };
+
+  std::vector<entry> tasks; // not handed to the workers yet
+  int64_t next_sequence_number;
+};
+
+
+/* Since the worker queues are FIFO and only hold a few tasks, the priorities decide
+   which tasks are started next. Blocked tasks keep their worker until they can continue.
+   All tasks pass through push_mutex: add_task() and idle workers move them from the
+   task_queues into the worker queues in priority order. Only taking a task from the
+   worker queues is lock-free.
  */
 
 class thread_pool
 {
  public:
-  bool stopped;
+  thread_pool();
+  ~thread_pool();
+
+  std::atomic<bool> stopped;
 
-  std::deque<thread_task*> tasks;  // we are not the owner
+  /* Each worker takes tasks from its own queue first and only takes tasks from the
+     other queues when its own queue is empty. New tasks are distributed round-robin. */
+  std::vector<task_fifo*> queues; // one per worker, we are not the owner of the tasks
+  int next_queue;                  // protected by push_mutex
 
-  de265_thread thread[MAX_THREADS];
+  /* Only a limited number of tasks is moved from the task_queues into the worker queues.
+     Since a task only waits for tasks with a smaller or equal priority, which are
+     handed out first, tasks still only wait for tasks that are in the worker queues already. */
+  std::vector<task_queue*> clients; // protected by push_mutex
+  int next_client;                  // protected by push_mutex
+  std::atomic<int> num_tasks_pending;    // tasks in the task_queues
+  std::atomic<int> num_tasks_dispatched; // tasks in the worker queues
+
+  std::vector<de265_thread> thread;
   int num_threads;
+  std::atomic<int> num_threads_started; // used to assign the worker index
+
+  std::atomic<int> num_threads_working;
+  std::atomic<int> num_threads_sleeping;
 
-  int num_threads_working;
+  std::vector<int> ctbx; // the CTB the thread is working on
+  std::vector<int> ctby;
 
-  int ctbx[MAX_THREADS]; // the CTB the thread is working on
-  int ctby[MAX_THREADS];
+  de265_mutex  push_mutex; // serializes moving tasks into the worker queues
 
-  de265_mutex  mutex;
+  de265_mutex  mutex;      // only for parking idle workers
   de265_cond   cond_var;
+
+ private:
+  thread_pool(const thread_pool&); // not copyable
+  thread_pool& operator=(const thread_pool&);
 };
 
 
-de265_error start_thread_pool(thread_pool* pool, int num_threads);
+/* Start 'num_threads' workers. When a placement policy is given, each worker is bound to
+   one CPU, chosen according to the CPU topology (currently only on Linux). */
+de265_error start_thread_pool(thread_pool* pool, int num_threads,
+                              enum de265_thread_placement placement = de265_thread_placement_none);
 void        stop_thread_pool(thread_pool* pool); // do not process remaining tasks
 
-void        add_task(thread_pool* pool, thread_task* task); // TOCO: can make thread_task const
+void        attach_task_queue(thread_pool* pool, task_queue* queue);
+void        detach_task_queue(task_queue* queue); // do not process remaining tasks
+
+void        add_task(task_queue* queue, thread_task* task); // TOCO: can make thread_task const
 
 #endif
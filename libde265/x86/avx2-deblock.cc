@@ -0,0 +1,576 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <immintrin.h>
+
+#include "x86/avx2-deblock.h"
+#include "libde265/util.h"
+
+
+/* Two edge segments (8 lines) are filtered at once. Each 32-bit lane holds one line across
+   the edge, the first segment is in the lower 128-bit lane and the second segment in the
+   upper one. Samples p[i] and q[i] are at distance i from the edge.
+
+   Since the segments are in separate 128-bit lanes, the filter decisions of each segment
+   (from its lines 0 and 3) are computed with in-lane shuffles and all segment parameters
+   (beta, tc, filterP, filterQ) are per-lane vectors.
+
+   Vertical edges are loaded row by row as 16-bit values and transposed.
+   Rows of segments that are not filtered are not written back.
+ */
+
+
+namespace {
+
+// --- one row of N samples, as 16-bit values ---
+
+template <int N> inline __m128i load_row(const uint8_t* p);
+template <int N> inline __m128i load_row(const uint16_t* p);
+template <int N> inline void store_row(uint8_t* p, __m128i v);
+template <int N> inline void store_row(uint16_t* p, __m128i v);
+
+template <> inline __m128i load_row<8>(const uint8_t* p)
+{
+  return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p));
+}
+
+template <> inline __m128i load_row<4>(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtepu8_epi16(_mm_cvtsi32_si128(v));
+}
+
+template <> inline __m128i load_row<8>(const uint16_t* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+template <> inline __m128i load_row<4>(const uint16_t* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template <> inline void store_row<8>(uint8_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(v,v));
+}
+
+template <> inline void store_row<4>(uint8_t* p, __m128i v)
+{
+  int32_t w = _mm_cvtsi128_si32(_mm_packus_epi16(v,v));
+  memcpy(p,&w,4);
+}
+
+template <> inline void store_row<8>(uint16_t* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+template <> inline void store_row<4>(uint16_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+
+inline void transpose_8x8_16(__m128i r[8])
+{
+  __m128i a0 = _mm_unpacklo_epi16(r[0],r[1]);
+  __m128i a1 = _mm_unpackhi_epi16(r[0],r[1]);
+  __m128i a2 = _mm_unpacklo_epi16(r[2],r[3]);
+  __m128i a3 = _mm_unpackhi_epi16(r[2],r[3]);
+  __m128i a4 = _mm_unpacklo_epi16(r[4],r[5]);
+  __m128i a5 = _mm_unpackhi_epi16(r[4],r[5]);
+  __m128i a6 = _mm_unpacklo_epi16(r[6],r[7]);
+  __m128i a7 = _mm_unpackhi_epi16(r[6],r[7]);
+
+  __m128i b0 = _mm_unpacklo_epi32(a0,a2);
+  __m128i b1 = _mm_unpackhi_epi32(a0,a2);
+  __m128i b2 = _mm_unpacklo_epi32(a1,a3);
+  __m128i b3 = _mm_unpackhi_epi32(a1,a3);
+  __m128i b4 = _mm_unpacklo_epi32(a4,a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4,a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5,a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5,a7);
+
+  r[0] = _mm_unpacklo_epi64(b0,b4);
+  r[1] = _mm_unpackhi_epi64(b0,b4);
+  r[2] = _mm_unpacklo_epi64(b1,b5);
+  r[3] = _mm_unpackhi_epi64(b1,b5);
+  r[4] = _mm_unpacklo_epi64(b2,b6);
+  r[5] = _mm_unpackhi_epi64(b2,b6);
+  r[6] = _mm_unpacklo_epi64(b3,b7);
+  r[7] = _mm_unpackhi_epi64(b3,b7);
+}
+
+
+/* Load N samples (N/2 on each side) of 'nLines' (4 or 8) lines across a vertical edge.
+   col[i] holds the samples at position i-N/2 relative to the edge. */
+template <int N, class pixel_t>
+inline void load_vertical_edge(const pixel_t* ptr, ptrdiff_t stride, int nLines, __m256i col[N])
+{
+  __m128i r[8];
+  for (int k=0;k<8;k++) {
+    r[k] = (k<nLines) ? load_row<N>(ptr + k*stride - N/2) : _mm_setzero_si128();
+  }
+
+  transpose_8x8_16(r);
+
+  for (int i=0;i<N;i++) {
+    col[i] = _mm256_cvtepu16_epi32(r[i]);
+  }
+}
+
+// write back the lines of the segments in 'segments' (bit 0: first segment, bit 1: second segment)
+template <int N, class pixel_t>
+inline void store_vertical_edge(pixel_t* ptr, ptrdiff_t stride, int segments, const __m256i col[N])
+{
+  __m128i r[8];
+  for (int i=0;i<N;i++) {
+    r[i] = _mm_packus_epi32(_mm256_castsi256_si128(col[i]), _mm256_extracti128_si256(col[i],1));
+  }
+  for (int i=N;i<8;i++) {
+    r[i] = _mm_setzero_si128();
+  }
+
+  transpose_8x8_16(r);
+
+  for (int k=0;k<8;k++) {
+    if (segments & (1<<(k/4))) {
+      store_row<N>(ptr + k*stride - N/2, r[k]);
+    }
+  }
+}
+
+
+// 'nLines' (4 or 8) samples along a horizontal edge
+
+inline __m256i load_line(const uint8_t* p, int nLines)
+{
+  if (nLines==8) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+  }
+  else {
+    int32_t v;
+    memcpy(&v,p,4);
+    return _mm256_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+  }
+}
+
+inline __m256i load_line(const uint16_t* p, int nLines)
+{
+  if (nLines==8) {
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+  }
+  else {
+    return _mm256_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+  }
+}
+
+inline void store_line(uint8_t* p, int segments, __m256i v)
+{
+  __m128i v8 = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v,1));
+  v8 = _mm_packus_epi16(v8,v8);
+
+  if (segments==3) {
+    _mm_storel_epi64((__m128i*)p, v8);
+  }
+  else if (segments==1) {
+    int32_t w = _mm_cvtsi128_si32(v8);
+    memcpy(p,&w,4);
+  }
+  else if (segments==2) {
+    int32_t w = _mm_extract_epi32(v8,1);
+    memcpy(p+4,&w,4);
+  }
+}
+
+inline void store_line(uint16_t* p, int segments, __m256i v)
+{
+  __m128i v16 = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v,1));
+
+  if (segments==3) {
+    _mm_storeu_si128((__m128i*)p, v16);
+  }
+  else if (segments==1) {
+    _mm_storel_epi64((__m128i*)p, v16);
+  }
+  else if (segments==2) {
+    _mm_storel_epi64((__m128i*)(p+4), _mm_srli_si128(v16,8));
+  }
+}
+
+
+// --- per-segment values ---
+
+inline __m256i segment_values(int v0, int v1)
+{
+  return _mm256_setr_epi32(v0,v0,v0,v0, v1,v1,v1,v1);
+}
+
+inline __m256i segment_mask(bool m0, bool m1)
+{
+  return segment_values(m0 ? -1 : 0, m1 ? -1 : 0);
+}
+
+// bit 0: some lane of the first segment is set, bit 1: some lane of the second segment
+inline int segments_in_mask(__m256i mask)
+{
+  int m = _mm256_movemask_ps(_mm256_castsi256_ps(mask));
+  return ((m & 0x0F) ? 1 : 0) | ((m & 0xF0) ? 2 : 0);
+}
+
+// sum of lines 0 and 3 of each segment, in all lanes of the segment
+inline __m256i sum_lines_0_3(__m256i v)
+{
+  return _mm256_add_epi32(_mm256_shuffle_epi32(v, 0x00), _mm256_shuffle_epi32(v, 0xFF));
+}
+
+inline __m256i clip_to_range(__m256i v, __m256i lo, __m256i hi)
+{
+  return _mm256_min_epi32(_mm256_max_epi32(v,lo),hi);
+}
+
+// Clip3(x-r, x+r, v)
+inline __m256i clip_around(__m256i v, __m256i x, __m256i r)
+{
+  return clip_to_range(v, _mm256_sub_epi32(x,r), _mm256_add_epi32(x,r));
+}
+
+}
+
+
+// filter one or two segments
+
+template <class pixel_t>
+static void deblock_luma_segments_avx2(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                       const int* beta_in, const int* tc_in,
+                                       const bool* filterP_in, const bool* filterQ_in,
+                                       int bit_depth)
+{
+  bool two = (nSegments==2);
+
+  const __m256i zero = _mm256_setzero_si256();
+
+  const __m256i tc   = segment_values(tc_in[0],   two ? tc_in[1]   : 0);
+  const __m256i beta = segment_values(beta_in[0], two ? beta_in[1] : 0);
+  const __m256i filterP = segment_mask(filterP_in[0], two && filterP_in[1]);
+  const __m256i filterQ = segment_mask(filterQ_in[0], two && filterQ_in[1]);
+
+  __m256i active = _mm256_and_si256(_mm256_cmpgt_epi32(tc,zero), _mm256_or_si256(filterP,filterQ));
+  if (_mm256_testz_si256(active,active)) {
+    return;
+  }
+
+  const int nLines = 4*nSegments;
+
+  __m256i p[4],q[4];
+
+  if (vertical) {
+    __m256i col[8];
+    load_vertical_edge<8>(ptr, stride, nLines, col);
+
+    for (int i=0;i<4;i++) {
+      p[i] = col[3-i];
+      q[i] = col[4+i];
+    }
+  }
+  else {
+    for (int i=0;i<4;i++) {
+      p[i] = load_line(ptr - (i+1)*stride, nLines);
+      q[i] = load_line(ptr +  i   *stride, nLines);
+    }
+  }
+
+
+  // decisions
+
+  __m256i dp  = _mm256_abs_epi32(_mm256_add_epi32(_mm256_sub_epi32(p[2], _mm256_slli_epi32(p[1],1)), p[0]));
+  __m256i dq  = _mm256_abs_epi32(_mm256_add_epi32(_mm256_sub_epi32(q[2], _mm256_slli_epi32(q[1],1)), q[0]));
+  __m256i dpq = _mm256_add_epi32(dp,dq);
+
+  // d < beta
+  active = _mm256_and_si256(active, _mm256_cmpgt_epi32(beta, sum_lines_0_3(dpq)));
+  if (_mm256_testz_si256(active,active)) {
+    return;
+  }
+
+  __m256i flat = _mm256_add_epi32(_mm256_abs_epi32(_mm256_sub_epi32(p[3],p[0])),
+                                  _mm256_abs_epi32(_mm256_sub_epi32(q[0],q[3])));
+  __m256i step = _mm256_abs_epi32(_mm256_sub_epi32(p[0],q[0]));
+
+  __m256i stepLimit = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_slli_epi32(tc,2),tc),
+                                                         _mm256_set1_epi32(1)), 1);
+
+  __m256i dSam = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_srai_epi32(beta,2), _mm256_slli_epi32(dpq,1)),
+                 _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_srai_epi32(beta,3), flat),
+                                  _mm256_cmpgt_epi32(stepLimit, step)));
+
+  __m256i strong = _mm256_and_si256(_mm256_shuffle_epi32(dSam, 0x00), _mm256_shuffle_epi32(dSam, 0xFF));
+
+  __m256i dEpLimit = _mm256_srai_epi32(_mm256_add_epi32(beta, _mm256_srai_epi32(beta,1)), 3);
+  __m256i dEp = _mm256_cmpgt_epi32(dEpLimit, sum_lines_0_3(dp));
+  __m256i dEq = _mm256_cmpgt_epi32(dEpLimit, sum_lines_0_3(dq));
+
+
+  // strong filtering
+
+  const __m256i tc2 = _mm256_slli_epi32(tc,1);
+  const __m256i c2  = _mm256_set1_epi32(2);
+  const __m256i c4  = _mm256_set1_epi32(4);
+
+  __m256i p0q0 = _mm256_add_epi32(p[0],q[0]);
+
+  __m256i strongP[3], strongQ[3];
+
+  {
+    // (p2 + 2*p1 + 2*p0 + 2*q0 + q1 + 4) >> 3
+    __m256i s = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(p[1],p0q0),1),
+                                 _mm256_add_epi32(_mm256_add_epi32(p[2],q[1]),c4));
+    strongP[0] = clip_around(_mm256_srai_epi32(s,3), p[0], tc2);
+
+    // (p2 + p1 + p0 + q0 + 2) >> 2
+    __m256i s4 = _mm256_add_epi32(_mm256_add_epi32(p[2],p[1]), p0q0);
+    strongP[1] = clip_around(_mm256_srai_epi32(_mm256_add_epi32(s4,c2),2), p[1], tc2);
+
+    // (2*p3 + 3*p2 + p1 + p0 + q0 + 4) >> 3
+    s = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(p[3],p[2]),1), _mm256_add_epi32(s4,c4));
+    strongP[2] = clip_around(_mm256_srai_epi32(s,3), p[2], tc2);
+  }
+
+  {
+    // (p1 + 2*p0 + 2*q0 + 2*q1 + q2 + 4) >> 3
+    __m256i s = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(q[1],p0q0),1),
+                                 _mm256_add_epi32(_mm256_add_epi32(q[2],p[1]),c4));
+    strongQ[0] = clip_around(_mm256_srai_epi32(s,3), q[0], tc2);
+
+    // (p0 + q0 + q1 + q2 + 2) >> 2
+    __m256i s4 = _mm256_add_epi32(_mm256_add_epi32(q[2],q[1]), p0q0);
+    strongQ[1] = clip_around(_mm256_srai_epi32(_mm256_add_epi32(s4,c2),2), q[1], tc2);
+
+    // (p0 + q0 + q1 + 3*q2 + 2*q3 + 4) >> 3
+    s = _mm256_add_epi32(_mm256_slli_epi32(_mm256_add_epi32(q[3],q[2]),1), _mm256_add_epi32(s4,c4));
+    strongQ[2] = clip_around(_mm256_srai_epi32(s,3), q[2], tc2);
+  }
+
+
+  // weak filtering
+
+  const __m256i maxval = _mm256_set1_epi32((1<<bit_depth)-1);
+
+  // delta = (9*(q0-p0) - 3*(q1-p1) + 8) >> 4
+
+  __m256i d0 = _mm256_sub_epi32(q[0],p[0]);
+  __m256i d1 = _mm256_sub_epi32(q[1],p[1]);
+  __m256i delta = _mm256_sub_epi32(_mm256_add_epi32(_mm256_slli_epi32(d0,3), d0),
+                                   _mm256_add_epi32(_mm256_slli_epi32(d1,1), d1));
+  delta = _mm256_srai_epi32(_mm256_add_epi32(delta, _mm256_set1_epi32(8)), 4);
+
+  // lines with |delta| >= 10*tc are left unchanged
+  __m256i tc10 = _mm256_add_epi32(_mm256_slli_epi32(tc,3), _mm256_slli_epi32(tc,1));
+  __m256i weak = _mm256_andnot_si256(strong, _mm256_cmpgt_epi32(tc10, _mm256_abs_epi32(delta)));
+
+  delta = clip_to_range(delta, _mm256_sub_epi32(zero,tc), tc);
+
+  const __m256i tcHalf  = _mm256_srai_epi32(tc,1);
+  const __m256i ntcHalf = _mm256_sub_epi32(zero,tcHalf);
+  const __m256i one     = _mm256_set1_epi32(1);
+
+  __m256i weakP0 = clip_to_range(_mm256_add_epi32(p[0],delta), zero, maxval);
+  __m256i weakQ0 = clip_to_range(_mm256_sub_epi32(q[0],delta), zero, maxval);
+
+  // Clip3(-(tc>>1), tc>>1, (((p2+p0+1)>>1)-p1+delta)>>1)
+  __m256i delta_p = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(p[2],p[0]),one),1);
+  delta_p = _mm256_srai_epi32(_mm256_add_epi32(_mm256_sub_epi32(delta_p,p[1]),delta),1);
+  delta_p = clip_to_range(delta_p, ntcHalf, tcHalf);
+  __m256i weakP1 = clip_to_range(_mm256_add_epi32(p[1],delta_p), zero, maxval);
+
+  // Clip3(-(tc>>1), tc>>1, (((q2+q0+1)>>1)-q1-delta)>>1)
+  __m256i delta_q = _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(q[2],q[0]),one),1);
+  delta_q = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(delta_q,q[1]),delta),1);
+  delta_q = clip_to_range(delta_q, ntcHalf, tcHalf);
+  __m256i weakQ1 = clip_to_range(_mm256_add_epi32(q[1],delta_q), zero, maxval);
+
+
+  // select the filtered samples
+
+  __m256i strongMaskP = _mm256_and_si256(_mm256_and_si256(active,strong), filterP);
+  __m256i strongMaskQ = _mm256_and_si256(_mm256_and_si256(active,strong), filterQ);
+  __m256i weakMaskP   = _mm256_and_si256(_mm256_and_si256(active,weak), filterP);
+  __m256i weakMaskQ   = _mm256_and_si256(_mm256_and_si256(active,weak), filterQ);
+
+  int segmentsP = segments_in_mask(_mm256_or_si256(strongMaskP,weakMaskP));
+  int segmentsQ = segments_in_mask(_mm256_or_si256(strongMaskQ,weakMaskQ));
+
+  if (segmentsP==0 && segmentsQ==0) {
+    return;
+  }
+
+  __m256i P[3],Q[3];
+
+  P[0] = _mm256_blendv_epi8(_mm256_blendv_epi8(p[0], strongP[0], strongMaskP), weakP0, weakMaskP);
+  Q[0] = _mm256_blendv_epi8(_mm256_blendv_epi8(q[0], strongQ[0], strongMaskQ), weakQ0, weakMaskQ);
+
+  P[1] = _mm256_blendv_epi8(_mm256_blendv_epi8(p[1], strongP[1], strongMaskP), weakP1,
+                            _mm256_and_si256(weakMaskP,dEp));
+  Q[1] = _mm256_blendv_epi8(_mm256_blendv_epi8(q[1], strongQ[1], strongMaskQ), weakQ1,
+                            _mm256_and_si256(weakMaskQ,dEq));
+
+  P[2] = _mm256_blendv_epi8(p[2], strongP[2], strongMaskP);
+  Q[2] = _mm256_blendv_epi8(q[2], strongQ[2], strongMaskQ);
+
+
+  // write back
+
+  if (vertical) {
+    __m256i col[8] = { p[3],P[2],P[1],P[0], Q[0],Q[1],Q[2],q[3] };
+    store_vertical_edge<8>(ptr, stride, segmentsP | segmentsQ, col);
+  }
+  else {
+    for (int i=0;i<3;i++) {
+      store_line(ptr - (i+1)*stride, segmentsP, P[i]);
+      store_line(ptr +  i   *stride, segmentsQ, Q[i]);
+    }
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_chroma_segments_avx2(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                         const int* tc_in,
+                                         const bool* filterP_in, const bool* filterQ_in,
+                                         int bit_depth)
+{
+  bool two = (nSegments==2);
+
+  const __m256i zero = _mm256_setzero_si256();
+
+  const __m256i tc = segment_values(tc_in[0], two ? tc_in[1] : 0);
+
+  __m256i active  = _mm256_cmpgt_epi32(tc,zero);
+  __m256i filterP = _mm256_and_si256(active, segment_mask(filterP_in[0], two && filterP_in[1]));
+  __m256i filterQ = _mm256_and_si256(active, segment_mask(filterQ_in[0], two && filterQ_in[1]));
+
+  int segmentsP = segments_in_mask(filterP);
+  int segmentsQ = segments_in_mask(filterQ);
+
+  if (segmentsP==0 && segmentsQ==0) {
+    return;
+  }
+
+  const int nLines = 4*nSegments;
+
+  __m256i p1,p0,q0,q1;
+
+  if (vertical) {
+    __m256i col[4];
+    load_vertical_edge<4>(ptr, stride, nLines, col);
+
+    p1 = col[0];
+    p0 = col[1];
+    q0 = col[2];
+    q1 = col[3];
+  }
+  else {
+    p1 = load_line(ptr - 2*stride, nLines);
+    p0 = load_line(ptr - 1*stride, nLines);
+    q0 = load_line(ptr,            nLines);
+    q1 = load_line(ptr + 1*stride, nLines);
+  }
+
+  // delta = Clip3(-tc,tc, ((((q0-p0)<<2) + p1-q1 + 4) >> 3))
+
+  __m256i delta = _mm256_add_epi32(_mm256_slli_epi32(_mm256_sub_epi32(q0,p0),2), _mm256_sub_epi32(p1,q1));
+  delta = _mm256_srai_epi32(_mm256_add_epi32(delta, _mm256_set1_epi32(4)), 3);
+  delta = clip_to_range(delta, _mm256_sub_epi32(zero,tc), tc);
+
+  const __m256i maxval = _mm256_set1_epi32((1<<bit_depth)-1);
+
+  p0 = _mm256_blendv_epi8(p0, clip_to_range(_mm256_add_epi32(p0,delta), zero, maxval), filterP);
+  q0 = _mm256_blendv_epi8(q0, clip_to_range(_mm256_sub_epi32(q0,delta), zero, maxval), filterQ);
+
+  if (vertical) {
+    __m256i col[4] = { p1,p0,q0,q1 };
+    store_vertical_edge<4>(ptr, stride, segmentsP | segmentsQ, col);
+  }
+  else {
+    store_line(ptr - 1*stride, segmentsP, p0);
+    store_line(ptr,            segmentsQ, q0);
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_luma_avx2(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                              const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                              int bit_depth)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s+=2) {
+    deblock_luma_segments_avx2(ptr + s*segmentStep, stride, vertical, libde265_min(nSegments-s,2),
+                               beta+s, tc+s, filterP+s, filterQ+s, bit_depth);
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_chroma_avx2(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                const int* tc, const bool* filterP, const bool* filterQ,
+                                int bit_depth)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s+=2) {
+    deblock_chroma_segments_avx2(ptr + s*segmentStep, stride, vertical, libde265_min(nSegments-s,2),
+                                 tc+s, filterP+s, filterQ+s, bit_depth);
+  }
+}
+
+
+void deblock_luma_8_avx2(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                         const int* beta, const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_luma_avx2<uint8_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,8);
+}
+
+void deblock_chroma_8_avx2(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                           const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_chroma_avx2<uint8_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,8);
+}
+
+void deblock_luma_16_avx2(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                          const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                          int bit_depth)
+{
+  deblock_luma_avx2<uint16_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,bit_depth);
+}
+
+void deblock_chroma_16_avx2(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                            const int* tc, const bool* filterP, const bool* filterQ, int bit_depth)
+{
+  deblock_chroma_avx2<uint16_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,bit_depth);
+}
@@ -0,0 +1,950 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <immintrin.h>
+
+#include "x86/avx2-motion.h"
+#include "libde265/util.h"
+
+
+/* An AVX2 register is used as two lanes of up to 8 16-bit values.
+   Blocks with a width of 16 or more are processed in segments of 16 samples of one row,
+   with the two halves of the segment in the two lanes. The remaining 8, 4 or 2 columns
+   are processed for two rows at once, one row in each lane.
+
+   For bit depths > 8, the samples are 16-bit values and all filters use madd.
+
+   As in the SSE code, the 8-bit horizontal filters load 16 bytes per lane and thus read up to
+   11 bytes beyond the filter support. The image planes are allocated with enough
+   padding (MEMORY_PADDING) for that.
+ */
+
+
+// --- loads and stores of single lanes with N values ---
+
+template <int N> static inline __m128i load_lane_pixels(const uint8_t* p);
+
+template <> inline __m128i load_lane_pixels<8>(const uint8_t* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template <> inline __m128i load_lane_pixels<4>(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtsi32_si128(v);
+}
+
+template <> inline __m128i load_lane_pixels<2>(const uint8_t* p)
+{
+  uint16_t v;
+  memcpy(&v,p,2);
+  return _mm_cvtsi32_si128(v);
+}
+
+
+template <int N> static inline __m128i load_lane_s16(const int16_t* p);
+
+template <> inline __m128i load_lane_s16<8>(const int16_t* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+template <> inline __m128i load_lane_s16<4>(const int16_t* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template <> inline __m128i load_lane_s16<2>(const int16_t* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtsi32_si128(v);
+}
+
+
+template <int N> static inline void store_lane_s16(int16_t* p, __m128i v);
+
+template <> inline void store_lane_s16<8>(int16_t* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+template <> inline void store_lane_s16<4>(int16_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+template <> inline void store_lane_s16<2>(int16_t* p, __m128i v)
+{
+  int32_t w = _mm_cvtsi128_si32(v);
+  memcpy(p,&w,4);
+}
+
+
+// stores the lower N bytes
+template <int N> static inline void store_lane_pixels(uint8_t* p, __m128i v);
+
+template <> inline void store_lane_pixels<8>(uint8_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+template <> inline void store_lane_pixels<4>(uint8_t* p, __m128i v)
+{
+  int32_t w = _mm_cvtsi128_si32(v);
+  memcpy(p,&w,4);
+}
+
+template <> inline void store_lane_pixels<2>(uint8_t* p, __m128i v)
+{
+  uint16_t w = (uint16_t)_mm_cvtsi128_si32(v);
+  memcpy(p,&w,2);
+}
+
+
+// --- loads and stores of both lanes ---
+
+/* N=8,4,2: N values at p0 in lane 0 and N values at p1 in lane 1.
+   N=16:    16 consecutive values at p0 (p1 is p0+8).
+ */
+
+static inline __m256i make_lanes(__m128i lane0, __m128i lane1)
+{
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lane0), lane1, 1);
+}
+
+template <int N>
+static inline __m256i load_lanes_pixels(const uint8_t* p0, const uint8_t* p1)
+{
+  return make_lanes(_mm_cvtepu8_epi16(load_lane_pixels<N>(p0)),
+                    _mm_cvtepu8_epi16(load_lane_pixels<N>(p1)));
+}
+
+template <>
+inline __m256i load_lanes_pixels<16>(const uint8_t* p0, const uint8_t* p1)
+{
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p0));
+}
+
+
+template <int N>
+static inline __m256i load_lanes_s16(const int16_t* p0, const int16_t* p1)
+{
+  return make_lanes(load_lane_s16<N>(p0), load_lane_s16<N>(p1));
+}
+
+template <>
+inline __m256i load_lanes_s16<16>(const int16_t* p0, const int16_t* p1)
+{
+  return _mm256_loadu_si256((const __m256i*)p0);
+}
+
+
+template <int N>
+static inline void store_lanes_s16(int16_t* p0, int16_t* p1, __m256i v)
+{
+  store_lane_s16<N>(p0, _mm256_castsi256_si128(v));
+  store_lane_s16<N>(p1, _mm256_extracti128_si256(v,1));
+}
+
+template <>
+inline void store_lanes_s16<16>(int16_t* p0, int16_t* p1, __m256i v)
+{
+  _mm256_storeu_si256((__m256i*)p0, v);
+}
+
+
+// clips the 16-bit values to [0;255]
+template <int N>
+static inline void store_lanes_pixels(uint8_t* p0, uint8_t* p1, __m256i v)
+{
+  __m256i packed = _mm256_packus_epi16(v,v);
+  store_lane_pixels<N>(p0, _mm256_castsi256_si128(packed));
+  store_lane_pixels<N>(p1, _mm256_extracti128_si256(packed,1));
+}
+
+template <>
+inline void store_lanes_pixels<16>(uint8_t* p0, uint8_t* p1, __m256i v)
+{
+  // packus works within the lanes, move the lower halves together
+  __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v,v), 0x08);
+  _mm_storeu_si128((__m128i*)p0, _mm256_castsi256_si128(packed));
+}
+
+
+/* Stores the values clipped to [0;maxval]. For 8-bit output, maxval is always 255 and
+   the clipping is done by the packing.
+ */
+template <int N>
+static inline void store_lanes_clipped(uint8_t* p0, uint8_t* p1, __m256i v, __m256i maxval)
+{
+  store_lanes_pixels<N>(p0,p1, v);
+}
+
+template <int N>
+static inline void store_lanes_clipped(uint16_t* p0, uint16_t* p1, __m256i v, __m256i maxval)
+{
+  v = _mm256_min_epi16(_mm256_max_epi16(v, _mm256_setzero_si256()), maxval);
+  store_lanes_s16<N>((int16_t*)p0, (int16_t*)p1, v);
+}
+
+
+/* Interleaves the samples of two rows (p and p+stride) to pairs of bytes.
+   The byte pairs are in the same order as the values of load_lanes_pixels().
+ */
+template <int N>
+static inline __m256i interleave_rows_pixels(const uint8_t* p0, const uint8_t* p1, ptrdiff_t stride)
+{
+  return make_lanes(_mm_unpacklo_epi8(load_lane_pixels<N>(p0), load_lane_pixels<N>(p0+stride)),
+                    _mm_unpacklo_epi8(load_lane_pixels<N>(p1), load_lane_pixels<N>(p1+stride)));
+}
+
+template <>
+inline __m256i interleave_rows_pixels<16>(const uint8_t* p0, const uint8_t* p1, ptrdiff_t stride)
+{
+  __m128i a = _mm_loadu_si128((const __m128i*)p0);
+  __m128i b = _mm_loadu_si128((const __m128i*)(p0+stride));
+  return make_lanes(_mm_unpacklo_epi8(a,b), _mm_unpackhi_epi8(a,b));
+}
+
+
+/* Calls kernel.run<N>(x0,y0, x1,y1), which processes N samples at (x0,y0) in lane 0
+   and N samples at (x1,y1) in lane 1 (or 16 samples at (x0,y0) for N=16), for all
+   samples of a width x height block. The width has to be a multiple of 2.
+ */
+
+template <int N, class Kernel>
+static inline void for_each_row_pair(Kernel& kernel, int x, int height)
+{
+  for (int y=0;y<height;y+=2) {
+    const int y1 = (y+1<height) ? y+1 : y; // an odd last row is simply processed twice
+    kernel.template run<N>(x,y, x,y1);
+  }
+}
+
+template <class Kernel>
+static inline void for_each_block(Kernel& kernel, int width, int height)
+{
+  const int width16 = width & ~15;
+
+  if (width16) {
+    for (int y=0;y<height;y++) {
+      for (int x=0;x<width16;x+=16) {
+        kernel.template run<16>(x,y, x+8,y);
+      }
+    }
+  }
+
+  int x = width16;
+  if (x+8<=width) { for_each_row_pair<8>(kernel, x, height); x+=8; }
+  if (x+4<=width) { for_each_row_pair<4>(kernel, x, height); x+=4; }
+  if (x+2<=width) { for_each_row_pair<2>(kernel, x, height); }
+}
+
+
+// --- weighted prediction ---
+
+// Coefficient pairs (a,b) for madd.
+static inline __m256i set1_pair(int a, int b)
+{
+  return _mm256_unpacklo_epi16(_mm256_set1_epi16(a), _mm256_set1_epi16(b));
+}
+
+
+// The types are local to this file, other motion compensation files use the same names.
+namespace {
+
+template <class pixel_t>
+struct unweighted_pred_kernel
+{
+  pixel_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+
+  __m256i offset, maxval;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    // The saturation does not change the result, because it is clipped anyway.
+    __m256i v = load_lanes_s16<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride);
+    v = _mm256_sra_epi16(_mm256_adds_epi16(v, offset), shift);
+    store_lanes_clipped<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, v, maxval);
+  }
+};
+
+template <class pixel_t>
+struct weighted_pred_avg_kernel
+{
+  pixel_t* dst;  ptrdiff_t dststride;
+  const int16_t* src1;
+  const int16_t* src2;  ptrdiff_t srcstride;
+
+  __m256i offset, maxval;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    const ptrdiff_t i0 = x0 + y0*srcstride;
+    const ptrdiff_t i1 = x1 + y1*srcstride;
+
+    // A saturated sum is still clipped to the maximum value, because 32767>>(15-bit_depth)
+    // equals (1<<bit_depth)-1.
+    __m256i v = _mm256_adds_epi16(load_lanes_s16<N>(src1+i0, src1+i1),
+                                  load_lanes_s16<N>(src2+i0, src2+i1));
+    v = _mm256_sra_epi16(_mm256_adds_epi16(v, offset), shift);
+    store_lanes_clipped<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, v, maxval);
+  }
+};
+
+template <class pixel_t>
+struct weighted_pred_kernel
+{
+  pixel_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+
+  __m256i w_rnd;  // pairs (w,rnd), multiplied with the pairs (src,1)
+  __m256i offset, maxval;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v   = load_lanes_s16<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride);
+    __m256i one = _mm256_set1_epi16(1);
+
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(v,one), w_rnd);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(v,one), w_rnd);
+    lo = _mm256_add_epi32(_mm256_sra_epi32(lo, shift), offset);
+    hi = _mm256_add_epi32(_mm256_sra_epi32(hi, shift), offset);
+
+    store_lanes_clipped<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride,
+                           _mm256_packs_epi32(lo,hi), maxval);
+  }
+};
+
+template <class pixel_t>
+struct weighted_bipred_kernel
+{
+  pixel_t* dst;  ptrdiff_t dststride;
+  const int16_t* src1;
+  const int16_t* src2;  ptrdiff_t srcstride;
+
+  __m256i w1_w2;
+  __m256i rnd, maxval;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    const ptrdiff_t i0 = x0 + y0*srcstride;
+    const ptrdiff_t i1 = x1 + y1*srcstride;
+
+    __m256i a = load_lanes_s16<N>(src1+i0, src1+i1);
+    __m256i b = load_lanes_s16<N>(src2+i0, src2+i1);
+
+    __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(a,b), w1_w2), rnd);
+    __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(a,b), w1_w2), rnd);
+    lo = _mm256_sra_epi32(lo, shift);
+    hi = _mm256_sra_epi32(hi, shift);
+
+    store_lanes_clipped<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride,
+                           _mm256_packs_epi32(lo,hi), maxval);
+  }
+};
+
+} // namespace
+
+
+template <class pixel_t>
+static void put_unweighted_pred(pixel_t *dst, ptrdiff_t dststride,
+                                const int16_t *src, ptrdiff_t srcstride,
+                                int width, int height, int bit_depth)
+{
+  int shift1 = 14-bit_depth;
+  int offset1 = 0;
+  if (shift1>0) { offset1 = 1<<(shift1-1); }
+
+  unweighted_pred_kernel<pixel_t> k;
+  k.dst = dst;  k.dststride = dststride;
+  k.src = src;  k.srcstride = srcstride;
+  k.offset = _mm256_set1_epi16(offset1);
+  k.maxval = _mm256_set1_epi16((1<<bit_depth)-1);
+  k.shift  = _mm_cvtsi32_si128(shift1);
+
+  for_each_block(k, width,height);
+}
+
+void put_unweighted_pred_8_avx2(uint8_t *dst, ptrdiff_t dststride,
+                                const int16_t *src, ptrdiff_t srcstride,
+                                int width, int height)
+{
+  put_unweighted_pred(dst,dststride, src,srcstride, width,height, 8);
+}
+
+void put_unweighted_pred_16_avx2(uint16_t *dst, ptrdiff_t dststride,
+                                 const int16_t *src, ptrdiff_t srcstride,
+                                 int width, int height, int bit_depth)
+{
+  put_unweighted_pred(dst,dststride, src,srcstride, width,height, bit_depth);
+}
+
+
+template <class pixel_t>
+static void put_weighted_pred_avg(pixel_t *dst, ptrdiff_t dststride,
+                                  const int16_t *src1, const int16_t *src2,
+                                  ptrdiff_t srcstride, int width, int height, int bit_depth)
+{
+  int shift2 = 15-bit_depth;
+
+  weighted_pred_avg_kernel<pixel_t> k;
+  k.dst  = dst;   k.dststride = dststride;
+  k.src1 = src1;  k.src2 = src2;  k.srcstride = srcstride;
+  k.offset = _mm256_set1_epi16(1<<(shift2-1));
+  k.maxval = _mm256_set1_epi16((1<<bit_depth)-1);
+  k.shift  = _mm_cvtsi32_si128(shift2);
+
+  for_each_block(k, width,height);
+}
+
+void put_weighted_pred_avg_8_avx2(uint8_t *dst, ptrdiff_t dststride,
+                                  const int16_t *src1, const int16_t *src2,
+                                  ptrdiff_t srcstride, int width, int height)
+{
+  put_weighted_pred_avg(dst,dststride, src1,src2,srcstride, width,height, 8);
+}
+
+void put_weighted_pred_avg_16_avx2(uint16_t *dst, ptrdiff_t dststride,
+                                   const int16_t *src1, const int16_t *src2,
+                                   ptrdiff_t srcstride, int width, int height, int bit_depth)
+{
+  put_weighted_pred_avg(dst,dststride, src1,src2,srcstride, width,height, bit_depth);
+}
+
+
+template <class pixel_t>
+static void put_weighted_pred(pixel_t *dst, ptrdiff_t dststride,
+                              const int16_t *src, ptrdiff_t srcstride,
+                              int width, int height,
+                              int w,int o,int log2WD, int bit_depth)
+{
+  const int rnd = (1<<(log2WD-1));
+
+  weighted_pred_kernel<pixel_t> k;
+  k.dst = dst;  k.dststride = dststride;
+  k.src = src;  k.srcstride = srcstride;
+  k.w_rnd  = set1_pair(w, rnd);
+  k.offset = _mm256_set1_epi32(o);
+  k.maxval = _mm256_set1_epi16((1<<bit_depth)-1);
+  k.shift  = _mm_cvtsi32_si128(log2WD);
+
+  for_each_block(k, width,height);
+}
+
+void put_weighted_pred_8_avx2(uint8_t *dst, ptrdiff_t dststride,
+                              const int16_t *src, ptrdiff_t srcstride,
+                              int width, int height,
+                              int w,int o,int log2WD)
+{
+  put_weighted_pred(dst,dststride, src,srcstride, width,height, w,o,log2WD, 8);
+}
+
+void put_weighted_pred_16_avx2(uint16_t *dst, ptrdiff_t dststride,
+                               const int16_t *src, ptrdiff_t srcstride,
+                               int width, int height,
+                               int w,int o,int log2WD, int bit_depth)
+{
+  put_weighted_pred(dst,dststride, src,srcstride, width,height, w,o,log2WD, bit_depth);
+}
+
+
+template <class pixel_t>
+static void put_weighted_bipred(pixel_t *dst, ptrdiff_t dststride,
+                                const int16_t *src1, const int16_t *src2, ptrdiff_t srcstride,
+                                int width, int height,
+                                int w1,int o1, int w2,int o2, int log2WD, int bit_depth)
+{
+  weighted_bipred_kernel<pixel_t> k;
+  k.dst  = dst;   k.dststride = dststride;
+  k.src1 = src1;  k.src2 = src2;  k.srcstride = srcstride;
+  k.w1_w2  = set1_pair(w1, w2);
+  k.rnd    = _mm256_set1_epi32((o1+o2+1) << log2WD);
+  k.maxval = _mm256_set1_epi16((1<<bit_depth)-1);
+  k.shift  = _mm_cvtsi32_si128(log2WD+1);
+
+  for_each_block(k, width,height);
+}
+
+void put_weighted_bipred_8_avx2(uint8_t *dst, ptrdiff_t dststride,
+                                const int16_t *src1, const int16_t *src2, ptrdiff_t srcstride,
+                                int width, int height,
+                                int w1,int o1, int w2,int o2, int log2WD)
+{
+  put_weighted_bipred(dst,dststride, src1,src2,srcstride, width,height, w1,o1,w2,o2,log2WD, 8);
+}
+
+void put_weighted_bipred_16_avx2(uint16_t *dst, ptrdiff_t dststride,
+                                 const int16_t *src1, const int16_t *src2, ptrdiff_t srcstride,
+                                 int width, int height,
+                                 int w1,int o1, int w2,int o2, int log2WD, int bit_depth)
+{
+  put_weighted_bipred(dst,dststride, src1,src2,srcstride, width,height, w1,o1,w2,o2,log2WD,
+                      bit_depth);
+}
+
+
+// --- interpolation filters ---
+
+/* Coefficients of the luma filters, starting at the first tap. The filters for xFrac=1
+   and xFrac=3 only have 7 taps and are padded with a zero coefficient. The samples of
+   this last tap are not read in vertical direction, because they are outside of the
+   reference block that mc_luma() provides (see mc_filter::skip_last_tap).
+ */
+static const int8_t qpel_filter[4][8] = {
+  {  0, 0,   0, 64,  0,   0, 0,  0 },
+  { -1, 4, -10, 58, 17,  -5, 1,  0 },
+  { -1, 4, -11, 40, 40, -11, 4, -1 },
+  {  1,-5,  17, 58,-10,   4,-1,  0 }
+};
+
+static const int qpel_first_tap[4] = { -3,-3,-3,-2 };
+
+static const int8_t epel_filter[8][4] = {
+  {  0, 64,  0,  0 },
+  { -2, 58, 10, -2 },
+  { -4, 54, 16, -2 },
+  { -6, 46, 28, -4 },
+  { -4, 36, 36, -4 },
+  { -4, 28, 46, -6 },
+  { -2, 16, 54, -4 },
+  { -2, 10, 58, -2 }
+};
+
+static const int epel_first_tap = -1;
+
+
+// pshufb masks that collect the sample pairs (i+2j, i+2j+1) for the outputs i=0..7 of a lane
+ALIGNED_32(static const int8_t) shuffle_sample_pairs[4][32] = {
+  {  0,  1,  1,  2,  2,  3,  3,  4,  4,  5,  5,  6,  6,  7,  7,  8,
+     0,  1,  1,  2,  2,  3,  3,  4,  4,  5,  5,  6,  6,  7,  7,  8 },
+  {  2,  3,  3,  4,  4,  5,  5,  6,  6,  7,  7,  8,  8,  9,  9, 10,
+     2,  3,  3,  4,  4,  5,  5,  6,  6,  7,  7,  8,  8,  9,  9, 10 },
+  {  4,  5,  5,  6,  6,  7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12,
+     4,  5,  5,  6,  6,  7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12 },
+  {  6,  7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14,
+     6,  7,  7,  8,  8,  9,  9, 10, 10, 11, 11, 12, 12, 13, 13, 14 }
+};
+
+
+namespace {
+
+/* A filter with NTAPS (4 or 8) taps. The taps are applied pairwise: with maddubs to
+   8-bit samples and with madd to 16-bit intermediate values.
+ */
+template <int NTAPS>
+struct mc_filter
+{
+  int first_tap; // offset of the first tap relative to the filtered sample
+  bool skip_last_tap; // the last coefficient is zero, its samples are not loaded
+
+  __m256i byte_pairs[NTAPS/2];
+  __m256i word_pairs[NTAPS/2];
+
+  void set(const int8_t* coeffs, int first) {
+    first_tap = first;
+    skip_last_tap = (coeffs[NTAPS-1]==0);
+
+    for (int j=0;j<NTAPS/2;j++) {
+      int c0 = coeffs[2*j];
+      int c1 = coeffs[2*j+1];
+      byte_pairs[j] = _mm256_set1_epi16((int16_t)(((c1 & 0xFF)<<8) | (c0 & 0xFF)));
+      word_pairs[j] = set1_pair(c0,c1);
+    }
+  }
+};
+
+
+// Horizontal filtering of 8 8-bit samples per lane. For 8-bit input, the result fits into 16 bits.
+template <int NTAPS>
+static inline __m256i filter_h_pixels(const uint8_t* p0, const uint8_t* p1, const mc_filter<NTAPS>& f)
+{
+  __m256i v = make_lanes(_mm_loadu_si128((const __m128i*)(p0 + f.first_tap)),
+                         _mm_loadu_si128((const __m128i*)(p1 + f.first_tap)));
+
+  const __m256i* shuffle = (const __m256i*)shuffle_sample_pairs;
+
+  __m256i sum = _mm256_maddubs_epi16(_mm256_shuffle_epi8(v, _mm256_load_si256(shuffle+0)), f.byte_pairs[0]);
+  for (int j=1;j<NTAPS/2;j++) {
+    sum = _mm256_add_epi16(sum, _mm256_maddubs_epi16(_mm256_shuffle_epi8(v, _mm256_load_si256(shuffle+j)),
+                                                     f.byte_pairs[j]));
+  }
+
+  return sum;
+}
+
+
+// Vertical filtering of N 8-bit samples per lane.
+template <int N, int NTAPS>
+static inline __m256i filter_v_pixels(const uint8_t* p0, const uint8_t* p1, ptrdiff_t stride,
+                                      const mc_filter<NTAPS>& f)
+{
+  p0 += f.first_tap*stride;
+  p1 += f.first_tap*stride;
+
+  __m256i sum = _mm256_setzero_si256();
+
+  for (int j=0;j<NTAPS/2;j++) {
+    // without the last row, the pairs are (sample,0) like the zero-extended samples
+    __m256i v;
+    if (j==NTAPS/2-1 && f.skip_last_tap) { v = load_lanes_pixels<N>(p0,p1); }
+    else                                 { v = interleave_rows_pixels<N>(p0,p1, stride); }
+
+    sum = _mm256_add_epi16(sum, _mm256_maddubs_epi16(v, f.byte_pairs[j]));
+
+    p0 += 2*stride;
+    p1 += 2*stride;
+  }
+
+  return sum;
+}
+
+
+/* Filtering of N 16-bit values per lane, horizontally (step=1) or vertically (step=stride),
+   with the result shifted right by 'shift'. The input are intermediate values or samples
+   with more than 8 bits. The sums need more than 16 bits and are computed in 32 bits.
+ */
+template <int N, int NTAPS>
+static inline __m256i filter_s16(const int16_t* p0, const int16_t* p1, ptrdiff_t step,
+                                 const mc_filter<NTAPS>& f, __m128i shift)
+{
+  p0 += f.first_tap*step;
+  p1 += f.first_tap*step;
+
+  __m256i lo = _mm256_setzero_si256();
+  __m256i hi = _mm256_setzero_si256();
+
+  for (int j=0;j<NTAPS/2;j++) {
+    __m256i a = load_lanes_s16<N>(p0, p1);
+    __m256i b;
+    if (j==NTAPS/2-1 && f.skip_last_tap) { b = _mm256_setzero_si256(); }
+    else                                 { b = load_lanes_s16<N>(p0+step, p1+step); }
+
+    lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a,b), f.word_pairs[j]));
+    hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a,b), f.word_pairs[j]));
+
+    p0 += 2*step;
+    p1 += 2*step;
+  }
+
+  return _mm256_packs_epi32(_mm256_sra_epi32(lo,shift), _mm256_sra_epi32(hi,shift));
+}
+
+
+// --- kernels ---
+
+struct copy_pixels_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const uint8_t* src;  ptrdiff_t srcstride;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v = load_lanes_pixels<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride);
+    store_lanes_s16<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, _mm256_slli_epi16(v,6));
+  }
+};
+
+template <int NTAPS>
+struct filter_h_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const uint8_t* src;  ptrdiff_t srcstride;
+  const mc_filter<NTAPS>* filter;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v = filter_h_pixels(src + x0 + y0*srcstride, src + x1 + y1*srcstride, *filter);
+    store_lanes_s16<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, v);
+  }
+};
+
+template <int NTAPS>
+struct filter_v_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const uint8_t* src;  ptrdiff_t srcstride;
+  const mc_filter<NTAPS>* filter;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v = filter_v_pixels<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride,
+                                   srcstride, *filter);
+    store_lanes_s16<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, v);
+  }
+};
+
+struct copy_s16_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v = load_lanes_s16<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride);
+    store_lanes_s16<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, _mm256_sll_epi16(v,shift));
+  }
+};
+
+template <int NTAPS>
+struct filter_s16_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  ptrdiff_t step;
+  const mc_filter<NTAPS>* filter;
+  __m128i shift;
+
+  template <int N> void run(int x0,int y0, int x1,int y1) {
+    __m256i v = filter_s16<N>(src + x0 + y0*srcstride, src + x1 + y1*srcstride,
+                              step, *filter, shift);
+    store_lanes_s16<N>(dst + x0 + y0*dststride, dst + x1 + y1*dststride, v);
+  }
+};
+
+} // namespace
+
+
+/* Separable 2D filtering. The horizontal filter is applied to all rows in the support
+   of the vertical filter and the result is stored in 'mcbuffer'
+   (of size MAX_CU_SIZE*(MAX_CU_SIZE+7)).
+ */
+template <int NTAPS>
+static void filter_hv(int16_t *dst, ptrdiff_t dststride,
+                      const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                      const mc_filter<NTAPS>& fh, const mc_filter<NTAPS>& fv,
+                      int16_t* mcbuffer)
+{
+  const int extra_top = -fv.first_tap;
+  const int nrows = height+NTAPS-1 - (fv.skip_last_tap ? 1 : 0);
+
+  filter_h_kernel<NTAPS> h = { mcbuffer, width, src - extra_top*srcstride, srcstride, &fh };
+  for_each_block(h, width, nrows);
+
+  filter_s16_kernel<NTAPS> v = { dst, dststride, mcbuffer + extra_top*width, width, width, &fv,
+                                  _mm_cvtsi32_si128(6) };
+  for_each_block(v, width, height);
+}
+
+
+// --- bit depths > 8 ---
+
+static void copy_samples_16(int16_t *dst, ptrdiff_t dststride,
+                            const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                            int bit_depth)
+{
+  copy_s16_kernel k = { dst,dststride, (const int16_t*)src,srcstride,
+                        _mm_cvtsi32_si128(14-bit_depth) };
+  for_each_block(k, width,height);
+}
+
+template <int NTAPS>
+static void filter_h_16(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        const mc_filter<NTAPS>& f, int bit_depth)
+{
+  filter_s16_kernel<NTAPS> k = { dst,dststride, (const int16_t*)src,srcstride, 1, &f,
+                                 _mm_cvtsi32_si128(bit_depth-8) };
+  for_each_block(k, width,height);
+}
+
+template <int NTAPS>
+static void filter_v_16(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        const mc_filter<NTAPS>& f, int bit_depth)
+{
+  filter_s16_kernel<NTAPS> k = { dst,dststride, (const int16_t*)src,srcstride, srcstride, &f,
+                                 _mm_cvtsi32_si128(bit_depth-8) };
+  for_each_block(k, width,height);
+}
+
+template <int NTAPS>
+static void filter_hv_16(int16_t *dst, ptrdiff_t dststride,
+                         const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                         const mc_filter<NTAPS>& fh, const mc_filter<NTAPS>& fv,
+                         int16_t* mcbuffer, int bit_depth)
+{
+  const int extra_top = -fv.first_tap;
+  const int nrows = height+NTAPS-1 - (fv.skip_last_tap ? 1 : 0);
+
+  filter_h_16(mcbuffer, width, src - extra_top*srcstride, srcstride, width, nrows,
+              fh, bit_depth);
+
+  filter_s16_kernel<NTAPS> v = { dst, dststride, mcbuffer + extra_top*width, width, width, &fv,
+                                  _mm_cvtsi32_si128(6) };
+  for_each_block(v, width, height);
+}
+
+
+// --- chroma ---
+
+void put_epel_8_avx2(int16_t *dst, ptrdiff_t dststride,
+                     const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                     int mx, int my, int16_t* mcbuffer)
+{
+  copy_pixels_kernel k = { dst,dststride, src,srcstride };
+  for_each_block(k, width,height);
+}
+
+void put_epel_h_8_avx2(int16_t *dst, ptrdiff_t dststride,
+                       const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[mx], epel_first_tap);
+
+  filter_h_kernel<4> k = { dst,dststride, src,srcstride, &f };
+  for_each_block(k, width,height);
+}
+
+void put_epel_v_8_avx2(int16_t *dst, ptrdiff_t dststride,
+                       const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[my], epel_first_tap);
+
+  filter_v_kernel<4> k = { dst,dststride, src,srcstride, &f };
+  for_each_block(k, width,height);
+}
+
+void put_epel_hv_8_avx2(int16_t *dst, ptrdiff_t dststride,
+                        const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                        int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> fh,fv;
+  fh.set(epel_filter[mx], epel_first_tap);
+  fv.set(epel_filter[my], epel_first_tap);
+
+  filter_hv(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer);
+}
+
+
+void put_epel_16_avx2(int16_t *dst, ptrdiff_t dststride,
+                      const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                      int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  copy_samples_16(dst,dststride, src,srcstride, width,height, bit_depth);
+}
+
+void put_epel_h_16_avx2(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[mx], epel_first_tap);
+
+  filter_h_16(dst,dststride, src,srcstride, width,height, f, bit_depth);
+}
+
+void put_epel_v_16_avx2(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[my], epel_first_tap);
+
+  filter_v_16(dst,dststride, src,srcstride, width,height, f, bit_depth);
+}
+
+void put_epel_hv_16_avx2(int16_t *dst, ptrdiff_t dststride,
+                         const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                         int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> fh,fv;
+  fh.set(epel_filter[mx], epel_first_tap);
+  fv.set(epel_filter[my], epel_first_tap);
+
+  filter_hv_16(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer, bit_depth);
+}
+
+
+// --- luma ---
+
+template <int xFrac, int yFrac>
+void put_qpel_8_avx2(int16_t *dst, ptrdiff_t dststride,
+                     const uint8_t *src, ptrdiff_t srcstride, int width, int height,
+                     int16_t* mcbuffer)
+{
+  mc_filter<8> fh,fv;
+  if (xFrac) { fh.set(qpel_filter[xFrac], qpel_first_tap[xFrac]); }
+  if (yFrac) { fv.set(qpel_filter[yFrac], qpel_first_tap[yFrac]); }
+
+  if (xFrac==0 && yFrac==0) {
+    copy_pixels_kernel k = { dst,dststride, src,srcstride };
+    for_each_block(k, width,height);
+  }
+  else if (yFrac==0) {
+    filter_h_kernel<8> k = { dst,dststride, src,srcstride, &fh };
+    for_each_block(k, width,height);
+  }
+  else if (xFrac==0) {
+    filter_v_kernel<8> k = { dst,dststride, src,srcstride, &fv };
+    for_each_block(k, width,height);
+  }
+  else {
+    filter_hv(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer);
+  }
+}
+
+template <int xFrac, int yFrac>
+void put_qpel_16_avx2(int16_t *dst, ptrdiff_t dststride,
+                      const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                      int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<8> fh,fv;
+  if (xFrac) { fh.set(qpel_filter[xFrac], qpel_first_tap[xFrac]); }
+  if (yFrac) { fv.set(qpel_filter[yFrac], qpel_first_tap[yFrac]); }
+
+  if (xFrac==0 && yFrac==0) {
+    copy_samples_16(dst,dststride, src,srcstride, width,height, bit_depth);
+  }
+  else if (yFrac==0) {
+    filter_h_16(dst,dststride, src,srcstride, width,height, fh, bit_depth);
+  }
+  else if (xFrac==0) {
+    filter_v_16(dst,dststride, src,srcstride, width,height, fv, bit_depth);
+  }
+  else {
+    filter_hv_16(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer, bit_depth);
+  }
+}
+
+
+#define INSTANTIATE_QPEL(xFrac) \
+  template void put_qpel_8_avx2<xFrac,0>(int16_t*,ptrdiff_t,const uint8_t*,ptrdiff_t,int,int,int16_t*); \
+  template void put_qpel_8_avx2<xFrac,1>(int16_t*,ptrdiff_t,const uint8_t*,ptrdiff_t,int,int,int16_t*); \
+  template void put_qpel_8_avx2<xFrac,2>(int16_t*,ptrdiff_t,const uint8_t*,ptrdiff_t,int,int,int16_t*); \
+  template void put_qpel_8_avx2<xFrac,3>(int16_t*,ptrdiff_t,const uint8_t*,ptrdiff_t,int,int,int16_t*); \
+  template void put_qpel_16_avx2<xFrac,0>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_avx2<xFrac,1>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_avx2<xFrac,2>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_avx2<xFrac,3>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int)
+
+INSTANTIATE_QPEL(0);
+INSTANTIATE_QPEL(1);
+INSTANTIATE_QPEL(2);
+INSTANTIATE_QPEL(3);
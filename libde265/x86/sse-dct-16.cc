@@ -0,0 +1,491 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <emmintrin.h>
+#include <smmintrin.h> // SSE4.1
+
+#include "x86/sse-dct-16.h"
+#include "libde265/fallback-dct.h"
+
+
+/* Both passes of the inverse transform compute sums over pairs of inputs with madd.
+
+   The vertical pass processes 8 columns (4 for 4x4 blocks) at once. The coefficients of
+   two rows are interleaved and multiplied with the broadcast matrix entries of these rows.
+
+   The horizontal pass processes one row at once. Two neighboring values of the row are
+   broadcast and multiplied with the matrix entries of four output samples.
+
+   Rows and columns after the last non-zero coefficient are skipped.
+ */
+
+
+static const int8_t mat_dct[32][32] = {
+  { 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,      64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64},
+  { 90, 90, 88, 85, 82, 78, 73, 67, 61, 54, 46, 38, 31, 22, 13,  4,      -4,-13,-22,-31,-38,-46,-54,-61,-67,-73,-78,-82,-85,-88,-90,-90},
+  { 90, 87, 80, 70, 57, 43, 25,  9, -9,-25,-43,-57,-70,-80,-87,-90,     -90,-87,-80,-70,-57,-43,-25, -9,  9, 25, 43, 57, 70, 80, 87, 90},
+  { 90, 82, 67, 46, 22, -4,-31,-54,-73,-85,-90,-88,-78,-61,-38,-13,      13, 38, 61, 78, 88, 90, 85, 73, 54, 31,  4,-22,-46,-67,-82,-90},
+  { 89, 75, 50, 18,-18,-50,-75,-89,-89,-75,-50,-18, 18, 50, 75, 89,      89, 75, 50, 18,-18,-50,-75,-89,-89,-75,-50,-18, 18, 50, 75, 89},
+  { 88, 67, 31,-13,-54,-82,-90,-78,-46, -4, 38, 73, 90, 85, 61, 22,     -22,-61,-85,-90,-73,-38,  4, 46, 78, 90, 82, 54, 13,-31,-67,-88},
+  { 87, 57,  9,-43,-80,-90,-70,-25, 25, 70, 90, 80, 43, -9,-57,-87,     -87,-57, -9, 43, 80, 90, 70, 25,-25,-70,-90,-80,-43,  9, 57, 87},
+  { 85, 46,-13,-67,-90,-73,-22, 38, 82, 88, 54, -4,-61,-90,-78,-31,      31, 78, 90, 61,  4,-54,-88,-82,-38, 22, 73, 90, 67, 13,-46,-85},
+  { 83, 36,-36,-83,-83,-36, 36, 83, 83, 36,-36,-83,-83,-36, 36, 83,      83, 36,-36,-83,-83,-36, 36, 83, 83, 36,-36,-83,-83,-36, 36, 83},
+  { 82, 22,-54,-90,-61, 13, 78, 85, 31,-46,-90,-67,  4, 73, 88, 38,     -38,-88,-73, -4, 67, 90, 46,-31,-85,-78,-13, 61, 90, 54,-22,-82},
+  { 80,  9,-70,-87,-25, 57, 90, 43,-43,-90,-57, 25, 87, 70, -9,-80,     -80, -9, 70, 87, 25,-57,-90,-43, 43, 90, 57,-25,-87,-70,  9, 80},
+  { 78, -4,-82,-73, 13, 85, 67,-22,-88,-61, 31, 90, 54,-38,-90,-46,      46, 90, 38,-54,-90,-31, 61, 88, 22,-67,-85,-13, 73, 82,  4,-78},
+  { 75,-18,-89,-50, 50, 89, 18,-75,-75, 18, 89, 50,-50,-89,-18, 75,      75,-18,-89,-50, 50, 89, 18,-75,-75, 18, 89, 50,-50,-89,-18, 75},
+  { 73,-31,-90,-22, 78, 67,-38,-90,-13, 82, 61,-46,-88, -4, 85, 54,     -54,-85,  4, 88, 46,-61,-82, 13, 90, 38,-67,-78, 22, 90, 31,-73},
+  { 70,-43,-87,  9, 90, 25,-80,-57, 57, 80,-25,-90, -9, 87, 43,-70,     -70, 43, 87, -9,-90,-25, 80, 57,-57,-80, 25, 90,  9,-87,-43, 70},
+  { 67,-54,-78, 38, 85,-22,-90,  4, 90, 13,-88,-31, 82, 46,-73,-61,      61, 73,-46,-82, 31, 88,-13,-90, -4, 90, 22,-85,-38, 78, 54,-67},
+  { 64,-64,-64, 64, 64,-64,-64, 64, 64,-64,-64, 64, 64,-64,-64, 64,      64,-64,-64, 64, 64,-64,-64, 64, 64,-64,-64, 64, 64,-64,-64, 64},
+  { 61,-73,-46, 82, 31,-88,-13, 90, -4,-90, 22, 85,-38,-78, 54, 67,     -67,-54, 78, 38,-85,-22, 90,  4,-90, 13, 88,-31,-82, 46, 73,-61},
+  { 57,-80,-25, 90, -9,-87, 43, 70,-70,-43, 87,  9,-90, 25, 80,-57,     -57, 80, 25,-90,  9, 87,-43,-70, 70, 43,-87, -9, 90,-25,-80, 57},
+  { 54,-85, -4, 88,-46,-61, 82, 13,-90, 38, 67,-78,-22, 90,-31,-73,      73, 31,-90, 22, 78,-67,-38, 90,-13,-82, 61, 46,-88,  4, 85,-54},
+  { 50,-89, 18, 75,-75,-18, 89,-50,-50, 89,-18,-75, 75, 18,-89, 50,      50,-89, 18, 75,-75,-18, 89,-50,-50, 89,-18,-75, 75, 18,-89, 50},
+  { 46,-90, 38, 54,-90, 31, 61,-88, 22, 67,-85, 13, 73,-82,  4, 78,     -78, -4, 82,-73,-13, 85,-67,-22, 88,-61,-31, 90,-54,-38, 90,-46},
+  { 43,-90, 57, 25,-87, 70,  9,-80, 80, -9,-70, 87,-25,-57, 90,-43,     -43, 90,-57,-25, 87,-70, -9, 80,-80,  9, 70,-87, 25, 57,-90, 43},
+  { 38,-88, 73, -4,-67, 90,-46,-31, 85,-78, 13, 61,-90, 54, 22,-82,      82,-22,-54, 90,-61,-13, 78,-85, 31, 46,-90, 67,  4,-73, 88,-38},
+  { 36,-83, 83,-36,-36, 83,-83, 36, 36,-83, 83,-36,-36, 83,-83, 36,      36,-83, 83,-36,-36, 83,-83, 36, 36,-83, 83,-36,-36, 83,-83, 36},
+  { 31,-78, 90,-61,  4, 54,-88, 82,-38,-22, 73,-90, 67,-13,-46, 85,     -85, 46, 13,-67, 90,-73, 22, 38,-82, 88,-54, -4, 61,-90, 78,-31},
+  { 25,-70, 90,-80, 43,  9,-57, 87,-87, 57, -9,-43, 80,-90, 70,-25,     -25, 70,-90, 80,-43, -9, 57,-87, 87,-57,  9, 43,-80, 90,-70, 25},
+  { 22,-61, 85,-90, 73,-38, -4, 46,-78, 90,-82, 54,-13,-31, 67,-88,      88,-67, 31, 13,-54, 82,-90, 78,-46,  4, 38,-73, 90,-85, 61,-22},
+  { 18,-50, 75,-89, 89,-75, 50,-18,-18, 50,-75, 89,-89, 75,-50, 18,      18,-50, 75,-89, 89,-75, 50,-18,-18, 50,-75, 89,-89, 75,-50, 18},
+  { 13,-38, 61,-78, 88,-90, 85,-73, 54,-31,  4, 22,-46, 67,-82, 90,     -90, 82,-67, 46,-22, -4, 31,-54, 73,-85, 90,-88, 78,-61, 38,-13},
+  {  9,-25, 43,-57, 70,-80, 87,-90, 90,-87, 80,-70, 57,-43, 25, -9,      -9, 25,-43, 57,-70, 80,-87, 90,-90, 87,-80, 70,-57, 43,-25,  9},
+  {  4,-13, 22,-31, 38,-46, 54,-61, 67,-73, 78,-82, 85,-88, 90,-90,      90,-90, 88,-85, 82,-78, 73,-67, 61,-54, 46,-38, 31,-22, 13, -4}};
+
+static const int8_t mat_dst[4][4] = {
+  { 29, 55, 74, 84 },
+  { 74, 74,  0,-74 },
+  { 84,-29,-74, 55 },
+  { 55,-84, 74,-29 }
+};
+
+
+// --- loads and stores of N 16-bit values ---
+
+template <int N> static inline __m128i load_s16(const int16_t* p);
+
+template <> inline __m128i load_s16<8>(const int16_t* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+template <> inline __m128i load_s16<4>(const int16_t* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+
+template <int N> static inline void store_s16(int16_t* p, __m128i v);
+
+template <> inline void store_s16<8>(int16_t* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+template <> inline void store_s16<4>(int16_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+
+// Adds the four 32-bit residuals to the pixels at 'dst' and clips the results to [0;maxval].
+static inline void add_to_pixels4(uint16_t* dst, __m128i r, __m128i maxval)
+{
+  __m128i p = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)dst));
+  p = _mm_packus_epi32(_mm_add_epi32(p, r), r);
+  _mm_storel_epi64((__m128i*)dst, _mm_min_epu16(p, maxval));
+}
+
+
+// The types are local to this file, other transform files use the same names.
+namespace {
+
+/* The transform matrix M (M[j][i]: factor of coefficient j for sample i) as pairs
+   (M[2jp][i], M[2jp+1][i]) for madd.
+ */
+template <int nT>
+struct transform_pairs
+{
+  int16_t pairs[nT/2][2*nT];
+
+  transform_pairs(const int8_t* mat, int matstride, int fact) {
+    for (int jp=0;jp<nT/2;jp++)
+      for (int i=0;i<nT;i++) {
+        pairs[jp][2*i  ] = mat[(2*jp  )*fact*matstride + i];
+        pairs[jp][2*i+1] = mat[(2*jp+1)*fact*matstride + i];
+      }
+  }
+
+  // the pair of sample i in all four 32-bit elements
+  __m128i broadcast(int jp, int i) const {
+    int32_t v;
+    memcpy(&v, &pairs[jp][2*i], 4);
+    return _mm_set1_epi32(v);
+  }
+
+  // the pairs of samples i..i+3
+  __m128i load(int jp, int i) const {
+    return _mm_loadu_si128((const __m128i*)&pairs[jp][2*i]);
+  }
+};
+
+
+// Stores the results of the horizontal pass as 32-bit residuals.
+struct residual_output
+{
+  int32_t* dst;
+  int nT;
+  __m128i rnd;
+  __m128i shift;
+
+  void store(int y, int x, __m128i sum) {
+    sum = _mm_sra_epi32(_mm_add_epi32(sum, rnd), shift);
+    _mm_storeu_si128((__m128i*)(dst + y*nT + x), sum);
+  }
+};
+
+// Adds the results of the horizontal pass to the prediction, optionally clipped to 16 bits.
+template <bool clip_to_int16>
+struct add_output
+{
+  uint16_t* dst;
+  ptrdiff_t stride;
+  __m128i rnd;
+  __m128i shift;
+  __m128i maxval;
+
+  void store(int y, int x, __m128i sum) {
+    sum = _mm_sra_epi32(_mm_add_epi32(sum, rnd), shift);
+    if (clip_to_int16) {
+      sum = _mm_min_epi32(_mm_max_epi32(sum, _mm_set1_epi32(-32768)), _mm_set1_epi32(32767));
+    }
+    add_to_pixels4(dst + y*stride + x, sum, maxval);
+  }
+};
+
+} // namespace
+
+
+template <int nT>
+static const transform_pairs<nT>& dct_pairs()
+{
+  static const transform_pairs<nT> pairs(&mat_dct[0][0], 32, 32/nT);
+  return pairs;
+}
+
+static const transform_pairs<4>& dst_pairs()
+{
+  static const transform_pairs<4> pairs(&mat_dst[0][0], 4, 1);
+  return pairs;
+}
+
+
+/* Determines the number of rows up to the last row with a non-zero coefficient and
+   the number of columns up to the last group of 8 (4 for 4x4 blocks) columns with a
+   non-zero coefficient.
+ */
+template <int nT>
+static void get_nonzero_extent(const int16_t* coeffs, int* nRows, int* nCols)
+{
+  const int W = (nT==4 ? 4 : 8);
+
+  __m128i cols[nT/W];
+  for (int k=0;k<nT/W;k++) { cols[k] = _mm_setzero_si128(); }
+
+  int rows=0;
+  for (int y=0;y<nT;y++) {
+    __m128i row = _mm_setzero_si128();
+    for (int k=0;k<nT/W;k++) {
+      __m128i v = load_s16<W>(coeffs + y*nT + k*W);
+      row     = _mm_or_si128(row, v);
+      cols[k] = _mm_or_si128(cols[k], v);
+    }
+
+    if (!_mm_testz_si128(row,row)) { rows = y+1; }
+  }
+
+  int c=0;
+  for (int k=0;k<nT/W;k++) {
+    if (!_mm_testz_si128(cols[k],cols[k])) { c = (k+1)*W; }
+  }
+
+  *nRows = rows;
+  *nCols = c;
+}
+
+
+/* Vertical pass. Computes the first nCols columns of 'g', clipped to 16 bits.
+   Only the first nRows rows of 'coeffs' are used, the others have to be zero.
+ */
+template <int nT>
+static void inverse_transform_v(int16_t* g, const int16_t* coeffs,
+                                const transform_pairs<nT>& m, int nRows, int nCols)
+{
+  const int W = (nT==4 ? 4 : 8);
+  const int nPairs = (nRows+1)/2;
+
+  const __m128i rnd = _mm_set1_epi32(1<<(7-1));
+
+  for (int c=0;c<nCols;c+=W) {
+
+    // interleave the coefficients of the row pairs
+
+    __m128i lo_pairs[nT/2], hi_pairs[nT/2];
+
+    for (int jp=0;jp<nPairs;jp++) {
+      __m128i a = load_s16<W>(coeffs + (2*jp  )*nT + c);
+      __m128i b = load_s16<W>(coeffs + (2*jp+1)*nT + c);
+      lo_pairs[jp] = _mm_unpacklo_epi16(a,b);
+      hi_pairs[jp] = _mm_unpackhi_epi16(a,b);
+    }
+
+    for (int i=0;i<nT;i++) {
+      __m128i lo = rnd;
+      __m128i hi = rnd;
+
+      for (int jp=0;jp<nPairs;jp++) {
+        __m128i w = m.broadcast(jp,i);
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(lo_pairs[jp], w));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(hi_pairs[jp], w));
+      }
+
+      __m128i v = _mm_packs_epi32(_mm_srai_epi32(lo,7), _mm_srai_epi32(hi,7));
+      store_s16<W>(g + i*nT + c, v);
+    }
+  }
+}
+
+
+/* Horizontal pass. Only the first nCols columns of 'g' are used, the others have to
+   be zero. The sums of four samples each are passed to out.store().
+ */
+template <int nT, class Output>
+static void inverse_transform_h(const int16_t* g, const transform_pairs<nT>& m, int nCols,
+                                Output& out)
+{
+  const int nPairs = nCols/2;
+
+  for (int y=0;y<nT;y++) {
+    __m128i sum[nT/4];
+    for (int k=0;k<nT/4;k++) { sum[k] = _mm_setzero_si128(); }
+
+    for (int jp=0;jp<nPairs;jp++) {
+      int32_t v;
+      memcpy(&v, g + y*nT + 2*jp, 4);
+      __m128i b = _mm_set1_epi32(v);
+
+      for (int k=0;k<nT/4;k++) {
+        sum[k] = _mm_add_epi32(sum[k], _mm_madd_epi16(b, m.load(jp,4*k)));
+      }
+    }
+
+    for (int k=0;k<nT/4;k++) {
+      out.store(y, 4*k, sum[k]);
+    }
+  }
+}
+
+
+template <int nT>
+static void transform_idct_add_16(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride,
+                                  int bit_depth)
+{
+  const transform_pairs<nT>& m = dct_pairs<nT>();
+
+  int nRows, nCols;
+  get_nonzero_extent<nT>(coeffs, &nRows, &nCols);
+
+  int16_t g[nT*nT];
+  inverse_transform_v(g, coeffs, m, nRows, nCols);
+
+  const int postShift = 20-bit_depth;
+
+  add_output<false> out;
+  out.dst    = dst;
+  out.stride = stride;
+  out.rnd    = _mm_set1_epi32(1<<(postShift-1));
+  out.shift  = _mm_cvtsi32_si128(postShift);
+  out.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  inverse_transform_h(g, m, nCols, out);
+}
+
+
+void transform_4x4_dst_add_16_sse4(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride, int bit_depth)
+{
+  const transform_pairs<4>& m = dst_pairs();
+
+  int16_t g[4*4];
+  inverse_transform_v(g, coeffs, m, 4,4);
+
+  const int postShift = 20-bit_depth;
+
+  add_output<true> out;
+  out.dst    = dst;
+  out.stride = stride;
+  out.rnd    = _mm_set1_epi32(1<<(postShift-1));
+  out.shift  = _mm_cvtsi32_si128(postShift);
+  out.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  inverse_transform_h(g, m, 4, out);
+}
+
+void transform_4x4_add_16_sse4(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride, int bit_depth)
+{
+  transform_idct_add_16<4>(dst,coeffs,stride,bit_depth);
+}
+
+void transform_8x8_add_16_sse4(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride, int bit_depth)
+{
+  transform_idct_add_16<8>(dst,coeffs,stride,bit_depth);
+}
+
+void transform_16x16_add_16_sse4(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride, int bit_depth)
+{
+  transform_idct_add_16<16>(dst,coeffs,stride,bit_depth);
+}
+
+void transform_32x32_add_16_sse4(uint16_t *dst, const int16_t *coeffs, ptrdiff_t stride, int bit_depth)
+{
+  transform_idct_add_16<32>(dst,coeffs,stride,bit_depth);
+}
+
+
+// --- 32-bit residual output ---
+
+/* The intermediate values are clipped to 16 bits with saturation. Extended precision
+   (max_coeff_bits > 15) is left to the fallback functions.
+ */
+
+template <int nT>
+static void transform_idct_residual(int32_t *dst, const int16_t *coeffs, int bdShift)
+{
+  const transform_pairs<nT>& m = dct_pairs<nT>();
+
+  int nRows, nCols;
+  get_nonzero_extent<nT>(coeffs, &nRows, &nCols);
+
+  int16_t g[nT*nT];
+  inverse_transform_v(g, coeffs, m, nRows, nCols);
+
+  residual_output out;
+  out.dst   = dst;
+  out.nT    = nT;
+  out.rnd   = _mm_set1_epi32(1<<(bdShift-1));
+  out.shift = _mm_cvtsi32_si128(bdShift);
+
+  inverse_transform_h(g, m, nCols, out);
+}
+
+
+void transform_idst_4x4_sse4(int32_t *dst, const int16_t *coeffs, int bdShift, int max_coeff_bits)
+{
+  if (max_coeff_bits != 15) {
+    transform_idst_4x4_fallback(dst,coeffs,bdShift,max_coeff_bits);
+    return;
+  }
+
+  const transform_pairs<4>& m = dst_pairs();
+
+  int16_t g[4*4];
+  inverse_transform_v(g, coeffs, m, 4,4);
+
+  residual_output out;
+  out.dst   = dst;
+  out.nT    = 4;
+  out.rnd   = _mm_set1_epi32(1<<(bdShift-1));
+  out.shift = _mm_cvtsi32_si128(bdShift);
+
+  inverse_transform_h(g, m, 4, out);
+}
+
+void transform_idct_4x4_sse4(int32_t *dst, const int16_t *coeffs, int bdShift, int max_coeff_bits)
+{
+  if (max_coeff_bits != 15) {
+    transform_idct_4x4_fallback(dst,coeffs,bdShift,max_coeff_bits);
+    return;
+  }
+
+  transform_idct_residual<4>(dst,coeffs,bdShift);
+}
+
+void transform_idct_8x8_sse4(int32_t *dst, const int16_t *coeffs, int bdShift, int max_coeff_bits)
+{
+  if (max_coeff_bits != 15) {
+    transform_idct_8x8_fallback(dst,coeffs,bdShift,max_coeff_bits);
+    return;
+  }
+
+  transform_idct_residual<8>(dst,coeffs,bdShift);
+}
+
+void transform_idct_16x16_sse4(int32_t *dst, const int16_t *coeffs, int bdShift, int max_coeff_bits)
+{
+  if (max_coeff_bits != 15) {
+    transform_idct_16x16_fallback(dst,coeffs,bdShift,max_coeff_bits);
+    return;
+  }
+
+  transform_idct_residual<16>(dst,coeffs,bdShift);
+}
+
+void transform_idct_32x32_sse4(int32_t *dst, const int16_t *coeffs, int bdShift, int max_coeff_bits)
+{
+  if (max_coeff_bits != 15) {
+    transform_idct_32x32_fallback(dst,coeffs,bdShift,max_coeff_bits);
+    return;
+  }
+
+  transform_idct_residual<32>(dst,coeffs,bdShift);
+}
+
+
+void add_residual_16_sse4(uint16_t *dst, ptrdiff_t stride, const int32_t* r, int nT, int bit_depth)
+{
+  const __m128i maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  if (nT==4) {
+    for (int y=0;y<4;y++) {
+      add_to_pixels4(dst + y*stride, _mm_loadu_si128((const __m128i*)(r + y*4)), maxval);
+    }
+    return;
+  }
+
+  for (int y=0;y<nT;y++) {
+    for (int x=0;x<nT;x+=8) {
+      uint16_t* p = dst + y*stride + x;
+      const int32_t* ri = r + y*nT + x;
+
+      __m128i v  = _mm_loadu_si128((const __m128i*)p);
+      __m128i lo = _mm_add_epi32(_mm_cvtepu16_epi32(v), _mm_loadu_si128((const __m128i*)ri));
+      __m128i hi = _mm_add_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(v,8)),
+                                 _mm_loadu_si128((const __m128i*)(ri+4)));
+
+      _mm_storeu_si128((__m128i*)p, _mm_min_epu16(_mm_packus_epi32(lo,hi), maxval));
+    }
+  }
+}
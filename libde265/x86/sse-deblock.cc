@@ -0,0 +1,395 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <emmintrin.h>
+#include <smmintrin.h> // SSE4.1
+
+#include "x86/sse-deblock.h"
+
+
+/* Each 32-bit lane holds one of the four lines across the edge. Samples p[i] and q[i]
+   are at distance i from the edge. Vertical edges are loaded row by row and transposed.
+
+   The filter decisions are taken from lines 0 and 3 only and are therefore computed
+   as scalars from the lanes 0 and 3.
+ */
+
+
+namespace {
+
+inline __m128i load_4(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+inline __m128i load_4(const uint16_t* p)
+{
+  return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+
+inline void store_4(uint8_t* p, __m128i v)
+{
+  v = _mm_packs_epi32(v,v);
+  v = _mm_packus_epi16(v,v);
+
+  int32_t w = _mm_cvtsi128_si32(v);
+  memcpy(p,&w,4);
+}
+
+inline void store_4(uint16_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, _mm_packus_epi32(v,v));
+}
+
+// store 4 + 4 consecutive pixels
+inline void store_8(uint8_t* p, __m128i lo, __m128i hi)
+{
+  __m128i v = _mm_packs_epi32(lo,hi);
+  _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(v,v));
+}
+
+inline void store_8(uint16_t* p, __m128i lo, __m128i hi)
+{
+  _mm_storeu_si128((__m128i*)p, _mm_packus_epi32(lo,hi));
+}
+
+
+inline void transpose_4x4(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+  __m128i t0 = _mm_unpacklo_epi32(a,b);
+  __m128i t1 = _mm_unpacklo_epi32(c,d);
+  __m128i t2 = _mm_unpackhi_epi32(a,b);
+  __m128i t3 = _mm_unpackhi_epi32(c,d);
+
+  a = _mm_unpacklo_epi64(t0,t1);
+  b = _mm_unpackhi_epi64(t0,t1);
+  c = _mm_unpacklo_epi64(t2,t3);
+  d = _mm_unpackhi_epi64(t2,t3);
+}
+
+
+inline __m128i clip_to_range(__m128i v, __m128i lo, __m128i hi)
+{
+  return _mm_min_epi32(_mm_max_epi32(v,lo),hi);
+}
+
+// Clip3(x-r, x+r, v)
+inline __m128i clip_around(__m128i v, __m128i x, __m128i r)
+{
+  return clip_to_range(v, _mm_sub_epi32(x,r), _mm_add_epi32(x,r));
+}
+
+inline int lane0(__m128i v) { return _mm_cvtsi128_si32(v); }
+inline int lane3(__m128i v) { return _mm_extract_epi32(v,3); }
+
+}
+
+
+template <class pixel_t>
+static void deblock_luma_segment_sse4(pixel_t* ptr, ptrdiff_t stride, bool vertical,
+                                      int beta, int tc, bool filterP, bool filterQ, int bit_depth)
+{
+  if (tc==0 || (!filterP && !filterQ)) {
+    return;
+  }
+
+  __m128i p[4],q[4];
+
+  if (vertical) {
+    for (int k=0;k<4;k++) {
+      p[3-k] = load_4(ptr + k*stride - 4);
+      q[k]   = load_4(ptr + k*stride);
+    }
+
+    transpose_4x4(p[3],p[2],p[1],p[0]);
+    transpose_4x4(q[0],q[1],q[2],q[3]);
+  }
+  else {
+    for (int i=0;i<4;i++) {
+      p[i] = load_4(ptr - (i+1)*stride);
+      q[i] = load_4(ptr +  i   *stride);
+    }
+  }
+
+
+  // decisions
+
+  __m128i dp   = _mm_abs_epi32(_mm_add_epi32(_mm_sub_epi32(p[2], _mm_slli_epi32(p[1],1)), p[0]));
+  __m128i dq   = _mm_abs_epi32(_mm_add_epi32(_mm_sub_epi32(q[2], _mm_slli_epi32(q[1],1)), q[0]));
+  __m128i dpq  = _mm_add_epi32(dp,dq);
+
+  int dpq0 = lane0(dpq);
+  int dpq3 = lane3(dpq);
+  int d    = dpq0 + dpq3;
+
+  if (d >= beta) {
+    return;
+  }
+
+  __m128i flat = _mm_add_epi32(_mm_abs_epi32(_mm_sub_epi32(p[3],p[0])),
+                               _mm_abs_epi32(_mm_sub_epi32(q[0],q[3])));
+  __m128i step = _mm_abs_epi32(_mm_sub_epi32(p[0],q[0]));
+
+  bool dSam0 = (2*dpq0 < (beta>>2) && lane0(flat) < (beta>>3) && lane0(step) < ((5*tc+1)>>1));
+  bool dSam3 = (2*dpq3 < (beta>>2) && lane3(flat) < (beta>>3) && lane3(step) < ((5*tc+1)>>1));
+
+  const __m128i zero   = _mm_setzero_si128();
+  const __m128i maxval = _mm_set1_epi32((1<<bit_depth)-1);
+
+  __m128i P[3] = { p[0],p[1],p[2] };
+  __m128i Q[3] = { q[0],q[1],q[2] };
+
+  if (dSam0 && dSam3) {
+    // strong filtering
+
+    const __m128i tc2 = _mm_set1_epi32(2*tc);
+    const __m128i c2  = _mm_set1_epi32(2);
+    const __m128i c4  = _mm_set1_epi32(4);
+
+    __m128i p0q0 = _mm_add_epi32(p[0],q[0]);
+
+    if (filterP) {
+      // (p2 + 2*p1 + 2*p0 + 2*q0 + q1 + 4) >> 3
+      __m128i s = _mm_add_epi32(_mm_slli_epi32(_mm_add_epi32(p[1],p0q0),1),
+                                _mm_add_epi32(_mm_add_epi32(p[2],q[1]),c4));
+      P[0] = clip_around(_mm_srai_epi32(s,3), p[0], tc2);
+
+      // (p2 + p1 + p0 + q0 + 2) >> 2
+      __m128i s4 = _mm_add_epi32(_mm_add_epi32(p[2],p[1]), p0q0);
+      P[1] = clip_around(_mm_srai_epi32(_mm_add_epi32(s4,c2),2), p[1], tc2);
+
+      // (2*p3 + 3*p2 + p1 + p0 + q0 + 4) >> 3
+      s = _mm_add_epi32(_mm_slli_epi32(_mm_add_epi32(p[3],p[2]),1), _mm_add_epi32(s4,c4));
+      P[2] = clip_around(_mm_srai_epi32(s,3), p[2], tc2);
+    }
+
+    if (filterQ) {
+      // (p1 + 2*p0 + 2*q0 + 2*q1 + q2 + 4) >> 3
+      __m128i s = _mm_add_epi32(_mm_slli_epi32(_mm_add_epi32(q[1],p0q0),1),
+                                _mm_add_epi32(_mm_add_epi32(q[2],p[1]),c4));
+      Q[0] = clip_around(_mm_srai_epi32(s,3), q[0], tc2);
+
+      // (p0 + q0 + q1 + q2 + 2) >> 2
+      __m128i s4 = _mm_add_epi32(_mm_add_epi32(q[2],q[1]), p0q0);
+      Q[1] = clip_around(_mm_srai_epi32(_mm_add_epi32(s4,c2),2), q[1], tc2);
+
+      // (p0 + q0 + q1 + 3*q2 + 2*q3 + 4) >> 3
+      s = _mm_add_epi32(_mm_slli_epi32(_mm_add_epi32(q[3],q[2]),1), _mm_add_epi32(s4,c4));
+      Q[2] = clip_around(_mm_srai_epi32(s,3), q[2], tc2);
+    }
+  }
+  else {
+    // weak filtering
+
+    int dEp_limit = (beta + (beta>>1))>>3;
+    bool dEp = (lane0(dp) + lane3(dp) < dEp_limit);
+    bool dEq = (lane0(dq) + lane3(dq) < dEp_limit);
+
+    const __m128i vtc   = _mm_set1_epi32(tc);
+    const __m128i vntc  = _mm_set1_epi32(-tc);
+
+    // delta = (9*(q0-p0) - 3*(q1-p1) + 8) >> 4
+
+    __m128i d0 = _mm_sub_epi32(q[0],p[0]);
+    __m128i d1 = _mm_sub_epi32(q[1],p[1]);
+    __m128i delta = _mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(d0,3), d0),
+                                  _mm_add_epi32(_mm_slli_epi32(d1,1), d1));
+    delta = _mm_srai_epi32(_mm_add_epi32(delta, _mm_set1_epi32(8)), 4);
+
+    __m128i filter = _mm_cmplt_epi32(_mm_abs_epi32(delta), _mm_set1_epi32(tc*10));
+    if (_mm_testz_si128(filter,filter)) {
+      return;
+    }
+
+    delta = clip_to_range(delta, vntc, vtc);
+
+    const __m128i vtc2  = _mm_set1_epi32(tc>>1);
+    const __m128i vntc2 = _mm_set1_epi32(-(tc>>1));
+    const __m128i one   = _mm_set1_epi32(1);
+
+    if (filterP) {
+      P[0] = clip_to_range(_mm_add_epi32(p[0],delta), zero, maxval);
+
+      if (dEp) {
+        // Clip3(-(tc>>1), tc>>1, (((p2+p0+1)>>1)-p1+delta)>>1)
+        __m128i delta_p = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(p[2],p[0]),one),1);
+        delta_p = _mm_srai_epi32(_mm_add_epi32(_mm_sub_epi32(delta_p,p[1]),delta),1);
+        delta_p = clip_to_range(delta_p, vntc2, vtc2);
+        P[1] = clip_to_range(_mm_add_epi32(p[1],delta_p), zero, maxval);
+      }
+    }
+
+    if (filterQ) {
+      Q[0] = clip_to_range(_mm_sub_epi32(q[0],delta), zero, maxval);
+
+      if (dEq) {
+        // Clip3(-(tc>>1), tc>>1, (((q2+q0+1)>>1)-q1-delta)>>1)
+        __m128i delta_q = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(q[2],q[0]),one),1);
+        delta_q = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(delta_q,q[1]),delta),1);
+        delta_q = clip_to_range(delta_q, vntc2, vtc2);
+        Q[1] = clip_to_range(_mm_add_epi32(q[1],delta_q), zero, maxval);
+      }
+    }
+
+    // lines with |delta| >= 10*tc are left unchanged
+
+    for (int i=0;i<2;i++) {
+      P[i] = _mm_blendv_epi8(p[i], P[i], filter);
+      Q[i] = _mm_blendv_epi8(q[i], Q[i], filter);
+    }
+  }
+
+
+  // write back (unfiltered samples are written with their original values)
+
+  if (vertical) {
+    __m128i p3 = p[3];
+    __m128i q3 = q[3];
+
+    transpose_4x4(p3,P[2],P[1],P[0]);
+    transpose_4x4(Q[0],Q[1],Q[2],q3);
+
+    store_8(ptr + 0*stride - 4, p3,  Q[0]);
+    store_8(ptr + 1*stride - 4, P[2],Q[1]);
+    store_8(ptr + 2*stride - 4, P[1],Q[2]);
+    store_8(ptr + 3*stride - 4, P[0],q3);
+  }
+  else {
+    for (int i=0;i<3;i++) {
+      if (filterP) store_4(ptr - (i+1)*stride, P[i]);
+      if (filterQ) store_4(ptr +  i   *stride, Q[i]);
+    }
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_chroma_segment_sse4(pixel_t* ptr, ptrdiff_t stride, bool vertical,
+                                        int tc, bool filterP, bool filterQ, int bit_depth)
+{
+  if (tc==0 || (!filterP && !filterQ)) {
+    return;
+  }
+
+  __m128i p1,p0,q0,q1;
+
+  if (vertical) {
+    p1 = load_4(ptr + 0*stride - 2);
+    p0 = load_4(ptr + 1*stride - 2);
+    q0 = load_4(ptr + 2*stride - 2);
+    q1 = load_4(ptr + 3*stride - 2);
+
+    transpose_4x4(p1,p0,q0,q1);
+  }
+  else {
+    p1 = load_4(ptr - 2*stride);
+    p0 = load_4(ptr - 1*stride);
+    q0 = load_4(ptr);
+    q1 = load_4(ptr + 1*stride);
+  }
+
+  // delta = Clip3(-tc,tc, ((((q0-p0)<<2) + p1-q1 + 4) >> 3))
+
+  __m128i delta = _mm_add_epi32(_mm_slli_epi32(_mm_sub_epi32(q0,p0),2), _mm_sub_epi32(p1,q1));
+  delta = _mm_srai_epi32(_mm_add_epi32(delta, _mm_set1_epi32(4)), 3);
+  delta = clip_to_range(delta, _mm_set1_epi32(-tc), _mm_set1_epi32(tc));
+
+  const __m128i zero   = _mm_setzero_si128();
+  const __m128i maxval = _mm_set1_epi32((1<<bit_depth)-1);
+
+  if (filterP) p0 = clip_to_range(_mm_add_epi32(p0,delta), zero, maxval);
+  if (filterQ) q0 = clip_to_range(_mm_sub_epi32(q0,delta), zero, maxval);
+
+  if (vertical) {
+    transpose_4x4(p1,p0,q0,q1);
+
+    store_4(ptr + 0*stride - 2, p1);
+    store_4(ptr + 1*stride - 2, p0);
+    store_4(ptr + 2*stride - 2, q0);
+    store_4(ptr + 3*stride - 2, q1);
+  }
+  else {
+    if (filterP) store_4(ptr - 1*stride, p0);
+    if (filterQ) store_4(ptr, q0);
+  }
+}
+
+
+// One segment fills one vector, the segments of a call are filtered one after the other.
+
+template <class pixel_t>
+static void deblock_luma_sse4(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                              const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                              int bit_depth)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s++) {
+    deblock_luma_segment_sse4(ptr + s*segmentStep, stride, vertical,
+                              beta[s], tc[s], filterP[s], filterQ[s], bit_depth);
+  }
+}
+
+
+template <class pixel_t>
+static void deblock_chroma_sse4(pixel_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                                const int* tc, const bool* filterP, const bool* filterQ,
+                                int bit_depth)
+{
+  const ptrdiff_t segmentStep = 4*(vertical ? stride : 1);
+
+  for (int s=0;s<nSegments;s++) {
+    deblock_chroma_segment_sse4(ptr + s*segmentStep, stride, vertical,
+                                tc[s], filterP[s], filterQ[s], bit_depth);
+  }
+}
+
+
+void deblock_luma_8_sse4(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                         const int* beta, const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_luma_sse4<uint8_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,8);
+}
+
+void deblock_chroma_8_sse4(uint8_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                           const int* tc, const bool* filterP, const bool* filterQ)
+{
+  deblock_chroma_sse4<uint8_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,8);
+}
+
+void deblock_luma_16_sse4(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                          const int* beta, const int* tc, const bool* filterP, const bool* filterQ,
+                          int bit_depth)
+{
+  deblock_luma_sse4<uint16_t>(ptr,stride,vertical,nSegments,beta,tc,filterP,filterQ,bit_depth);
+}
+
+void deblock_chroma_16_sse4(uint16_t* ptr, ptrdiff_t stride, bool vertical, int nSegments,
+                            const int* tc, const bool* filterP, const bool* filterQ, int bit_depth)
+{
+  deblock_chroma_sse4<uint16_t>(ptr,stride,vertical,nSegments,tc,filterP,filterQ,bit_depth);
+}
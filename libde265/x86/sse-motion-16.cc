@@ -0,0 +1,496 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <emmintrin.h>
+#include <smmintrin.h> // SSE4.1
+
+#include "x86/sse-motion-16.h"
+
+
+/* The samples are processed as 16-bit values, 8 per register. Since the samples have
+   at most 14 bits, the filters can be applied pairwise with madd, giving 32-bit sums.
+   Rows are processed in segments of 8, 4 and 2 samples. Only the samples in the filter
+   support are read.
+ */
+
+
+// --- loads and stores of N values ---
+
+template <int N> static inline __m128i load_s16(const int16_t* p);
+
+template <> inline __m128i load_s16<8>(const int16_t* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+template <> inline __m128i load_s16<4>(const int16_t* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template <> inline __m128i load_s16<2>(const int16_t* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtsi32_si128(v);
+}
+
+
+template <int N> static inline void store_s16(int16_t* p, __m128i v);
+
+template <> inline void store_s16<8>(int16_t* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+template <> inline void store_s16<4>(int16_t* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+template <> inline void store_s16<2>(int16_t* p, __m128i v)
+{
+  int32_t w = _mm_cvtsi128_si32(v);
+  memcpy(p,&w,4);
+}
+
+
+// clips the values to [0;maxval]
+template <int N>
+static inline void store_pixels(uint16_t* p, __m128i v, __m128i maxval)
+{
+  v = _mm_min_epi16(_mm_max_epi16(v, _mm_setzero_si128()), maxval);
+  store_s16<N>((int16_t*)p, v);
+}
+
+
+// Calls kernel.run<N>(x,y) for segments of N samples covering the block.
+template <class Kernel>
+static inline void for_each_segment(Kernel& kernel, int width, int height)
+{
+  for (int y=0;y<height;y++) {
+    int x=0;
+    for (;x+8<=width;x+=8) { kernel.template run<8>(x,y); }
+    if (x+4<=width) { kernel.template run<4>(x,y); x+=4; }
+    if (x+2<=width) { kernel.template run<2>(x,y); }
+  }
+}
+
+
+// Coefficient pairs (a,b) for madd.
+static inline __m128i set1_pair(int a, int b)
+{
+  return _mm_unpacklo_epi16(_mm_set1_epi16(a), _mm_set1_epi16(b));
+}
+
+
+// --- weighted prediction ---
+
+// The types are local to this file, other motion compensation files use the same names.
+namespace {
+
+struct unweighted_pred_kernel
+{
+  uint16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  __m128i offset, shift, maxval;
+
+  template <int N> void run(int x,int y) {
+    // The saturation does not change the result, because it is clipped anyway.
+    __m128i v = _mm_adds_epi16(load_s16<N>(src + x + y*srcstride), offset);
+    store_pixels<N>(dst + x + y*dststride, _mm_sra_epi16(v, shift), maxval);
+  }
+};
+
+struct weighted_pred_avg_kernel
+{
+  uint16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src1;
+  const int16_t* src2;  ptrdiff_t srcstride;
+  __m128i offset, shift, maxval;
+
+  template <int N> void run(int x,int y) {
+    const ptrdiff_t i = x + y*srcstride;
+
+    // A saturated sum is still clipped to the maximum value, because 32767>>(15-bit_depth)
+    // equals (1<<bit_depth)-1.
+    __m128i v = _mm_adds_epi16(load_s16<N>(src1+i), load_s16<N>(src2+i));
+    v = _mm_adds_epi16(v, offset);
+    store_pixels<N>(dst + x + y*dststride, _mm_sra_epi16(v, shift), maxval);
+  }
+};
+
+struct weighted_pred_kernel
+{
+  uint16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  __m128i w_rnd;  // pairs (w,rnd), multiplied with the pairs (src,1)
+  __m128i offset, shift, maxval;
+
+  template <int N> void run(int x,int y) {
+    __m128i v   = load_s16<N>(src + x + y*srcstride);
+    __m128i one = _mm_set1_epi16(1);
+
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(v,one), w_rnd);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(v,one), w_rnd);
+    lo = _mm_add_epi32(_mm_sra_epi32(lo, shift), offset);
+    hi = _mm_add_epi32(_mm_sra_epi32(hi, shift), offset);
+
+    store_pixels<N>(dst + x + y*dststride, _mm_packs_epi32(lo,hi), maxval);
+  }
+};
+
+struct weighted_bipred_kernel
+{
+  uint16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src1;
+  const int16_t* src2;  ptrdiff_t srcstride;
+  __m128i w1_w2, rnd, shift, maxval;
+
+  template <int N> void run(int x,int y) {
+    const ptrdiff_t i = x + y*srcstride;
+
+    __m128i a = load_s16<N>(src1+i);
+    __m128i b = load_s16<N>(src2+i);
+
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a,b), w1_w2), rnd);
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a,b), w1_w2), rnd);
+    lo = _mm_sra_epi32(lo, shift);
+    hi = _mm_sra_epi32(hi, shift);
+
+    store_pixels<N>(dst + x + y*dststride, _mm_packs_epi32(lo,hi), maxval);
+  }
+};
+
+} // namespace
+
+
+void put_unweighted_pred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                const int16_t *src, ptrdiff_t srcstride,
+                                int width, int height, int bit_depth)
+{
+  int shift1 = 14-bit_depth;
+  int offset1 = 0;
+  if (shift1>0) { offset1 = 1<<(shift1-1); }
+
+  unweighted_pred_kernel k;
+  k.dst = dst;  k.dststride = dststride;
+  k.src = src;  k.srcstride = srcstride;
+  k.offset = _mm_set1_epi16(offset1);
+  k.shift  = _mm_cvtsi32_si128(shift1);
+  k.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  for_each_segment(k, width,height);
+}
+
+
+void put_weighted_pred_avg_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                  const int16_t *src1, const int16_t *src2,
+                                  ptrdiff_t srcstride, int width, int height, int bit_depth)
+{
+  int shift2 = 15-bit_depth;
+
+  weighted_pred_avg_kernel k;
+  k.dst  = dst;   k.dststride = dststride;
+  k.src1 = src1;  k.src2 = src2;  k.srcstride = srcstride;
+  k.offset = _mm_set1_epi16(1<<(shift2-1));
+  k.shift  = _mm_cvtsi32_si128(shift2);
+  k.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  for_each_segment(k, width,height);
+}
+
+
+void put_weighted_pred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                              const int16_t *src, ptrdiff_t srcstride,
+                              int width, int height,
+                              int w,int o,int log2WD, int bit_depth)
+{
+  const int rnd = (1<<(log2WD-1));
+
+  weighted_pred_kernel k;
+  k.dst = dst;  k.dststride = dststride;
+  k.src = src;  k.srcstride = srcstride;
+  k.w_rnd  = set1_pair(w, rnd);
+  k.offset = _mm_set1_epi32(o);
+  k.shift  = _mm_cvtsi32_si128(log2WD);
+  k.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  for_each_segment(k, width,height);
+}
+
+
+void put_weighted_bipred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                const int16_t *src1, const int16_t *src2, ptrdiff_t srcstride,
+                                int width, int height,
+                                int w1,int o1, int w2,int o2, int log2WD, int bit_depth)
+{
+  weighted_bipred_kernel k;
+  k.dst  = dst;   k.dststride = dststride;
+  k.src1 = src1;  k.src2 = src2;  k.srcstride = srcstride;
+  k.w1_w2  = set1_pair(w1, w2);
+  k.rnd    = _mm_set1_epi32((o1+o2+1) << log2WD);
+  k.shift  = _mm_cvtsi32_si128(log2WD+1);
+  k.maxval = _mm_set1_epi16((1<<bit_depth)-1);
+
+  for_each_segment(k, width,height);
+}
+
+
+// --- interpolation filters ---
+
+/* The filters for xFrac=1 and xFrac=3 only have 7 taps and are padded with a zero coefficient.
+   The samples of this last tap are not read, they are outside of the reference block that
+   mc_luma() provides (see mc_filter::skip_last_tap).
+ */
+static const int8_t qpel_filter[4][8] = {
+  {  0, 0,   0, 64,  0,   0, 0,  0 },
+  { -1, 4, -10, 58, 17,  -5, 1,  0 },
+  { -1, 4, -11, 40, 40, -11, 4, -1 },
+  {  1,-5,  17, 58,-10,   4,-1,  0 }
+};
+
+static const int qpel_first_tap[4] = { -3,-3,-3,-2 };
+
+static const int8_t epel_filter[8][4] = {
+  {  0, 64,  0,  0 },
+  { -2, 58, 10, -2 },
+  { -4, 54, 16, -2 },
+  { -6, 46, 28, -4 },
+  { -4, 36, 36, -4 },
+  { -4, 28, 46, -6 },
+  { -2, 16, 54, -4 },
+  { -2, 10, 58, -2 }
+};
+
+static const int epel_first_tap = -1;
+
+
+namespace {
+
+template <int NTAPS>
+struct mc_filter
+{
+  int first_tap; // offset of the first tap relative to the filtered sample
+  bool skip_last_tap; // the last coefficient is zero, its samples are not loaded
+  __m128i pairs[NTAPS/2];
+
+  void set(const int8_t* coeffs, int first) {
+    first_tap = first;
+    skip_last_tap = (coeffs[NTAPS-1]==0);
+    for (int j=0;j<NTAPS/2;j++) {
+      pairs[j] = set1_pair(coeffs[2*j], coeffs[2*j+1]);
+    }
+  }
+};
+
+
+/* Filters N samples, horizontally (step=1) or vertically (step=stride), and shifts the
+   result right by 'shift'. The input may be samples or 16-bit intermediate values.
+ */
+template <int N, int NTAPS>
+static inline __m128i apply_filter(const int16_t* p, ptrdiff_t step,
+                                   const mc_filter<NTAPS>& f, __m128i shift)
+{
+  p += f.first_tap*step;
+
+  __m128i lo = _mm_setzero_si128();
+  __m128i hi = _mm_setzero_si128();
+
+  for (int j=0;j<NTAPS/2;j++) {
+    __m128i a = load_s16<N>(p);
+    __m128i b;
+    if (j==NTAPS/2-1 && f.skip_last_tap) { b = _mm_setzero_si128(); }
+    else                                 { b = load_s16<N>(p+step); }
+
+    lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a,b), f.pairs[j]));
+    if (N==8) {
+      hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a,b), f.pairs[j]));
+    }
+
+    p += 2*step;
+  }
+
+  return _mm_packs_epi32(_mm_sra_epi32(lo,shift), _mm_sra_epi32(hi,shift));
+}
+
+
+struct copy_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  __m128i shift;
+
+  template <int N> void run(int x,int y) {
+    __m128i v = load_s16<N>(src + x + y*srcstride);
+    store_s16<N>(dst + x + y*dststride, _mm_sll_epi16(v, shift));
+  }
+};
+
+template <int NTAPS>
+struct filter_kernel
+{
+  int16_t* dst;  ptrdiff_t dststride;
+  const int16_t* src;  ptrdiff_t srcstride;
+  ptrdiff_t step;
+  const mc_filter<NTAPS>* filter;
+  __m128i shift;
+
+  template <int N> void run(int x,int y) {
+    __m128i v = apply_filter<N>(src + x + y*srcstride, step, *filter, shift);
+    store_s16<N>(dst + x + y*dststride, v);
+  }
+};
+
+} // namespace
+
+
+static void copy_samples(int16_t *dst, ptrdiff_t dststride,
+                         const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                         int bit_depth)
+{
+  copy_kernel k = { dst,dststride, (const int16_t*)src,srcstride, _mm_cvtsi32_si128(14-bit_depth) };
+  for_each_segment(k, width,height);
+}
+
+template <int NTAPS>
+static void filter_h(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     const mc_filter<NTAPS>& f, int bit_depth)
+{
+  filter_kernel<NTAPS> k = { dst,dststride, (const int16_t*)src,srcstride, 1, &f,
+                             _mm_cvtsi32_si128(bit_depth-8) };
+  for_each_segment(k, width,height);
+}
+
+template <int NTAPS>
+static void filter_v(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     const mc_filter<NTAPS>& f, int bit_depth)
+{
+  filter_kernel<NTAPS> k = { dst,dststride, (const int16_t*)src,srcstride, srcstride, &f,
+                             _mm_cvtsi32_si128(bit_depth-8) };
+  for_each_segment(k, width,height);
+}
+
+/* Separable 2D filtering. The horizontal filter is applied to all rows in the support
+   of the vertical filter and the result is stored in 'mcbuffer'
+   (of size MAX_CU_SIZE*(MAX_CU_SIZE+7)).
+ */
+template <int NTAPS>
+static void filter_hv(int16_t *dst, ptrdiff_t dststride,
+                      const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                      const mc_filter<NTAPS>& fh, const mc_filter<NTAPS>& fv,
+                      int16_t* mcbuffer, int bit_depth)
+{
+  const int extra_top = -fv.first_tap;
+  const int nrows = height+NTAPS-1 - (fv.skip_last_tap ? 1 : 0);
+
+  filter_h(mcbuffer, width, src - extra_top*srcstride, srcstride, width, nrows,
+           fh, bit_depth);
+
+  filter_kernel<NTAPS> v = { dst,dststride, mcbuffer + extra_top*width, width, width, &fv,
+                             _mm_cvtsi32_si128(6) };
+  for_each_segment(v, width,height);
+}
+
+
+// --- chroma ---
+
+void put_epel_16_sse(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  copy_samples(dst,dststride, src,srcstride, width,height, bit_depth);
+}
+
+void put_epel_h_16_sse(int16_t *dst, ptrdiff_t dststride,
+                       const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[mx], epel_first_tap);
+
+  filter_h(dst,dststride, src,srcstride, width,height, f, bit_depth);
+}
+
+void put_epel_v_16_sse(int16_t *dst, ptrdiff_t dststride,
+                       const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> f;
+  f.set(epel_filter[my], epel_first_tap);
+
+  filter_v(dst,dststride, src,srcstride, width,height, f, bit_depth);
+}
+
+void put_epel_hv_16_sse(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        int mx, int my, int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<4> fh,fv;
+  fh.set(epel_filter[mx], epel_first_tap);
+  fv.set(epel_filter[my], epel_first_tap);
+
+  filter_hv(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer, bit_depth);
+}
+
+
+// --- luma ---
+
+template <int xFrac, int yFrac>
+void put_qpel_16_sse(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     int16_t* mcbuffer, int bit_depth)
+{
+  mc_filter<8> fh,fv;
+  if (xFrac) { fh.set(qpel_filter[xFrac], qpel_first_tap[xFrac]); }
+  if (yFrac) { fv.set(qpel_filter[yFrac], qpel_first_tap[yFrac]); }
+
+  if (xFrac==0 && yFrac==0) {
+    copy_samples(dst,dststride, src,srcstride, width,height, bit_depth);
+  }
+  else if (yFrac==0) {
+    filter_h(dst,dststride, src,srcstride, width,height, fh, bit_depth);
+  }
+  else if (xFrac==0) {
+    filter_v(dst,dststride, src,srcstride, width,height, fv, bit_depth);
+  }
+  else {
+    filter_hv(dst,dststride, src,srcstride, width,height, fh,fv, mcbuffer, bit_depth);
+  }
+}
+
+
+#define INSTANTIATE_QPEL(xFrac) \
+  template void put_qpel_16_sse<xFrac,0>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_sse<xFrac,1>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_sse<xFrac,2>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int); \
+  template void put_qpel_16_sse<xFrac,3>(int16_t*,ptrdiff_t,const uint16_t*,ptrdiff_t,int,int,int16_t*,int)
+
+INSTANTIATE_QPEL(0);
+INSTANTIATE_QPEL(1);
+INSTANTIATE_QPEL(2);
+INSTANTIATE_QPEL(3);
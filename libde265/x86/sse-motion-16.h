@@ -0,0 +1,74 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SSE_MOTION_16_H
+#define SSE_MOTION_16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* SSE4.1 versions of the motion compensation functions for bit depths > 8.
+   The results are identical to the fallback functions for bit depths up to 14.
+ */
+
+void put_unweighted_pred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                const int16_t *src, ptrdiff_t srcstride,
+                                int width, int height, int bit_depth);
+
+void put_weighted_pred_avg_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                  const int16_t *src1, const int16_t *src2,
+                                  ptrdiff_t srcstride, int width, int height, int bit_depth);
+
+void put_weighted_pred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                              const int16_t *src, ptrdiff_t srcstride,
+                              int width, int height,
+                              int w,int o,int log2WD, int bit_depth);
+
+void put_weighted_bipred_16_sse(uint16_t *dst, ptrdiff_t dststride,
+                                const int16_t *src1, const int16_t *src2, ptrdiff_t srcstride,
+                                int width, int height,
+                                int w1,int o1, int w2,int o2, int log2WD, int bit_depth);
+
+
+void put_epel_16_sse(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     int mx, int my, int16_t* mcbuffer, int bit_depth);
+
+void put_epel_h_16_sse(int16_t *dst, ptrdiff_t dststride,
+                       const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth);
+
+void put_epel_v_16_sse(int16_t *dst, ptrdiff_t dststride,
+                       const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                       int mx, int my, int16_t* mcbuffer, int bit_depth);
+
+void put_epel_hv_16_sse(int16_t *dst, ptrdiff_t dststride,
+                        const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                        int mx, int my, int16_t* mcbuffer, int bit_depth);
+
+
+// Instantiated for all 16 combinations of xFrac,yFrac in sse-motion-16.cc.
+template <int xFrac, int yFrac>
+void put_qpel_16_sse(int16_t *dst, ptrdiff_t dststride,
+                     const uint16_t *src, ptrdiff_t srcstride, int width, int height,
+                     int16_t* mcbuffer, int bit_depth);
+
+#endif
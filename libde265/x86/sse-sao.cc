@@ -0,0 +1,337 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <emmintrin.h>
+#include <tmmintrin.h> // SSSE3
+#include <smmintrin.h> // SSE4.1
+
+#include "x86/sse-sao.h"
+#include "libde265/fallback-sao.h"
+
+
+/* The offset of each sample is looked up with a byte shuffle: the 32 band offsets are
+   split into two 16-entry tables, the edge offsets are indexed with the sum of the two
+   difference signs (+2). High bit depth samples are packed to byte indices for the lookup.
+
+   The offsets are added with unsigned saturation (positive and negative parts separately),
+   which also implements the clipping to the valid sample range.
+
+   Each row is processed in full registers, followed by half and quarter registers.
+   Remaining columns are passed to the fallback functions.
+ */
+
+
+namespace {
+
+template <int NBYTES> inline __m128i load_bytes(const void* p);
+
+template <> inline __m128i load_bytes<16>(const void* p)
+{
+  return _mm_loadu_si128((const __m128i*)p);
+}
+
+template <> inline __m128i load_bytes<8>(const void* p)
+{
+  return _mm_loadl_epi64((const __m128i*)p);
+}
+
+template <> inline __m128i load_bytes<4>(const void* p)
+{
+  int32_t v;
+  memcpy(&v,p,4);
+  return _mm_cvtsi32_si128(v);
+}
+
+
+template <int NBYTES> inline void store_bytes(void* p, __m128i v);
+
+template <> inline void store_bytes<16>(void* p, __m128i v)
+{
+  _mm_storeu_si128((__m128i*)p, v);
+}
+
+template <> inline void store_bytes<8>(void* p, __m128i v)
+{
+  _mm_storel_epi64((__m128i*)p, v);
+}
+
+template <> inline void store_bytes<4>(void* p, __m128i v)
+{
+  int32_t w = _mm_cvtsi128_si32(v);
+  memcpy(p,&w,4);
+}
+
+
+inline __m128i add_offset_8(__m128i v, __m128i offset)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i pos = _mm_max_epi8(offset, zero);
+  __m128i neg = _mm_abs_epi8(_mm_min_epi8(offset, zero));
+
+  return _mm_subs_epu8(_mm_adds_epu8(v,pos),neg);
+}
+
+// 'offset' are 8 bytes that are sign-extended to 16 bit
+inline __m128i add_offset_16(__m128i v, __m128i offset, __m128i maxval)
+{
+  const __m128i zero = _mm_setzero_si128();
+  offset = _mm_cvtepi8_epi16(offset);
+  __m128i pos = _mm_max_epi16(offset, zero);
+  __m128i neg = _mm_abs_epi16(_mm_min_epi16(offset, zero));
+
+  return _mm_min_epu16(_mm_subs_epu16(_mm_adds_epu16(v,pos),neg), maxval);
+}
+
+// byte lookup in a 32-entry table
+inline __m128i lookup_32(__m128i idx, __m128i tableLo, __m128i tableHi)
+{
+  return _mm_blendv_epi8(_mm_shuffle_epi8(tableLo, idx),
+                         _mm_shuffle_epi8(tableHi, idx),
+                         _mm_cmpgt_epi8(idx, _mm_set1_epi8(15)));
+}
+
+// Sign(a-b) for unsigned bytes
+inline __m128i sign_diff_8(__m128i a, __m128i b)
+{
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  a = _mm_xor_si128(a,bias);
+  b = _mm_xor_si128(b,bias);
+  return _mm_sub_epi8(_mm_cmpgt_epi8(b,a), _mm_cmpgt_epi8(a,b));
+}
+
+// Sign(a-b) for unsigned 16-bit values
+inline __m128i sign_diff_16(__m128i a, __m128i b)
+{
+  const __m128i bias = _mm_set1_epi16((short)0x8000);
+  a = _mm_xor_si128(a,bias);
+  b = _mm_xor_si128(b,bias);
+  return _mm_sub_epi16(_mm_cmpgt_epi16(b,a), _mm_cmpgt_epi16(a,b));
+}
+
+
+struct band_offset_8
+{
+  __m128i tableLo, tableHi;
+
+  template <int NBYTES> __m128i filter(const uint8_t* in) const
+  {
+    __m128i v   = load_bytes<NBYTES>(in);
+    __m128i idx = _mm_and_si128(_mm_srli_epi16(v,3), _mm_set1_epi8(31));
+    return add_offset_8(v, lookup_32(idx, tableLo,tableHi));
+  }
+};
+
+struct band_offset_16
+{
+  __m128i tableLo, tableHi;
+  __m128i shift;
+  __m128i maxval;
+
+  template <int NBYTES> __m128i filter(const uint16_t* in) const
+  {
+    __m128i v   = load_bytes<NBYTES>(in);
+    __m128i idx = _mm_srl_epi16(v,shift);
+    idx = _mm_packus_epi16(idx,idx);
+    return add_offset_16(v, lookup_32(idx, tableLo,tableHi), maxval);
+  }
+};
+
+struct edge_offset_8
+{
+  __m128i table;
+  ptrdiff_t pos0, pos1;
+
+  template <int NBYTES> __m128i filter(const uint8_t* in) const
+  {
+    __m128i v = load_bytes<NBYTES>(in);
+    __m128i a = load_bytes<NBYTES>(in+pos0);
+    __m128i b = load_bytes<NBYTES>(in+pos1);
+
+    __m128i idx = _mm_add_epi8(_mm_add_epi8(sign_diff_8(v,a), sign_diff_8(v,b)),
+                               _mm_set1_epi8(2));
+    return add_offset_8(v, _mm_shuffle_epi8(table, idx));
+  }
+};
+
+struct edge_offset_16
+{
+  __m128i table;
+  __m128i maxval;
+  ptrdiff_t pos0, pos1;
+
+  template <int NBYTES> __m128i filter(const uint16_t* in) const
+  {
+    __m128i v = load_bytes<NBYTES>(in);
+    __m128i a = load_bytes<NBYTES>(in+pos0);
+    __m128i b = load_bytes<NBYTES>(in+pos1);
+
+    __m128i idx = _mm_add_epi16(_mm_add_epi16(sign_diff_16(v,a), sign_diff_16(v,b)),
+                                _mm_set1_epi16(2));
+    idx = _mm_packs_epi16(idx,idx);
+    return add_offset_16(v, _mm_shuffle_epi8(table, idx), maxval);
+  }
+};
+
+
+/* Filters all rows and returns the number of columns that have been processed.
+   This is the same for all rows, as it only depends on the width.
+ */
+template <class pixel_t, class kernel>
+int filter_block(pixel_t* out, ptrdiff_t out_stride,
+                 const pixel_t* in, ptrdiff_t in_stride,
+                 int width, int height, const kernel& k)
+{
+  const int n = 16/sizeof(pixel_t); // samples per register
+
+  int x=0;
+
+  for (int y=0;y<height;y++) {
+    x=0;
+
+    for (;x+n<=width;x+=n) {
+      store_bytes<16>(out+x, k.template filter<16>(in+x));
+    }
+
+    if (x+n/2<=width) {
+      store_bytes<8>(out+x, k.template filter<8>(in+x));
+      x+=n/2;
+    }
+
+    if (x+n/4<=width) {
+      store_bytes<4>(out+x, k.template filter<4>(in+x));
+      x+=n/4;
+    }
+
+    out += out_stride;
+    in  += in_stride;
+  }
+
+  return x;
+}
+
+
+void init_band_table(__m128i& tableLo, __m128i& tableHi,
+                     int saoLeftClass, const int8_t* saoOffsetVal)
+{
+  int8_t table[32];
+  memset(table,0,32);
+
+  for (int k=0;k<4;k++) {
+    table[ (k+saoLeftClass)&31 ] = saoOffsetVal[k];
+  }
+
+  tableLo = _mm_loadu_si128((const __m128i*)&table[0]);
+  tableHi = _mm_loadu_si128((const __m128i*)&table[16]);
+}
+
+__m128i init_edge_table(const int8_t* saoOffsetVal)
+{
+  return _mm_setr_epi8(saoOffsetVal[0], saoOffsetVal[1], 0, saoOffsetVal[2], saoOffsetVal[3],
+                       0,0,0, 0,0,0,0, 0,0,0,0);
+}
+
+void edge_neighbor_offsets(int SaoEoClass, ptrdiff_t in_stride, ptrdiff_t& pos0, ptrdiff_t& pos1)
+{
+  int hPos[2], vPos[2];
+  sao_edge_offset_neighbors(SaoEoClass, hPos,vPos);
+
+  pos0 = hPos[0] + vPos[0]*in_stride;
+  pos1 = hPos[1] + vPos[1]*in_stride;
+}
+
+}
+
+
+void sao_band_offset_8_sse4(uint8_t* out, ptrdiff_t out_stride,
+                            const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height,
+                            int saoLeftClass, const int8_t* saoOffsetVal)
+{
+  band_offset_8 k;
+  init_band_table(k.tableLo, k.tableHi, saoLeftClass, saoOffsetVal);
+
+  int x = filter_block(out,out_stride, in,in_stride, width,height, k);
+
+  if (x<width) {
+    sao_band_offset_8_fallback(out+x,out_stride, in+x,in_stride, width-x,height,
+                               saoLeftClass,saoOffsetVal);
+  }
+}
+
+
+void sao_band_offset_16_sse4(uint16_t* out, ptrdiff_t out_stride,
+                             const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height,
+                             int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth)
+{
+  band_offset_16 k;
+  init_band_table(k.tableLo, k.tableHi, saoLeftClass, saoOffsetVal);
+  k.shift  = _mm_cvtsi32_si128(bit_depth-5);
+  k.maxval = _mm_set1_epi16((short)((1<<bit_depth)-1));
+
+  int x = filter_block(out,out_stride, in,in_stride, width,height, k);
+
+  if (x<width) {
+    sao_band_offset_16_fallback(out+x,out_stride, in+x,in_stride, width-x,height,
+                                saoLeftClass,saoOffsetVal, bit_depth);
+  }
+}
+
+
+void sao_edge_offset_8_sse4(uint8_t* out, ptrdiff_t out_stride,
+                            const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height,
+                            int SaoEoClass, const int8_t* saoOffsetVal)
+{
+  edge_offset_8 k;
+  k.table = init_edge_table(saoOffsetVal);
+  edge_neighbor_offsets(SaoEoClass, in_stride, k.pos0, k.pos1);
+
+  int x = filter_block(out,out_stride, in,in_stride, width,height, k);
+
+  if (x<width) {
+    sao_edge_offset_8_fallback(out+x,out_stride, in+x,in_stride, width-x,height,
+                               SaoEoClass,saoOffsetVal);
+  }
+}
+
+
+void sao_edge_offset_16_sse4(uint16_t* out, ptrdiff_t out_stride,
+                             const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height,
+                             int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth)
+{
+  edge_offset_16 k;
+  k.table  = init_edge_table(saoOffsetVal);
+  k.maxval = _mm_set1_epi16((short)((1<<bit_depth)-1));
+  edge_neighbor_offsets(SaoEoClass, in_stride, k.pos0, k.pos1);
+
+  int x = filter_block(out,out_stride, in,in_stride, width,height, k);
+
+  if (x<width) {
+    sao_edge_offset_16_fallback(out+x,out_stride, in+x,in_stride, width-x,height,
+                                SaoEoClass,saoOffsetVal, bit_depth);
+  }
+}
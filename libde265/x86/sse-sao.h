@@ -0,0 +1,52 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SSE_SAO_H
+#define SSE_SAO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* SSE4.1 sample adaptive offset filters. The results are identical to the fallback functions.
+ */
+
+void sao_band_offset_8_sse4(uint8_t* out, ptrdiff_t out_stride,
+                            const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height,
+                            int saoLeftClass, const int8_t* saoOffsetVal);
+
+void sao_band_offset_16_sse4(uint16_t* out, ptrdiff_t out_stride,
+                             const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height,
+                             int saoLeftClass, const int8_t* saoOffsetVal, int bit_depth);
+
+void sao_edge_offset_8_sse4(uint8_t* out, ptrdiff_t out_stride,
+                            const uint8_t* in, ptrdiff_t in_stride,
+                            int width, int height,
+                            int SaoEoClass, const int8_t* saoOffsetVal);
+
+void sao_edge_offset_16_sse4(uint16_t* out, ptrdiff_t out_stride,
+                             const uint16_t* in, ptrdiff_t in_stride,
+                             int width, int height,
+                             int SaoEoClass, const int8_t* saoOffsetVal, int bit_depth);
+
+#endif
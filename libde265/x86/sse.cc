@@ -24,7 +24,15 @@
 
 #include "x86/sse.h"
 #include "x86/sse-motion.h"
+#include "x86/sse-motion-16.h"
 #include "x86/sse-dct.h"
+#include "x86/sse-dct-16.h"
+#include "x86/sse-deblock.h"
+#include "x86/sse-sao.h"
+#ifdef HAVE_AVX2
+#include "x86/avx2-motion.h"
+#include "x86/avx2-deblock.h"
+#endif
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -89,6 +97,33 @@ void init_acceleration_functions_sse(struct acceleration_functions* accel)
     accel->put_hevc_qpel_8[3][2] = ff_hevc_put_hevc_qpel_h_3_v_2_sse;
     accel->put_hevc_qpel_8[3][3] = ff_hevc_put_hevc_qpel_h_3_v_3_sse;
 
+    accel->put_unweighted_pred_16   = put_unweighted_pred_16_sse;
+    accel->put_weighted_pred_avg_16 = put_weighted_pred_avg_16_sse;
+    accel->put_weighted_pred_16     = put_weighted_pred_16_sse;
+    accel->put_weighted_bipred_16   = put_weighted_bipred_16_sse;
+
+    accel->put_hevc_epel_16    = put_epel_16_sse;
+    accel->put_hevc_epel_h_16  = put_epel_h_16_sse;
+    accel->put_hevc_epel_v_16  = put_epel_v_16_sse;
+    accel->put_hevc_epel_hv_16 = put_epel_hv_16_sse;
+
+    accel->put_hevc_qpel_16[0][0] = put_qpel_16_sse<0,0>;
+    accel->put_hevc_qpel_16[0][1] = put_qpel_16_sse<0,1>;
+    accel->put_hevc_qpel_16[0][2] = put_qpel_16_sse<0,2>;
+    accel->put_hevc_qpel_16[0][3] = put_qpel_16_sse<0,3>;
+    accel->put_hevc_qpel_16[1][0] = put_qpel_16_sse<1,0>;
+    accel->put_hevc_qpel_16[1][1] = put_qpel_16_sse<1,1>;
+    accel->put_hevc_qpel_16[1][2] = put_qpel_16_sse<1,2>;
+    accel->put_hevc_qpel_16[1][3] = put_qpel_16_sse<1,3>;
+    accel->put_hevc_qpel_16[2][0] = put_qpel_16_sse<2,0>;
+    accel->put_hevc_qpel_16[2][1] = put_qpel_16_sse<2,1>;
+    accel->put_hevc_qpel_16[2][2] = put_qpel_16_sse<2,2>;
+    accel->put_hevc_qpel_16[2][3] = put_qpel_16_sse<2,3>;
+    accel->put_hevc_qpel_16[3][0] = put_qpel_16_sse<3,0>;
+    accel->put_hevc_qpel_16[3][1] = put_qpel_16_sse<3,1>;
+    accel->put_hevc_qpel_16[3][2] = put_qpel_16_sse<3,2>;
+    accel->put_hevc_qpel_16[3][3] = put_qpel_16_sse<3,3>;
+
     accel->transform_skip_8 = ff_hevc_transform_skip_8_sse;
 
     // actually, for these two functions, the scalar fallback seems to be faster than the SSE code
@@ -98,7 +133,149 @@ void init_acceleration_functions_sse(struct acceleration_functions* accel)
     accel->transform_add_8[1] = ff_hevc_transform_8x8_add_8_sse4;
     accel->transform_add_8[2] = ff_hevc_transform_16x16_add_8_sse4;
     accel->transform_add_8[3] = ff_hevc_transform_32x32_add_8_sse4;
+
+    accel->transform_4x4_dst_add_16 = transform_4x4_dst_add_16_sse4;
+    accel->transform_add_16[0] = transform_4x4_add_16_sse4;
+    accel->transform_add_16[1] = transform_8x8_add_16_sse4;
+    accel->transform_add_16[2] = transform_16x16_add_16_sse4;
+    accel->transform_add_16[3] = transform_32x32_add_16_sse4;
+
+    accel->transform_idst_4x4   = transform_idst_4x4_sse4;
+    accel->transform_idct_4x4   = transform_idct_4x4_sse4;
+    accel->transform_idct_8x8   = transform_idct_8x8_sse4;
+    accel->transform_idct_16x16 = transform_idct_16x16_sse4;
+    accel->transform_idct_32x32 = transform_idct_32x32_sse4;
+
+    accel->add_residual_16 = add_residual_16_sse4;
+
+    accel->deblock_luma_8    = deblock_luma_8_sse4;
+    accel->deblock_chroma_8  = deblock_chroma_8_sse4;
+    accel->deblock_luma_16   = deblock_luma_16_sse4;
+    accel->deblock_chroma_16 = deblock_chroma_16_sse4;
+
+    accel->sao_band_offset_8  = sao_band_offset_8_sse4;
+    accel->sao_edge_offset_8  = sao_edge_offset_8_sse4;
+    accel->sao_band_offset_16 = sao_band_offset_16_sse4;
+    accel->sao_edge_offset_16 = sao_edge_offset_16_sse4;
   }
 #endif
 }
 
+
+
+#ifdef HAVE_AVX2
+static bool cpu_supports_AVX2()
+{
+  uint32_t ecx1=0, ebx7=0;
+
+#ifdef _MSC_VER
+  int regs[4];
+
+  __cpuid(regs, 0);
+  if (regs[0] < 7) {
+    return false;
+  }
+
+  __cpuid(regs, 1);
+  ecx1 = regs[2];
+
+  __cpuidex(regs, 7, 0);
+  ebx7 = regs[1];
+#else
+  uint32_t eax,ebx,ecx,edx;
+  if (__get_cpuid_max(0, NULL) < 7) {
+    return false;
+  }
+
+  __get_cpuid(1, &eax,&ebx,&ecx1,&edx);
+  __cpuid_count(7, 0, eax,ebx7,ecx,edx);
+#endif
+
+  int have_OSXSAVE = !!(ecx1 & (1<<27));
+  int have_AVX     = !!(ecx1 & (1<<28));
+  int have_AVX2    = !!(ebx7 & (1<<5));
+
+  if (!have_OSXSAVE || !have_AVX || !have_AVX2) {
+    return false;
+  }
+
+  // the operating system has to save the YMM registers on context switches
+
+#ifdef _MSC_VER
+  uint64_t xcr0 = _xgetbv(0);
+#else
+  uint32_t xcr0_lo, xcr0_hi;
+  __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+  uint64_t xcr0 = xcr0_lo | ((uint64_t)xcr0_hi << 32);
+#endif
+
+  return (xcr0 & 6) == 6;
+}
+
+
+void init_acceleration_functions_avx2(struct acceleration_functions* accel)
+{
+  if (!cpu_supports_AVX2()) {
+    return;
+  }
+
+  accel->put_unweighted_pred_8   = put_unweighted_pred_8_avx2;
+  accel->put_weighted_pred_avg_8 = put_weighted_pred_avg_8_avx2;
+  accel->put_weighted_pred_8     = put_weighted_pred_8_avx2;
+  accel->put_weighted_bipred_8   = put_weighted_bipred_8_avx2;
+
+  accel->put_hevc_epel_8    = put_epel_8_avx2;
+  accel->put_hevc_epel_h_8  = put_epel_h_8_avx2;
+  accel->put_hevc_epel_v_8  = put_epel_v_8_avx2;
+  accel->put_hevc_epel_hv_8 = put_epel_hv_8_avx2;
+
+  accel->put_hevc_qpel_8[0][0] = put_qpel_8_avx2<0,0>;
+  accel->put_hevc_qpel_8[0][1] = put_qpel_8_avx2<0,1>;
+  accel->put_hevc_qpel_8[0][2] = put_qpel_8_avx2<0,2>;
+  accel->put_hevc_qpel_8[0][3] = put_qpel_8_avx2<0,3>;
+  accel->put_hevc_qpel_8[1][0] = put_qpel_8_avx2<1,0>;
+  accel->put_hevc_qpel_8[1][1] = put_qpel_8_avx2<1,1>;
+  accel->put_hevc_qpel_8[1][2] = put_qpel_8_avx2<1,2>;
+  accel->put_hevc_qpel_8[1][3] = put_qpel_8_avx2<1,3>;
+  accel->put_hevc_qpel_8[2][0] = put_qpel_8_avx2<2,0>;
+  accel->put_hevc_qpel_8[2][1] = put_qpel_8_avx2<2,1>;
+  accel->put_hevc_qpel_8[2][2] = put_qpel_8_avx2<2,2>;
+  accel->put_hevc_qpel_8[2][3] = put_qpel_8_avx2<2,3>;
+  accel->put_hevc_qpel_8[3][0] = put_qpel_8_avx2<3,0>;
+  accel->put_hevc_qpel_8[3][1] = put_qpel_8_avx2<3,1>;
+  accel->put_hevc_qpel_8[3][2] = put_qpel_8_avx2<3,2>;
+  accel->put_hevc_qpel_8[3][3] = put_qpel_8_avx2<3,3>;
+
+  accel->put_unweighted_pred_16   = put_unweighted_pred_16_avx2;
+  accel->put_weighted_pred_avg_16 = put_weighted_pred_avg_16_avx2;
+  accel->put_weighted_pred_16     = put_weighted_pred_16_avx2;
+  accel->put_weighted_bipred_16   = put_weighted_bipred_16_avx2;
+
+  accel->put_hevc_epel_16    = put_epel_16_avx2;
+  accel->put_hevc_epel_h_16  = put_epel_h_16_avx2;
+  accel->put_hevc_epel_v_16  = put_epel_v_16_avx2;
+  accel->put_hevc_epel_hv_16 = put_epel_hv_16_avx2;
+
+  accel->put_hevc_qpel_16[0][0] = put_qpel_16_avx2<0,0>;
+  accel->put_hevc_qpel_16[0][1] = put_qpel_16_avx2<0,1>;
+  accel->put_hevc_qpel_16[0][2] = put_qpel_16_avx2<0,2>;
+  accel->put_hevc_qpel_16[0][3] = put_qpel_16_avx2<0,3>;
+  accel->put_hevc_qpel_16[1][0] = put_qpel_16_avx2<1,0>;
+  accel->put_hevc_qpel_16[1][1] = put_qpel_16_avx2<1,1>;
+  accel->put_hevc_qpel_16[1][2] = put_qpel_16_avx2<1,2>;
+  accel->put_hevc_qpel_16[1][3] = put_qpel_16_avx2<1,3>;
+  accel->put_hevc_qpel_16[2][0] = put_qpel_16_avx2<2,0>;
+  accel->put_hevc_qpel_16[2][1] = put_qpel_16_avx2<2,1>;
+  accel->put_hevc_qpel_16[2][2] = put_qpel_16_avx2<2,2>;
+  accel->put_hevc_qpel_16[2][3] = put_qpel_16_avx2<2,3>;
+  accel->put_hevc_qpel_16[3][0] = put_qpel_16_avx2<3,0>;
+  accel->put_hevc_qpel_16[3][1] = put_qpel_16_avx2<3,1>;
+  accel->put_hevc_qpel_16[3][2] = put_qpel_16_avx2<3,2>;
+  accel->put_hevc_qpel_16[3][3] = put_qpel_16_avx2<3,3>;
+
+  accel->deblock_luma_8    = deblock_luma_8_avx2;
+  accel->deblock_chroma_8  = deblock_chroma_8_avx2;
+  accel->deblock_luma_16   = deblock_luma_16_avx2;
+  accel->deblock_chroma_16 = deblock_chroma_16_avx2;
+}
+#endif
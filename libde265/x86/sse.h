@@ -25,4 +25,7 @@
 
 void init_acceleration_functions_sse(struct acceleration_functions* accel);
 
+// Does nothing if the CPU or the operating system does not support AVX2.
+void init_acceleration_functions_avx2(struct acceleration_functions* accel);
+
 #endif